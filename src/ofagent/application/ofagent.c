@@ -99,6 +99,8 @@ typedef struct
   int           debugComps[10]; // 10: TODO: update from OF Agent debug levels
 #endif
   of_dpid_t     dpid;
+  uint32_t      statsMaxAge;
+  uint32_t      pollBudget;
 } arguments_t;
 
 /* The options we understand. */
@@ -112,6 +114,8 @@ static struct argp_option options[] =
   { "controller", 't', "IP:PORT", 0,  "Controller" },
   { "listen",   'l',  "IP:PORT", 0,  "Listen" },
   { "dpid", 'i',  "DATAPATHID", 0,  "Specify Datapath ID." },
+  { "statsmaxage", 's', "MSEC", 0, "Longest time counters are served from the driver cache; 0 reads them from OF-DPA on every request." },
+  { "pollbudget", 'p', "CALLS", 0, "OF-DPA calls the counter poller may make per time slice; 0 disables the poller." },
   { 0 }
 };
 
@@ -178,6 +182,7 @@ sighup_callback(int socket_id, void *cookie,
         /* silence warn_unused_result */
     }
     AIM_LOG_MSG("Received SIGHUP");
+    ind_ofdpa_poll_stats_log();
 }
 
 static void
@@ -284,6 +289,30 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 
     break;
 
+    case 's':                           /* statsmaxage */
+      errno = 0;
+
+      arguments->statsMaxAge = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid statsmaxage \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
+    case 'p':                           /* pollbudget */
+      errno = 0;
+
+      arguments->pollBudget = strtoul(arg, NULL, 0);
+      if (errno != 0)
+      {
+        argp_error(state, "Invalid pollbudget \"%s\"", arg);
+        return errno;
+      }
+
+    break;
+
     case ARGP_KEY_NO_ARGS:
     case ARGP_KEY_END:
       break;
@@ -468,6 +497,8 @@ int main(int argc, char *argv[])
     .debugComps = { 0 },
 #endif
     .dpid = OFSTATEMANAGER_CONFIG_DPID_DEFAULT,
+    .statsMaxAge = IND_OFDPA_FLOW_STATS_MAX_AGE_MS,
+    .pollBudget = IND_OFDPA_POLL_BUDGET,
   };
 
   argp_program_version = ""; 
@@ -492,6 +523,8 @@ int main(int argc, char *argv[])
   }
 #endif
   i += snprintf(&docBuffer[i], sizeof(docBuffer) - i, "DATAPATHID = 0x%016llX\n", (long long unsigned int)OFSTATEMANAGER_CONFIG_DPID_DEFAULT);
+  i += snprintf(&docBuffer[i], sizeof(docBuffer) - i, "STATSMAXAGE = %d ms\n", IND_OFDPA_FLOW_STATS_MAX_AGE_MS);
+  i += snprintf(&docBuffer[i], sizeof(docBuffer) - i, "POLLBUDGET = %d calls per %d ms\n", IND_OFDPA_POLL_BUDGET, IND_OFDPA_POLL_SLICE_MS);
 
   i += snprintf(&docBuffer[i], sizeof(docBuffer) - i, "\n");
 
@@ -573,6 +606,11 @@ int main(int argc, char *argv[])
   printf("OF Datapath ID: 0x%016llX\n", (long long unsigned int)arguments.dpid);
   (void)indigo_core_dpid_set(arguments.dpid);
 
+  /* Bound on how stale flow stats replies may be */
+  printf("Flow stats max age: %u ms\n", arguments.statsMaxAge);
+  ind_ofdpa_flow_stats_max_age_set(arguments.statsMaxAge);
+  ind_ofdpa_poll_budget_set(arguments.pollBudget);
+
   /* Initialize all modules */
   printf("Initializing the system.\r\n");
 
@@ -592,6 +630,9 @@ int main(int argc, char *argv[])
     return rc;
   }
 
+  /* The supported flow tables do not change while running */
+  ind_ofdpa_tables_init();
+
   if (ind_soc_init(&soc_cfg) < 0) {
       AIM_LOG_FATAL("Failed to initialize Indigo socket manager");
       return 1;
@@ -740,10 +781,27 @@ int main(int argc, char *argv[])
     return 1;
   }
 
+  /* Flow adds are made from the driver worker thread */
+  if (ind_ofdpa_flow_batch_init() != INDIGO_ERROR_NONE)
+  {
+    AIM_LOG_FATAL("Failed to start OF-DPA driver worker thread");
+    return 1;
+  }
+
+  /* Counters are refreshed in the background */
+  if (ind_ofdpa_poll_init() != INDIGO_ERROR_NONE)
+  {
+    AIM_LOG_FATAL("Failed to start OF-DPA counter poller");
+    return 1;
+  }
+
   ind_soc_select_and_run(-1);
 
   AIM_LOG_MSG("Stopping %s", argp_program_version);
 
+  ind_ofdpa_poll_finish();
+  ind_ofdpa_flow_batch_finish();
+
   ind_core_finish();
   ind_cxn_finish();
   ind_soc_finish();
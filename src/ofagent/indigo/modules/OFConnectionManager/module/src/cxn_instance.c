@@ -37,6 +37,7 @@
 
 #include <indigo/memory.h>
 #include <indigo/assert.h>
+#include <indigo/of_state_manager.h>
 
 #include <loci/loci_dump.h>
 #include <loci/loci_show.h>
@@ -502,7 +503,7 @@ periodic_keepalive(void *cookie)
  */
 
 static indigo_error_t
-send_barrier_reply(connection_t *cxn)
+send_barrier_reply(connection_t *cxn, uint32_t xid)
 {
    of_barrier_reply_t *obj = 0;
 
@@ -511,8 +512,8 @@ send_barrier_reply(connection_t *cxn)
       return INDIGO_ERROR_UNKNOWN;
    }
 
-   of_barrier_reply_xid_set(obj, cxn->barrier.xid);
-   LOG_TRACE(cxn, "Responding to barrier request xid %u", cxn->barrier.xid);
+   of_barrier_reply_xid_set(obj, xid);
+   LOG_TRACE(cxn, "Responding to barrier request xid %u", xid);
 
    indigo_cxn_send_controller_message(cxn->cxn_id, obj);
    return INDIGO_ERROR_NONE;
@@ -577,29 +578,77 @@ echo_reply_handle(connection_t *cxn, of_object_t *_obj)
     return rv;
 }
 
+#define FENCE_NEXT(epoch) (((epoch) + 1) & (CXN_FENCES_MAX - 1))
+
+AIM_STATIC_ASSERT(cxn_fences_max,
+                  CXN_FENCES_MAX - 1 <= CXN_COOKIE_EPOCH_MASK &&
+                  (CXN_FENCES_MAX & (CXN_FENCES_MAX - 1)) == 0);
+
+/**
+ * Send the replies to barriers whose operations have all completed
+ *
+ * Resumes reading once an epoch is free again.
+ */
+
+static void
+fences_release(connection_t *cxn)
+{
+    while (cxn->fences.head != cxn->fences.tail &&
+           cxn->fences.ops[cxn->fences.head] == 0) {
+        LOG_TRACE(cxn, "Barrier xid %u complete",
+                  cxn->fences.xid[cxn->fences.head]);
+        send_barrier_reply(cxn, cxn->fences.xid[cxn->fences.head]);
+        cxn->fences.head = FENCE_NEXT(cxn->fences.head);
+    }
+
+    if (cxn->fences.pausedf &&
+            FENCE_NEXT(cxn->fences.tail) != cxn->fences.head) {
+        LOG_TRACE(cxn, "Barrier epoch free, resuming read");
+        cxn->fences.pausedf = 0;
+        (void)ind_soc_data_in_resume(cxn->sd);
+    }
+}
+
 /**
  * Handle a barrier request message
+ *
+ * The barrier closes the current epoch of operations and the connection
+ * keeps reading; operations after it join the next epoch. The reply is
+ * sent by fences_release once every operation issued before the barrier
+ * has completed, so replies go out in order.
  */
 
 static indigo_error_t
 barrier_request_handle(connection_t *cxn, of_object_t *_obj)
 {
     of_barrier_request_t *obj = _obj;
+    uint32_t xid;
 
-    of_barrier_request_xid_get(obj, &cxn->barrier.xid);
-    LOG_TRACE(cxn, "Got barrier req with xid %u", cxn->barrier.xid);
+    of_barrier_request_xid_get(obj, &xid);
+    LOG_TRACE(cxn, "Got barrier req with xid %u", xid);
 
     /* No outstanding operations; send reply immediately */
     if (cxn->outstanding_op_cnt == 0)  {
-        return (send_barrier_reply(cxn));
+        return (send_barrier_reply(cxn, xid));
     }
     LOG_TRACE(cxn, "Outstanding op count %d", cxn->outstanding_op_cnt);
 
-    /* Pause the socket and mark a barrier is pending */
-    if (ind_soc_data_in_pause(cxn->sd) < 0) {
-        LOG_ERROR(cxn, "Error pausing soc read on barrier request");
+    cxn->fences.xid[cxn->fences.tail] = xid;
+    cxn->fences.tail = FENCE_NEXT(cxn->fences.tail);
+    INDIGO_ASSERT(cxn->fences.ops[cxn->fences.tail] == 0);
+
+    /* Out of epochs for the next barrier; wait for one to complete */
+    if (FENCE_NEXT(cxn->fences.tail) == cxn->fences.head) {
+        LOG_TRACE(cxn, "%d barriers pending, pausing read",
+                  CXN_FENCES_MAX - 1);
+        if (ind_soc_data_in_pause(cxn->sd) < 0) {
+            LOG_ERROR(cxn, "Error pausing soc read on barrier request");
+        }
+        cxn->fences.pausedf = 1;
     }
-    cxn->barrier.pendingf = 1;
+
+    /* Don't let batching hold back operations the barrier waits on */
+    indigo_core_barrier_notify(cxn->cxn_id);
 
     return (INDIGO_ERROR_NONE);
 }
@@ -841,6 +890,7 @@ static void
 cxn_object_delete_cb(of_object_t *obj)
 {
     connection_t *cxn;
+    int epoch;
 
     cxn = cookie_to_cxn(obj->track_info.delete_cookie);
     if (cxn == NULL) {
@@ -855,20 +905,21 @@ cxn_object_delete_cb(of_object_t *obj)
 
     INDIGO_ASSERT(cxn->outstanding_op_cnt > 0);
     cxn->outstanding_op_cnt -= 1;
+    epoch = ((uintptr_t)obj->track_info.delete_cookie >>
+             CXN_COOKIE_EPOCH_SHIFT) & CXN_COOKIE_EPOCH_MASK;
+    INDIGO_ASSERT(cxn->fences.ops[epoch] > 0);
+    cxn->fences.ops[epoch] -= 1;
 
     LOG_TRACE(cxn, "Op count %d", cxn->outstanding_op_cnt);
 
     /* Check if outstanding ops is now 0 and clean up if needed */
-    if (cxn->outstanding_op_cnt == 0) {
-        if (CONNECTION_STATE(cxn) == INDIGO_CXN_S_CLOSING) {
+    if (CONNECTION_STATE(cxn) == INDIGO_CXN_S_CLOSING) {
+        if (cxn->outstanding_op_cnt == 0) {
             LOG_TRACE(cxn, "Op count 0, disconnecting");
             cxn_state_set(cxn, INDIGO_CXN_S_DISCONNECTED);
-        } else if (cxn->barrier.pendingf) {
-            LOG_TRACE(cxn, "Op count 0, sending barrier reply");
-            send_barrier_reply(cxn);
-            cxn->barrier.pendingf = 0;
-            (void)ind_soc_data_in_resume(cxn->sd);
         }
+    } else if (epoch == cxn->fences.head) {
+        fences_release(cxn);
     }
 }
 
@@ -887,8 +938,11 @@ void
 cxn_message_track_setup(connection_t *cxn, of_object_t *obj)
 {
     obj->track_info.delete_cb = cxn_object_delete_cb;
-    obj->track_info.delete_cookie = cxn_to_cookie(cxn);
+    obj->track_info.delete_cookie = (void *)
+        ((uintptr_t)cxn_to_cookie(cxn) |
+         ((uintptr_t)cxn->fences.tail << CXN_COOKIE_EPOCH_SHIFT));
     cxn->outstanding_op_cnt++;
+    cxn->fences.ops[cxn->fences.tail]++;
 }
 
 
@@ -1546,7 +1600,7 @@ ind_cxn_disconnected_init(connection_t *cxn)
     cxn->bytes_needed = OF_MESSAGE_HEADER_LENGTH;
     cxn->flags = 0;
     cxn->outstanding_op_cnt = 0;
-    cxn->barrier.pendingf = 0;
+    INDIGO_MEM_CLEAR(&cxn->fences, sizeof(cxn->fences));
     cxn->keepalive.outstanding_echo_cnt = 0;
     cxn->status.bytes_in = 0;
     cxn->status.bytes_out = 0;
@@ -54,6 +54,16 @@
  */
 #define CXN_TO_BE_REMOVED 0x1
 
+/**
+ * Barriers waiting on outstanding operations, per connection
+ *
+ * Each barrier closes an epoch of operations. Its reply is sent once the
+ * operations of its epoch and all earlier ones have completed. Reading
+ * from the connection is paused only while this many epochs are in use.
+ * Must be a power of 2 that fits in CXN_COOKIE_EPOCH_MASK.
+ */
+#define CXN_FENCES_MAX 16
+
 /* Connection control block */
 typedef struct connection_s {
     indigo_cxn_protocol_params_t protocol_params;
@@ -95,9 +105,12 @@ typedef struct connection_s {
 
     int outstanding_op_cnt; /* Number of outstanding operations */
     struct {
-        unsigned char pendingf;           /* Barrier reply pending flag */
-        uint32_t      xid;                /* XID of barrier request */
-    } barrier;
+        int ops[CXN_FENCES_MAX];          /* Outstanding ops by epoch */
+        uint32_t xid[CXN_FENCES_MAX];     /* Barrier closing each epoch */
+        uint8_t head;                     /* Oldest epoch in use */
+        uint8_t tail;                     /* Epoch new ops are added to */
+        unsigned char pausedf;            /* Reading paused, epochs full */
+    } fences;
 
     /* @todo clean this up */
     struct {
@@ -162,7 +162,7 @@ static int preferred_cxn_id = -1;
 
 #define GEN_ID_SHIFT 16
 #define GEN_ID_MASK 0xffff
-#define CXN_ID_MASK 0xffff
+#define CXN_ID_MASK 0xfff   /* Bits above carry the barrier epoch */
 
 void *cxn_to_cookie(connection_t *cxn)
 {
@@ -72,6 +72,13 @@ extern uint64_t ind_cxn_generation_id;
 void *cxn_to_cookie(connection_t *cxn);
 connection_t* cookie_to_cxn(void* cookie);
 
+/*
+ * Cookies of tracked messages also carry the barrier epoch of the
+ * operation, in bits cookie_to_cxn ignores
+ */
+#define CXN_COOKIE_EPOCH_SHIFT 12
+#define CXN_COOKIE_EPOCH_MASK 0xf
+
 
 /*
  * Priority for sockets and timers registered with SocketManager.
@@ -49,6 +49,12 @@ indigo_core_connection_count_notify(int new_count)
     printf("Connection count is %d\n", new_count);
 }
 
+void
+indigo_core_barrier_notify(indigo_cxn_id_t cxn_id)
+{
+    printf("Barrier pending on cxn %d\n", cxn_id);
+}
+
 
 static ind_cxn_config_t cm_config;
 
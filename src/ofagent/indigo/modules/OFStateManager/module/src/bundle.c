@@ -0,0 +1,849 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Bundles
+ *
+ * Implements ONF extension 230, the OpenFlow 1.3 form of the OpenFlow 1.4
+ * bundle messages, for flow_mods. LOCI has no classes for it, so the
+ * bundle control and bundle add messages are decoded from the payload
+ * of plain experimenter messages.
+ *
+ * Each bundle add is parsed and validated as it arrives, including
+ * translation by forwarding (indigo_fwd_flow_validate), so errors are
+ * reported then. Forwarding may keep the translation for the commit.
+ *
+ * A commit applies the staged flow_mods to the flowtable in order. When
+ * forwarding supports it (indigo_fwd_bundle_begin), the flow changes it
+ * is asked for meanwhile are only recorded, and are made in one ordered
+ * run (indigo_fwd_bundle_commit) once every flow_mod has applied. A
+ * flow_mod that fails then leaves the hardware untouched, and a change
+ * the hardware rejects is undone by forwarding with the ones before it.
+ * Otherwise each change is made as its flow_mod applies, and flow adds
+ * forwarding queued are submitted at the end with indigo_fwd_flush.
+ *
+ * OF-DPA has no transactions, so a commit is not atomic in the hardware.
+ * Packets meet a mix of old and new flows while the run lasts, and again
+ * while forwarding undoes it after a failure. Flows it deletes and has
+ * to add back start their counters from zero.
+ *
+ * While a commit runs, the flow_mod paths record how to undo each change
+ * to the flowtable: the ID of each flow added, and a copy of each flow as
+ * it was before being modified, replaced or deleted. If the commit fails
+ * the log is played back in reverse. With staged changes, only the
+ * flowtable is put back, and flows keep their IDs and counters. Changes
+ * made as they applied are undone through forwarding as well; deleted
+ * flows come back with new IDs and their counters start from zero.
+ *
+ * Flow_removed messages for the flows a commit deletes are sent as it
+ * applies, even if it is rolled back.
+ *
+ * Bundles are discarded when their connection closes.
+ */
+
+#include "ofstatemanager_log.h"
+
+#include <time.h>
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+#include <indigo/forwarding.h>
+#include <indigo/of_connection_manager.h>
+#include <indigo/of_state_manager.h>
+#include <loci/loci.h>
+#include <AIM/aim_list.h>
+#include "ofstatemanager_decs.h"
+#include "ofstatemanager_int.h"
+#include "handlers.h"
+#include "ft.h"
+#include "expiration.h"
+#include "table.h"
+#include "bundle.h"
+
+/* Bundle flags */
+#define BUNDLE_FLAG_ATOMIC 0x1
+#define BUNDLE_FLAG_ORDERED 0x2
+
+/* Bundle errors, sent as experimenter errors */
+enum {
+    BUNDLE_ERR_UNKNOWN = 2300,
+    BUNDLE_ERR_EPERM = 2301,
+    BUNDLE_ERR_BAD_ID = 2302,
+    BUNDLE_ERR_BUNDLE_EXIST = 2303,
+    BUNDLE_ERR_BUNDLE_CLOSED = 2304,
+    BUNDLE_ERR_OUT_OF_BUNDLES = 2305,
+    BUNDLE_ERR_BAD_TYPE = 2306,
+    BUNDLE_ERR_BAD_FLAGS = 2307,
+    BUNDLE_ERR_MSG_BAD_LEN = 2308,
+    BUNDLE_ERR_MSG_BAD_XID = 2309,
+    BUNDLE_ERR_MSG_UNSUP = 2310,
+    BUNDLE_ERR_MSG_CONFLICT = 2311,
+    BUNDLE_ERR_MSG_TOO_MANY = 2312,
+    BUNDLE_ERR_MSG_FAILED = 2313,
+};
+
+/* Length of the fields before the message in a bundle add */
+#define BUNDLE_ADD_HEADER_LEN 8
+#define BUNDLE_CTRL_LEN 8
+
+typedef struct bundle_s {
+    list_links_t links;
+    indigo_cxn_id_t cxn_id;
+    uint32_t id;
+    uint16_t flags;
+    bool closed;
+    of_object_t **msgs;         /* Validated flow_mods, in order */
+    int num_msgs;
+    int alloc_msgs;
+} bundle_t;
+
+/* A change made by the commit in progress */
+typedef struct bundle_undo_s {
+    indigo_flow_id_t flow_id;
+    of_flow_add_t *flow_add;    /* The flow as it was, or NULL if added */
+    uint8_t table_id;
+    indigo_time_t insert_time;
+    indigo_time_t last_counter_change;
+    uint64_t packets;
+    uint64_t bytes;
+} bundle_undo_t;
+
+static LIST_DEFINE(bundles);
+static int num_bundles;
+
+static struct {
+    bool active;
+    bool staged;                /* Forwarding holds the changes */
+    indigo_error_t result;      /* First failure of a queued flow add */
+    bundle_undo_t *undo;
+    int num_undo;
+    int alloc_undo;
+} commit;
+
+static ind_core_bundle_stats_t bundle_stats;
+
+static inline uint16_t
+bundle_u16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t
+bundle_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void
+bundle_error_send(of_object_t *orig, indigo_cxn_id_t cxn_id, uint16_t code)
+{
+    of_experimenter_error_msg_t *msg;
+    of_octets_t payload;
+    uint32_t xid;
+
+    LOG_TRACE("Bundle error %u for cxn %d", code, cxn_id);
+
+    if ((msg = of_experimenter_error_msg_new(orig->version)) == NULL) {
+        LOG_ERROR("Could not allocate error message");
+        return;
+    }
+
+    /* At least 64 bytes of the request, but not the whole bundle add */
+    payload.data = OF_OBJECT_BUFFER_INDEX(orig, 0);
+    payload.bytes = orig->length < 64 ? orig->length : 64;
+
+    of_experimenter_xid_get(orig, &xid);
+    of_experimenter_error_msg_xid_set(msg, xid);
+    of_experimenter_error_msg_subtype_set(msg, code);
+    of_experimenter_error_msg_experimenter_set(msg, IND_CORE_BUNDLE_EXPERIMENTER);
+    if (of_experimenter_error_msg_data_set(msg, &payload) < 0) {
+        LOG_WARN("Failed to append original request to error message");
+    }
+
+    indigo_cxn_send_controller_message(cxn_id, msg);
+}
+
+static void
+bundle_ctrl_reply_send(of_object_t *req, indigo_cxn_id_t cxn_id,
+                       uint32_t bundle_id, uint16_t type, uint16_t flags)
+{
+    of_experimenter_t *reply;
+    uint8_t buf[BUNDLE_CTRL_LEN];
+    of_octets_t data = { .data = buf, .bytes = sizeof(buf) };
+    uint32_t xid;
+
+    if ((reply = of_experimenter_new(req->version)) == NULL) {
+        LOG_ERROR("Could not allocate bundle reply");
+        return;
+    }
+
+    buf[0] = bundle_id >> 24;
+    buf[1] = bundle_id >> 16;
+    buf[2] = bundle_id >> 8;
+    buf[3] = bundle_id;
+    buf[4] = type >> 8;
+    buf[5] = type;
+    buf[6] = flags >> 8;
+    buf[7] = flags;
+
+    of_experimenter_xid_get(req, &xid);
+    of_experimenter_xid_set(reply, xid);
+    of_experimenter_experimenter_set(reply, IND_CORE_BUNDLE_EXPERIMENTER);
+    of_experimenter_subtype_set(reply, IND_CORE_BUNDLE_CTRL);
+    if (of_experimenter_data_set(reply, &data) < 0) {
+        LOG_ERROR("Failed to set bundle reply data");
+        of_object_delete(reply);
+        return;
+    }
+
+    indigo_cxn_send_controller_message(cxn_id, reply);
+}
+
+static bundle_t *
+bundle_lookup(indigo_cxn_id_t cxn_id, uint32_t bundle_id)
+{
+    list_links_t *cur;
+
+    LIST_FOREACH(&bundles, cur) {
+        bundle_t *bundle = container_of(cur, links, bundle_t);
+        if (bundle->cxn_id == cxn_id && bundle->id == bundle_id) {
+            return bundle;
+        }
+    }
+
+    return NULL;
+}
+
+/* Returns NULL if too many bundles are open */
+static bundle_t *
+bundle_open(indigo_cxn_id_t cxn_id, uint32_t bundle_id, uint16_t flags)
+{
+    bundle_t *bundle;
+
+    if (num_bundles >= IND_CORE_BUNDLES_MAX) {
+        return NULL;
+    }
+
+    bundle = aim_zmalloc(sizeof(*bundle));
+    bundle->cxn_id = cxn_id;
+    bundle->id = bundle_id;
+    bundle->flags = flags;
+    list_push(&bundles, &bundle->links);
+    num_bundles++;
+
+    LOG_TRACE("Opened bundle %u for cxn %d", bundle_id, cxn_id);
+
+    return bundle;
+}
+
+static void
+bundle_msg_delete(of_object_t *msg)
+{
+    if (msg->object_id == OF_FLOW_ADD) {
+        indigo_fwd_flow_release(msg);
+    }
+    of_object_delete(msg);
+}
+
+static void
+bundle_destroy(bundle_t *bundle)
+{
+    int i;
+
+    for (i = 0; i < bundle->num_msgs; i++) {
+        bundle_msg_delete(bundle->msgs[i]);
+    }
+    aim_free(bundle->msgs);
+    list_remove(&bundle->links);
+    num_bundles--;
+    aim_free(bundle);
+}
+
+/****************************************************************
+ * Commit
+ ****************************************************************/
+
+static bundle_undo_t *
+bundle_undo_push(void)
+{
+    if (commit.num_undo == commit.alloc_undo) {
+        commit.alloc_undo = commit.alloc_undo ? commit.alloc_undo * 2 : 64;
+        commit.undo = aim_realloc(commit.undo,
+                                  commit.alloc_undo * sizeof(*commit.undo));
+        AIM_TRUE_OR_DIE(commit.undo != NULL);
+    }
+
+    return &commit.undo[commit.num_undo++];
+}
+
+static void
+bundle_undo_clear(void)
+{
+    int i;
+
+    for (i = 0; i < commit.num_undo; i++) {
+        if (commit.undo[i].flow_add != NULL) {
+            of_object_delete(commit.undo[i].flow_add);
+        }
+    }
+    commit.num_undo = 0;
+}
+
+void
+ind_core_bundle_flow_added(ft_entry_t *entry)
+{
+    bundle_undo_t *undo;
+
+    if (!commit.active) {
+        return;
+    }
+
+    undo = bundle_undo_push();
+    undo->flow_id = entry->id;
+    undo->flow_add = NULL;
+    undo->table_id = entry->table_id;
+}
+
+/* A flow_add recreating the entry as it is now */
+static of_flow_add_t *
+bundle_flow_snapshot(ft_entry_t *entry)
+{
+    of_version_t version = entry->effects.actions->version;
+    of_flow_add_t *obj;
+    uint16_t flags;
+
+    if ((obj = of_flow_add_new(version)) == NULL) {
+        return NULL;
+    }
+
+    /* Only the result of the original add matters now */
+    flags = entry->flags & ~OF_FLOW_MOD_FLAG_CHECK_OVERLAP_BY_VERSION(version);
+    if (version >= OF_VERSION_1_3) {
+        flags &= ~OF_FLOW_MOD_FLAG_RESET_COUNTS_BY_VERSION(version);
+    }
+
+    of_flow_add_cookie_set(obj, entry->cookie);
+    of_flow_add_priority_set(obj, entry->priority);
+    of_flow_add_idle_timeout_set(obj, entry->idle_timeout);
+    of_flow_add_hard_timeout_set(obj, entry->hard_timeout);
+    of_flow_add_flags_set(obj, flags);
+
+    if (of_flow_add_match_set(obj, &entry->match) < 0) {
+        of_object_delete(obj);
+        return NULL;
+    }
+
+    if (version == OF_VERSION_1_0) {
+        if (of_flow_add_actions_set(obj, entry->effects.actions) < 0) {
+            of_object_delete(obj);
+            return NULL;
+        }
+    } else {
+        of_flow_add_table_id_set(obj, entry->table_id);
+        if (of_flow_add_instructions_set(obj, entry->effects.instructions) < 0) {
+            of_object_delete(obj);
+            return NULL;
+        }
+    }
+
+    return obj;
+}
+
+void
+ind_core_bundle_flow_changing(ft_entry_t *entry)
+{
+    of_flow_add_t *flow_add;
+    bundle_undo_t *undo;
+
+    if (!commit.active) {
+        return;
+    }
+
+    if ((flow_add = bundle_flow_snapshot(entry)) == NULL) {
+        LOG_ERROR("Failed to save flow " INDIGO_FLOW_ID_PRINTF_FORMAT
+                  " for bundle rollback",
+                  INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
+        if (commit.result == INDIGO_ERROR_NONE) {
+            commit.result = INDIGO_ERROR_RESOURCE;
+        }
+        return;
+    }
+
+    undo = bundle_undo_push();
+    undo->flow_id = entry->id;
+    undo->flow_add = flow_add;
+    undo->table_id = entry->table_id;
+    undo->insert_time = entry->insert_time;
+    undo->last_counter_change = entry->last_counter_change;
+    undo->packets = entry->packets;
+    undo->bytes = entry->bytes;
+}
+
+void
+ind_core_bundle_flow_add_failed(indigo_error_t result)
+{
+    if (commit.active && commit.result == INDIGO_ERROR_NONE) {
+        commit.result = result;
+    }
+}
+
+/*
+ * Put a flow back in the flowtable as it was before the commit, under
+ * the same ID. Only for staged commits, which never left it changed in
+ * forwarding.
+ */
+static void
+bundle_flow_restore(bundle_undo_t *undo)
+{
+    ft_entry_t *entry;
+    bool timed;
+
+    entry = ft_lookup(ind_core_ft, undo->flow_id);
+    if (entry != NULL) {
+        ft_entry_replace(ind_core_ft, entry, undo->flow_add);
+    } else {
+        if (ft_add(ind_core_ft, undo->flow_id, undo->flow_add, &entry) !=
+                INDIGO_ERROR_NONE) {
+            LOG_ERROR("Failed to restore flow " INDIGO_FLOW_ID_PRINTF_FORMAT
+                      " after bundle failure",
+                      INDIGO_FLOW_ID_PRINTF_ARG(undo->flow_id));
+            return;
+        }
+        ft_entry_set_table_id(ind_core_ft, entry, undo->table_id);
+
+        /* Its packets were counted as removed with it */
+        ind_core_ft->status.removed_packets -= undo->packets;
+        FT_TABLE(ind_core_ft, undo->table_id)->status.removed_packets -=
+            undo->packets;
+    }
+
+    ft_entry_counters_update(ind_core_ft, entry, undo->packets, undo->bytes);
+
+    /* Timeouts still run from the original add */
+    timed = entry->idle_timeout || entry->hard_timeout;
+    if (timed) {
+        ind_core_expiration_remove(entry);
+    }
+    entry->insert_time = undo->insert_time;
+    entry->last_counter_change = undo->last_counter_change;
+    if (timed) {
+        ind_core_expiration_add(entry);
+    }
+}
+
+/* Tables registered with the state manager make changes as they apply */
+static bool
+bundle_undo_staged(bundle_undo_t *undo)
+{
+    return commit.staged && ind_core_table_get(undo->table_id) == NULL;
+}
+
+/* Undo the changes made by a failed commit, latest first */
+static void
+bundle_rollback(indigo_cxn_id_t cxn_id)
+{
+    bundle_undo_t *undo;
+    ft_entry_t *entry;
+    indigo_error_t rv;
+    int i;
+
+    for (i = commit.num_undo - 1; i >= 0; i--) {
+        undo = &commit.undo[i];
+        if (undo->flow_add == NULL) {
+            /* Forwarding may have failed the add already */
+            entry = ft_lookup(ind_core_ft, undo->flow_id);
+            if (entry == NULL) {
+                continue;
+            }
+
+            if (bundle_undo_staged(undo)) {
+                ft_delete(ind_core_ft, entry);
+            } else {
+                /* No flow_removed for a flow the controller never had */
+                ind_core_flow_entry_delete(entry, INDIGO_FLOW_REMOVED_OVERWRITE);
+            }
+        } else if (bundle_undo_staged(undo)) {
+            bundle_flow_restore(undo);
+        } else {
+            rv = ind_core_flow_mod_apply(undo->flow_add, cxn_id);
+            if (rv != INDIGO_ERROR_NONE) {
+                LOG_ERROR("Failed to restore flow after bundle failure: %s",
+                          indigo_strerror(rv));
+            }
+        }
+    }
+
+    if (!commit.staged) {
+        indigo_fwd_flush();
+    }
+}
+
+static indigo_error_t
+bundle_commit(bundle_t *bundle)
+{
+    struct timespec start, end;
+    indigo_error_t rv = INDIGO_ERROR_NONE;
+    uint64_t us;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* Flow adds queued before the bundle are reported first */
+    indigo_fwd_flush();
+
+    commit.active = true;
+    commit.staged = indigo_fwd_bundle_begin() == INDIGO_ERROR_NONE;
+    commit.result = INDIGO_ERROR_NONE;
+
+    for (i = 0; i < bundle->num_msgs && rv == INDIGO_ERROR_NONE; i++) {
+        rv = ind_core_flow_mod_apply(bundle->msgs[i], bundle->cxn_id);
+    }
+
+    if (!commit.staged) {
+        /* Submit the queued flow adds together and collect their results */
+        indigo_fwd_flush();
+    }
+
+    if (rv == INDIGO_ERROR_NONE) {
+        rv = commit.result;
+    }
+
+    if (commit.staged) {
+        /* Make the recorded changes only if every flow_mod applied */
+        if (rv == INDIGO_ERROR_NONE) {
+            rv = indigo_fwd_bundle_commit();
+        } else {
+            indigo_fwd_bundle_abort();
+        }
+    }
+    commit.active = false;
+
+    if (rv != INDIGO_ERROR_NONE) {
+        LOG_VERBOSE("Rolling back bundle %u: %s", bundle->id,
+                    indigo_strerror(rv));
+        bundle_rollback(bundle->cxn_id);
+        bundle_stats.rollbacks++;
+    } else {
+        bundle_stats.commits++;
+        bundle_stats.messages += bundle->num_msgs;
+    }
+    bundle_undo_clear();
+    commit.staged = false;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    us = (end.tv_sec - start.tv_sec) * 1000000ULL +
+        (end.tv_nsec - start.tv_nsec) / 1000;
+    bundle_stats.commit_us_last = us;
+    bundle_stats.commit_us_total += us;
+    if (us > bundle_stats.commit_us_max) {
+        bundle_stats.commit_us_max = us;
+    }
+
+    LOG_VERBOSE("Bundle %u with %d messages %s in %" PRIu64 " us",
+                bundle->id, bundle->num_msgs,
+                rv == INDIGO_ERROR_NONE ? "committed" : "rolled back", us);
+
+    return rv;
+}
+
+/****************************************************************
+ * Message handling
+ ****************************************************************/
+
+static void
+bundle_ctrl_handle(of_experimenter_t *obj, indigo_cxn_id_t cxn_id,
+                   of_octets_t *data)
+{
+    bundle_t *bundle;
+    uint32_t bundle_id;
+    uint16_t type, flags;
+
+    if (data->bytes < BUNDLE_CTRL_LEN) {
+        indigo_cxn_send_error_reply(cxn_id, obj,
+                                    OF_ERROR_TYPE_BAD_REQUEST,
+                                    OF_REQUEST_FAILED_BAD_LEN);
+        return;
+    }
+
+    bundle_id = bundle_u32(data->data);
+    type = bundle_u16(data->data + 4);
+    flags = bundle_u16(data->data + 6);
+    bundle = bundle_lookup(cxn_id, bundle_id);
+
+    switch (type) {
+    case IND_CORE_BUNDLE_OPEN_REQUEST:
+        if (bundle != NULL) {
+            bundle_error_send(obj, cxn_id, BUNDLE_ERR_BUNDLE_EXIST);
+        } else if (flags & ~(BUNDLE_FLAG_ATOMIC | BUNDLE_FLAG_ORDERED)) {
+            bundle_error_send(obj, cxn_id, BUNDLE_ERR_BAD_FLAGS);
+        } else if (bundle_open(cxn_id, bundle_id, flags) == NULL) {
+            bundle_error_send(obj, cxn_id, BUNDLE_ERR_OUT_OF_BUNDLES);
+        } else {
+            bundle_ctrl_reply_send(obj, cxn_id, bundle_id,
+                                   IND_CORE_BUNDLE_OPEN_REPLY, flags);
+        }
+        break;
+
+    case IND_CORE_BUNDLE_CLOSE_REQUEST:
+        if (bundle == NULL) {
+            bundle_error_send(obj, cxn_id, BUNDLE_ERR_BAD_ID);
+        } else if (bundle->closed) {
+            bundle_error_send(obj, cxn_id, BUNDLE_ERR_BUNDLE_CLOSED);
+        } else if (flags != bundle->flags) {
+            bundle_error_send(obj, cxn_id, BUNDLE_ERR_BAD_FLAGS);
+        } else {
+            bundle->closed = true;
+            bundle_ctrl_reply_send(obj, cxn_id, bundle_id,
+                                   IND_CORE_BUNDLE_CLOSE_REPLY, flags);
+        }
+        break;
+
+    case IND_CORE_BUNDLE_COMMIT_REQUEST:
+        if (bundle == NULL) {
+            bundle_error_send(obj, cxn_id, BUNDLE_ERR_BAD_ID);
+        } else if (flags != bundle->flags) {
+            bundle_error_send(obj, cxn_id, BUNDLE_ERR_BAD_FLAGS);
+        } else {
+            /* The bundle is gone whether the commit succeeds or not */
+            if (bundle_commit(bundle) == INDIGO_ERROR_NONE) {
+                bundle_ctrl_reply_send(obj, cxn_id, bundle_id,
+                                       IND_CORE_BUNDLE_COMMIT_REPLY, flags);
+            } else {
+                bundle_error_send(obj, cxn_id, BUNDLE_ERR_MSG_FAILED);
+            }
+            bundle_destroy(bundle);
+        }
+        break;
+
+    case IND_CORE_BUNDLE_DISCARD_REQUEST:
+        if (bundle == NULL) {
+            bundle_error_send(obj, cxn_id, BUNDLE_ERR_BAD_ID);
+        } else {
+            bundle_destroy(bundle);
+            bundle_stats.discards++;
+            bundle_ctrl_reply_send(obj, cxn_id, bundle_id,
+                                   IND_CORE_BUNDLE_DISCARD_REPLY, flags);
+        }
+        break;
+
+    default:
+        bundle_error_send(obj, cxn_id, BUNDLE_ERR_BAD_TYPE);
+        break;
+    }
+}
+
+static void
+bundle_add_handle(of_experimenter_t *obj, indigo_cxn_id_t cxn_id,
+                  of_octets_t *data)
+{
+    of_object_storage_t storage;
+    of_object_t *msg;
+    bundle_t *bundle;
+    uint32_t bundle_id, xid, msg_xid;
+    uint16_t flags;
+    int msg_len;
+
+    if (data->bytes < BUNDLE_ADD_HEADER_LEN + OF_MESSAGE_HEADER_LENGTH) {
+        bundle_error_send(obj, cxn_id, BUNDLE_ERR_MSG_BAD_LEN);
+        return;
+    }
+
+    bundle_id = bundle_u32(data->data);
+    flags = bundle_u16(data->data + 6);
+    msg_len = bundle_u16(data->data + BUNDLE_ADD_HEADER_LEN + 2);
+
+    /* Properties may follow the message */
+    if (msg_len < OF_MESSAGE_HEADER_LENGTH ||
+            msg_len > data->bytes - BUNDLE_ADD_HEADER_LEN) {
+        bundle_error_send(obj, cxn_id, BUNDLE_ERR_MSG_BAD_LEN);
+        return;
+    }
+
+    bundle = bundle_lookup(cxn_id, bundle_id);
+    if (bundle == NULL) {
+        /* Adding to a new bundle opens it */
+        if (flags & ~(BUNDLE_FLAG_ATOMIC | BUNDLE_FLAG_ORDERED)) {
+            bundle_error_send(obj, cxn_id, BUNDLE_ERR_BAD_FLAGS);
+            return;
+        }
+        if ((bundle = bundle_open(cxn_id, bundle_id, flags)) == NULL) {
+            bundle_error_send(obj, cxn_id, BUNDLE_ERR_OUT_OF_BUNDLES);
+            return;
+        }
+    } else if (bundle->closed) {
+        bundle_error_send(obj, cxn_id, BUNDLE_ERR_BUNDLE_CLOSED);
+        return;
+    } else if (flags != bundle->flags) {
+        bundle_error_send(obj, cxn_id, BUNDLE_ERR_BAD_FLAGS);
+        return;
+    }
+
+    if (bundle->num_msgs >= IND_CORE_BUNDLE_MESSAGES_MAX) {
+        bundle_error_send(obj, cxn_id, BUNDLE_ERR_MSG_TOO_MANY);
+        return;
+    }
+
+    msg = of_object_new_from_message_preallocated(
+        &storage, data->data + BUNDLE_ADD_HEADER_LEN, msg_len);
+    if (msg == NULL || msg->version != obj->version) {
+        bundle_error_send(obj, cxn_id, BUNDLE_ERR_MSG_BAD_LEN);
+        return;
+    }
+
+    of_experimenter_xid_get(obj, &xid);
+    msg_xid = of_message_xid_get(OF_OBJECT_BUFFER_INDEX(msg, 0));
+    if (msg_xid != xid) {
+        bundle_error_send(obj, cxn_id, BUNDLE_ERR_MSG_BAD_XID);
+        return;
+    }
+
+    switch (msg->object_id) {
+    case OF_FLOW_ADD:
+    case OF_FLOW_MODIFY:
+    case OF_FLOW_MODIFY_STRICT:
+    case OF_FLOW_DELETE:
+    case OF_FLOW_DELETE_STRICT:
+        break;
+    default:
+        LOG_TRACE("Unsupported %s message in bundle",
+                  of_object_id_str[msg->object_id]);
+        bundle_error_send(obj, cxn_id, BUNDLE_ERR_MSG_UNSUP);
+        return;
+    }
+
+    /* Forwarding may keep its translation of the copy the commit applies */
+    msg = of_object_dup(msg);
+    AIM_TRUE_OR_DIE(msg != NULL);
+
+    /* Errors are reported for the message itself */
+    if (ind_core_flow_mod_validate(msg, cxn_id) != INDIGO_ERROR_NONE) {
+        bundle_msg_delete(msg);
+        return;
+    }
+
+    if (bundle->num_msgs == bundle->alloc_msgs) {
+        bundle->alloc_msgs = bundle->alloc_msgs ? bundle->alloc_msgs * 2 : 16;
+        bundle->msgs = aim_realloc(bundle->msgs,
+                                   bundle->alloc_msgs * sizeof(*bundle->msgs));
+        AIM_TRUE_OR_DIE(bundle->msgs != NULL);
+    }
+
+    bundle->msgs[bundle->num_msgs++] = msg;
+}
+
+bool
+ind_core_bundle_handler(of_object_t *obj, indigo_cxn_id_t cxn_id)
+{
+    uint32_t experimenter, subtype;
+    of_octets_t data;
+
+    if (obj->version < OF_VERSION_1_3) {
+        return false;
+    }
+
+    of_experimenter_experimenter_get(obj, &experimenter);
+    if (experimenter != IND_CORE_BUNDLE_EXPERIMENTER) {
+        return false;
+    }
+
+    of_experimenter_subtype_get(obj, &subtype);
+    of_experimenter_data_get(obj, &data);
+
+    switch (subtype) {
+    case IND_CORE_BUNDLE_CTRL:
+        bundle_ctrl_handle(obj, cxn_id, &data);
+        return true;
+    case IND_CORE_BUNDLE_ADD:
+        bundle_add_handle(obj, cxn_id, &data);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Discard the bundles of a connection that goes away */
+static void
+bundle_cxn_status_change(indigo_cxn_id_t cxn_id,
+                         indigo_cxn_protocol_params_t *cxn_proto_params,
+                         indigo_cxn_state_t state,
+                         void *cookie)
+{
+    list_links_t *cur, *next;
+
+    if (state != INDIGO_CXN_S_CLOSING && state != INDIGO_CXN_S_DISCONNECTED) {
+        return;
+    }
+
+    LIST_FOREACH_SAFE(&bundles, cur, next) {
+        bundle_t *bundle = container_of(cur, links, bundle_t);
+        if (bundle->cxn_id == cxn_id) {
+            LOG_VERBOSE("Discarding bundle %u of closed cxn %d",
+                        bundle->id, cxn_id);
+            bundle_destroy(bundle);
+            bundle_stats.discards++;
+        }
+    }
+}
+
+void
+ind_core_bundle_stats_get(ind_core_bundle_stats_t *stats)
+{
+    *stats = bundle_stats;
+}
+
+void
+ind_core_bundle_stats(aim_pvs_t *pvs)
+{
+    uint64_t attempts = bundle_stats.commits + bundle_stats.rollbacks;
+
+    aim_printf(pvs, "Bundle stats:\n");
+    aim_printf(pvs, "  Open:           %d\n", num_bundles);
+    aim_printf(pvs, "  Commits:        %" PRIu64 " (%" PRIu64 " messages)\n",
+               bundle_stats.commits, bundle_stats.messages);
+    aim_printf(pvs, "  Rollbacks:      %" PRIu64 "\n", bundle_stats.rollbacks);
+    aim_printf(pvs, "  Discards:       %" PRIu64 "\n", bundle_stats.discards);
+    aim_printf(pvs, "  Commit us:      %" PRIu64 " last, %" PRIu64 " max, "
+               "%" PRIu64 " avg\n",
+               bundle_stats.commit_us_last, bundle_stats.commit_us_max,
+               attempts ? bundle_stats.commit_us_total / attempts : 0);
+}
+
+void
+ind_core_bundle_init(void)
+{
+    if (indigo_cxn_status_change_register(bundle_cxn_status_change, NULL) < 0) {
+        LOG_ERROR("Failed to register for connection status changes");
+    }
+}
+
+void
+ind_core_bundle_finish(void)
+{
+    list_links_t *cur, *next;
+
+    indigo_cxn_status_change_unregister(bundle_cxn_status_change, NULL);
+
+    LIST_FOREACH_SAFE(&bundles, cur, next) {
+        bundle_destroy(container_of(cur, links, bundle_t));
+    }
+
+    aim_free(commit.undo);
+    commit.undo = NULL;
+    commit.alloc_undo = 0;
+}
@@ -0,0 +1,89 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Bundle interfaces
+ *
+ * Bundles stage flow_mods from a connection and commit them all at once,
+ * undoing the ones already applied if any of them fails.
+ */
+
+#ifndef _OFSTATEMANAGER_BUNDLE_H_
+#define _OFSTATEMANAGER_BUNDLE_H_
+
+#include <indigo/indigo.h>
+#include <indigo/of_connection_manager.h>
+#include <loci/loci.h>
+
+#include "ft_entry.h"
+
+/* ONF extension 230, bundles for OpenFlow 1.3 */
+#define IND_CORE_BUNDLE_EXPERIMENTER 0x4f4e4600
+#define IND_CORE_BUNDLE_CTRL 2300
+#define IND_CORE_BUNDLE_ADD 2301
+
+/* Bundle control message types */
+enum {
+    IND_CORE_BUNDLE_OPEN_REQUEST = 0,
+    IND_CORE_BUNDLE_OPEN_REPLY = 1,
+    IND_CORE_BUNDLE_CLOSE_REQUEST = 2,
+    IND_CORE_BUNDLE_CLOSE_REPLY = 3,
+    IND_CORE_BUNDLE_COMMIT_REQUEST = 4,
+    IND_CORE_BUNDLE_COMMIT_REPLY = 5,
+    IND_CORE_BUNDLE_DISCARD_REQUEST = 6,
+    IND_CORE_BUNDLE_DISCARD_REPLY = 7,
+};
+
+/* Limits on staged state */
+#define IND_CORE_BUNDLES_MAX 64
+#define IND_CORE_BUNDLE_MESSAGES_MAX 65536
+
+typedef struct ind_core_bundle_stats_s {
+    uint64_t commits;           /* Bundles committed */
+    uint64_t rollbacks;         /* Commits that failed and were undone */
+    uint64_t discards;          /* Bundles discarded unapplied */
+    uint64_t messages;          /* Flow_mods in committed bundles */
+    uint64_t commit_us_last;    /* Commit latency */
+    uint64_t commit_us_max;
+    uint64_t commit_us_total;
+} ind_core_bundle_stats_t;
+
+/**
+ * Handle a bundle experimenter message
+ * @returns Whether obj was a bundle message
+ */
+bool ind_core_bundle_handler(of_object_t *obj, indigo_cxn_id_t cxn_id);
+
+/**
+ * Hooks for the flow_mod paths, to record what a commit must undo
+ *
+ * They do nothing unless a bundle is being committed.
+ */
+void ind_core_bundle_flow_added(ft_entry_t *entry);
+void ind_core_bundle_flow_changing(ft_entry_t *entry);
+void ind_core_bundle_flow_add_failed(indigo_error_t result);
+
+void ind_core_bundle_stats_get(ind_core_bundle_stats_t *stats);
+void ind_core_bundle_stats(aim_pvs_t *pvs);
+
+void ind_core_bundle_init(void);
+void ind_core_bundle_finish(void);
+
+#endif /* _OFSTATEMANAGER_BUNDLE_H_ */
@@ -25,6 +25,7 @@
 #include <OFStateManager/ofstatemanager_config.h>
 #include <indigo/indigo.h>
 #include <SocketManager/socketmanager.h>
+#include <stdlib.h>
 
 #include "ofstatemanager_log.h"
 #include "ofstatemanager_decs.h"
@@ -33,7 +34,45 @@
 
 static void send_idle_notification(ft_entry_t *entry);
 
-static LIST_DEFINE(expiration_queue);
+/*
+ * Hierarchical timing wheel
+ *
+ * Each level is an array of slots (list heads) covering a fixed time span.
+ * A flow is linked (through expiration_links) into the slot of the lowest
+ * level whose span covers the time remaining until it expires. When the
+ * wheel advances past the boundary of a higher level slot, the flows in
+ * that slot are cascaded down into the finer levels. Flows in a level 0
+ * slot expire on the tick the slot is processed, and are moved onto the
+ * due list for the expiration task.
+ *
+ * Insert, re-arm and cancel are O(1). The expiration task only touches
+ * slots whose time has passed.
+ */
+
+#define WHEEL_LEVELS 4
+
+struct wheel_level {
+    indigo_time_t tick_ms;      /* Time covered by one slot */
+    int num_slots;
+    list_head_t *slots;
+};
+
+static list_head_t wheel_slots_ms[1000];
+static list_head_t wheel_slots_sec[60];
+static list_head_t wheel_slots_min[60];
+static list_head_t wheel_slots_hour[64];
+
+static struct wheel_level wheel[WHEEL_LEVELS] = {
+    { 1, AIM_ARRAYSIZE(wheel_slots_ms), wheel_slots_ms },
+    { 1000, AIM_ARRAYSIZE(wheel_slots_sec), wheel_slots_sec },
+    { 60 * 1000, AIM_ARRAYSIZE(wheel_slots_min), wheel_slots_min },
+    { 60 * 60 * 1000, AIM_ARRAYSIZE(wheel_slots_hour), wheel_slots_hour },
+};
+
+static bool wheel_init_done = false;
+static indigo_time_t wheel_now;    /* Last tick processed */
+static int wheel_count;             /* Flows in the wheel or due list */
+static LIST_DEFINE(due_list);       /* Expired flows waiting for the task */
 static bool task_running = false;
 
 static indigo_time_t
@@ -58,102 +97,350 @@ calc_expiration_time(ft_entry_t *entry, int *reason)
     }
 }
 
-void
-ind_core_expiration_add(ft_entry_t *entry)
+static void
+wheel_init(void)
+{
+    int level, idx;
+
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (idx = 0; idx < wheel[level].num_slots; idx++) {
+            list_init(&wheel[level].slots[idx]);
+        }
+    }
+
+    wheel_now = INDIGO_CURRENT_TIME;
+    wheel_init_done = true;
+}
+
+/* Append all entries of src to the tail of dst, leaving src empty */
+static void
+wheel_splice_tail(list_head_t *src, list_head_t *dst)
+{
+    list_links_t *first, *last;
+
+    if (list_empty(src)) {
+        return;
+    }
+
+    first = src->links.next;
+    last = src->links.prev;
+
+    first->prev = dst->links.prev;
+    dst->links.prev->next = first;
+    last->next = &dst->links;
+    dst->links.prev = last;
+
+    list_init(src);
+}
+
+/*
+ * Link an entry into the wheel relative to wheel_now
+ *
+ * Entries whose expiration time has already passed are placed in the
+ * slot for the next tick.
+ */
+static void
+wheel_insert(ft_entry_t *entry)
 {
     int reason;
     indigo_time_t expiration_time = calc_expiration_time(entry, &reason);
+    indigo_time_t delta;
+    struct wheel_level *wl;
+    int level;
+
+    if (expiration_time <= wheel_now) {
+        expiration_time = wheel_now + 1;
+    }
+
+    delta = expiration_time - wheel_now;
+
+    for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+        wl = &wheel[level];
+        if (delta < wl->tick_ms * wl->num_slots) {
+            break;
+        }
+    }
+
+    wl = &wheel[level];
+    if (delta >= wl->tick_ms * wl->num_slots) {
+        /* Beyond the top level; park in its farthest slot and re-cascade */
+        expiration_time = wheel_now + wl->tick_ms * (wl->num_slots - 1);
+    }
+
+    list_push(&wl->slots[(expiration_time / wl->tick_ms) % wl->num_slots],
+              &entry->expiration_links);
+}
+
+/* Re-insert every entry of a higher level slot relative to wheel_now */
+static void
+wheel_cascade(int level)
+{
+    struct wheel_level *wl = &wheel[level];
+    list_head_t *slot = &wl->slots[(wheel_now / wl->tick_ms) % wl->num_slots];
+    list_head_t tmp;
     list_links_t *cur;
 
-    /* Iterate over list in reverse order */
-    for (cur = expiration_queue.links.prev;
-         cur != &expiration_queue.links;
-         cur = cur->prev) {
-        ft_entry_t *other = FT_ENTRY_CONTAINER(cur, expiration);
-        if (calc_expiration_time(other, &reason) <= expiration_time) {
-            /* 'other' expires before us. Insert after it. */
-            list_insert_after(cur, &entry->expiration_links);
-            return;
+    list_move(slot, &tmp);
+    while ((cur = list_shift(&tmp)) != NULL) {
+        wheel_insert(FT_ENTRY_CONTAINER(cur, expiration));
+    }
+}
+
+/*
+ * Advance the wheel to 'now', moving expired flows to the due list
+ */
+static void
+wheel_advance(indigo_time_t now)
+{
+    int level;
+
+    if (wheel_count == 0) {
+        /* Nothing to expire; skip ahead */
+        if (now > wheel_now) {
+            wheel_now = now;
         }
+        return;
     }
 
-    /* Lowest expiration time. Insert at front of list. */
-    list_unshift(&expiration_queue, &entry->expiration_links);
+    while (wheel_now < now) {
+        wheel_now++;
+
+        /* Cascade from the coarsest level whose slot boundary we crossed */
+        for (level = WHEEL_LEVELS - 1; level > 0; level--) {
+            if (wheel_now % wheel[level].tick_ms == 0) {
+                wheel_cascade(level);
+            }
+        }
+
+        wheel_splice_tail(&wheel[0].slots[wheel_now % wheel[0].num_slots],
+                          &due_list);
+    }
+}
+
+void
+ind_core_expiration_add(ft_entry_t *entry)
+{
+    if (!wheel_init_done) {
+        wheel_init();
+    }
+
+    if (wheel_count == 0) {
+        /* Empty wheel; no need to catch up on ticks nobody is waiting for */
+        wheel_now = INDIGO_CURRENT_TIME;
+    }
+
+    wheel_insert(entry);
+    wheel_count++;
 }
 
 void
 ind_core_expiration_remove(ft_entry_t *entry)
 {
     list_remove(&entry->expiration_links);
+    wheel_count--;
+}
+
+ft_entry_t *
+ind_core_expiration_next(indigo_time_t now, int *reason)
+{
+    list_links_t *links;
+    ft_entry_t *entry;
+
+    if (!wheel_init_done) {
+        return NULL;
+    }
+
+    /*
+     * Catch up before handing anything out, so relinked entries land
+     * after 'now' and are not returned again for it. Callers may then
+     * collect several entries before processing them.
+     */
+    wheel_advance(now);
+
+    while ((links = list_shift(&due_list)) != NULL) {
+        /*
+         * Relink the entry before handing it out. If the caller neither
+         * deletes nor re-arms it (e.g. the hit status query failed), it
+         * will be retried on the next tick.
+         */
+        entry = FT_ENTRY_CONTAINER(links, expiration);
+        wheel_insert(entry);
+        if (calc_expiration_time(entry, reason) <= now) {
+            return entry;
+        }
+    }
+
+    return NULL;
 }
 
 static void
 expire_flow(ft_entry_t *entry, int reason)
 {
-    if (reason == INDIGO_FLOW_REMOVED_HARD_TIMEOUT) {
-        LOG_TRACE("Hard TO (%d): " INDIGO_FLOW_ID_PRINTF_FORMAT,
-                  entry->hard_timeout,
-                  INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
-        ind_core_flow_entry_delete(entry, reason);
-    } else if (reason == OF_FLOW_REMOVED_REASON_IDLE_TIMEOUT) {
-        int rv;
-        bool hit;
-
-        /* Get hit status for idle timeouts */
-        ind_core_table_t *table = ind_core_table_get(entry->table_id);
-        if (table != NULL) {
-            rv = table->ops->entry_hit_status_get(table->priv, entry->priv, &hit);
+    LOG_TRACE("Hard TO (%d): " INDIGO_FLOW_ID_PRINTF_FORMAT,
+              entry->hard_timeout,
+              INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
+    ind_core_flow_entry_delete(entry, reason);
+}
+
+static void
+expire_idle_flow(ft_entry_t *entry, bool hit)
+{
+    if (hit || entry->flags & OF_FLOW_MOD_FLAG_BSN_SEND_IDLE) {
+        /* Reinsert entry into the expiration list */
+        entry->last_counter_change = INDIGO_CURRENT_TIME;
+        ind_core_expiration_remove(entry);
+        ind_core_expiration_add(entry);
+    }
+
+    if (!hit) {
+        if (entry->flags & OF_FLOW_MOD_FLAG_BSN_SEND_IDLE) {
+            send_idle_notification(entry);
         } else {
-            rv = indigo_fwd_flow_hit_status_get(entry->id, &hit);
+            LOG_TRACE("Idle TO (%d): " INDIGO_FLOW_ID_PRINTF_FORMAT,
+                      entry->idle_timeout,
+                      INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
+            ind_core_flow_entry_delete(entry, OF_FLOW_REMOVED_REASON_IDLE_TIMEOUT);
         }
+    }
+}
 
-        if (rv != INDIGO_ERROR_NONE) {
-            LOG_ERROR("Failed to get hit status for flow "
-                      INDIGO_FLOW_ID_PRINTF_FORMAT": %s",
-                      entry->id, indigo_strerror(rv));
-            return;
-        }
+/*
+ * Idle timeout candidates
+ *
+ * Hit status is fetched for a batch of candidates at once, with one bulk
+ * call per table, before each flow is re-armed or expired.
+ */
+
+#define IDLE_BATCH_SIZE 256
+
+static struct {
+    int count;
+    ft_entry_t *entries[IDLE_BATCH_SIZE];
+    void *privs[IDLE_BATCH_SIZE];
+    indigo_cookie_t flow_ids[IDLE_BATCH_SIZE];
+    bool hits[IDLE_BATCH_SIZE];
+    indigo_error_t results[IDLE_BATCH_SIZE];
+} idle_batch;
+
+static int
+idle_batch_cmp(const void *a, const void *b)
+{
+    const ft_entry_t *entry_a = *(ft_entry_t * const *)a;
+    const ft_entry_t *entry_b = *(ft_entry_t * const *)b;
+
+    return (int)entry_a->table_id - (int)entry_b->table_id;
+}
 
-        if (hit || entry->flags & OF_FLOW_MOD_FLAG_BSN_SEND_IDLE) {
-            /* Reinsert entry into the expiration list */
-            entry->last_counter_change = INDIGO_CURRENT_TIME;
-            ind_core_expiration_remove(entry);
-            ind_core_expiration_add(entry);
+/*
+ * Get and reset the hit status of 'count' batched entries starting at
+ * 'first', all in the same table
+ */
+static void
+idle_batch_hit_status_get(int first, int count)
+{
+    ft_entry_t **entries = &idle_batch.entries[first];
+    bool *hits = &idle_batch.hits[first];
+    indigo_error_t *results = &idle_batch.results[first];
+    ind_core_table_t *table = ind_core_table_get(entries[0]->table_id);
+    indigo_error_t rv = INDIGO_ERROR_NOT_SUPPORTED;
+    int i;
+
+    if (table != NULL && table->ops->entry_hit_status_get_bulk != NULL) {
+        void **privs = &idle_batch.privs[first];
+        for (i = 0; i < count; i++) {
+            privs[i] = entries[i]->priv;
         }
+        rv = table->ops->entry_hit_status_get_bulk(table->priv, count, privs,
+                                                   hits, results);
+    } else if (table == NULL) {
+        indigo_cookie_t *flow_ids = &idle_batch.flow_ids[first];
+        for (i = 0; i < count; i++) {
+            flow_ids[i] = entries[i]->id;
+        }
+        rv = indigo_fwd_flow_hit_status_get_bulk(count, flow_ids, hits, results);
+    }
 
-        if (!hit) {
-            if (entry->flags & OF_FLOW_MOD_FLAG_BSN_SEND_IDLE) {
-                send_idle_notification(entry);
+    if (rv == INDIGO_ERROR_NOT_SUPPORTED) {
+        for (i = 0; i < count; i++) {
+            if (table != NULL) {
+                results[i] = table->ops->entry_hit_status_get(
+                    table->priv, entries[i]->priv, &hits[i]);
             } else {
-                LOG_TRACE("Idle TO (%d): " INDIGO_FLOW_ID_PRINTF_FORMAT,
-                          entry->idle_timeout,
-                          INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
-                ind_core_flow_entry_delete(entry, reason);
+                results[i] = indigo_fwd_flow_hit_status_get(entries[i]->id,
+                                                            &hits[i]);
             }
         }
+    } else if (rv != INDIGO_ERROR_NONE) {
+        for (i = 0; i < count; i++) {
+            results[i] = rv;
+        }
     }
 }
 
+/* Fetch hit status for the batch and re-arm or expire each entry */
+static void
+idle_batch_process(void)
+{
+    ft_entry_t *entry;
+    int first, i;
+
+    if (idle_batch.count == 0) {
+        return;
+    }
+
+    qsort(idle_batch.entries, idle_batch.count, sizeof(idle_batch.entries[0]),
+          idle_batch_cmp);
+
+    for (first = 0; first < idle_batch.count; first = i) {
+        for (i = first + 1; i < idle_batch.count; i++) {
+            if (idle_batch.entries[i]->table_id !=
+                    idle_batch.entries[first]->table_id) {
+                break;
+            }
+        }
+        idle_batch_hit_status_get(first, i - first);
+    }
+
+    for (i = 0; i < idle_batch.count; i++) {
+        entry = idle_batch.entries[i];
+        if (idle_batch.results[i] != INDIGO_ERROR_NONE) {
+            /* Left in the wheel and retried on the next tick */
+            LOG_ERROR("Failed to get hit status for flow "
+                      INDIGO_FLOW_ID_PRINTF_FORMAT": %s",
+                      entry->id, indigo_strerror(idle_batch.results[i]));
+            continue;
+        }
+        expire_idle_flow(entry, idle_batch.hits[i]);
+    }
+
+    idle_batch.count = 0;
+}
+
 static ind_soc_task_status_t
 expiration_task(void *cookie)
 {
     indigo_time_t current_time = INDIGO_CURRENT_TIME;
+    ft_entry_t *entry;
+    int reason;
     (void) cookie;
 
-    while (!list_empty(&expiration_queue)) {
-        int reason;
-        list_links_t *links = expiration_queue.links.next;
-        ft_entry_t *entry = FT_ENTRY_CONTAINER(links, expiration);
-        if (calc_expiration_time(entry, &reason) <= current_time) {
-            expire_flow(entry, reason);
+    while ((entry = ind_core_expiration_next(current_time, &reason)) != NULL) {
+        if (reason == OF_FLOW_REMOVED_REASON_IDLE_TIMEOUT) {
+            idle_batch.entries[idle_batch.count++] = entry;
+            if (idle_batch.count == IDLE_BATCH_SIZE) {
+                idle_batch_process();
+            }
         } else {
-            break;
+            expire_flow(entry, reason);
         }
         if (ind_soc_should_yield()) {
+            idle_batch_process();
             return IND_SOC_TASK_CONTINUE;
         }
     }
 
+    idle_batch_process();
+
     task_running = false;
     return IND_SOC_TASK_FINISHED;
 }
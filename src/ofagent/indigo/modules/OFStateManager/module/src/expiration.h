@@ -44,6 +44,17 @@ void ind_core_expiration_add(ft_entry_t *entry);
  */
 void ind_core_expiration_remove(ft_entry_t *entry);
 
+/**
+ * Return the next flow entry whose timeout has passed
+ * @param now Current time
+ * @param reason Set to the OF_FLOW_REMOVED_REASON_* of the timeout
+ *
+ * The entry stays linked into the expiration datastructure and will be
+ * returned again on a later call with a later 'now' unless it is removed or
+ * re-added. Returns NULL when no more entries have expired.
+ */
+ft_entry_t *ind_core_expiration_next(indigo_time_t now, int *reason);
+
 /**
  * Expire flows that have exceeded their timeout
  *
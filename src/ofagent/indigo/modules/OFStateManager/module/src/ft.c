@@ -25,17 +25,26 @@
 #include <OFStateManager/ofstatemanager_config.h>
 #include <indigo/indigo.h>
 #include <murmur/murmur.h>
+#include <string.h>
 
 #include "ofstatemanager_log.h"
 #include "ft.h"
 #include "expiration.h"
 
-static indigo_error_t ft_entry_create(indigo_flow_id_t id, of_flow_add_t *flow_add, ft_entry_t **entry_p);
+static indigo_error_t ft_entry_create(ft_instance_t ft, indigo_flow_id_t id, of_flow_add_t *flow_add, ft_entry_t **entry_p);
 static void ft_entry_destroy(ft_instance_t ft, ft_entry_t *entry);
-static indigo_error_t ft_entry_set_effects(ft_entry_t *entry, of_flow_modify_t *flow_mod);
+static indigo_error_t ft_entry_set_effects(ft_instance_t ft, ft_entry_t *entry, of_flow_modify_t *flow_mod);
 static void ft_entry_link(ft_instance_t ft, ft_entry_t *entry);
 static void ft_entry_unlink(ft_instance_t ft, ft_entry_t *entry);
-static int ft_entry_has_out_port(ft_entry_t *entry, of_port_no_t port);
+static void ft_entry_link_table(ft_instance_t ft, ft_entry_t *entry);
+static void ft_entry_unlink_table(ft_instance_t ft, ft_entry_t *entry);
+static int ft_entry_out_match(of_meta_match_t *query, ft_entry_t *entry);
+static void ft_rehash_task_start(ft_instance_t ft);
+static void ft_iterator_advance(ft_iterator_t *iter);
+
+struct ft_rehash_task_state {
+    ft_instance_t ft;
+};
 
 #define FT_HASH_SEED 0
 
@@ -44,86 +53,60 @@ static int ft_entry_has_out_port(ft_entry_t *entry, of_port_no_t port);
  * hash calculations.  Multiplying by a prime is a good option
  */
 
-static int
-ft_strict_match_to_bucket_index(ft_instance_t ft,
-                                of_match_t *match,
-                                uint16_t priority)
+static uint32_t
+ft_strict_match_hash(of_match_t *match, uint16_t priority)
 {
     uint32_t h = FT_HASH_SEED;
     h = murmur_hash(match, sizeof(*match), h);
     h = murmur_hash(&priority, sizeof(priority), h);
-    return h % ft->config.strict_match_bucket_count;
+    return h;
 }
 
-static int
-ft_flow_id_to_bucket_index(ft_instance_t ft, indigo_flow_id_t *flow_id)
+static uint32_t
+ft_entry_strict_match_hash(ft_entry_t *entry)
 {
-    return (murmur_hash(flow_id, sizeof(*flow_id), FT_HASH_SEED) %
-            ft->config.flow_id_bucket_count);
-}
-
-static int
-ft_cookie_to_bucket_index(ft_instance_t ft, uint64_t cookie)
-{
-    return cookie >> (64-FT_COOKIE_PREFIX_LEN);
+    return ft_strict_match_hash(&entry->match, entry->priority);
 }
 
 ft_instance_t
 ft_create(ft_config_t *config)
 {
     ft_instance_t ft;
-    int bytes;
-    int idx;
+    int table_id;
 
     /* Allocate the flow table itself */
     ft = aim_zmalloc(sizeof(*ft));
     INDIGO_MEM_COPY(&ft->config,  config, sizeof(ft_config_t));
 
     list_init(&ft->all_list);
-
-    /* Allocate and init buckets for each search type */
-    bytes = sizeof(list_head_t) * config->strict_match_bucket_count;
-    ft->strict_match_buckets = aim_zmalloc(bytes);
-    for (idx = 0; idx < config->strict_match_bucket_count; idx++) {
-        list_init(&ft->strict_match_buckets[idx]);
+    ft_overlap_init(&ft->overlap);
+    ft_slab_init(&ft->entry_slab, "entry", sizeof(ft_entry_t));
+    ft_slab_init(&ft->cookie_slab, "cookie", sizeof(ft_cookie_node_t));
+    ft_effects_init(&ft->effects);
+
+    for (table_id = 0; table_id < FT_MAX_TABLES; table_id++) {
+        ft_table_t *table = FT_TABLE(ft, table_id);
+        list_init(&table->entries);
+        list_init(&table->tuples);
+        ft_cookie_init(&table->cookies, &ft->cookie_slab);
+        table->tuple_buckets = FT_TUPLE_INITIAL_BUCKETS;
     }
 
-    bytes = sizeof(list_head_t) * config->flow_id_bucket_count;
-    ft->flow_id_buckets = aim_zmalloc(bytes);
-    for (idx = 0; idx < config->flow_id_bucket_count; idx++) {
-        list_init(&ft->flow_id_buckets[idx]);
-    }
-
-    bytes = sizeof(list_head_t) * (1 << FT_COOKIE_PREFIX_LEN);
-    ft->cookie_buckets = aim_zmalloc(bytes);
-    for (idx = 0; idx < (1 << FT_COOKIE_PREFIX_LEN); idx++) {
-        list_init(&ft->cookie_buckets[idx]);
-    }
+    /* Init hash indexes for each search type */
+    ft_hash_init(&ft->strict_match_hash, config->strict_match_bucket_count,
+                 offsetof(ft_entry_t, strict_match_links),
+                 ft_entry_strict_match_hash);
+    ft_id_map_init(&ft->flow_id_map, config->flow_id_bucket_count);
 
     return ft;
 }
 
-/* Macro for checking bucket lists are empty */
-#if !defined(FT_NO_ERROR_CHECKING)
-#define CHECK_BUCKETS(type) do {                                           \
-        int idx, cnt;                                                      \
-        for (idx = 0; idx < ft->config.type##_bucket_count; idx++) {       \
-            if ((cnt = list_length(&ft->type##_buckets[idx])) != 0) {      \
-                LOG_ERROR("ERROR: bucket list %s has len %d on delete",    \
-                          #type, cnt);                                     \
-                break;                                                     \
-            }                                                              \
-        }                                                                  \
-    } while (0)
-#else
-#define CHECK_BUCKETS(type)
-#endif
-
 void
 ft_destroy(ft_instance_t ft)
 {
     ft_entry_t *entry;
     list_links_t *cur, *next;
+    int table_id;
 
     if (ft == NULL) {
         return;
@@ -134,19 +117,25 @@ ft_destroy(ft_instance_t ft)
         ft_entry_destroy(ft, entry);
     }
 
-    if (ft->strict_match_buckets != NULL) {
-        CHECK_BUCKETS(strict_match);
-        aim_free(ft->strict_match_buckets);
-        ft->strict_match_buckets = NULL;
-    }
-    if (ft->flow_id_buckets != NULL) {
-        CHECK_BUCKETS(flow_id);
-        aim_free(ft->flow_id_buckets);
-        ft->flow_id_buckets = NULL;
+    ft_hash_cleanup(&ft->strict_match_hash, "strict_match");
+    ft_id_map_cleanup(&ft->flow_id_map);
+
+    for (table_id = 0; table_id < FT_MAX_TABLES; table_id++) {
+        ft_table_t *table = FT_TABLE(ft, table_id);
+        if (!list_empty(&table->entries) || !list_empty(&table->tuples)) {
+            LOG_ERROR("ERROR: table %d not empty on delete", table_id);
+        }
+        ft_cookie_cleanup(&table->cookies);
     }
-    if (ft->cookie_buckets != NULL) {
-        aim_free(ft->cookie_buckets);
-        ft->cookie_buckets = NULL;
+    ft_overlap_cleanup(&ft->overlap);
+    ft_slab_cleanup(&ft->cookie_slab);
+    ft_slab_cleanup(&ft->entry_slab);
+    ft_effects_cleanup(&ft->effects);
+
+    if (ft->rehash_task != NULL) {
+        /* Detach the task; it frees its state on the next run */
+        ft->rehash_task->ft = NULL;
+        ft->rehash_task = NULL;
     }
 
     aim_free(ft);
@@ -166,13 +155,15 @@ ft_add(ft_instance_t ft, indigo_flow_id_t id,
         return INDIGO_ERROR_EXISTS;
     }
 
-    if ((rv = ft_entry_create(id, flow_add, &entry)) < 0) {
+    if ((rv = ft_entry_create(ft, id, flow_add, &entry)) < 0) {
         return rv;
     }
 
     ft_entry_link(ft, entry);
     ft->status.adds += 1;
     ft->status.current_count += 1;
+    FT_TABLE(ft, entry->table_id)->status.adds += 1;
+    FT_TABLE(ft, entry->table_id)->status.current_count += 1;
 
     if (entry_p != NULL) {
         *entry_p = entry;
@@ -184,6 +175,9 @@ ft_add(ft_instance_t ft, indigo_flow_id_t id,
 void
 ft_delete(ft_instance_t ft, ft_entry_t *entry)
 {
+    ft_table_t *table = FT_TABLE(ft, entry->table_id);
+    uint64_t packets = entry->packets;
+
     LOG_TRACE("Delete flow " INDIGO_FLOW_ID_PRINTF_FORMAT, entry->id);
 
     ft_entry_unlink(ft, entry);
@@ -191,6 +185,10 @@ ft_delete(ft_instance_t ft, ft_entry_t *entry)
 
     ft->status.current_count -= 1;
     ft->status.deletes += 1;
+    ft->status.removed_packets += packets;
+    table->status.current_count -= 1;
+    table->status.deletes += 1;
+    table->status.removed_packets += packets;
 }
 
 indigo_error_t
@@ -198,41 +196,51 @@ ft_strict_match(ft_instance_t instance,
                of_meta_match_t *query,
                ft_entry_t **entry_ptr)
 {
-    int bucket_idx;
+    list_head_t *buckets[2];
     list_links_t *cur;
+    int num_buckets, i;
 
     INDIGO_ASSERT(query->mode == OF_MATCH_STRICT);
 
-    bucket_idx = ft_strict_match_to_bucket_index(instance, &query->match,
-                                                 query->priority);
-    list_head_t *bucket = &instance->strict_match_buckets[bucket_idx];
-
-    LIST_FOREACH(bucket, cur) {
-        ft_entry_t *entry = FT_ENTRY_CONTAINER(cur, strict_match);
-        if (ft_entry_meta_match(query, entry)) {
-            *entry_ptr = entry;
-            return INDIGO_ERROR_NONE;
+    num_buckets = ft_hash_buckets(&instance->strict_match_hash,
+                                  ft_strict_match_hash(&query->match,
+                                                       query->priority),
+                                  buckets);
+
+    for (i = 0; i < num_buckets; i++) {
+        LIST_FOREACH(buckets[i], cur) {
+            ft_entry_t *entry = FT_ENTRY_CONTAINER(cur, strict_match);
+            if (ft_entry_meta_match(query, entry)) {
+                *entry_ptr = entry;
+                return INDIGO_ERROR_NONE;
+            }
         }
     }
 
     return INDIGO_ERROR_NOT_FOUND;
 }
 
-ft_entry_t *
-ft_lookup(ft_instance_t ft, indigo_flow_id_t id)
+indigo_error_t
+ft_overlap_match(ft_instance_t instance,
+                 of_meta_match_t *query,
+                 ft_entry_t **entry_ptr)
 {
-    int bucket_idx = ft_flow_id_to_bucket_index(ft, &id);
-    list_head_t *bucket = &ft->flow_id_buckets[bucket_idx];
-    list_links_t *cur;
+    ft_entry_t *entry;
 
-    LIST_FOREACH(bucket, cur) {
-        ft_entry_t *entry = FT_ENTRY_CONTAINER(cur, flow_id);
-        if (entry->id == id) {
-            return entry;
-        }
+    INDIGO_ASSERT(query->mode == OF_MATCH_OVERLAP);
+
+    if ((entry = ft_overlap_find(&instance->overlap, query)) == NULL) {
+        return INDIGO_ERROR_NOT_FOUND;
     }
 
-    return NULL;
+    *entry_ptr = entry;
+    return INDIGO_ERROR_NONE;
+}
+
+ft_entry_t *
+ft_lookup(ft_instance_t ft, indigo_flow_id_t id)
+{
+    return ft_id_map_lookup(&ft->flow_id_map, id);
 }
 
 int
@@ -265,10 +273,8 @@ ft_entry_meta_match(of_meta_match_t *query, ft_entry_t *entry)
         if (!of_match_more_specific(&entry->match, &query->match)) {
             break;
         }
-        if (query->out_port != OF_PORT_DEST_WILDCARD) {
-            if (!ft_entry_has_out_port(entry, query->out_port)) {
-                break;
-            }
+        if (!ft_entry_out_match(query, entry)) {
+            break;
         }
         rv = 1;
         break;
@@ -276,10 +282,8 @@ ft_entry_meta_match(of_meta_match_t *query, ft_entry_t *entry)
         if (!of_match_eq(&entry->match, &query->match)) {
             break;
         }
-        if (query->out_port != OF_PORT_DEST_WILDCARD) {
-            if (!ft_entry_has_out_port(entry, query->out_port)) {
-                break;
-            }
+        if (!ft_entry_out_match(query, entry)) {
+            break;
         }
         rv = 1;
         break;
@@ -312,14 +316,153 @@ ft_entry_modify_effects(ft_instance_t instance,
     LOG_TRACE("Modifying effects of entry " INDIGO_FLOW_ID_PRINTF_FORMAT,
               entry->id);
 
-    err = ft_entry_set_effects(entry, flow_mod);
+    err = ft_entry_set_effects(instance, entry, flow_mod);
     if (err == INDIGO_ERROR_NONE) {
         instance->status.updates += 1;
+        FT_TABLE(instance, entry->table_id)->status.updates += 1;
     }
 
     return err;
 }
 
+bool
+ft_entry_effects_equal(ft_entry_t *entry, of_flow_modify_t *flow_mod)
+{
+    if (flow_mod->version == OF_VERSION_1_0) {
+        of_list_action_t actions;
+        of_flow_modify_actions_bind(flow_mod, &actions);
+        return ft_effects_equal(entry->effects.actions, &actions);
+    } else {
+        of_list_instruction_t instructions;
+        of_flow_modify_instructions_bind(flow_mod, &instructions);
+        return ft_effects_equal(entry->effects.instructions, &instructions);
+    }
+}
+
+void
+ft_entry_replace(ft_instance_t ft, ft_entry_t *entry, of_flow_add_t *flow_add)
+{
+    ft_table_t *table = FT_TABLE(ft, entry->table_id);
+    list_links_t *cur, *next;
+    uint64_t cookie;
+
+    LOG_TRACE("Replacing entry " INDIGO_FLOW_ID_PRINTF_FORMAT, entry->id);
+
+    of_flow_add_cookie_get(flow_add, &cookie);
+    if (cookie != entry->cookie) {
+        /* Move iterators off the entry's cookie list before relinking it */
+        LIST_FOREACH_SAFE(&entry->iterators, cur, next) {
+            ft_iterator_t *iter = container_of(cur, entry_links, ft_iterator_t);
+            if (iter->links_offset == offsetof(ft_entry_t, cookie_links)) {
+                ft_iterator_advance(iter);
+            }
+        }
+
+        ft_cookie_unlink(&table->cookies, entry);
+        entry->cookie = cookie;
+        ft_cookie_link(&table->cookies, entry);
+    }
+
+    if (entry->idle_timeout || entry->hard_timeout) {
+        ind_core_expiration_remove(entry);
+    }
+
+    of_flow_add_flags_get(flow_add, &entry->flags);
+    of_flow_add_idle_timeout_get(flow_add, &entry->idle_timeout);
+    of_flow_add_hard_timeout_get(flow_add, &entry->hard_timeout);
+    (void) ft_entry_set_effects(ft, entry, flow_add);
+
+    entry->insert_time = INDIGO_CURRENT_TIME;
+    entry->last_counter_change = entry->insert_time;
+
+    if (entry->idle_timeout || entry->hard_timeout) {
+        ind_core_expiration_add(entry);
+    }
+
+    ft->status.updates += 1;
+    table->status.updates += 1;
+}
+
+void
+ft_entry_set_table_id(ft_instance_t ft, ft_entry_t *entry, uint8_t table_id)
+{
+    list_links_t *cur, *next;
+    ft_table_t *old_table = FT_TABLE(ft, entry->table_id);
+    ft_table_t *new_table = FT_TABLE(ft, table_id);
+
+    if (entry->table_id == table_id) {
+        return;
+    }
+
+    LOG_TRACE("Moving entry " INDIGO_FLOW_ID_PRINTF_FORMAT " to table %d",
+              entry->id, table_id);
+
+    /* Move iterators off the entry's partition lists before relinking it */
+    LIST_FOREACH_SAFE(&entry->iterators, cur, next) {
+        ft_iterator_t *iter = container_of(cur, entry_links, ft_iterator_t);
+        if (iter->links_offset != offsetof(ft_entry_t, table_links) &&
+                iter->links_offset != offsetof(ft_entry_t, effects_links)) {
+            ft_iterator_advance(iter);
+        }
+    }
+
+    ft_entry_unlink_table(ft, entry);
+    entry->table_id = table_id;
+    ft_entry_link_table(ft, entry);
+    ft_rehash_task_start(ft);
+
+    /* The add is counted in the table forwarding placed the entry in */
+    old_table->status.current_count -= 1;
+    old_table->status.adds -= 1;
+    new_table->status.current_count += 1;
+    new_table->status.adds += 1;
+}
+
+void
+ft_table_capacity_set(ft_instance_t ft, uint8_t table_id,
+                      uint32_t max_entries, uint32_t reserved_entries)
+{
+    ft_table_t *table = FT_TABLE(ft, table_id);
+    uint32_t buckets = max_entries / FT_HASH_MAX_LOAD;
+
+    table->max_entries = max_entries;
+    table->reserved_entries = reserved_entries;
+
+    /*
+     * Most entries of a table usually share a few mask shapes, so a full
+     * table would grow its tuples' hashes towards its capacity. Starting
+     * there saves the resizes, within a bound for tables of many shapes.
+     */
+    if (buckets < FT_TUPLE_INITIAL_BUCKETS) {
+        buckets = FT_TUPLE_INITIAL_BUCKETS;
+    } else if (buckets > FT_TUPLE_MAX_INITIAL_BUCKETS) {
+        buckets = FT_TUPLE_MAX_INITIAL_BUCKETS;
+    }
+    table->tuple_buckets = buckets;
+}
+
+uint32_t
+ft_table_headroom(ft_instance_t ft, uint8_t table_id)
+{
+    ft_table_t *table = FT_TABLE(ft, table_id);
+    uint32_t used;
+
+    if (table->max_entries == 0) {
+        return UINT32_MAX;
+    }
+
+    used = table->reserved_entries + table->status.current_count;
+    return used >= table->max_entries ? 0 : table->max_entries - used;
+}
+
+void
+ft_entry_counters_update(ft_instance_t ft, ft_entry_t *entry,
+                         uint64_t packets, uint64_t bytes)
+{
+    ft_cookie_counters_update(&FT_TABLE(ft, entry->table_id)->cookies, entry,
+                              packets, bytes);
+}
+
 /*
  * Flowtable iterator task
  *
@@ -383,6 +526,102 @@ ft_spawn_iter_task(ft_instance_t instance,
     return INDIGO_ERROR_NONE;
 }
 
+/*
+ * Rehash task
+ *
+ * Resizing the hash indexes is done incrementally in a SocketManager task
+ * so that a large table does not stall the event loop. The task state is
+ * detached from the flowtable if it is destroyed before the task finishes.
+ */
+
+#define FT_REHASH_STEP_BUCKETS 64
+#define FT_REHASH_STEP_GROUPS 16
+
+static ind_soc_task_status_t
+ft_rehash_task_callback(void *cookie)
+{
+    struct ft_rehash_task_state *state = cookie;
+    ft_instance_t ft = state->ft;
+    bool more;
+
+    if (ft == NULL) {
+        aim_free(state);
+        return IND_SOC_TASK_FINISHED;
+    }
+
+    do {
+        list_links_t *cur;
+        int table_id;
+        more = ft_hash_rehash_step(&ft->strict_match_hash, FT_REHASH_STEP_BUCKETS);
+        more |= ft_id_map_rehash_step(&ft->flow_id_map, FT_REHASH_STEP_GROUPS);
+        for (table_id = 0; table_id < FT_MAX_TABLES; table_id++) {
+            LIST_FOREACH(&FT_TABLE(ft, table_id)->tuples, cur) {
+                ft_tuple_t *tuple = container_of(cur, links, ft_tuple_t);
+                more |= ft_hash_rehash_step(&tuple->hash, FT_REHASH_STEP_BUCKETS);
+            }
+        }
+    } while (more && !ind_soc_should_yield());
+
+    if (more) {
+        return IND_SOC_TASK_CONTINUE;
+    }
+
+    ft->rehash_task = NULL;
+    aim_free(state);
+    return IND_SOC_TASK_FINISHED;
+}
+
+/* Whether any index has a rehash the task can make progress on */
+static bool
+ft_rehash_pending(ft_instance_t ft)
+{
+    list_links_t *cur;
+    int table_id;
+
+    if (ft_hash_rehashing(&ft->strict_match_hash) ||
+            ft_id_map_rehashing(&ft->flow_id_map)) {
+        return true;
+    }
+
+    for (table_id = 0; table_id < FT_MAX_TABLES; table_id++) {
+        LIST_FOREACH(&FT_TABLE(ft, table_id)->tuples, cur) {
+            ft_tuple_t *tuple = container_of(cur, links, ft_tuple_t);
+            if (ft_hash_rehashing(&tuple->hash) && tuple->hash.pins == 0) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static void
+ft_rehash_task_start(ft_instance_t ft)
+{
+    struct ft_rehash_task_state *state;
+
+    if (ft->rehash_task != NULL) {
+        return;
+    }
+
+    if (!ft_rehash_pending(ft)) {
+        return;
+    }
+
+    state = aim_zmalloc(sizeof(*state));
+    state->ft = ft;
+
+    if (ind_soc_task_register(ft_rehash_task_callback, state,
+                              IND_SOC_DEFAULT_PRIORITY) < 0) {
+        /* Inserts will still make progress on the rehash */
+        LOG_ERROR("Failed to start flowtable rehash task");
+        aim_free(state);
+        return;
+    }
+
+    ft->rehash_task = state;
+}
+
 static ft_entry_t *
 ft_iterator_links_to_entry(ft_iterator_t *iter, list_links_t *links)
 {
@@ -395,9 +634,223 @@ ft_iterator_entry_to_links(ft_iterator_t *iter, ft_entry_t *entry)
     return (list_links_t *)(((char *)entry) + iter->links_offset);
 }
 
+/*
+ * Move to the next partition, for queries on any table
+ */
+static bool
+ft_iterator_next_table(ft_iterator_t *iter)
+{
+    if (iter->query.table_id != TABLE_ID_ANY ||
+            iter->table_id + 1 >= FT_MAX_TABLES) {
+        return false;
+    }
+
+    iter->table_id++;
+    return true;
+}
+
+/*
+ * Move a tuple space iterator to its next list
+ *
+ * The remaining buckets of the current tuple come first. Then the
+ * following tuples that cover the query are searched: with a single hash
+ * lookup if the masks are the same as the query's, otherwise by walking
+ * all their entries. The tuple's hash is pinned while its buckets are
+ * being walked so that a resize can't move entries between them.
+ */
+static void
+ft_iterator_next_tuple_list(ft_iterator_t *iter)
+{
+    ft_instance_t ft = iter->ft;
+    list_links_t *cur;
+
+    if (iter->pinned != NULL) {
+        if (++iter->bucket_idx < iter->num_buckets) {
+            iter->head = iter->buckets[iter->bucket_idx];
+            return;
+        }
+        ft_hash_unpin(iter->pinned);
+        iter->pinned = NULL;
+        ft_rehash_task_start(ft);
+    }
+
+    if (iter->tuple != NULL) {
+        cur = iter->tuple->links.next;
+    } else {
+        cur = FT_TABLE(ft, iter->table_id)->tuples.links.next;
+    }
+
+    while (true) {
+        list_head_t *tuples = &FT_TABLE(ft, iter->table_id)->tuples;
+
+        for (; cur != &tuples->links; cur = cur->next) {
+            ft_tuple_t *tuple = container_of(cur, links, ft_tuple_t);
+
+            if (!ft_tuple_covers(tuple, &iter->query)) {
+                continue;
+            }
+
+            iter->tuple = tuple;
+
+            if (ft_tuple_masks_eq(tuple, &iter->query.match.masks)) {
+                ft_hash_pin(&tuple->hash);
+                iter->pinned = &tuple->hash;
+                iter->num_buckets = ft_hash_buckets(&tuple->hash, iter->key_hash,
+                                                    iter->buckets);
+                iter->bucket_idx = 0;
+                iter->head = iter->buckets[0];
+                iter->links_offset = offsetof(ft_entry_t, tuple_hash_links);
+            } else {
+                iter->head = &tuple->entries;
+                iter->links_offset = offsetof(ft_entry_t, tuple_links);
+            }
+
+            return;
+        }
+
+        if (!ft_iterator_next_table(iter)) {
+            break;
+        }
+        cur = FT_TABLE(ft, iter->table_id)->tuples.links.next;
+    }
+
+    /* Finished iteration */
+    iter->tuple = NULL;
+    iter->head = NULL;
+}
+
+/*
+ * Move an output index iterator to the entries of the next effects that
+ * output to the query's port or group
+ */
+static void
+ft_iterator_next_out_list(ft_iterator_t *iter)
+{
+    list_links_t *cur;
+
+    cur = iter->out != NULL ? iter->out->links.next : iter->out_key->outs.links.next;
+    if (cur == &iter->out_key->outs.links) {
+        /* Finished iteration */
+        iter->out = NULL;
+        iter->head = NULL;
+        return;
+    }
+
+    iter->out = container_of(cur, links, ft_effects_out_t);
+    iter->head = &iter->out->effects->entries;
+    iter->links_offset = offsetof(ft_entry_t, effects_links);
+}
+
+/*
+ * Move a cookie index iterator to the entries of the next matching cookie
+ */
+static void
+ft_iterator_next_cookie_list(ft_iterator_t *iter)
+{
+    ft_cookie_node_t *leaf;
+
+    while ((leaf = ft_cookie_next(&FT_TABLE(iter->ft, iter->table_id)->cookies,
+                                  iter->query.cookie, iter->query.cookie_mask,
+                                  iter->cookie, iter->cookie_started)) == NULL) {
+        if (!ft_iterator_next_table(iter)) {
+            /* Finished iteration */
+            iter->head = NULL;
+            return;
+        }
+        iter->cookie_started = false;
+    }
+
+    iter->cookie = leaf->cookie;
+    iter->cookie_started = true;
+    iter->head = &leaf->entries;
+    iter->links_offset = offsetof(ft_entry_t, cookie_links);
+}
+
+/*
+ * Point the iterator at the first entry of the current list, moving on to
+ * the following lists while they are empty.
+ */
+static void
+ft_iterator_seek(ft_iterator_t *iter)
+{
+    while (iter->head != NULL) {
+        if (!list_empty(iter->head)) {
+            iter->next_entry = ft_iterator_links_to_entry(iter, iter->head->links.next);
+            list_push(&iter->next_entry->iterators, &iter->entry_links);
+            return;
+        }
+
+        if (iter->next_list != NULL) {
+            iter->next_list(iter);
+        } else {
+            iter->head = NULL;
+        }
+    }
+
+    iter->next_entry = NULL;
+}
+
+/*
+ * Whether the tuple space index can narrow the query
+ *
+ * Without any constraint on the match the tuples would hold every entry of
+ * the table, so the cookie index, the table's partition or the full list
+ * are used instead.
+ */
+static bool
+ft_iterator_use_tuples(of_meta_match_t *query)
+{
+    static const of_match_fields_t zero_masks;
+
+    if (query->mode != OF_MATCH_NON_STRICT && query->mode != OF_MATCH_STRICT) {
+        return false;
+    }
+
+    return memcmp(&query->match.masks, &zero_masks, sizeof(zero_masks)) != 0;
+}
+
+/*
+ * Find the output index key for an out_port or out_group query
+ *
+ * Returns false if the query doesn't filter on outputs. Otherwise *key_p
+ * is NULL if nothing outputs to the port or group.
+ */
+static bool
+ft_iterator_out_key(ft_instance_t ft, of_meta_match_t *query,
+                    ft_effects_key_t **key_p)
+{
+    if (query->mode != OF_MATCH_NON_STRICT && query->mode != OF_MATCH_STRICT) {
+        return false;
+    }
+
+    if (query->out_port != OF_PORT_DEST_WILDCARD) {
+        *key_p = ft_effects_find_key(&ft->effects, FT_EFFECTS_OUT_PORT,
+                                     query->out_port);
+        return true;
+    }
+
+    if (query->check_out_group) {
+        *key_p = ft_effects_find_key(&ft->effects, FT_EFFECTS_OUT_GROUP,
+                                     query->out_group);
+        return true;
+    }
+
+    return false;
+}
+
 void
 ft_iterator_init(ft_iterator_t *iter, ft_instance_t ft, of_meta_match_t *query)
 {
+    ft_effects_key_t *out_key;
+
+    iter->ft = ft;
+    iter->next_list = NULL;
+    iter->tuple = NULL;
+    iter->pinned = NULL;
+    iter->out_key = NULL;
+    iter->out = NULL;
+    iter->cookie_started = false;
+
     if (query != NULL) {
         iter->query = *query;
         iter->use_query = true;
@@ -405,49 +858,85 @@ ft_iterator_init(ft_iterator_t *iter, ft_instance_t ft, of_meta_match_t *query)
         iter->use_query = false;
     }
 
-    if (query && (query->cookie_mask & FT_COOKIE_PREFIX_MASK) == FT_COOKIE_PREFIX_MASK) {
-        /* Using cookie bucket */
-        iter->head = &ft->cookie_buckets[ft_cookie_to_bucket_index(ft, query->cookie)];
-        iter->links_offset = offsetof(ft_entry_t, cookie_links);
+    if (query && query->table_id != TABLE_ID_ANY) {
+        iter->table_id = query->table_id;
+    } else {
+        iter->table_id = 0;
+    }
+
+    if (query && ft_iterator_out_key(ft, query, &out_key)) {
+        /* Using output index */
+        if (out_key != NULL) {
+            iter->out_key = out_key;
+            iter->next_list = ft_iterator_next_out_list;
+            ft_iterator_next_out_list(iter);
+        } else {
+            iter->head = NULL;
+        }
+    } else if (query && ft_iterator_use_tuples(query)) {
+        /* Using tuple space index */
+        iter->key_hash = ft_tuple_key_hash(&query->match.fields,
+                                           &query->match.masks);
+        iter->next_list = ft_iterator_next_tuple_list;
+        ft_iterator_next_tuple_list(iter);
+    } else if (query && query->cookie_mask != 0) {
+        /* Using cookie index */
+        iter->next_list = ft_iterator_next_cookie_list;
+        ft_iterator_next_cookie_list(iter);
+    } else if (query && query->table_id != TABLE_ID_ANY) {
+        /* Using the table's partition */
+        iter->head = &FT_TABLE(ft, query->table_id)->entries;
+        iter->links_offset = offsetof(ft_entry_t, partition_links);
     } else {
         iter->head = &ft->all_list;
         iter->links_offset = offsetof(ft_entry_t, table_links);
     }
 
-    if (list_empty(iter->head)) {
-        iter->next_entry = NULL;
-    } else {
-        iter->next_entry = ft_iterator_links_to_entry(iter, iter->head->links.next);
+    ft_iterator_seek(iter);
+}
+
+/*
+ * Move the iterator past next_entry, whether or not it matches the query.
+ * This is also used when next_entry is about to be unlinked.
+ */
+static void
+ft_iterator_advance(ft_iterator_t *iter)
+{
+    list_links_t *next_links;
+
+    INDIGO_ASSERT(iter->next_entry != NULL);
+
+    list_remove(&iter->entry_links);
+
+    next_links = ft_iterator_entry_to_links(iter, iter->next_entry)->next;
+    if (next_links != &iter->head->links) {
+        iter->next_entry = ft_iterator_links_to_entry(iter, next_links);
         list_push(&iter->next_entry->iterators, &iter->entry_links);
+        return;
     }
+
+    /* End of this list */
+    if (iter->next_list != NULL) {
+        iter->next_list(iter);
+    } else {
+        iter->head = NULL;
+    }
+
+    ft_iterator_seek(iter);
 }
 
 ft_entry_t *
 ft_iterator_next(ft_iterator_t *iter)
 {
-    if (iter->next_entry != NULL) {
-        list_remove(&iter->entry_links);
-    }
-
     while (iter->next_entry != NULL) {
         ft_entry_t *entry = iter->next_entry;
 
-        list_links_t *next_links = ft_iterator_entry_to_links(iter, iter->next_entry)->next;
-        if (next_links == &iter->head->links) {
-            /* Finished iteration */
-            iter->next_entry = NULL;
-        } else {
-            iter->next_entry = ft_iterator_links_to_entry(iter, next_links);
-        }
+        ft_iterator_advance(iter);
 
         if (iter->use_query && !ft_entry_meta_match(&iter->query, entry)) {
             continue;
         }
 
-        if (iter->next_entry != NULL) {
-            list_push(&iter->next_entry->iterators, &iter->entry_links);
-        }
-
         return entry;
     }
 
@@ -461,6 +950,12 @@ ft_iterator_cleanup(ft_iterator_t *iter)
         list_remove(&iter->entry_links);
         iter->next_entry = NULL;
     }
+
+    if (iter->pinned != NULL) {
+        ft_hash_unpin(iter->pinned);
+        iter->pinned = NULL;
+        ft_rehash_task_start(iter->ft);
+    }
 }
 
 /**
@@ -470,8 +965,6 @@ ft_iterator_cleanup(ft_iterator_t *iter)
 static void
 ft_entry_link(ft_instance_t ft, ft_entry_t *entry)
 {
-    int idx;
-
     if (ft == NULL || entry == NULL) {
         INDIGO_ASSERT(!"ft_entry_link called with NULL ft or entry");
         return;
@@ -480,18 +973,12 @@ ft_entry_link(ft_instance_t ft, ft_entry_t *entry)
     /* Link to full table iteration */
     list_push(&ft->all_list, &entry->table_links);
 
-    if (ft->strict_match_buckets) { /* Strict match hash */
-        idx = ft_strict_match_to_bucket_index(ft, &entry->match, entry->priority);
-        list_push(&ft->strict_match_buckets[idx], &entry->strict_match_links);
-    }
-    if (ft->flow_id_buckets) { /* Flow ID hash */
-        idx = ft_flow_id_to_bucket_index(ft, &entry->id);
-        list_push(&ft->flow_id_buckets[idx], &entry->flow_id_links);
-    }
-    if (ft->cookie_buckets) { /* Cookie prefix */
-        idx = ft_cookie_to_bucket_index(ft, entry->cookie);
-        list_push(&ft->cookie_buckets[idx], &entry->cookie_links);
-    }
+    ft_hash_insert(&ft->strict_match_hash, entry);
+    ft_id_map_insert(&ft->flow_id_map, entry);
+    ft_entry_link_table(ft, entry);
+    list_push(&ft_effects_from_obj(entry->effects.actions)->entries,
+              &entry->effects_links);
+    ft_rehash_task_start(ft);
 
     list_init(&entry->iterators);
 
@@ -517,36 +1004,57 @@ ft_entry_unlink(ft_instance_t ft, ft_entry_t *entry)
     /* Advance iterators pointing to this entry */
     list_links_t *cur, *next;
     LIST_FOREACH_SAFE(&entry->iterators, cur, next) {
-        ft_iterator_next(container_of(cur, entry_links, ft_iterator_t));
+        ft_iterator_advance(container_of(cur, entry_links, ft_iterator_t));
     }
 
     /* Remove from full table iteration */
     list_remove(&entry->table_links);
 
-    if (ft->strict_match_buckets) { /* Strict match hash */
-        INDIGO_ASSERT(!list_empty(&ft->strict_match_buckets[
-            ft_strict_match_to_bucket_index(ft, &entry->match, entry->priority)]));
-        list_remove(&entry->strict_match_links);
-    }
-    if (ft->flow_id_buckets) { /* Flow ID hash */
-        INDIGO_ASSERT(!list_empty(&ft->flow_id_buckets[ft_flow_id_to_bucket_index(ft,
-            &entry->id)]));
-        list_remove(&entry->flow_id_links);
-    }
-    if (ft->cookie_buckets) { /* Cookie prefix */
-        INDIGO_ASSERT(!list_empty(&ft->cookie_buckets[ft_cookie_to_bucket_index(ft,
-            entry->cookie)]));
-        list_remove(&entry->cookie_links);
-    }
+    ft_hash_remove(&ft->strict_match_hash, entry);
+    ft_id_map_remove(&ft->flow_id_map, entry);
+    ft_entry_unlink_table(ft, entry);
+    list_remove(&entry->effects_links);
+    ft_rehash_task_start(ft);
 
     if (entry->idle_timeout || entry->hard_timeout) {
         ind_core_expiration_remove(entry);
     }
 }
 
+/**
+ * Link an entry into the partition for its table ID
+ */
+
+static void
+ft_entry_link_table(ft_instance_t ft, ft_entry_t *entry)
+{
+    ft_table_t *table = FT_TABLE(ft, entry->table_id);
+
+    list_push(&table->entries, &entry->partition_links);
+    ft_tuple_link(&table->tuples, entry, table->tuple_buckets);
+    ft_cookie_link(&table->cookies, entry);
+    ft_overlap_link(&ft->overlap, entry);
+}
+
+/**
+ * Unlink an entry from the partition for its table ID
+ */
+
+static void
+ft_entry_unlink_table(ft_instance_t ft, ft_entry_t *entry)
+{
+    ft_table_t *table = FT_TABLE(ft, entry->table_id);
+
+    list_remove(&entry->partition_links);
+    ft_tuple_unlink(entry);
+    ft_cookie_unlink(&table->cookies, entry);
+    ft_overlap_unlink(&ft->overlap, entry);
+}
+
 /**
  * Allocate and initialize a new flowtable entry
  *
+ * @param ft The flow table the entry will be added to
  * @param id The flow ID to use
  * @param flow_add Pointer to the flow add object for the entry
  * @param_p entry Populated with pointer to new flowtable entry on success
@@ -554,17 +1062,19 @@ ft_entry_unlink(ft_instance_t ft, ft_entry_t *entry)
  * The list links are not modified by this call.
  */
 static indigo_error_t
-ft_entry_create(indigo_flow_id_t id, of_flow_add_t *flow_add, ft_entry_t **entry_p)
+ft_entry_create(ft_instance_t ft, indigo_flow_id_t id,
+                of_flow_add_t *flow_add, ft_entry_t **entry_p)
 {
     indigo_error_t err;
     ft_entry_t *entry;
 
-    entry = aim_zmalloc(sizeof(*entry));
+    entry = ft_slab_alloc(&ft->entry_slab);
+    INDIGO_MEM_SET(entry, 0, sizeof(*entry));
 
     entry->id = id;
 
     if (of_flow_add_match_get(flow_add, &entry->match) < 0) {
-        aim_free(entry);
+        ft_slab_free(entry);
         return INDIGO_ERROR_UNKNOWN;
     }
     of_flow_add_cookie_get(flow_add, &entry->cookie);
@@ -572,10 +1082,14 @@ ft_entry_create(indigo_flow_id_t id, of_flow_add_t *flow_add, ft_entry_t **entry
     of_flow_add_flags_get(flow_add, &entry->flags);
     of_flow_add_idle_timeout_get(flow_add, &entry->idle_timeout);
     of_flow_add_hard_timeout_get(flow_add, &entry->hard_timeout);
+    if (flow_add->version >= OF_VERSION_1_1) {
+        /* Forwarding may still move the flow; see ft_entry_set_table_id */
+        of_flow_add_table_id_get(flow_add, &entry->table_id);
+    }
 
-    err = ft_entry_set_effects(entry, flow_add);
+    err = ft_entry_set_effects(ft, entry, flow_add);
     if (err != INDIGO_ERROR_NONE) {
-        aim_free(entry);
+        ft_slab_free(entry);
         return err;
     }
 
@@ -597,96 +1111,74 @@ ft_entry_create(indigo_flow_id_t id, of_flow_add_t *flow_add, ft_entry_t **entry
 static void
 ft_entry_destroy(ft_instance_t ft, ft_entry_t *entry)
 {
-    if (entry->effects.actions != NULL) {
-        of_list_action_delete(entry->effects.actions);
-        entry->effects.actions = NULL;
-    }
+    ft_effects_release(&ft->effects, entry->effects.actions);
+    entry->effects.actions = NULL;
 
-    aim_free(entry);
+    ft_slab_free(entry);
 }
 
-/* Populate the output port list and effects */
+/*
+ * Populate the effects
+ *
+ * The entry takes a reference on the interned copy of the flow_mod's
+ * effects and drops the one it held, so a modify to the same effects
+ * leaves the shared object alone. Entries are linked into their effects'
+ * entries by ft_entry_link, so only a modify needs to move the entry.
+ */
 static indigo_error_t
-ft_entry_set_effects(ft_entry_t *entry,
-                    of_flow_modify_t *flow_mod)
-{
-    if (flow_mod->version == OF_VERSION_1_0)
-    {
-        of_list_action_t *actions;
-        if ((actions = of_flow_modify_actions_get(flow_mod)) == NULL) {
-            LOG_ERROR("Could not get action list");
-            return INDIGO_ERROR_RESOURCE;
-        }
-        of_list_action_delete(entry->effects.actions);
-        entry->effects.actions = actions;
-    } else {
-        of_list_instruction_t *instructions;
-        if ((instructions = of_flow_modify_instructions_get(flow_mod)) == NULL) {
-            LOG_ERROR("Could not get instruction list");
-            return INDIGO_ERROR_RESOURCE;
-        }
-        of_list_instruction_delete(entry->effects.instructions);
-        entry->effects.instructions = instructions;
-    }
-
-    return INDIGO_ERROR_NONE;
-}
-
-static int
-action_list_has_out_port(of_list_action_t *actions, of_port_no_t port)
+ft_entry_set_effects(ft_instance_t ft, ft_entry_t *entry,
+                     of_flow_modify_t *flow_mod)
 {
-    of_action_t act;
-    int loop_rv;
-    of_port_no_t out_port;
+    of_object_t *effects;
+    list_links_t *cur, *next;
 
-    OF_LIST_ACTION_ITER(actions, &act, loop_rv) {
-        if (act.header.object_id == OF_ACTION_OUTPUT) {
-            of_action_output_port_get(&act.output, &out_port);
-            if (out_port == port) {
-                return 1;
-            }
-        }
+    if (flow_mod->version == OF_VERSION_1_0) {
+        of_list_action_t actions;
+        of_flow_modify_actions_bind(flow_mod, &actions);
+        effects = ft_effects_intern(&ft->effects, &actions);
+    } else {
+        of_list_instruction_t instructions;
+        of_flow_modify_instructions_bind(flow_mod, &instructions);
+        effects = ft_effects_intern(&ft->effects, &instructions);
     }
 
-    return 0;
-}
-
-static int
-instruction_list_has_out_port(of_list_instruction_t *instructions, of_port_no_t port)
-{
-    of_instruction_t inst;
-    int loop_rv;
-
-    OF_LIST_INSTRUCTION_ITER(instructions, &inst, loop_rv) {
-        if (inst.header.object_id == OF_INSTRUCTION_APPLY_ACTIONS) {
-            of_list_action_t actions;
-            of_instruction_apply_actions_actions_bind(&inst.apply_actions, &actions);
-            if (action_list_has_out_port(&actions, port)) {
-                return 1;
-            }
-        } else if (inst.header.object_id == OF_INSTRUCTION_WRITE_ACTIONS) {
-            of_list_action_t actions;
-            of_instruction_write_actions_actions_bind(&inst.write_actions, &actions);
-            if (action_list_has_out_port(&actions, port)) {
-                return 1;
+    if (entry->effects.actions != NULL && effects != entry->effects.actions) {
+        /* Modifying a linked entry; move it to the new effects' entries */
+        LIST_FOREACH_SAFE(&entry->iterators, cur, next) {
+            ft_iterator_t *iter = container_of(cur, entry_links, ft_iterator_t);
+            if (iter->links_offset == offsetof(ft_entry_t, effects_links)) {
+                ft_iterator_advance(iter);
             }
         }
+
+        list_remove(&entry->effects_links);
+        list_push(&ft_effects_from_obj(effects)->entries,
+                  &entry->effects_links);
     }
 
-    return 0;
+    ft_effects_release(&ft->effects, entry->effects.actions);
+    entry->effects.actions = effects;
+
+    return INDIGO_ERROR_NONE;
 }
 
 /**
- * Determine if the given entry has port as an output port
+ * Determine if the entry outputs to the query's out_port and out_group
  */
 static int
-ft_entry_has_out_port(ft_entry_t *entry, of_port_no_t port)
+ft_entry_out_match(of_meta_match_t *query, ft_entry_t *entry)
 {
-    if (entry->effects.actions->version == OF_VERSION_1_0) {
-        return action_list_has_out_port(entry->effects.actions, port);
-    } else {
-        return instruction_list_has_out_port(entry->effects.instructions, port);
+    if (query->out_port != OF_PORT_DEST_WILDCARD &&
+            !ft_effects_has_out(entry->effects.actions, FT_EFFECTS_OUT_PORT,
+                                query->out_port)) {
+        return 0;
+    }
+
+    if (query->check_out_group &&
+            !ft_effects_has_out(entry->effects.actions, FT_EFFECTS_OUT_GROUP,
+                                query->out_group)) {
+        return 0;
     }
 
-    return 0;
+    return 1;
 }
@@ -55,12 +55,13 @@
 #include <stdbool.h>
 
 #include "ft_entry.h"
-
-/**
- * Length of the prefix used for bucketing flows by cookie.
- */
-#define FT_COOKIE_PREFIX_LEN 8
-#define FT_COOKIE_PREFIX_MASK (~(uint64_t)0 << (64-FT_COOKIE_PREFIX_LEN))
+#include "ft_hash.h"
+#include "ft_id_map.h"
+#include "ft_tuple.h"
+#include "ft_overlap.h"
+#include "ft_slab.h"
+#include "ft_effects.h"
+#include "ft_cookie.h"
 
 /**
  * Forward declaration of flowtable handle for other typedefs
@@ -81,8 +82,12 @@ typedef ft_public_t *ft_instance_t;
 /**
  * Flow table configuration structure
  * @param max_entries Maximum number of entries to support
- * @param strict_match_bucket_count How many buckets for strict_match hash table
- * @param flow_id_bucket_count How many buckets for flow_id hash table
+ * @param strict_match_bucket_count Initial and minimum number of buckets
+ * for the strict_match hash table
+ * @param flow_id_bucket_count Initial and minimum number of slots for
+ * the flow_id map
+ *
+ * The indexes grow and shrink with the number of entries.
  */
 
 typedef struct ft_config_s {
@@ -105,6 +110,8 @@ typedef struct ft_config_s {
  * in the table.
  * @param forwarding_add_errors Number of adds that failed due to a
  * failure in the forwarding layer.
+ * @param removed_packets Last reported packet count of the deleted
+ * entries, so matched counts do not go back when a flow is removed.
  */
 
 typedef struct ft_status_s {
@@ -116,8 +123,31 @@ typedef struct ft_status_s {
     uint64_t updates;
     uint64_t table_full_errors;
     uint64_t forwarding_add_errors;
+    uint64_t removed_packets;
 } ft_status_t;
 
+/* Table IDs index the partitions directly */
+#define FT_MAX_TABLES 256
+
+/**
+ * A partition of the flowtable holding the entries of one table
+ *
+ * Queries for a specific table only look at its partition. The tuple and
+ * cookie indexes are kept per table. The overlap index is partitioned by
+ * table already, and the strict match, flow ID and output indexes are
+ * shared.
+ */
+typedef struct ft_table_s {
+    list_head_t entries;           /* Entries of the table */
+    list_head_t tuples;            /* Tuple space index; list of ft_tuple_t */
+    ft_cookie_index_t cookies;     /* Cookie index */
+    ft_status_t status;            /* Counters for this table */
+    uint32_t max_entries;          /* Capacity in forwarding; 0 if unknown */
+    uint32_t reserved_entries;     /* Held in forwarding outside the
+                                      flowtable */
+    uint32_t tuple_buckets;        /* Initial hash size of new tuples */
+} ft_table_t;
+
 /**
  * The public view of the instance for easier dereference
  *
@@ -130,28 +160,60 @@ struct ft_public_s {
 
     list_head_t all_list;          /* Single list of all current entries */
 
-    list_head_t *strict_match_buckets;  /* Array of strict match based buckets */
-    list_head_t *flow_id_buckets;  /* Array of flow_id based buckets */
-    list_head_t *cookie_buckets;   /* Array of cookie (prefix) based buckets */
+    ft_hash_t strict_match_hash;   /* Strict match based hash index */
+    ft_id_map_t flow_id_map;       /* Flow ID based index */
+    ft_table_t tables[FT_MAX_TABLES]; /* Partitions by table ID */
+    ft_overlap_t overlap;          /* Overlap index */
+    ft_slab_t entry_slab;          /* Storage for ft_entry_t */
+    ft_slab_t cookie_slab;         /* Storage for the cookie indexes */
+    ft_effects_table_t effects;    /* Interned entry effects */
+
+    struct ft_rehash_task_state *rehash_task; /* Non-NULL while resizing */
 };
 
 #define FT_CONFIG(_ft) (&(_ft)->config)
 #define FT_STATUS(_ft) (&(_ft)->status)
+#define FT_TABLE(_ft, _table_id) (&(_ft)->tables[_table_id])
 
 /**
  * Safe iterator for the flowtable
  *
  * See ft_iterator_init, ft_iterator_next, and ft_iterator_cleanup.
  *
+ * The iterator walks a sequence of lists. When the end of the current
+ * list is reached, next_list (if set) selects the next one and the
+ * links_offset used to map its links to entries.
+ *
  * This struct should be treated as opaque.
  */
 typedef struct ft_iterator_s {
-    list_head_t *head;             /* List head for this iteration */
+    ft_instance_t ft;
+    list_head_t *head;             /* Current list head for this iteration */
     ft_entry_t *next_entry;        /* Entry to be returned on next() */
     int links_offset;              /* Offset of the links we're using in the flowtable entry */
     list_links_t entry_links;      /* Linked into next_entry->iterators if next_entry != NULL */
     bool use_query;                /* Whether 'query' is valid */
     of_meta_match_t query;         /* Optional query to filter by */
+    void (*next_list)(struct ft_iterator_s *iter); /* Advance to the next list */
+
+    int table_id;                  /* Current partition for the tuple and
+                                      cookie indexes */
+
+    /* Tuple space iteration */
+    struct ft_tuple_s *tuple;      /* Current tuple */
+    uint32_t key_hash;             /* Hash of the query's masked fields */
+    list_head_t *buckets[2];       /* Buckets to visit in a pinned tuple hash */
+    int num_buckets;
+    int bucket_idx;
+    ft_hash_t *pinned;             /* Tuple hash pinned while in its buckets */
+
+    /* Output index iteration */
+    ft_effects_key_t *out_key;     /* Port or group from the query */
+    ft_effects_out_t *out;         /* Current effects outputting to it */
+
+    /* Cookie index iteration */
+    uint64_t cookie;               /* Cookie of the current leaf */
+    bool cookie_started;           /* Whether cookie is valid */
 } ft_iterator_t;
 
 /**
@@ -173,6 +235,19 @@ typedef struct ft_iterator_s {
              _next = _cur->next, _cur != &((_ft)->all_list.links);      \
              _cur = _next, _entry = FT_ENTRY_CONTAINER((_cur), table))
 
+/**
+ * Safe iterator for one table of the flow table
+ *
+ * Like FT_ITER, but only visits the entries of the given table.
+ */
+
+#define FT_TABLE_ITER(_ft, _table_id, _entry, _cur, _next)              \
+    for ((_cur) = FT_TABLE(_ft, _table_id)->entries.links.next,         \
+             _entry = FT_ENTRY_CONTAINER(_cur, partition);              \
+         _next = _cur->next,                                            \
+             _cur != &(FT_TABLE(_ft, _table_id)->entries.links);        \
+         _cur = _next, _entry = FT_ENTRY_CONTAINER((_cur), partition))
+
 /*
  * Create a flow table instance
  *
@@ -230,6 +305,18 @@ indigo_error_t ft_strict_match(ft_instance_t instance,
                                of_meta_match_t *query,
                                ft_entry_t **entry_ptr);
 
+/**
+ * Query the flow table (overlap) and return the first match if found
+ * @param ft Handle for a flow table instance
+ * @param query The meta-match data for the query; the priority must be set
+ * @param entry_ptr (out) Pointer to where to store the result if found
+ * @returns INDIGO_ERROR_NONE if found; otherwise INDIGO_ERROR_NOT_FOUND
+ */
+
+indigo_error_t ft_overlap_match(ft_instance_t instance,
+                                of_meta_match_t *query,
+                                ft_entry_t **entry_ptr);
+
 /**
  * Look up a flow by ID
  *
@@ -254,6 +341,84 @@ ft_entry_modify_effects(ft_instance_t instance,
                         ft_entry_t *entry,
                         of_flow_modify_t *flow_mod);
 
+/**
+ * Whether a flow mod's effects are identical to a flow entry's
+ * @param entry Pointer to the entry
+ * @param flow_mod The LOCI flow mod object
+ */
+
+bool
+ft_entry_effects_equal(ft_entry_t *entry, of_flow_modify_t *flow_mod);
+
+/**
+ * Replace a flow entry in place
+ * @param ft The flow table handle
+ * @param entry Pointer to the entry to replace
+ * @param flow_add The LOCI flow add with the entry's match and priority
+ *
+ * Used for a flow add that overwrites an existing entry in the same
+ * table. The entry keeps its flow ID and takes the cookie, flags,
+ * timeouts and effects of flow_add. Its duration restarts.
+ */
+
+void
+ft_entry_replace(ft_instance_t ft, ft_entry_t *entry, of_flow_add_t *flow_add);
+
+/**
+ * Change the table ID of a flow entry
+ * @param ft The flow table handle
+ * @param entry Pointer to the entry to update
+ * @param table_id The new table ID
+ *
+ * Used when the forwarding layer places the flow in a different table
+ * than the one requested.
+ */
+
+void
+ft_entry_set_table_id(ft_instance_t ft, ft_entry_t *entry, uint8_t table_id);
+
+/**
+ * Set the capacity forwarding has for a table
+ * @param ft The flow table handle
+ * @param table_id The table
+ * @param max_entries Most entries forwarding can hold; 0 if unknown
+ * @param reserved_entries Entries forwarding holds that are not in the
+ * flowtable, such as those present at startup
+ *
+ * Also sizes the hashes of the table's tuples for its capacity.
+ */
+
+void
+ft_table_capacity_set(ft_instance_t ft, uint8_t table_id,
+                      uint32_t max_entries, uint32_t reserved_entries);
+
+/**
+ * Free entries in a table
+ * @param ft The flow table handle
+ * @param table_id The table
+ * @returns The number of entries that can still be added, or UINT32_MAX
+ * if the capacity is unknown
+ *
+ * Entries count from the time they are added to the flowtable, so adds
+ * forwarding has not completed yet are included.
+ */
+
+uint32_t
+ft_table_headroom(ft_instance_t ft, uint8_t table_id);
+
+/**
+ * Record the counters forwarding reported for a flow entry
+ * @param ft The flow table handle
+ * @param entry Pointer to the entry
+ * @param packets Packet count
+ * @param bytes Byte count
+ * Keeps the cookie index totals used for aggregate stats current.
+ */
+
+void
+ft_entry_counters_update(ft_instance_t ft, ft_entry_t *entry,
+                         uint64_t packets, uint64_t bytes);
+
 /*
  * Spawn a task that iterates over the flowtable
  *
@@ -265,7 +430,7 @@ ft_entry_modify_effects(ft_instance_t instance,
  * This function does not guarantee a consistent view of the
  * flowtable over the course of the task.
  *
- * This function does not use any indexes on the flowtable.
+ * Queries are narrowed with the same indexes as ft_iterator_init.
  *
  * The callback function will be called with a NULL entry argument at
  * the end of the iteration.
@@ -292,6 +457,13 @@ ft_spawn_iter_task(ft_instance_t instance,
  * This iterator does not guarantee a consistent view of the flowtable over
  * the course of the iteration. Flows added during the iteration may or may
  * not be returned by the iterator.
+ *
+ * Strict and non-strict queries with an out_port or out_group only visit
+ * the entries outputting to it. Those that constrain the match or table ID
+ * only visit the tuples that can contain matching entries, unless the match
+ * is wildcarded and the query has a cookie mask. Queries with a cookie
+ * mask otherwise only visit the cookies matching it. Any other query with
+ * a table ID only visits that table.
  */
 void
 ft_iterator_init(ft_iterator_t *iter, ft_instance_t ft, of_meta_match_t *query);
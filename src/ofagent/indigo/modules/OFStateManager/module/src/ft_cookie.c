@@ -0,0 +1,322 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Cookie index
+ */
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+
+#include "ofstatemanager_int.h"
+#include "ofstatemanager_log.h"
+#include "ft_cookie.h"
+
+#define FT_COOKIE_LEAF (-1)
+
+static inline bool
+ft_cookie_is_leaf(ft_cookie_node_t *node)
+{
+    return node->bit == FT_COOKIE_LEAF;
+}
+
+static inline int
+ft_cookie_dir(uint64_t cookie, int bit)
+{
+    return (cookie >> bit) & 1;
+}
+
+/* Bits above bit, which all cookies below a node agree on */
+static inline uint64_t
+ft_cookie_high_mask(int bit)
+{
+    return bit == 63 ? 0 : ~(uint64_t)0 << (bit + 1);
+}
+
+void
+ft_cookie_init(ft_cookie_index_t *index, ft_slab_t *node_slab)
+{
+    index->root = NULL;
+    index->count = 0;
+    index->node_slab = node_slab;
+}
+
+void
+ft_cookie_cleanup(ft_cookie_index_t *index)
+{
+    if (index->root != NULL) {
+        LOG_ERROR("ERROR: %u cookies remain on delete", index->count);
+    }
+}
+
+/* Add to the totals of every node from the root to a cookie's leaf */
+static void
+ft_cookie_totals_add(ft_cookie_index_t *index, uint64_t cookie,
+                     uint64_t flows, uint64_t packets, uint64_t bytes)
+{
+    ft_cookie_node_t *node = index->root;
+
+    while (node != NULL) {
+        node->totals.flows += flows;
+        node->totals.packets += packets;
+        node->totals.bytes += bytes;
+        if (ft_cookie_is_leaf(node)) {
+            break;
+        }
+        node = node->child[ft_cookie_dir(cookie, node->bit)];
+    }
+}
+
+/* Find the leaf for a cookie, creating it if needed */
+static ft_cookie_node_t *
+ft_cookie_leaf(ft_cookie_index_t *index, uint64_t cookie)
+{
+    ft_cookie_node_t *node, *leaf, *internal;
+    ft_cookie_node_t **link;
+    uint64_t diff;
+    int bit;
+
+    /* The closest leaf shares the longest prefix with the cookie */
+    node = index->root;
+    while (node != NULL && !ft_cookie_is_leaf(node)) {
+        node = node->child[ft_cookie_dir(cookie, node->bit)];
+    }
+
+    if (node != NULL && node->cookie == cookie) {
+        return node;
+    }
+
+    leaf = ft_slab_alloc(index->node_slab);
+    leaf->child[0] = leaf->child[1] = NULL;
+    leaf->cookie = cookie;
+    leaf->bit = FT_COOKIE_LEAF;
+    list_init(&leaf->entries);
+    INDIGO_MEM_SET(&leaf->totals, 0, sizeof(leaf->totals));
+    index->count++;
+
+    if (node == NULL) {
+        index->root = leaf;
+        return leaf;
+    }
+
+    diff = node->cookie ^ cookie;
+    bit = 63 - __builtin_clzll(diff);
+
+    /* Insert above the first node splitting on a lower bit */
+    link = &index->root;
+    while (!ft_cookie_is_leaf(*link) && (*link)->bit > bit) {
+        link = &(*link)->child[ft_cookie_dir(cookie, (*link)->bit)];
+    }
+
+    internal = ft_slab_alloc(index->node_slab);
+    internal->cookie = cookie;
+    internal->bit = bit;
+    list_init(&internal->entries);
+    internal->totals = (*link)->totals;
+    internal->child[ft_cookie_dir(cookie, bit)] = leaf;
+    internal->child[!ft_cookie_dir(cookie, bit)] = *link;
+    *link = internal;
+
+    return leaf;
+}
+
+static void
+ft_cookie_remove_leaf(ft_cookie_index_t *index, ft_cookie_node_t *leaf)
+{
+    ft_cookie_node_t **link = &index->root;
+    ft_cookie_node_t **parent_link = NULL;
+    ft_cookie_node_t *parent = NULL;
+    int dir = 0;
+
+    while (*link != leaf) {
+        INDIGO_ASSERT(!ft_cookie_is_leaf(*link));
+        parent_link = link;
+        parent = *link;
+        dir = ft_cookie_dir(leaf->cookie, parent->bit);
+        link = &parent->child[dir];
+    }
+
+    if (parent == NULL) {
+        index->root = NULL;
+    } else {
+        /* The sibling takes the parent's place */
+        *parent_link = parent->child[!dir];
+        ft_slab_free(parent);
+    }
+
+    index->count--;
+    ft_slab_free(leaf);
+}
+
+void
+ft_cookie_link(ft_cookie_index_t *index, ft_entry_t *entry)
+{
+    ft_cookie_node_t *leaf = ft_cookie_leaf(index, entry->cookie);
+
+    list_push(&leaf->entries, &entry->cookie_links);
+    entry->cookie_node = leaf;
+
+    ft_cookie_totals_add(index, entry->cookie, 1, entry->packets, entry->bytes);
+}
+
+void
+ft_cookie_unlink(ft_cookie_index_t *index, ft_entry_t *entry)
+{
+    ft_cookie_node_t *leaf = entry->cookie_node;
+
+    /* Unsigned wraparound subtracts */
+    ft_cookie_totals_add(index, entry->cookie, -1, -entry->packets,
+                         -entry->bytes);
+
+    list_remove(&entry->cookie_links);
+    entry->cookie_node = NULL;
+
+    if (list_empty(&leaf->entries)) {
+        ft_cookie_remove_leaf(index, leaf);
+    }
+}
+
+void
+ft_cookie_counters_update(ft_cookie_index_t *index, ft_entry_t *entry,
+                          uint64_t packets, uint64_t bytes)
+{
+    if (entry->cookie_node != NULL) {
+        ft_cookie_totals_add(index, entry->cookie, 0,
+                             packets - entry->packets, bytes - entry->bytes);
+    }
+
+    entry->packets = packets;
+    entry->bytes = bytes;
+}
+
+bool
+ft_cookie_totals(ft_cookie_index_t *index, uint64_t cookie, uint64_t mask,
+                 ft_cookie_totals_t *totals)
+{
+    ft_cookie_node_t *node = index->root;
+    uint64_t wild = ~mask;
+
+    /* The wildcarded bits must be the low ones */
+    if (wild & (wild + 1)) {
+        return false;
+    }
+
+    while (node != NULL) {
+        if (ft_cookie_is_leaf(node)) {
+            if ((node->cookie ^ cookie) & mask) {
+                return true;
+            }
+            break;
+        }
+
+        if ((node->cookie ^ cookie) & mask & ft_cookie_high_mask(node->bit)) {
+            return true;
+        }
+
+        /* Below the prefix every cookie of the subtree matches */
+        if (!((mask >> node->bit) & 1)) {
+            break;
+        }
+
+        node = node->child[ft_cookie_dir(cookie, node->bit)];
+    }
+
+    if (node != NULL) {
+        totals->flows += node->totals.flows;
+        totals->packets += node->totals.packets;
+        totals->bytes += node->totals.bytes;
+    }
+
+    return true;
+}
+
+/*
+ * Search a subtree in cookie order. While strict, the cookies below node
+ * agree with after on the bits above node's bit, and only cookies greater
+ * than after are wanted.
+ */
+static ft_cookie_node_t *
+ft_cookie_search(ft_cookie_node_t *node, uint64_t cookie, uint64_t mask,
+                 uint64_t after, bool strict)
+{
+    uint64_t high_mask;
+    ft_cookie_node_t *found;
+    bool child_strict;
+    int dir, after_dir;
+
+    if (ft_cookie_is_leaf(node)) {
+        if ((node->cookie ^ cookie) & mask) {
+            return NULL;
+        }
+        if (strict && node->cookie <= after) {
+            return NULL;
+        }
+        return node;
+    }
+
+    high_mask = ft_cookie_high_mask(node->bit);
+    if ((node->cookie ^ cookie) & mask & high_mask) {
+        return NULL;
+    }
+
+    if (strict) {
+        if ((node->cookie & high_mask) < (after & high_mask)) {
+            return NULL;
+        } else if ((node->cookie & high_mask) > (after & high_mask)) {
+            strict = false;
+        }
+    }
+
+    for (dir = 0; dir < 2; dir++) {
+        if ((mask >> node->bit) & 1 &&
+                ft_cookie_dir(cookie, node->bit) != dir) {
+            continue;
+        }
+
+        child_strict = strict;
+        if (strict) {
+            after_dir = ft_cookie_dir(after, node->bit);
+            if (dir < after_dir) {
+                continue;
+            } else if (dir > after_dir) {
+                child_strict = false;
+            }
+        }
+
+        found = ft_cookie_search(node->child[dir], cookie, mask, after,
+                                 child_strict);
+        if (found != NULL) {
+            return found;
+        }
+    }
+
+    return NULL;
+}
+
+ft_cookie_node_t *
+ft_cookie_next(ft_cookie_index_t *index, uint64_t cookie, uint64_t mask,
+               uint64_t after, bool started)
+{
+    if (index->root == NULL) {
+        return NULL;
+    }
+
+    return ft_cookie_search(index->root, cookie, mask, after, started);
+}
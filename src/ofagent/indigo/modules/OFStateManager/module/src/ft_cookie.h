@@ -0,0 +1,126 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Cookie index
+ *
+ * A crit-bit tree over the full 64 bit cookie. Each leaf holds the
+ * entries with one cookie. Each internal node splits its subtree on the
+ * most significant bit where the cookies below it differ. All of those
+ * cookies agree on the bits above it.
+ *
+ * A (cookie, mask) query only descends into one child at nodes whose bit
+ * is in the mask, and skips subtrees whose common high bits disagree with
+ * the query. Leaves are enumerated in cookie order, and the next one is
+ * searched for by value. So the tree can change between steps without
+ * invalidating an iteration.
+ *
+ * Every node also keeps the flow count and the last reported packet and
+ * byte counters of the entries below it. A cookie prefix names one
+ * subtree, so its totals are found in a single descent.
+ */
+
+#ifndef _OFSTATEMANAGER_FT_COOKIE_H_
+#define _OFSTATEMANAGER_FT_COOKIE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <AIM/aim_list.h>
+
+#include "ft_entry.h"
+#include "ft_slab.h"
+
+typedef struct ft_cookie_totals_s {
+    uint64_t flows;
+    uint64_t packets;
+    uint64_t bytes;
+} ft_cookie_totals_t;
+
+typedef struct ft_cookie_node_s {
+    struct ft_cookie_node_s *child[2]; /* Internal nodes; by the value of bit */
+    uint64_t cookie;               /* Leaf: the cookie. Internal: a cookie
+                                      below, for the bits above bit */
+    int bit;                       /* Internal: the crit bit; -1 for leaves */
+    list_head_t entries;           /* Leaf: through cookie_links */
+    ft_cookie_totals_t totals;     /* Of the entries below */
+} ft_cookie_node_t;
+
+typedef struct ft_cookie_index_s {
+    ft_cookie_node_t *root;
+    uint32_t count;                /* Number of leaves (distinct cookies) */
+    ft_slab_t *node_slab;          /* Storage for leaves and internal nodes */
+} ft_cookie_index_t;
+
+/**
+ * Initialize a cookie index
+ * @param index The cookie index
+ * @param node_slab Slab for ft_cookie_node_t, may be shared between indexes
+ */
+void ft_cookie_init(ft_cookie_index_t *index, ft_slab_t *node_slab);
+
+/**
+ * Free a cookie index
+ *
+ * Logs an error if the index is not empty.
+ */
+void ft_cookie_cleanup(ft_cookie_index_t *index);
+
+/**
+ * Link an entry into the leaf for its cookie
+ */
+void ft_cookie_link(ft_cookie_index_t *index, ft_entry_t *entry);
+
+/**
+ * Unlink an entry, removing its leaf if it becomes empty
+ */
+void ft_cookie_unlink(ft_cookie_index_t *index, ft_entry_t *entry);
+
+/**
+ * Set the counters of a linked entry, updating the totals above it
+ */
+void ft_cookie_counters_update(ft_cookie_index_t *index, ft_entry_t *entry,
+                               uint64_t packets, uint64_t bytes);
+
+/**
+ * Totals of the entries matching (cookie, mask)
+ * @param index The cookie index
+ * @param cookie The query cookie
+ * @param mask The query cookie mask
+ * @param totals Output; added to, not overwritten
+ * @returns false if the mask is not a prefix mask (0, all ones, or
+ * contiguous high bits), in which case totals is unchanged
+ */
+bool ft_cookie_totals(ft_cookie_index_t *index, uint64_t cookie,
+                      uint64_t mask, ft_cookie_totals_t *totals);
+
+/**
+ * Find the leaf with the smallest cookie matching (cookie, mask)
+ * @param index The cookie index
+ * @param cookie The query cookie
+ * @param mask The query cookie mask
+ * @param after If started, only cookies greater than this are returned
+ * @param started Whether after is valid
+ * @returns The leaf, or NULL if there are no more matching cookies
+ */
+ft_cookie_node_t *ft_cookie_next(ft_cookie_index_t *index,
+                                 uint64_t cookie, uint64_t mask,
+                                 uint64_t after, bool started);
+
+#endif /* _OFSTATEMANAGER_FT_COOKIE_H_ */
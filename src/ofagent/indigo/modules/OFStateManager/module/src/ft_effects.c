@@ -0,0 +1,404 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Interned flow effects
+ */
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+#include <murmur/murmur.h>
+#include <string.h>
+
+#include "ofstatemanager_int.h"
+#include "ofstatemanager_log.h"
+#include "ft_effects.h"
+
+#define FT_EFFECTS_HASH_SEED 0
+#define FT_EFFECTS_INITIAL_BUCKETS 64
+#define FT_EFFECTS_INITIAL_OUT_BUCKETS 64
+
+static uint32_t
+ft_effects_hash(of_object_t *obj)
+{
+    uint32_t h = FT_EFFECTS_HASH_SEED;
+    uint32_t key[2] = { obj->object_id, obj->version };
+
+    h = murmur_hash(key, sizeof(key), h);
+    return murmur_hash(OF_OBJECT_BUFFER_INDEX(obj, 0), obj->length, h);
+}
+
+static list_head_t *
+ft_effects_bucket(ft_effects_table_t *table, uint32_t hash)
+{
+    return &table->buckets[hash & (table->buckets_size - 1)];
+}
+
+/*
+ * Double a bucket array. There are far fewer distinct effects and outputs
+ * than entries, so this is done all at once.
+ */
+static void
+ft_effects_grow(list_head_t **buckets_p, uint32_t *buckets_size_p,
+                uint32_t (*hash_f)(list_links_t *links))
+{
+    list_head_t *old_buckets = *buckets_p;
+    uint32_t old_buckets_size = *buckets_size_p;
+    uint32_t buckets_size = old_buckets_size * 2;
+    list_head_t *buckets;
+    list_links_t *cur;
+    uint32_t idx;
+
+    buckets = aim_malloc(sizeof(*buckets) * buckets_size);
+    for (idx = 0; idx < buckets_size; idx++) {
+        list_init(&buckets[idx]);
+    }
+
+    for (idx = 0; idx < old_buckets_size; idx++) {
+        while ((cur = list_shift(&old_buckets[idx])) != NULL) {
+            list_push(&buckets[hash_f(cur) & (buckets_size - 1)], cur);
+        }
+    }
+
+    aim_free(old_buckets);
+    *buckets_p = buckets;
+    *buckets_size_p = buckets_size;
+}
+
+static uint32_t
+ft_effects_links_hash(list_links_t *cur)
+{
+    ft_effects_t *effects = container_of(cur, links, ft_effects_t);
+
+    return effects->hash;
+}
+
+/*
+ * Output index
+ */
+
+static uint32_t
+ft_effects_key_hash(ft_effects_out_kind_t kind, uint32_t id)
+{
+    uint32_t key[2] = { kind, id };
+
+    return murmur_hash(key, sizeof(key), FT_EFFECTS_HASH_SEED);
+}
+
+static uint32_t
+ft_effects_key_links_hash(list_links_t *cur)
+{
+    ft_effects_key_t *key = container_of(cur, links, ft_effects_key_t);
+
+    return ft_effects_key_hash(key->kind, key->id);
+}
+
+static list_head_t *
+ft_effects_out_bucket(ft_effects_table_t *table, ft_effects_out_kind_t kind,
+                      uint32_t id)
+{
+    uint32_t hash = ft_effects_key_hash(kind, id);
+
+    return &table->out_buckets[hash & (table->out_buckets_size - 1)];
+}
+
+ft_effects_key_t *
+ft_effects_find_key(ft_effects_table_t *table, ft_effects_out_kind_t kind,
+                    uint32_t id)
+{
+    list_links_t *cur;
+
+    LIST_FOREACH(ft_effects_out_bucket(table, kind, id), cur) {
+        ft_effects_key_t *key = container_of(cur, links, ft_effects_key_t);
+        if (key->kind == kind && key->id == id) {
+            return key;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+ft_effects_link_out(ft_effects_table_t *table, ft_effects_out_t *out,
+                    ft_effects_out_kind_t kind, uint32_t id)
+{
+    ft_effects_key_t *key = ft_effects_find_key(table, kind, id);
+
+    if (key == NULL) {
+        key = aim_malloc(sizeof(*key));
+        key->kind = kind;
+        key->id = id;
+        list_init(&key->outs);
+        list_push(ft_effects_out_bucket(table, kind, id), &key->links);
+        if (++table->out_count > table->out_buckets_size) {
+            ft_effects_grow(&table->out_buckets, &table->out_buckets_size,
+                            ft_effects_key_links_hash);
+        }
+    }
+
+    out->key = key;
+    list_push(&key->outs, &out->links);
+}
+
+static void
+ft_effects_unlink_out(ft_effects_table_t *table, ft_effects_out_t *out)
+{
+    ft_effects_key_t *key = out->key;
+
+    list_remove(&out->links);
+    if (list_empty(&key->outs)) {
+        list_remove(&key->links);
+        table->out_count--;
+        aim_free(key);
+    }
+}
+
+/*
+ * Add an output to effects->outs[n] unless it's already in the first n,
+ * and return the new count. With effects NULL this just counts, giving an
+ * upper bound for the allocation.
+ */
+static uint32_t
+ft_effects_add_out(ft_effects_table_t *table, ft_effects_t *effects,
+                   uint32_t n, ft_effects_out_kind_t kind, uint32_t id)
+{
+    uint32_t i;
+
+    if (effects == NULL) {
+        return n + 1;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (effects->outs[i].key->kind == kind &&
+                effects->outs[i].key->id == id) {
+            return n;
+        }
+    }
+
+    effects->outs[n].effects = effects;
+    ft_effects_link_out(table, &effects->outs[n], kind, id);
+    return n + 1;
+}
+
+static uint32_t
+ft_effects_scan_actions(ft_effects_table_t *table, ft_effects_t *effects,
+                        uint32_t n, of_list_action_t *actions)
+{
+    of_action_t act;
+    int loop_rv;
+    of_port_no_t port;
+    uint32_t group_id;
+
+    OF_LIST_ACTION_ITER(actions, &act, loop_rv) {
+        if (act.header.object_id == OF_ACTION_OUTPUT) {
+            of_action_output_port_get(&act.output, &port);
+            n = ft_effects_add_out(table, effects, n,
+                                   FT_EFFECTS_OUT_PORT, port);
+        } else if (act.header.object_id == OF_ACTION_GROUP) {
+            of_action_group_group_id_get(&act.group, &group_id);
+            n = ft_effects_add_out(table, effects, n,
+                                   FT_EFFECTS_OUT_GROUP, group_id);
+        }
+    }
+
+    return n;
+}
+
+static uint32_t
+ft_effects_scan(ft_effects_table_t *table, ft_effects_t *effects,
+                of_object_t *obj)
+{
+    of_instruction_t inst;
+    of_list_action_t actions;
+    int loop_rv;
+    uint32_t n = 0;
+
+    if (obj->version == OF_VERSION_1_0) {
+        return ft_effects_scan_actions(table, effects, n, obj);
+    }
+
+    OF_LIST_INSTRUCTION_ITER(obj, &inst, loop_rv) {
+        if (inst.header.object_id == OF_INSTRUCTION_APPLY_ACTIONS) {
+            of_instruction_apply_actions_actions_bind(&inst.apply_actions,
+                                                      &actions);
+            n = ft_effects_scan_actions(table, effects, n, &actions);
+        } else if (inst.header.object_id == OF_INSTRUCTION_WRITE_ACTIONS) {
+            of_instruction_write_actions_actions_bind(&inst.write_actions,
+                                                      &actions);
+            n = ft_effects_scan_actions(table, effects, n, &actions);
+        }
+    }
+
+    return n;
+}
+
+bool
+ft_effects_has_out(of_object_t *obj, ft_effects_out_kind_t kind, uint32_t id)
+{
+    ft_effects_t *effects = ft_effects_from_obj(obj);
+    uint32_t i;
+
+    for (i = 0; i < effects->num_outs; i++) {
+        if (effects->outs[i].key->kind == kind &&
+                effects->outs[i].key->id == id) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+ft_effects_init(ft_effects_table_t *table)
+{
+    uint32_t idx;
+
+    table->buckets = aim_malloc(sizeof(*table->buckets) *
+                                FT_EFFECTS_INITIAL_BUCKETS);
+    table->buckets_size = FT_EFFECTS_INITIAL_BUCKETS;
+    for (idx = 0; idx < table->buckets_size; idx++) {
+        list_init(&table->buckets[idx]);
+    }
+    table->count = 0;
+    table->refs = 0;
+
+    table->out_buckets = aim_malloc(sizeof(*table->out_buckets) *
+                                    FT_EFFECTS_INITIAL_OUT_BUCKETS);
+    table->out_buckets_size = FT_EFFECTS_INITIAL_OUT_BUCKETS;
+    for (idx = 0; idx < table->out_buckets_size; idx++) {
+        list_init(&table->out_buckets[idx]);
+    }
+    table->out_count = 0;
+
+    ft_arena_init(&table->arena);
+}
+
+void
+ft_effects_cleanup(ft_effects_table_t *table)
+{
+    if (table->count != 0) {
+        LOG_ERROR("ERROR: %u effects with %u references on delete",
+                  table->count, table->refs);
+    }
+
+    aim_free(table->buckets);
+    table->buckets = NULL;
+    aim_free(table->out_buckets);
+    table->out_buckets = NULL;
+    ft_arena_cleanup(&table->arena);
+}
+
+static bool
+ft_effects_eq(ft_effects_t *effects, of_object_t *obj)
+{
+    of_object_t *interned = &effects->storage.obj;
+
+    return interned->object_id == obj->object_id &&
+        interned->version == obj->version &&
+        interned->length == obj->length &&
+        memcmp(effects->storage.wbuf.buf,
+               OF_OBJECT_BUFFER_INDEX(obj, 0), obj->length) == 0;
+}
+
+bool
+ft_effects_equal(of_object_t *obj, of_object_t *src)
+{
+    return ft_effects_eq(ft_effects_from_obj(obj), src);
+}
+
+of_object_t *
+ft_effects_intern(ft_effects_table_t *table, of_object_t *src)
+{
+    uint32_t hash = ft_effects_hash(src);
+    list_head_t *bucket = ft_effects_bucket(table, hash);
+    ft_effects_t *effects;
+    list_links_t *cur;
+    uint32_t max_outs;
+
+    LIST_FOREACH(bucket, cur) {
+        effects = container_of(cur, links, ft_effects_t);
+        if (effects->hash == hash && ft_effects_eq(effects, src)) {
+            effects->refcount++;
+            table->refs++;
+            return &effects->storage.obj;
+        }
+    }
+
+    max_outs = ft_effects_scan(table, NULL, src);
+    effects = ft_arena_alloc(&table->arena, sizeof(*effects) +
+                             max_outs * sizeof(ft_effects_out_t) +
+                             src->length);
+    INDIGO_MEM_SET(effects, 0, sizeof(*effects));
+    list_init(&effects->entries);
+
+    effects->storage.wbuf.buf = (uint8_t *)(effects->outs + max_outs);
+    effects->storage.wbuf.alloc_bytes = src->length;
+    effects->storage.wbuf.current_bytes = src->length;
+    effects->storage.obj.wire_object.wbuf = &effects->storage.wbuf;
+
+    of_object_init_map[src->object_id](&effects->storage.obj, src->version,
+                                       src->length, 0);
+
+    INDIGO_MEM_COPY(effects->storage.wbuf.buf,
+                    OF_OBJECT_BUFFER_INDEX(src, 0), src->length);
+
+    /* Duplicates may leave some of the outs unused */
+    effects->num_outs = ft_effects_scan(table, effects, src);
+
+    effects->hash = hash;
+    effects->refcount = 1;
+    list_push(bucket, &effects->links);
+    table->refs++;
+
+    if (++table->count > table->buckets_size) {
+        ft_effects_grow(&table->buckets, &table->buckets_size,
+                        ft_effects_links_hash);
+    }
+
+    return &effects->storage.obj;
+}
+
+void
+ft_effects_release(ft_effects_table_t *table, of_object_t *obj)
+{
+    ft_effects_t *effects;
+    uint32_t i;
+
+    if (obj == NULL) {
+        return;
+    }
+
+    effects = ft_effects_from_obj(obj);
+    INDIGO_ASSERT(effects->refcount > 0);
+    table->refs--;
+
+    if (--effects->refcount > 0) {
+        return;
+    }
+
+    INDIGO_ASSERT(list_empty(&effects->entries));
+    for (i = 0; i < effects->num_outs; i++) {
+        ft_effects_unlink_out(table, &effects->outs[i]);
+    }
+
+    list_remove(&effects->links);
+    table->count--;
+    ft_arena_free(&table->arena, effects);
+}
@@ -0,0 +1,149 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Interned flow effects
+ *
+ * Large tables have many flows with the same instructions (for example
+ * goto-table plus write-group), so the effects are interned: flows with
+ * byte-identical action or instruction lists share one refcounted,
+ * immutable LOCI object.
+ *
+ * Each interned object lives in a single arena block together with its
+ * wire buffer and data. It is not owned by LOCI; it must be released
+ * with ft_effects_release, never of_object_delete, and must not be
+ * modified.
+ *
+ * The table also indexes the effects by the ports and groups they output
+ * to, for out_port and out_group queries. Entries sharing effects have the
+ * same outputs, so the index goes from a port or group to the effects
+ * sending to it, and from each effects to the entries linked to it.
+ */
+
+#ifndef _OFSTATEMANAGER_FT_EFFECTS_H_
+#define _OFSTATEMANAGER_FT_EFFECTS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <AIM/aim_list.h>
+#include <loci/loci.h>
+
+#include "ft_slab.h"
+
+typedef enum ft_effects_out_kind_e {
+    FT_EFFECTS_OUT_PORT,
+    FT_EFFECTS_OUT_GROUP,
+} ft_effects_out_kind_t;
+
+/* A port or group that some effects output to */
+typedef struct ft_effects_key_s {
+    list_links_t links;            /* Linked into an out bucket */
+    ft_effects_out_kind_t kind;
+    uint32_t id;
+    list_head_t outs;              /* List of ft_effects_out_t */
+} ft_effects_key_t;
+
+/* Reference from effects to one of their outputs */
+typedef struct ft_effects_out_s {
+    list_links_t links;            /* Linked into key->outs */
+    ft_effects_key_t *key;
+    struct ft_effects_s *effects;
+} ft_effects_out_t;
+
+/* Arena block for interned effects; the outputs and then the data follow */
+typedef struct ft_effects_s {
+    of_object_storage_t storage;
+    list_links_t links;            /* Linked into an intern bucket */
+    uint32_t hash;
+    uint32_t refcount;
+    list_head_t entries;           /* Linked entries, through effects_links */
+    uint32_t num_outs;
+    ft_effects_out_t outs[];       /* Distinct output ports and groups */
+} ft_effects_t;
+
+typedef struct ft_effects_table_s {
+    list_head_t *buckets;          /* Interned effects by hash of the data */
+    uint32_t buckets_size;         /* always a power of 2 */
+    uint32_t count;                /* Distinct effects */
+    uint32_t refs;                 /* References from entries */
+    list_head_t *out_buckets;      /* ft_effects_key_t by kind and id */
+    uint32_t out_buckets_size;     /* always a power of 2 */
+    uint32_t out_count;            /* Number of keys */
+    ft_arena_t arena;              /* Storage for the effects */
+} ft_effects_table_t;
+
+/**
+ * Get the interned block for an object returned by ft_effects_intern
+ */
+static inline ft_effects_t *
+ft_effects_from_obj(of_object_t *obj)
+{
+    return container_of(obj, storage.obj, ft_effects_t);
+}
+
+/**
+ * Initialize an effects table
+ */
+void ft_effects_init(ft_effects_table_t *table);
+
+/**
+ * Free an effects table
+ *
+ * Logs an error if effects are still referenced.
+ */
+void ft_effects_cleanup(ft_effects_table_t *table);
+
+/**
+ * Get a reference to the interned copy of an action or instruction list
+ * @param table The effects table
+ * @param src The list; typically bound into a flow_mod message
+ * @returns The shared object
+ */
+of_object_t *ft_effects_intern(ft_effects_table_t *table, of_object_t *src);
+
+/**
+ * Whether interned effects are byte-identical to a list
+ * @param obj Object returned by ft_effects_intern
+ * @param src The list to compare with
+ */
+bool ft_effects_equal(of_object_t *obj, of_object_t *src);
+
+/**
+ * Release a reference returned by ft_effects_intern
+ *
+ * NULL is ignored.
+ */
+void ft_effects_release(ft_effects_table_t *table, of_object_t *obj);
+
+/**
+ * Find the key for a port or group
+ * @returns The key, or NULL if no effects output to it
+ */
+ft_effects_key_t *ft_effects_find_key(ft_effects_table_t *table,
+                                      ft_effects_out_kind_t kind,
+                                      uint32_t id);
+
+/**
+ * Whether interned effects output to a port or group
+ */
+bool ft_effects_has_out(of_object_t *obj, ft_effects_out_kind_t kind,
+                        uint32_t id);
+
+#endif /* _OFSTATEMANAGER_FT_EFFECTS_H_ */
@@ -48,9 +48,15 @@
  * @param bytes Number of bytes matched by the entry
  * @param last_counter_change Last update when counters changed
  * @param table_links For iterating across the flow table
+ * @param partition_links For iterating across the entry's table
  * @param prio_links Search by priority
  * @param match_links Search by strict match
- * @param flow_id_links Search by flow id
+ * @param tuple The tuple (table_id, masks) the entry belongs to
+ * @param tuple_links Iterating across the entries of the tuple
+ * @param tuple_hash_links Search by masked match within the tuple
+ * @param overlap_shape The overlap shape (table_id, priority, masks)
+ * @param overlap_links Search by masked match within the overlap shape
+ * @param effects_links Iterating across the entries sharing the effects
  *
  * The effects (actions or instructions) are tied to a specific OpenFlow
  * version. For example, a flow may be added using OpenFlow 1.0 but
@@ -85,12 +91,21 @@ typedef struct ft_entry_s {
     uint8_t table_id;
     indigo_time_t insert_time;
     indigo_time_t last_counter_change;
+    uint64_t packets;              /* Last counters reported by forwarding */
+    uint64_t bytes;
 
     /* For linked list maintance */
     list_links_t table_links;      /* For iterating across the flow table */
+    list_links_t partition_links;  /* Entries of the table's partition */
     list_links_t strict_match_links;  /* Search by strict match */
-    list_links_t flow_id_links;    /* Search by flow id */
-    list_links_t cookie_links;     /* Search by cookie */
+    struct ft_cookie_node_s *cookie_node; /* Cookie index leaf */
+    list_links_t cookie_links;     /* Entries with the same cookie */
+    struct ft_tuple_s *tuple;      /* Tuple for this table_id and masks */
+    list_links_t tuple_links;      /* Entries of the tuple */
+    list_links_t tuple_hash_links; /* Search by masked match in the tuple */
+    struct ft_overlap_shape_s *overlap_shape; /* Overlap index shape */
+    list_links_t overlap_links;    /* Search by masked match in the shape */
+    list_links_t effects_links;    /* Entries sharing the interned effects */
     list_links_t expiration_links; /* Expiration list entry */
     list_head_t iterators;         /* List of ft_iterator_t objects
                                       pointing to this entry */
@@ -163,6 +178,8 @@ typedef struct of_meta_match_s {
     int check_priority;     /* Boolean; should priority be checked */
     int check_overlap;      /* Boolean, for adds */
     of_port_no_t out_port;  /* OFPP_ANY means do not match */
+    int check_out_group;    /* Boolean; should out_group be checked */
+    uint32_t out_group;
     uint8_t table_id;       /* Set to TABLE_ID_ANY to wildcard */
 } of_meta_match_t;
 
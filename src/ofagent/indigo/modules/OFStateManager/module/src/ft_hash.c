@@ -0,0 +1,212 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Resizable chained hash index over flowtable entries
+ */
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+
+#include "ofstatemanager_log.h"
+#include "ft_hash.h"
+
+static list_links_t *
+ft_hash_entry_to_links(ft_hash_t *hash, ft_entry_t *entry)
+{
+    return (list_links_t *)(((char *)entry) + hash->links_offset);
+}
+
+static list_head_t *
+ft_hash_buckets_alloc(uint32_t buckets_size)
+{
+    list_head_t *buckets = aim_malloc(sizeof(*buckets) * buckets_size);
+    uint32_t idx;
+
+    for (idx = 0; idx < buckets_size; idx++) {
+        list_init(&buckets[idx]);
+    }
+
+    return buckets;
+}
+
+/*
+ * Switch to a new bucket array of the given size. The existing buckets
+ * become old_buckets and are migrated by ft_hash_rehash_step.
+ */
+static void
+ft_hash_resize(ft_hash_t *hash, uint32_t buckets_size)
+{
+    INDIGO_ASSERT(!ft_hash_rehashing(hash));
+
+    LOG_TRACE("Resizing hash from %u to %u buckets",
+              hash->buckets_size, buckets_size);
+
+    hash->old_buckets = hash->buckets;
+    hash->old_buckets_size = hash->buckets_size;
+    hash->rehash_idx = 0;
+
+    hash->buckets = ft_hash_buckets_alloc(buckets_size);
+    hash->buckets_size = buckets_size;
+}
+
+static void
+ft_hash_check_load(ft_hash_t *hash)
+{
+    if (ft_hash_rehashing(hash) || hash->pins > 0) {
+        return;
+    }
+
+    if (hash->count > hash->buckets_size * FT_HASH_MAX_LOAD) {
+        ft_hash_resize(hash, hash->buckets_size * 2);
+    } else if (hash->buckets_size > hash->min_buckets_size &&
+               hash->count < hash->buckets_size / FT_HASH_MIN_LOAD) {
+        ft_hash_resize(hash, hash->buckets_size / 2);
+    }
+}
+
+void
+ft_hash_init(ft_hash_t *hash, uint32_t buckets_size, int links_offset,
+             ft_hash_entry_f hash_entry)
+{
+    uint32_t size = 1;
+
+    while (size < buckets_size) {
+        size <<= 1;
+    }
+
+    hash->buckets = ft_hash_buckets_alloc(size);
+    hash->buckets_size = size;
+    hash->old_buckets = NULL;
+    hash->old_buckets_size = 0;
+    hash->rehash_idx = 0;
+    hash->min_buckets_size = size;
+    hash->count = 0;
+    hash->pins = 0;
+    hash->links_offset = links_offset;
+    hash->hash_entry = hash_entry;
+}
+
+void
+ft_hash_cleanup(ft_hash_t *hash, const char *name)
+{
+    if (hash->count != 0) {
+        LOG_ERROR("ERROR: hash %s has %u entries on delete", name, hash->count);
+    }
+
+    aim_free(hash->buckets);
+    hash->buckets = NULL;
+    aim_free(hash->old_buckets);
+    hash->old_buckets = NULL;
+}
+
+void
+ft_hash_insert(ft_hash_t *hash, ft_entry_t *entry)
+{
+    uint32_t h = hash->hash_entry(entry);
+
+    list_push(&hash->buckets[h & (hash->buckets_size - 1)],
+              ft_hash_entry_to_links(hash, entry));
+    hash->count++;
+
+    /* Keep an ongoing rehash moving even if the task is starved */
+    if (ft_hash_rehashing(hash) && hash->pins == 0) {
+        ft_hash_rehash_step(hash, 1);
+    }
+
+    ft_hash_check_load(hash);
+}
+
+void
+ft_hash_remove(ft_hash_t *hash, ft_entry_t *entry)
+{
+    list_remove(ft_hash_entry_to_links(hash, entry));
+    hash->count--;
+
+    if (ft_hash_rehashing(hash) && hash->pins == 0) {
+        ft_hash_rehash_step(hash, 1);
+    }
+
+    ft_hash_check_load(hash);
+}
+
+void
+ft_hash_unpin(ft_hash_t *hash)
+{
+    INDIGO_ASSERT(hash->pins > 0);
+    hash->pins--;
+    ft_hash_check_load(hash);
+}
+
+int
+ft_hash_buckets(ft_hash_t *hash, uint32_t h, list_head_t *buckets[2])
+{
+    int n = 0;
+
+    buckets[n++] = &hash->buckets[h & (hash->buckets_size - 1)];
+
+    if (ft_hash_rehashing(hash)) {
+        uint32_t idx = h & (hash->old_buckets_size - 1);
+        if (idx >= hash->rehash_idx) {
+            buckets[n++] = &hash->old_buckets[idx];
+        }
+    }
+
+    return n;
+}
+
+bool
+ft_hash_rehash_step(ft_hash_t *hash, int max_buckets)
+{
+    list_links_t *cur;
+
+    if (!ft_hash_rehashing(hash)) {
+        return false;
+    }
+
+    if (hash->pins > 0) {
+        return false;
+    }
+
+    while (max_buckets-- > 0 && hash->rehash_idx < hash->old_buckets_size) {
+        list_head_t *bucket = &hash->old_buckets[hash->rehash_idx++];
+        while ((cur = list_shift(bucket)) != NULL) {
+            ft_entry_t *entry = ft_hash_links_to_entry(hash, cur);
+            uint32_t h = hash->hash_entry(entry);
+            list_push(&hash->buckets[h & (hash->buckets_size - 1)], cur);
+        }
+    }
+
+    if (hash->rehash_idx < hash->old_buckets_size) {
+        return true;
+    }
+
+    LOG_TRACE("Finished rehash to %u buckets", hash->buckets_size);
+
+    aim_free(hash->old_buckets);
+    hash->old_buckets = NULL;
+    hash->old_buckets_size = 0;
+    hash->rehash_idx = 0;
+
+    /* The load may have crossed a threshold during the rehash */
+    ft_hash_check_load(hash);
+
+    return ft_hash_rehashing(hash);
+}
@@ -0,0 +1,152 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Resizable chained hash index over flowtable entries
+ *
+ * Entries are linked into buckets through a list_links_t embedded in
+ * ft_entry_t, identified by its offset. The bucket array doubles when the
+ * load factor exceeds FT_HASH_MAX_LOAD and halves when it drops below
+ * FT_HASH_MIN_LOAD, never going under the initial size.
+ *
+ * A resize allocates the new bucket array and then migrates the old
+ * buckets a few at a time with ft_hash_rehash_step. While a rehash is in
+ * progress new entries go to the new array and lookups must search both
+ * arrays; see ft_hash_buckets.
+ *
+ * An index can be pinned while a caller walks one of its buckets. A pinned
+ * index neither starts nor continues a resize, so bucket lists stay put
+ * (entries may still be inserted and removed).
+ */
+
+#ifndef _OFSTATEMANAGER_FT_HASH_H_
+#define _OFSTATEMANAGER_FT_HASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <AIM/aim_list.h>
+
+#include "ft_entry.h"
+
+/* Grow when there are more entries than buckets */
+#define FT_HASH_MAX_LOAD 1
+/* Shrink when fewer than one entry per this many buckets */
+#define FT_HASH_MIN_LOAD 8
+
+/**
+ * Compute the hash of an entry's key
+ */
+typedef uint32_t (*ft_hash_entry_f)(ft_entry_t *entry);
+
+typedef struct ft_hash_s {
+    list_head_t *buckets;          /* Current bucket array */
+    uint32_t buckets_size;         /* always a power of 2 */
+    list_head_t *old_buckets;      /* Bucket array being migrated, or NULL */
+    uint32_t old_buckets_size;
+    uint32_t rehash_idx;           /* Next bucket in old_buckets to migrate */
+    uint32_t min_buckets_size;
+    uint32_t count;                /* Number of entries */
+    int pins;                      /* Resizing is deferred while nonzero */
+    int links_offset;              /* Offset of the links in ft_entry_t */
+    ft_hash_entry_f hash_entry;
+} ft_hash_t;
+
+/**
+ * Initialize a hash index
+ * @param hash The hash index
+ * @param buckets_size Initial (and minimum) number of buckets; rounded
+ * up to a power of 2
+ * @param links_offset offsetof the list_links_t in ft_entry_t
+ * @param hash_entry Function computing the hash of an entry
+ */
+void ft_hash_init(ft_hash_t *hash, uint32_t buckets_size, int links_offset,
+                  ft_hash_entry_f hash_entry);
+
+/**
+ * Free the bucket arrays of a hash index
+ *
+ * Logs an error if the index is not empty.
+ */
+void ft_hash_cleanup(ft_hash_t *hash, const char *name);
+
+/**
+ * Link an entry into the hash index
+ *
+ * May start a resize.
+ */
+void ft_hash_insert(ft_hash_t *hash, ft_entry_t *entry);
+
+/**
+ * Unlink an entry from the hash index
+ *
+ * May start a resize.
+ */
+void ft_hash_remove(ft_hash_t *hash, ft_entry_t *entry);
+
+/**
+ * Get the buckets that may hold entries with the given hash
+ * @param hash The hash index
+ * @param h Hash value
+ * @param buckets Output array of bucket heads
+ * @returns Number of buckets stored (2 while rehashing, otherwise 1)
+ */
+int ft_hash_buckets(ft_hash_t *hash, uint32_t h, list_head_t *buckets[2]);
+
+/**
+ * Migrate up to max_buckets buckets from the old array
+ * @returns true if the rehash is still in progress and not pinned
+ */
+bool ft_hash_rehash_step(ft_hash_t *hash, int max_buckets);
+
+/**
+ * Prevent bucket lists from being resized or migrated
+ */
+static inline void
+ft_hash_pin(ft_hash_t *hash)
+{
+    hash->pins++;
+}
+
+/**
+ * Release a pin taken with ft_hash_pin
+ *
+ * Any resize that was deferred may start here.
+ */
+void ft_hash_unpin(ft_hash_t *hash);
+
+/**
+ * Whether a rehash is in progress
+ */
+static inline bool
+ft_hash_rehashing(ft_hash_t *hash)
+{
+    return hash->old_buckets != NULL;
+}
+
+/**
+ * Entry for the given links
+ */
+static inline ft_entry_t *
+ft_hash_links_to_entry(ft_hash_t *hash, list_links_t *links)
+{
+    return (ft_entry_t *)(((char *)links) - hash->links_offset);
+}
+
+#endif /* _OFSTATEMANAGER_FT_HASH_H_ */
@@ -0,0 +1,404 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Open addressing flow ID index
+ */
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ofstatemanager_log.h"
+#include "ft_id_map.h"
+
+#define CTRL_EMPTY   ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xfe)
+
+/* Full slots keep the low 7 bits of the hash; the rest selects the group */
+#define HASH_TAG(h)   ((uint8_t)((h) & 0x7f))
+#define HASH_GROUP(h) ((h) >> 7)
+
+/* Maximum number of full or deleted slots before a resize */
+#define MAX_LOAD(size) ((size) - (size) / 8)
+
+/*
+ * 64-bit finalizer from MurmurHash3. Flow IDs are often sequential, so
+ * all bits need to be mixed into both the tag and the group index.
+ */
+static inline uint64_t
+ft_id_map_hash(indigo_flow_id_t id)
+{
+    uint64_t h = id;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * Group operations
+ *
+ * Each returns a bitmask with bit i set if control byte i of the group
+ * satisfies the condition.
+ */
+
+#ifdef __SSE2__
+
+static inline uint32_t
+group_match(const uint8_t *ctrl, uint8_t tag)
+{
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+}
+
+/* EMPTY or DELETED; both have the high bit set */
+static inline uint32_t
+group_match_free(const uint8_t *ctrl)
+{
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+}
+
+#else
+
+static inline uint32_t
+group_match(const uint8_t *ctrl, uint8_t tag)
+{
+    uint32_t mask = 0;
+    int i;
+
+    for (i = 0; i < FT_ID_MAP_GROUP_SIZE; i++) {
+        if (ctrl[i] == tag) {
+            mask |= 1 << i;
+        }
+    }
+
+    return mask;
+}
+
+static inline uint32_t
+group_match_free(const uint8_t *ctrl)
+{
+    uint32_t mask = 0;
+    int i;
+
+    for (i = 0; i < FT_ID_MAP_GROUP_SIZE; i++) {
+        if (ctrl[i] & 0x80) {
+            mask |= 1 << i;
+        }
+    }
+
+    return mask;
+}
+
+#endif
+
+static inline uint32_t
+group_match_empty(const uint8_t *ctrl)
+{
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+/*
+ * Table operations
+ *
+ * Groups are probed with triangular steps, which visits every group of a
+ * power of 2 sized table.
+ */
+
+static void
+table_alloc(ft_id_map_table_t *t, uint32_t size)
+{
+    t->ctrl = aim_malloc(size);
+    memset(t->ctrl, CTRL_EMPTY, size);
+    t->slots = aim_malloc(sizeof(*t->slots) * size);
+    t->size = size;
+    t->used = 0;
+    t->deleted = 0;
+}
+
+static void
+table_free(ft_id_map_table_t *t)
+{
+    aim_free(t->ctrl);
+    aim_free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+static int
+table_find(ft_id_map_table_t *t, indigo_flow_id_t id, uint64_t h)
+{
+    uint32_t group_mask, group, probe;
+
+    if (t->used == 0) {
+        return -1;
+    }
+
+    group_mask = t->size / FT_ID_MAP_GROUP_SIZE - 1;
+    group = HASH_GROUP(h) & group_mask;
+
+    for (probe = 0; probe <= group_mask; ) {
+        const uint8_t *ctrl = t->ctrl + group * FT_ID_MAP_GROUP_SIZE;
+        uint32_t match = group_match(ctrl, HASH_TAG(h));
+
+        while (match) {
+            int idx = group * FT_ID_MAP_GROUP_SIZE + __builtin_ctz(match);
+            if (t->slots[idx].id == id) {
+                return idx;
+            }
+            match &= match - 1;
+        }
+
+        if (group_match_empty(ctrl)) {
+            return -1;
+        }
+
+        group = (group + ++probe) & group_mask;
+    }
+
+    return -1;
+}
+
+/* Caller ensures there is a free slot */
+static void
+table_insert(ft_id_map_table_t *t, indigo_flow_id_t id, ft_entry_t *entry,
+             uint64_t h)
+{
+    uint32_t group_mask = t->size / FT_ID_MAP_GROUP_SIZE - 1;
+    uint32_t group = HASH_GROUP(h) & group_mask;
+    uint32_t probe = 0;
+    uint32_t free_mask;
+    int idx;
+
+    while ((free_mask = group_match_free(t->ctrl + group * FT_ID_MAP_GROUP_SIZE)) == 0) {
+        group = (group + ++probe) & group_mask;
+        INDIGO_ASSERT(probe <= group_mask);
+    }
+
+    idx = group * FT_ID_MAP_GROUP_SIZE + __builtin_ctz(free_mask);
+    if (t->ctrl[idx] == CTRL_DELETED) {
+        t->deleted--;
+    }
+
+    t->ctrl[idx] = HASH_TAG(h);
+    t->slots[idx].id = id;
+    t->slots[idx].entry = entry;
+    t->used++;
+}
+
+static void
+table_erase(ft_id_map_table_t *t, int idx)
+{
+    const uint8_t *ctrl = t->ctrl + (idx & ~(FT_ID_MAP_GROUP_SIZE - 1));
+
+    /*
+     * Groups are aligned, so if this group already has an EMPTY slot every
+     * probe through it stops here anyway and the slot can become EMPTY.
+     * Otherwise leave a tombstone so longer probe sequences continue.
+     */
+    if (group_match_empty(ctrl)) {
+        t->ctrl[idx] = CTRL_EMPTY;
+    } else {
+        t->ctrl[idx] = CTRL_DELETED;
+        t->deleted++;
+    }
+
+    t->used--;
+}
+
+static bool
+table_has_room(ft_id_map_table_t *t)
+{
+    return t->used + t->deleted + 1 <= MAX_LOAD(t->size);
+}
+
+/*
+ * Map operations
+ */
+
+static void
+ft_id_map_resize(ft_id_map_t *map, uint32_t size)
+{
+    INDIGO_ASSERT(!ft_id_map_rehashing(map));
+
+    LOG_TRACE("Resizing flow ID map from %u to %u slots",
+              map->table.size, size);
+
+    map->old_table = map->table;
+    map->rehash_idx = 0;
+    table_alloc(&map->table, size);
+}
+
+static void
+ft_id_map_check_load(ft_id_map_t *map)
+{
+    ft_id_map_table_t *t = &map->table;
+
+    if (ft_id_map_rehashing(map)) {
+        return;
+    }
+
+    if (t->used + t->deleted >= MAX_LOAD(t->size)) {
+        /* Grow if mostly live entries, otherwise just drop the tombstones */
+        if (t->used >= MAX_LOAD(t->size) / 2) {
+            ft_id_map_resize(map, t->size * 2);
+        } else {
+            ft_id_map_resize(map, t->size);
+        }
+    } else if (t->size > map->min_size && t->used < t->size / 8) {
+        ft_id_map_resize(map, t->size / 2);
+    }
+}
+
+void
+ft_id_map_init(ft_id_map_t *map, uint32_t size)
+{
+    uint32_t actual = FT_ID_MAP_GROUP_SIZE;
+
+    while (actual < size) {
+        actual <<= 1;
+    }
+
+    memset(map, 0, sizeof(*map));
+    table_alloc(&map->table, actual);
+    map->min_size = actual;
+}
+
+void
+ft_id_map_cleanup(ft_id_map_t *map)
+{
+    if (ft_id_map_count(map) != 0) {
+        LOG_ERROR("ERROR: flow ID map has %u entries on delete",
+                  ft_id_map_count(map));
+    }
+
+    table_free(&map->table);
+    if (ft_id_map_rehashing(map)) {
+        table_free(&map->old_table);
+    }
+}
+
+void
+ft_id_map_insert(ft_id_map_t *map, ft_entry_t *entry)
+{
+    uint64_t h = ft_id_map_hash(entry->id);
+
+    if (ft_id_map_rehashing(map)) {
+        /* Keep an ongoing rehash moving even if the task is starved */
+        ft_id_map_rehash_step(map, 1);
+    }
+
+    if (!table_has_room(&map->table)) {
+        /* Only reachable if inserts outpace the rehash; finish it now */
+        while (ft_id_map_rehash_step(map, map->old_table.size)) {
+            if (table_has_room(&map->table)) {
+                break;
+            }
+        }
+    }
+
+    table_insert(&map->table, entry->id, entry, h);
+
+    ft_id_map_check_load(map);
+}
+
+void
+ft_id_map_remove(ft_id_map_t *map, ft_entry_t *entry)
+{
+    uint64_t h = ft_id_map_hash(entry->id);
+    int idx;
+
+    if ((idx = table_find(&map->table, entry->id, h)) >= 0) {
+        table_erase(&map->table, idx);
+    } else if ((idx = table_find(&map->old_table, entry->id, h)) >= 0) {
+        table_erase(&map->old_table, idx);
+    } else {
+        INDIGO_ASSERT(!"flow ID missing from map");
+        return;
+    }
+
+    ft_id_map_check_load(map);
+}
+
+ft_entry_t *
+ft_id_map_lookup(ft_id_map_t *map, indigo_flow_id_t id)
+{
+    uint64_t h = ft_id_map_hash(id);
+    int idx;
+
+    if ((idx = table_find(&map->table, id, h)) >= 0) {
+        return map->table.slots[idx].entry;
+    }
+
+    if ((idx = table_find(&map->old_table, id, h)) >= 0) {
+        return map->old_table.slots[idx].entry;
+    }
+
+    return NULL;
+}
+
+bool
+ft_id_map_rehash_step(ft_id_map_t *map, int max_groups)
+{
+    ft_id_map_table_t *old = &map->old_table;
+    uint32_t num_groups = old->size / FT_ID_MAP_GROUP_SIZE;
+
+    if (!ft_id_map_rehashing(map)) {
+        return false;
+    }
+
+    while (max_groups-- > 0 && map->rehash_idx < num_groups && old->used > 0) {
+        uint32_t base = map->rehash_idx++ * FT_ID_MAP_GROUP_SIZE;
+        /* Full slots have the high bit clear */
+        uint32_t full = ~group_match_free(old->ctrl + base) & 0xffff;
+
+        while (full) {
+            int idx = base + __builtin_ctz(full);
+            ft_id_map_slot_t *slot = &old->slots[idx];
+            table_insert(&map->table, slot->id, slot->entry,
+                         ft_id_map_hash(slot->id));
+            /* Tombstone keeps probe sequences through this group intact */
+            old->ctrl[idx] = CTRL_DELETED;
+            old->deleted++;
+            old->used--;
+            full &= full - 1;
+        }
+    }
+
+    if (map->rehash_idx < num_groups && old->used > 0) {
+        return true;
+    }
+
+    LOG_TRACE("Finished flow ID map rehash to %u slots", map->table.size);
+
+    table_free(old);
+    map->rehash_idx = 0;
+
+    /* The load may have crossed a threshold during the rehash */
+    ft_id_map_check_load(map);
+
+    return ft_id_map_rehashing(map);
+}
@@ -0,0 +1,132 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Open addressing flow ID index
+ *
+ * Maps flow IDs to flowtable entries without touching the entries
+ * themselves. The {flow_id, entry} pairs live in a contiguous slot array
+ * next to an array of one byte control tags, in the style of a Swiss
+ * table:
+ *
+ *   - Slots are grouped in FT_ID_MAP_GROUP_SIZE aligned groups.
+ *   - Each control byte is EMPTY, DELETED, or the low 7 bits of the
+ *     key's hash for a full slot.
+ *   - A probe checks a whole group at once by comparing its control
+ *     bytes against the hash tag (with SSE2 when available), and only
+ *     reads the slots whose tags match.
+ *   - A probe sequence ends at the first group with an EMPTY slot.
+ *
+ * Like ft_hash, the table grows and shrinks incrementally: a resize
+ * allocates the new arrays and the old groups are migrated a few at a
+ * time with ft_id_map_rehash_step.
+ */
+
+#ifndef _OFSTATEMANAGER_FT_ID_MAP_H_
+#define _OFSTATEMANAGER_FT_ID_MAP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <indigo/types.h>
+
+#include "ft_entry.h"
+
+#define FT_ID_MAP_GROUP_SIZE 16
+
+typedef struct ft_id_map_slot_s {
+    indigo_flow_id_t id;
+    ft_entry_t *entry;
+} ft_id_map_slot_t;
+
+typedef struct ft_id_map_table_s {
+    uint8_t *ctrl;                 /* Control byte per slot */
+    ft_id_map_slot_t *slots;
+    uint32_t size;                 /* Number of slots; power of 2 */
+    uint32_t used;                 /* Full slots */
+    uint32_t deleted;              /* DELETED (tombstone) slots */
+} ft_id_map_table_t;
+
+typedef struct ft_id_map_s {
+    ft_id_map_table_t table;       /* Current table */
+    ft_id_map_table_t old_table;   /* Table being migrated; size 0 if none */
+    uint32_t rehash_idx;           /* Next group of old_table to migrate */
+    uint32_t min_size;
+} ft_id_map_t;
+
+/**
+ * Initialize a flow ID map
+ * @param map The map
+ * @param size Initial (and minimum) number of slots; rounded up to a
+ * power of 2 of at least FT_ID_MAP_GROUP_SIZE
+ */
+void ft_id_map_init(ft_id_map_t *map, uint32_t size);
+
+/**
+ * Free the arrays of a flow ID map
+ *
+ * Logs an error if the map is not empty.
+ */
+void ft_id_map_cleanup(ft_id_map_t *map);
+
+/**
+ * Add an entry to the map
+ *
+ * The entry's id must not already be present. May start a resize.
+ */
+void ft_id_map_insert(ft_id_map_t *map, ft_entry_t *entry);
+
+/**
+ * Remove an entry from the map
+ *
+ * May start a resize.
+ */
+void ft_id_map_remove(ft_id_map_t *map, ft_entry_t *entry);
+
+/**
+ * Find the entry with the given flow ID
+ * @returns The entry or NULL
+ */
+ft_entry_t *ft_id_map_lookup(ft_id_map_t *map, indigo_flow_id_t id);
+
+/**
+ * Migrate up to max_groups groups from the old table
+ * @returns true if the rehash is still in progress
+ */
+bool ft_id_map_rehash_step(ft_id_map_t *map, int max_groups);
+
+/**
+ * Whether a rehash is in progress
+ */
+static inline bool
+ft_id_map_rehashing(ft_id_map_t *map)
+{
+    return map->old_table.size != 0;
+}
+
+/**
+ * Number of entries in the map
+ */
+static inline uint32_t
+ft_id_map_count(ft_id_map_t *map)
+{
+    return map->table.used + map->old_table.used;
+}
+
+#endif /* _OFSTATEMANAGER_FT_ID_MAP_H_ */
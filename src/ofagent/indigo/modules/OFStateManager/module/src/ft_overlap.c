@@ -0,0 +1,367 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Overlap index for CHECK_OVERLAP flow adds
+ */
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+#include <murmur/murmur.h>
+#include <string.h>
+
+#include "ofstatemanager_log.h"
+#include "ft_overlap.h"
+#include "ft_tuple.h"
+
+#define FT_OVERLAP_HASH_SEED 0
+#define FT_OVERLAP_INITIAL_BUCKETS 64
+#define FT_OVERLAP_SHAPE_BUCKETS 4
+
+#define FIELD_WORDS (sizeof(of_match_fields_t) / sizeof(uint64_t))
+
+static uint32_t
+ft_overlap_part_hash(uint8_t table_id, uint16_t priority)
+{
+    uint32_t key = (table_id << 16) | priority;
+    return murmur_hash(&key, sizeof(key), FT_OVERLAP_HASH_SEED);
+}
+
+static uint32_t
+ft_overlap_entry_hash(ft_entry_t *entry)
+{
+    return ft_tuple_key_hash(&entry->match.fields, &entry->overlap_shape->key);
+}
+
+static list_head_t *
+ft_overlap_bucket(ft_overlap_t *overlap, uint8_t table_id, uint16_t priority)
+{
+    uint32_t h = ft_overlap_part_hash(table_id, priority);
+    return &overlap->buckets[h & (overlap->buckets_size - 1)];
+}
+
+static void
+ft_overlap_resize(ft_overlap_t *overlap, uint32_t buckets_size)
+{
+    list_head_t *old_buckets = overlap->buckets;
+    uint32_t old_buckets_size = overlap->buckets_size;
+    list_links_t *cur;
+    uint32_t idx;
+
+    LOG_TRACE("Resizing overlap partitions from %u to %u buckets",
+              old_buckets_size, buckets_size);
+
+    overlap->buckets = aim_malloc(sizeof(*overlap->buckets) * buckets_size);
+    overlap->buckets_size = buckets_size;
+    for (idx = 0; idx < buckets_size; idx++) {
+        list_init(&overlap->buckets[idx]);
+    }
+
+    for (idx = 0; idx < old_buckets_size; idx++) {
+        while ((cur = list_shift(&old_buckets[idx])) != NULL) {
+            ft_overlap_part_t *part = container_of(cur, links, ft_overlap_part_t);
+            list_push(ft_overlap_bucket(overlap, part->table_id, part->priority),
+                      cur);
+        }
+    }
+
+    aim_free(old_buckets);
+}
+
+void
+ft_overlap_init(ft_overlap_t *overlap)
+{
+    uint32_t idx;
+
+    overlap->buckets = aim_malloc(sizeof(*overlap->buckets) *
+                                  FT_OVERLAP_INITIAL_BUCKETS);
+    overlap->buckets_size = FT_OVERLAP_INITIAL_BUCKETS;
+    overlap->count = 0;
+    for (idx = 0; idx < overlap->buckets_size; idx++) {
+        list_init(&overlap->buckets[idx]);
+    }
+}
+
+void
+ft_overlap_cleanup(ft_overlap_t *overlap)
+{
+    if (overlap->count != 0) {
+        LOG_ERROR("ERROR: overlap index has %u partitions on delete",
+                  overlap->count);
+    }
+
+    aim_free(overlap->buckets);
+    overlap->buckets = NULL;
+}
+
+static ft_overlap_part_t *
+ft_overlap_part_find(ft_overlap_t *overlap, uint8_t table_id, uint16_t priority)
+{
+    list_links_t *cur;
+
+    LIST_FOREACH(ft_overlap_bucket(overlap, table_id, priority), cur) {
+        ft_overlap_part_t *part = container_of(cur, links, ft_overlap_part_t);
+        if (part->table_id == table_id && part->priority == priority) {
+            return part;
+        }
+    }
+
+    return NULL;
+}
+
+void
+ft_overlap_link(ft_overlap_t *overlap, ft_entry_t *entry)
+{
+    of_match_fields_t *masks = &entry->match.masks;
+    uint32_t mask_hash = murmur_hash(masks, sizeof(*masks), FT_OVERLAP_HASH_SEED);
+    ft_overlap_part_t *part;
+    ft_overlap_shape_t *shape = NULL;
+    list_links_t *cur;
+
+    part = ft_overlap_part_find(overlap, entry->table_id, entry->priority);
+    if (part == NULL) {
+        part = aim_zmalloc(sizeof(*part));
+        part->table_id = entry->table_id;
+        part->priority = entry->priority;
+        list_init(&part->shapes);
+        list_push(ft_overlap_bucket(overlap, part->table_id, part->priority),
+                  &part->links);
+        if (++overlap->count > overlap->buckets_size) {
+            ft_overlap_resize(overlap, overlap->buckets_size * 2);
+        }
+    }
+
+    LIST_FOREACH(&part->shapes, cur) {
+        ft_overlap_shape_t *s = container_of(cur, links, ft_overlap_shape_t);
+        if (s->mask_hash == mask_hash &&
+                memcmp(&s->masks, masks, sizeof(*masks)) == 0) {
+            shape = s;
+            break;
+        }
+    }
+
+    if (shape == NULL) {
+        shape = aim_zmalloc(sizeof(*shape));
+        shape->mask_hash = mask_hash;
+        shape->masks = *masks;
+        shape->key = *masks;
+        ft_hash_init(&shape->hash, FT_OVERLAP_SHAPE_BUCKETS,
+                     offsetof(ft_entry_t, overlap_links),
+                     ft_overlap_entry_hash);
+        list_push(&part->shapes, &shape->links);
+    }
+
+    entry->overlap_shape = shape;
+    ft_hash_insert(&shape->hash, entry);
+}
+
+void
+ft_overlap_unlink(ft_overlap_t *overlap, ft_entry_t *entry)
+{
+    ft_overlap_shape_t *shape = entry->overlap_shape;
+    ft_overlap_part_t *part;
+
+    ft_hash_remove(&shape->hash, entry);
+    entry->overlap_shape = NULL;
+
+    if (shape->hash.count > 0) {
+        return;
+    }
+
+    list_remove(&shape->links);
+    ft_hash_cleanup(&shape->hash, "overlap");
+    aim_free(shape);
+
+    part = ft_overlap_part_find(overlap, entry->table_id, entry->priority);
+    INDIGO_ASSERT(part != NULL);
+    if (list_empty(&part->shapes)) {
+        list_remove(&part->links);
+        aim_free(part);
+        overlap->count--;
+    }
+}
+
+/* Store a & b in result; returns whether it is nonzero */
+static bool
+ft_overlap_masks_intersect(of_match_fields_t *a, of_match_fields_t *b,
+                           of_match_fields_t *result)
+{
+    const uint64_t *wa = (const uint64_t *)a;
+    const uint64_t *wb = (const uint64_t *)b;
+    uint64_t *wr = (uint64_t *)result;
+    uint64_t any = 0;
+    int i;
+
+    for (i = 0; i < FIELD_WORDS; i++) {
+        wr[i] = wa[i] & wb[i];
+        any |= wr[i];
+    }
+
+    return any != 0;
+}
+
+/* Whether every bit in a is also set in b */
+static bool
+ft_overlap_masks_subset(of_match_fields_t *a, of_match_fields_t *b)
+{
+    const uint64_t *wa = (const uint64_t *)a;
+    const uint64_t *wb = (const uint64_t *)b;
+    int i;
+
+    for (i = 0; i < FIELD_WORDS; i++) {
+        if (wa[i] & ~wb[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static ft_entry_t *
+ft_overlap_search_bucket(ft_hash_t *hash, list_head_t *bucket,
+                         of_meta_match_t *query)
+{
+    list_links_t *cur;
+
+    LIST_FOREACH(bucket, cur) {
+        ft_entry_t *entry = ft_hash_links_to_entry(hash, cur);
+        if (ft_entry_meta_match(query, entry)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Rehash the shape's entries on a smaller key. The new hash starts out
+ * large enough for the entries but may shrink back to the default size.
+ */
+static void
+ft_overlap_shape_rekey(ft_overlap_shape_t *shape, of_match_fields_t *key)
+{
+    ft_hash_t old_hash = shape->hash;
+    list_links_t *cur;
+    uint32_t idx;
+
+    LOG_TRACE("Rekeying overlap shape %p with %u entries",
+              shape, old_hash.count);
+
+    shape->key = *key;
+    ft_hash_init(&shape->hash, old_hash.count,
+                 offsetof(ft_entry_t, overlap_links), ft_overlap_entry_hash);
+    shape->hash.min_buckets_size = FT_OVERLAP_SHAPE_BUCKETS;
+
+    for (idx = 0; idx < old_hash.buckets_size + old_hash.old_buckets_size; idx++) {
+        list_head_t *bucket = idx < old_hash.buckets_size ?
+            &old_hash.buckets[idx] :
+            &old_hash.old_buckets[idx - old_hash.buckets_size];
+        while ((cur = list_shift(bucket)) != NULL) {
+            old_hash.count--;
+            ft_hash_insert(&shape->hash, ft_hash_links_to_entry(&old_hash, cur));
+        }
+    }
+
+    ft_hash_cleanup(&old_hash, "overlap");
+}
+
+static ft_entry_t *
+ft_overlap_find_in_shape(ft_overlap_shape_t *shape, of_meta_match_t *query)
+{
+    ft_hash_t *hash = &shape->hash;
+    list_head_t *buckets[2];
+    of_match_fields_t key;
+    ft_entry_t *entry = NULL;
+    uint32_t idx;
+    int num_buckets, i;
+
+    if (!ft_overlap_masks_intersect(&shape->masks, &query->match.masks, &key)) {
+        /* Nothing in common with the query; every entry overlaps */
+        for (idx = 0; idx < hash->buckets_size && entry == NULL; idx++) {
+            entry = ft_overlap_search_bucket(hash, &hash->buckets[idx], query);
+        }
+        for (idx = 0; idx < hash->old_buckets_size && entry == NULL; idx++) {
+            entry = ft_overlap_search_bucket(hash, &hash->old_buckets[idx], query);
+        }
+        return entry;
+    }
+
+    if (!ft_overlap_masks_subset(&shape->key, &query->match.masks)) {
+        /* The query doesn't cover the key; narrow it to the common masks */
+        ft_overlap_masks_intersect(&shape->key, &query->match.masks, &key);
+        ft_overlap_shape_rekey(shape, &key);
+    }
+
+    /* Overlapping entries have the query's fields under the key */
+    num_buckets = ft_hash_buckets(hash,
+                                  ft_tuple_key_hash(&query->match.fields,
+                                                    &shape->key),
+                                  buckets);
+    for (i = 0; i < num_buckets && entry == NULL; i++) {
+        entry = ft_overlap_search_bucket(hash, buckets[i], query);
+    }
+
+    return entry;
+}
+
+static ft_entry_t *
+ft_overlap_find_in_part(ft_overlap_t *overlap, uint8_t table_id,
+                        of_meta_match_t *query)
+{
+    ft_overlap_part_t *part;
+    list_links_t *cur;
+
+    part = ft_overlap_part_find(overlap, table_id, query->priority);
+    if (part == NULL) {
+        return NULL;
+    }
+
+    LIST_FOREACH(&part->shapes, cur) {
+        ft_overlap_shape_t *shape = container_of(cur, links, ft_overlap_shape_t);
+        ft_entry_t *entry = ft_overlap_find_in_shape(shape, query);
+        if (entry != NULL) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+ft_entry_t *
+ft_overlap_find(ft_overlap_t *overlap, of_meta_match_t *query)
+{
+    int table_id;
+
+    INDIGO_ASSERT(query->mode == OF_MATCH_OVERLAP);
+    INDIGO_ASSERT(query->check_priority);
+
+    if (query->table_id != TABLE_ID_ANY) {
+        return ft_overlap_find_in_part(overlap, query->table_id, query);
+    }
+
+    for (table_id = 0; table_id <= TABLE_ID_ANY; table_id++) {
+        ft_entry_t *entry = ft_overlap_find_in_part(overlap, table_id, query);
+        if (entry != NULL) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
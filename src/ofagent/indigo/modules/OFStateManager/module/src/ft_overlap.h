@@ -0,0 +1,103 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Overlap index for CHECK_OVERLAP flow adds
+ *
+ * Two flows can only overlap if they are in the same table and have the
+ * same priority, so entries are partitioned by (table_id, priority).
+ * Within a partition entries are grouped into shapes by their masks, and
+ * each shape hashes its entries by their match fields under a key mask.
+ *
+ * An entry overlaps a query if their fields agree on every bit that both
+ * of them match on. If the shape's key is a subset of the query's masks,
+ * the only candidates are in one bucket of the shape's hash. The key
+ * starts out as the shape's masks and is narrowed to the bits in common
+ * with the query when a query doesn't cover it. Controllers use a handful
+ * of mask shapes, so this settles after a few rehashes.
+ */
+
+#ifndef _OFSTATEMANAGER_FT_OVERLAP_H_
+#define _OFSTATEMANAGER_FT_OVERLAP_H_
+
+#include <stdint.h>
+#include <AIM/aim_list.h>
+#include <loci/loci.h>
+
+#include "ft_entry.h"
+#include "ft_hash.h"
+
+typedef struct ft_overlap_shape_s {
+    list_links_t links;            /* Linked into the partition's shapes */
+    uint32_t mask_hash;            /* Hash of masks, to speed up searching */
+    of_match_fields_t masks;
+    of_match_fields_t key;         /* Subset of masks used as the hash key */
+    ft_hash_t hash;                /* By match fields under key, through
+                                      overlap_links */
+} ft_overlap_shape_t;
+
+typedef struct ft_overlap_part_s {
+    list_links_t links;            /* Linked into a partition bucket */
+    uint8_t table_id;
+    uint16_t priority;
+    list_head_t shapes;            /* List of ft_overlap_shape_t */
+} ft_overlap_part_t;
+
+/*
+ * There are far fewer partitions than entries, so the partition buckets
+ * are resized all at once rather than incrementally.
+ */
+typedef struct ft_overlap_s {
+    list_head_t *buckets;          /* Partitions by (table_id, priority) */
+    uint32_t buckets_size;         /* always a power of 2 */
+    uint32_t count;                /* Number of partitions */
+} ft_overlap_t;
+
+/**
+ * Initialize an overlap index
+ */
+void ft_overlap_init(ft_overlap_t *overlap);
+
+/**
+ * Free an overlap index
+ *
+ * Logs an error if the index is not empty.
+ */
+void ft_overlap_cleanup(ft_overlap_t *overlap);
+
+/**
+ * Link an entry into the partition for its table_id and priority
+ */
+void ft_overlap_link(ft_overlap_t *overlap, ft_entry_t *entry);
+
+/**
+ * Unlink an entry, freeing its shape and partition if they become empty
+ */
+void ft_overlap_unlink(ft_overlap_t *overlap, ft_entry_t *entry);
+
+/**
+ * Find an entry overlapping an OF_MATCH_OVERLAP query
+ * @param overlap The overlap index
+ * @param query The query; its priority must be set
+ * @returns An overlapping entry, or NULL if there are none
+ */
+ft_entry_t *ft_overlap_find(ft_overlap_t *overlap, of_meta_match_t *query);
+
+#endif /* _OFSTATEMANAGER_FT_OVERLAP_H_ */
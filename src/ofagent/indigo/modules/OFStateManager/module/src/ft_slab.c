@@ -0,0 +1,256 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Slab allocators for flowtable entries and effects
+ */
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+
+#include "ofstatemanager_int.h"
+#include "ofstatemanager_log.h"
+#include "ft_slab.h"
+
+/* Objects keep malloc alignment */
+#define FT_SLAB_ALIGN 16
+
+typedef struct ft_slab_page_s {
+    list_links_t links;            /* In the slab's partial or full list */
+    ft_slab_t *slab;
+    void *free;                    /* Returned objects */
+    uint32_t in_use;
+    uint32_t fresh;                /* Objects never handed out, at the end */
+} ft_slab_page_t;
+
+/*
+ * Header before each object. The page is NULL for arena allocations that
+ * came from the heap.
+ */
+typedef union ft_slab_hdr_u {
+    ft_slab_page_t *page;
+    uint8_t pad[FT_SLAB_ALIGN];
+} ft_slab_hdr_t;
+
+#define PAGE_HDR_BYTES \
+    ((sizeof(ft_slab_page_t) + FT_SLAB_ALIGN - 1) & ~(FT_SLAB_ALIGN - 1))
+
+static inline ft_slab_hdr_t *
+ft_slab_ptr_to_hdr(void *ptr)
+{
+    return ((ft_slab_hdr_t *)ptr) - 1;
+}
+
+static inline uint8_t *
+ft_slab_page_obj(ft_slab_page_t *page, uint32_t idx)
+{
+    return (uint8_t *)page + PAGE_HDR_BYTES + idx * page->slab->obj_size;
+}
+
+void
+ft_slab_init(ft_slab_t *slab, const char *name, uint32_t size)
+{
+    slab->name = name;
+    slab->obj_size = (sizeof(ft_slab_hdr_t) + size + FT_SLAB_ALIGN - 1) &
+        ~(FT_SLAB_ALIGN - 1);
+    slab->objs_per_page = (FT_SLAB_PAGE_BYTES - PAGE_HDR_BYTES) / slab->obj_size;
+    INDIGO_ASSERT(slab->objs_per_page > 0);
+    list_init(&slab->partial);
+    list_init(&slab->full);
+    slab->empty = NULL;
+    slab->num_pages = 0;
+    slab->in_use = 0;
+}
+
+static void
+ft_slab_free_pages(list_head_t *pages)
+{
+    list_links_t *cur;
+
+    while ((cur = list_shift(pages)) != NULL) {
+        aim_free(container_of(cur, links, ft_slab_page_t));
+    }
+}
+
+void
+ft_slab_cleanup(ft_slab_t *slab)
+{
+    if (slab->in_use != 0) {
+        LOG_ERROR("ERROR: slab %s has %u objects on delete",
+                  slab->name, slab->in_use);
+    }
+
+    ft_slab_free_pages(&slab->partial);
+    ft_slab_free_pages(&slab->full);
+    aim_free(slab->empty);
+    slab->empty = NULL;
+    slab->num_pages = 0;
+}
+
+static ft_slab_page_t *
+ft_slab_page_new(ft_slab_t *slab)
+{
+    ft_slab_page_t *page;
+
+    if (slab->empty != NULL) {
+        page = slab->empty;
+        slab->empty = NULL;
+    } else {
+        page = aim_malloc(FT_SLAB_PAGE_BYTES);
+        page->slab = slab;
+        page->free = NULL;
+        page->in_use = 0;
+        page->fresh = slab->objs_per_page;
+        slab->num_pages++;
+    }
+
+    list_push(&slab->partial, &page->links);
+    return page;
+}
+
+void *
+ft_slab_alloc(ft_slab_t *slab)
+{
+    ft_slab_page_t *page;
+    ft_slab_hdr_t *hdr;
+
+    if (list_empty(&slab->partial)) {
+        page = ft_slab_page_new(slab);
+    } else {
+        page = container_of(list_first(&slab->partial), links, ft_slab_page_t);
+    }
+
+    if (page->free != NULL) {
+        hdr = page->free;
+        page->free = *(void **)(hdr + 1);
+    } else {
+        INDIGO_ASSERT(page->fresh > 0);
+        hdr = (ft_slab_hdr_t *)ft_slab_page_obj(page,
+                                                slab->objs_per_page - page->fresh);
+        page->fresh--;
+    }
+
+    hdr->page = page;
+    page->in_use++;
+    slab->in_use++;
+
+    if (page->free == NULL && page->fresh == 0) {
+        list_remove(&page->links);
+        list_push(&slab->full, &page->links);
+    }
+
+    return hdr + 1;
+}
+
+void
+ft_slab_free(void *ptr)
+{
+    ft_slab_hdr_t *hdr = ft_slab_ptr_to_hdr(ptr);
+    ft_slab_page_t *page = hdr->page;
+    ft_slab_t *slab = page->slab;
+    bool was_full = page->free == NULL && page->fresh == 0;
+
+    *(void **)ptr = page->free;
+    page->free = hdr;
+    page->in_use--;
+    slab->in_use--;
+
+    if (page->in_use == 0) {
+        list_remove(&page->links);
+        /* Reset so the page fills from the front again */
+        page->free = NULL;
+        page->fresh = slab->objs_per_page;
+        if (slab->empty == NULL) {
+            slab->empty = page;
+        } else {
+            aim_free(page);
+            slab->num_pages--;
+        }
+    } else if (was_full) {
+        list_remove(&page->links);
+        list_push(&slab->partial, &page->links);
+    }
+}
+
+/*
+ * Arena
+ */
+
+static const char *ft_arena_class_names[FT_ARENA_NUM_CLASSES] = {
+    "64", "128", "256", "512", "1024", "2048", "4096",
+};
+
+void
+ft_arena_init(ft_arena_t *arena)
+{
+    int i;
+
+    for (i = 0; i < FT_ARENA_NUM_CLASSES; i++) {
+        ft_slab_init(&arena->classes[i], ft_arena_class_names[i],
+                     FT_ARENA_MIN_CLASS_BYTES << i);
+    }
+    arena->large_in_use = 0;
+}
+
+void
+ft_arena_cleanup(ft_arena_t *arena)
+{
+    int i;
+
+    for (i = 0; i < FT_ARENA_NUM_CLASSES; i++) {
+        ft_slab_cleanup(&arena->classes[i]);
+    }
+
+    if (arena->large_in_use != 0) {
+        LOG_ERROR("ERROR: arena has %u large allocations on delete",
+                  arena->large_in_use);
+    }
+}
+
+void *
+ft_arena_alloc(ft_arena_t *arena, uint32_t bytes)
+{
+    ft_slab_hdr_t *hdr;
+    int i;
+
+    for (i = 0; i < FT_ARENA_NUM_CLASSES; i++) {
+        if (bytes <= (FT_ARENA_MIN_CLASS_BYTES << i)) {
+            return ft_slab_alloc(&arena->classes[i]);
+        }
+    }
+
+    hdr = aim_malloc(sizeof(*hdr) + bytes);
+    hdr->page = NULL;
+    arena->large_in_use++;
+    return hdr + 1;
+}
+
+void
+ft_arena_free(ft_arena_t *arena, void *ptr)
+{
+    ft_slab_hdr_t *hdr = ft_slab_ptr_to_hdr(ptr);
+
+    if (hdr->page == NULL) {
+        arena->large_in_use--;
+        aim_free(hdr);
+    } else {
+        ft_slab_free(ptr);
+    }
+}
@@ -0,0 +1,120 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Slab allocators for flowtable entries and effects
+ *
+ * A slab hands out fixed size objects carved from FT_SLAB_PAGE_BYTES
+ * pages. Each object is preceded by a pointer to its page, so freeing
+ * doesn't need the size. Pages are filled from the front and only keep
+ * a free list for objects that have been returned, so a new page is not
+ * touched beyond what is used. Pages that become empty are released,
+ * except for one kept per slab to absorb churn around a page boundary.
+ *
+ * An arena is a set of slabs with power of 2 size classes, for variable
+ * sized data such as the stored effects. Requests larger than the
+ * biggest class go to the heap.
+ */
+
+#ifndef _OFSTATEMANAGER_FT_SLAB_H_
+#define _OFSTATEMANAGER_FT_SLAB_H_
+
+#include <stdint.h>
+#include <AIM/aim_list.h>
+
+#define FT_SLAB_PAGE_BYTES (64 * 1024)
+
+/* Arena size classes are 64 << n bytes, n < FT_ARENA_NUM_CLASSES */
+#define FT_ARENA_MIN_CLASS_BYTES 64
+#define FT_ARENA_NUM_CLASSES 7
+
+typedef struct ft_slab_s {
+    const char *name;
+    uint32_t obj_size;             /* Including the page pointer */
+    uint32_t objs_per_page;
+    list_head_t partial;           /* Pages with free objects */
+    list_head_t full;              /* Pages with no free objects */
+    struct ft_slab_page_s *empty;  /* Spare empty page, or NULL */
+    uint32_t num_pages;            /* Including the spare page */
+    uint32_t in_use;               /* Allocated objects */
+} ft_slab_t;
+
+/**
+ * Initialize a slab
+ * @param slab The slab
+ * @param name For statistics and error messages
+ * @param size Object size in bytes
+ */
+void ft_slab_init(ft_slab_t *slab, const char *name, uint32_t size);
+
+/**
+ * Release all pages of a slab
+ *
+ * Logs an error if objects are still allocated.
+ */
+void ft_slab_cleanup(ft_slab_t *slab);
+
+/**
+ * Allocate an object; its contents are undefined
+ */
+void *ft_slab_alloc(ft_slab_t *slab);
+
+/**
+ * Return an object to the slab it was allocated from
+ */
+void ft_slab_free(void *ptr);
+
+/**
+ * Number of objects the slab's pages can hold
+ */
+static inline uint32_t
+ft_slab_capacity(ft_slab_t *slab)
+{
+    return slab->num_pages * slab->objs_per_page;
+}
+
+typedef struct ft_arena_s {
+    ft_slab_t classes[FT_ARENA_NUM_CLASSES];
+    uint32_t large_in_use;         /* Allocations from the heap */
+} ft_arena_t;
+
+/**
+ * Initialize an arena
+ */
+void ft_arena_init(ft_arena_t *arena);
+
+/**
+ * Release all pages of an arena
+ *
+ * Logs an error if allocations are still outstanding.
+ */
+void ft_arena_cleanup(ft_arena_t *arena);
+
+/**
+ * Allocate bytes from the smallest class that fits; contents are undefined
+ */
+void *ft_arena_alloc(ft_arena_t *arena, uint32_t bytes);
+
+/**
+ * Return an allocation to the arena
+ */
+void ft_arena_free(ft_arena_t *arena, void *ptr);
+
+#endif /* _OFSTATEMANAGER_FT_SLAB_H_ */
@@ -0,0 +1,151 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Tuple space index for flowtable queries
+ */
+
+#include <OFStateManager/ofstatemanager_config.h>
+#include <indigo/indigo.h>
+#include <murmur/murmur.h>
+#include <string.h>
+
+#include "ofstatemanager_log.h"
+#include "ft_tuple.h"
+
+#define FT_TUPLE_HASH_SEED 0
+
+/* of_match_fields_t is handled as an array of words */
+#define FIELD_WORDS (sizeof(of_match_fields_t) / sizeof(uint64_t))
+AIM_STATIC_ASSERT(ft_tuple_fields_words,
+                  sizeof(of_match_fields_t) % sizeof(uint64_t) == 0);
+
+uint32_t
+ft_tuple_key_hash(of_match_fields_t *fields, of_match_fields_t *masks)
+{
+    uint64_t key[FIELD_WORDS];
+    const uint64_t *f = (const uint64_t *)fields;
+    const uint64_t *m = (const uint64_t *)masks;
+    int i;
+
+    for (i = 0; i < FIELD_WORDS; i++) {
+        key[i] = f[i] & m[i];
+    }
+
+    return murmur_hash(key, sizeof(key), FT_TUPLE_HASH_SEED);
+}
+
+static uint32_t
+ft_tuple_entry_hash(ft_entry_t *entry)
+{
+    return ft_tuple_key_hash(&entry->match.fields, &entry->match.masks);
+}
+
+bool
+ft_tuple_masks_eq(ft_tuple_t *tuple, of_match_fields_t *masks)
+{
+    return memcmp(&tuple->masks, masks, sizeof(*masks)) == 0;
+}
+
+bool
+ft_tuple_covers(ft_tuple_t *tuple, of_meta_match_t *query)
+{
+    const uint64_t *tm = (const uint64_t *)&tuple->masks;
+    const uint64_t *qm = (const uint64_t *)&query->match.masks;
+    int i;
+
+    if (query->table_id != TABLE_ID_ANY && query->table_id != tuple->table_id) {
+        return false;
+    }
+
+    if (query->mode == OF_MATCH_STRICT) {
+        return ft_tuple_masks_eq(tuple, &query->match.masks);
+    }
+
+    for (i = 0; i < FIELD_WORDS; i++) {
+        if (qm[i] & ~tm[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static ft_tuple_t *
+ft_tuple_find(list_head_t *tuples, uint8_t table_id,
+              of_match_fields_t *masks, uint32_t mask_hash)
+{
+    list_links_t *cur;
+
+    LIST_FOREACH(tuples, cur) {
+        ft_tuple_t *tuple = container_of(cur, links, ft_tuple_t);
+        if (tuple->mask_hash == mask_hash && tuple->table_id == table_id &&
+                ft_tuple_masks_eq(tuple, masks)) {
+            return tuple;
+        }
+    }
+
+    return NULL;
+}
+
+void
+ft_tuple_link(list_head_t *tuples, ft_entry_t *entry, uint32_t buckets)
+{
+    of_match_fields_t *masks = &entry->match.masks;
+    uint32_t mask_hash = murmur_hash(masks, sizeof(*masks), FT_TUPLE_HASH_SEED);
+    ft_tuple_t *tuple;
+
+    tuple = ft_tuple_find(tuples, entry->table_id, masks, mask_hash);
+    if (tuple == NULL) {
+        tuple = aim_zmalloc(sizeof(*tuple));
+        tuple->table_id = entry->table_id;
+        tuple->mask_hash = mask_hash;
+        tuple->masks = *masks;
+        list_init(&tuple->entries);
+        ft_hash_init(&tuple->hash, buckets,
+                     offsetof(ft_entry_t, tuple_hash_links),
+                     ft_tuple_entry_hash);
+        list_push(tuples, &tuple->links);
+        LOG_TRACE("Created tuple %p for table %d", tuple, tuple->table_id);
+    }
+
+    list_push(&tuple->entries, &entry->tuple_links);
+    ft_hash_insert(&tuple->hash, entry);
+    entry->tuple = tuple;
+}
+
+void
+ft_tuple_unlink(ft_entry_t *entry)
+{
+    ft_tuple_t *tuple = entry->tuple;
+
+    list_remove(&entry->tuple_links);
+    ft_hash_remove(&tuple->hash, entry);
+    entry->tuple = NULL;
+
+    if (list_empty(&tuple->entries)) {
+        /* Iterators pin the hash only while positioned on one of its entries */
+        INDIGO_ASSERT(tuple->hash.pins == 0);
+        LOG_TRACE("Destroying tuple %p for table %d", tuple, tuple->table_id);
+        list_remove(&tuple->links);
+        ft_hash_cleanup(&tuple->hash, "tuple");
+        aim_free(tuple);
+    }
+}
@@ -0,0 +1,93 @@
+/****************************************************************
+ *
+ *        Copyright 2013, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+/**
+ * @file
+ * @brief Tuple space index for flowtable queries
+ *
+ * Entries are grouped into tuples by (table_id, match masks). A
+ * non-strict query can only match entries whose masks are a superset of
+ * the query's masks, so only the tuples that cover the query need to be
+ * visited. Within a tuple, entries are hashed by their masked match
+ * fields, so a query with exactly the tuple's masks is a single bucket
+ * lookup.
+ *
+ * There are usually few distinct mask shapes, so the tuples are kept in
+ * a plain list. A tuple is freed when its last entry is removed.
+ */
+
+#ifndef _OFSTATEMANAGER_FT_TUPLE_H_
+#define _OFSTATEMANAGER_FT_TUPLE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <AIM/aim_list.h>
+#include <loci/loci.h>
+
+#include "ft_entry.h"
+#include "ft_hash.h"
+
+/* Bounds on the initial hash size of a tuple */
+#define FT_TUPLE_INITIAL_BUCKETS 16
+#define FT_TUPLE_MAX_INITIAL_BUCKETS 256
+
+typedef struct ft_tuple_s {
+    list_links_t links;            /* Linked into the flowtable's tuples */
+    uint8_t table_id;
+    uint32_t mask_hash;            /* Hash of masks, to speed up searching */
+    of_match_fields_t masks;
+    list_head_t entries;           /* All entries, through tuple_links */
+    ft_hash_t hash;                /* By masked match fields, through
+                                      tuple_hash_links */
+} ft_tuple_t;
+
+/**
+ * Link an entry into the tuple for its table_id and masks
+ * @param tuples List of tuples; a new tuple is appended if needed
+ * @param entry The entry
+ * @param buckets Initial hash size of a new tuple
+ */
+void ft_tuple_link(list_head_t *tuples, ft_entry_t *entry, uint32_t buckets);
+
+/**
+ * Unlink an entry from its tuple, freeing the tuple if it becomes empty
+ */
+void ft_tuple_unlink(ft_entry_t *entry);
+
+/**
+ * Whether entries in the tuple may match the query
+ *
+ * True if the table ID agrees and the tuple's masks are a superset of
+ * the query's masks (equal for strict queries).
+ */
+bool ft_tuple_covers(ft_tuple_t *tuple, of_meta_match_t *query);
+
+/**
+ * Whether the tuple's masks are exactly the given masks
+ */
+bool ft_tuple_masks_eq(ft_tuple_t *tuple, of_match_fields_t *masks);
+
+/**
+ * Hash of the match fields restricted to the masks
+ *
+ * This is the key of the per-tuple hash.
+ */
+uint32_t ft_tuple_key_hash(of_match_fields_t *fields, of_match_fields_t *masks);
+
+#endif /* _OFSTATEMANAGER_FT_TUPLE_H_ */
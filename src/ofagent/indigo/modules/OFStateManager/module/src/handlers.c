@@ -39,11 +39,25 @@
 #include "handlers.h"
 #include "ft.h"
 #include "table.h"
+#include "bundle.h"
 
 static void
 flow_mod_err_msg_send(indigo_error_t indigo_err, of_version_t ver,
                       indigo_cxn_id_t cxn_id, of_flow_modify_t *flow_mod);
 
+/*
+ * A flow add that forwarding has queued. The tracked copy of the request
+ * holds back barriers on the connection until the result is reported.
+ */
+typedef struct pending_flow_add_s {
+    list_links_t links;
+    indigo_flow_id_t flow_id;
+    indigo_cxn_id_t cxn_id;
+    of_flow_add_t *request;
+} pending_flow_add_t;
+
+static LIST_DEFINE(pending_flow_adds); /* In creation order */
+
 /****************************************************************
  *
  * Message handling
@@ -282,6 +296,10 @@ flow_mod_setup_query(of_flow_modify_t *obj, /* Works with add, mod, del */
     } else {
         /* Could check object_id is delete or delete_strict */
         of_flow_add_out_port_get(obj, &(query->out_port));
+        if (obj->version >= OF_VERSION_1_1) {
+            of_flow_add_out_group_get(obj, &query->out_group);
+            query->check_out_group = query->out_group != OF_GROUP_ANY;
+        }
     }
     if (query_mode != OF_MATCH_OVERLAP && obj->version >= OF_VERSION_1_1) {
         of_flow_add_cookie_get(obj, &query->cookie);
@@ -301,18 +319,11 @@ static int
 overlap_found(of_flow_modify_t *obj)
 {
     ft_entry_t *entry;
-    list_links_t *cur, *next;
     of_meta_match_t query;
 
     _TRY(flow_mod_setup_query(obj, &query, OF_MATCH_OVERLAP, 1));
 
-    FT_ITER(ind_core_ft, entry, cur, next) {
-        if (ft_entry_meta_match(&query, entry)) {
-            return 1;
-        }
-    }
-
-    return 0;
+    return ft_overlap_match(ind_core_ft, &query, &entry) == INDIGO_ERROR_NONE;
 }
 
 static indigo_flow_id_t
@@ -328,17 +339,79 @@ flow_id_next(void)
 }
 
 /**
- * Handle a flow_add message
+ * Replace an existing flow in place for a flow_add that overwrites it
+ * @param entry The flow strictly matching the flow_add
+ * @param obj The flow_add
+ * @returns Whether the flow was replaced
+ *
+ * The flow keeps its ID, and forwarding is asked to modify it rather than
+ * delete and re-add it. Nothing is sent to forwarding if the effects and
+ * timeouts are unchanged. The caller falls back to delete and add when
+ * the counters must be reset or forwarding fails the modify.
+ */
+static bool
+flow_add_replace(ft_entry_t *entry, of_flow_add_t *obj)
+{
+    indigo_error_t rv;
+    uint16_t flags, idle_timeout, hard_timeout;
+    uint8_t table_id = 0;
+
+    of_flow_add_flags_get(obj, &flags);
+    of_flow_add_idle_timeout_get(obj, &idle_timeout);
+    of_flow_add_hard_timeout_get(obj, &hard_timeout);
+    if (obj->version >= OF_VERSION_1_1) {
+        of_flow_add_table_id_get(obj, &table_id);
+    }
+
+    if (entry->table_id != table_id) {
+        return false;
+    }
+
+    if (obj->version >= OF_VERSION_1_3 &&
+            (flags & OF_FLOW_MOD_FLAG_RESET_COUNTS_BY_VERSION(obj->version))) {
+        return false;
+    }
+
+    if (ft_entry_effects_equal(entry, obj) &&
+            entry->idle_timeout == idle_timeout &&
+            entry->hard_timeout == hard_timeout) {
+        LOG_TRACE("Flow add repeats flow " INDIGO_FLOW_ID_PRINTF_FORMAT,
+                  INDIGO_FLOW_ID_PRINTF_ARG(entry->id));
+    } else {
+        ind_core_table_t *table = ind_core_table_get(entry->table_id);
+        if (table != NULL) {
+            rv = table->ops->entry_modify(table->priv, entry->priv, obj);
+        } else {
+            rv = indigo_fwd_flow_modify(entry->id, obj);
+        }
+
+        if (rv != INDIGO_ERROR_NONE) {
+            LOG_TRACE("Forwarding could not replace flow in place: %s",
+                      indigo_strerror(rv));
+            return false;
+        }
+    }
+
+    ind_core_bundle_flow_changing(entry);
+    ft_entry_replace(ind_core_ft, entry, obj);
+
+    return true;
+}
+
+/**
+ * Add a flow for a flow_add, or a modify matching no flows
+ * @param obj The flow_add
  * @param cxn_id Connection handler for the owning connection
- * @param _obj Generic type object for the message to be coerced
- * @returns Error code
+ * @returns Error code, already reported to the connection
+ *
+ * INDIGO_ERROR_NONE is returned if forwarding queued the flow; its result
+ * is reported by indigo_core_flow_create_complete.
  */
 
-void
-ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+static indigo_error_t
+flow_add(of_flow_modify_t *obj, indigo_cxn_id_t cxn_id)
 {
     indigo_error_t rv = INDIGO_ERROR_NONE;
-    of_flow_modify_t *obj = _obj; /* Coerce to flow_modify object */
     of_meta_match_t query;
     uint16_t flags;
     of_version_t ver;
@@ -362,7 +435,7 @@ ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
                     cxn_id, obj,
                     OF_ERROR_TYPE_FLOW_MOD_FAILED_BY_VERSION(ver),
                     OF_FLOW_MOD_FAILED_OVERLAP_BY_VERSION(ver));
-            return;
+            return INDIGO_ERROR_EXISTS;
         }
     }
 
@@ -373,21 +446,40 @@ ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
                 cxn_id, obj,
                 OF_ERROR_TYPE_FLOW_MOD_FAILED_BY_VERSION(ver),
                 OF_FLOW_MOD_FAILED_BAD_EMERG_TIMEOUT_BY_VERSION(ver));
-        return;
+        return INDIGO_ERROR_PARAM;
     }
 
     /* Search table; if match found, replace entry */
     rv = flow_mod_setup_query(obj, &query, OF_MATCH_STRICT, 1);
     if (rv != INDIGO_ERROR_NONE) {
         /* TODO send error */
-        return;
+        return rv;
     }
 
-    /* Delete existing flow if any */
+    /* Replace existing flow if any */
     if (ft_strict_match(ind_core_ft, &query, &entry) == INDIGO_ERROR_NONE) {
+        if (flow_add_replace(entry, obj)) {
+            LOG_TRACE("Replaced flow in place");
+            return INDIGO_ERROR_NONE;
+        }
         ind_core_flow_entry_delete(entry, INDIGO_FLOW_REMOVED_OVERWRITE);
     }
 
+    table_id = 0;
+    if (obj->version >= OF_VERSION_1_1) {
+        of_flow_add_table_id_get(obj, &table_id);
+    }
+
+    /* A full table fails the add before forwarding translates the flow */
+    if (ft_table_headroom(ind_core_ft, table_id) == 0) {
+        LOG_TRACE("Table %d is full", table_id);
+        ind_core_ft->status.table_full_errors += 1;
+        FT_TABLE(ind_core_ft, table_id)->status.table_full_errors += 1;
+        flow_mod_err_msg_send(INDIGO_ERROR_TABLE_FULL, obj->version, cxn_id,
+                              obj);
+        return INDIGO_ERROR_TABLE_FULL;
+    }
+
     /* No match found, add as normal */
     LOG_TRACE("Adding new flow");
 
@@ -398,13 +490,10 @@ ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
         LOG_ERROR("Failed to insert flow in OFStateManager flowtable: %s",
                   indigo_strerror(rv));
         /* TODO send error */
-        return;
+        return rv;
     }
 
-    table_id = 0;
-    if (obj->version >= OF_VERSION_1_1) {
-        of_flow_add_table_id_get(obj, &table_id);
-    }
+    ind_core_bundle_flow_added(entry);
 
     ind_core_table_t *table = ind_core_table_get(table_id);
     if (table != NULL) {
@@ -416,13 +505,21 @@ ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     if (rv == INDIGO_ERROR_NONE) {
         LOG_TRACE("Flow table now has %d entries",
                   FT_STATUS(ind_core_ft)->current_count);
-        entry->table_id = table_id;
+        ft_entry_set_table_id(ind_core_ft, entry, table_id);
+    } else if (rv == INDIGO_ERROR_PENDING && table == NULL) {
+        pending_flow_add_t *pending = aim_zmalloc(sizeof(*pending));
+        pending->flow_id = flow_id;
+        pending->cxn_id = cxn_id;
+        pending->request = ind_core_dup_tracking(obj, cxn_id);
+        list_push(&pending_flow_adds, &pending->links);
+        rv = INDIGO_ERROR_NONE;
     } else { /* Error during insertion at forwarding layer */
        uint32_t xid;
 
        LOG_ERROR("Error from Forwarding while inserting flow: %s",
                  indigo_strerror(rv));
        ind_core_ft->status.forwarding_add_errors += 1;
+       FT_TABLE(ind_core_ft, entry->table_id)->status.forwarding_add_errors += 1;
 
        of_flow_add_xid_get(obj, &xid);
        flow_mod_err_msg_send(rv, obj->version, cxn_id,
@@ -431,6 +528,81 @@ ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
        /* Free entry in local flow table */
        ft_delete(ind_core_ft, entry);
     }
+
+    return rv;
+}
+
+/**
+ * Handle a flow_add message
+ * @param cxn_id Connection handler for the owning connection
+ * @param _obj Generic type object for the message to be coerced
+ * @returns Error code
+ */
+
+void
+ind_core_flow_add_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+{
+    (void)flow_add(_obj, cxn_id);
+}
+
+/**
+ * Report the result of a flow add that forwarding queued
+ *
+ * On failure the error goes to the connection that sent the flow_add and
+ * the flow is removed from the flowtable.
+ */
+void
+indigo_core_flow_create_complete(indigo_cookie_t flow_id,
+                                 indigo_error_t result, uint8_t table_id)
+{
+    pending_flow_add_t *pending = NULL;
+    list_links_t *cur;
+    ft_entry_t *entry;
+
+    /* Results normally arrive in creation order */
+    LIST_FOREACH(&pending_flow_adds, cur) {
+        pending_flow_add_t *p = container_of(cur, links, pending_flow_add_t);
+        if (p->flow_id == flow_id) {
+            pending = p;
+            break;
+        }
+    }
+
+    if (pending == NULL) {
+        LOG_ERROR("No pending flow add for flow id 0x%" PRIx64, flow_id);
+        return;
+    }
+
+    list_remove(&pending->links);
+
+    /* The flow may have been deleted or overwritten since */
+    entry = ft_lookup(ind_core_ft, flow_id);
+
+    if (result == INDIGO_ERROR_NONE) {
+        if (entry != NULL) {
+            ft_entry_set_table_id(ind_core_ft, entry, table_id);
+        }
+    } else {
+        LOG_ERROR("Error from Forwarding while inserting flow: %s",
+                  indigo_strerror(result));
+        ind_core_bundle_flow_add_failed(result);
+        ind_core_ft->status.forwarding_add_errors += 1;
+        if (entry != NULL) {
+            FT_TABLE(ind_core_ft, entry->table_id)->status.forwarding_add_errors += 1;
+        }
+
+        flow_mod_err_msg_send(result, pending->request->version,
+                              pending->cxn_id,
+                              (of_flow_modify_t *)pending->request);
+
+        if (entry != NULL) {
+            ft_delete(ind_core_ft, entry);
+        }
+    }
+
+    /* Releases the barrier count */
+    of_object_delete(pending->request);
+    aim_free(pending);
 }
 
 /**
@@ -543,6 +715,35 @@ struct flow_modify_state {
     int num_matched;
 };
 
+/**
+ * Modify one flow for a flow_modify or flow_modify_strict
+ * @returns Error code, already reported to the connection
+ */
+static indigo_error_t
+flow_modify_entry(ft_entry_t *entry, of_flow_modify_t *obj,
+                  indigo_cxn_id_t cxn_id)
+{
+    indigo_error_t rv;
+
+    ind_core_table_t *table = ind_core_table_get(entry->table_id);
+    if (table != NULL) {
+        rv = table->ops->entry_modify(table->priv, entry->priv, obj);
+    } else {
+        rv = indigo_fwd_flow_modify(entry->id, obj);
+    }
+
+    if (rv == INDIGO_ERROR_NONE) {
+        ind_core_bundle_flow_changing(entry);
+        ft_entry_modify_effects(ind_core_ft, entry, obj);
+    } else {
+        LOG_ERROR("Error from Forwarding while modifying flow: %d",
+                  indigo_strerror(rv));
+        flow_mod_err_msg_send(rv, obj->version, cxn_id, obj);
+    }
+
+    return rv;
+}
+
 /* Flowtable iterator for ind_core_flow_modify_handler */
 static void
 modify_iter_cb(void *cookie, ft_entry_t *entry)
@@ -550,22 +751,8 @@ modify_iter_cb(void *cookie, ft_entry_t *entry)
     struct flow_modify_state *state = cookie;
 
     if (entry != NULL) {
-        indigo_error_t rv;
         state->num_matched++;
-        ind_core_table_t *table = ind_core_table_get(entry->table_id);
-        if (table != NULL) {
-            rv = table->ops->entry_modify(table->priv, entry->priv, state->request);
-        } else {
-            rv = indigo_fwd_flow_modify(entry->id, state->request);
-        }
-        if (rv == INDIGO_ERROR_NONE) {
-            ft_entry_modify_effects(ind_core_ft, entry, state->request);
-        } else {
-            LOG_ERROR("Error from Forwarding while modifying flow: %d",
-                      indigo_strerror(rv));
-            flow_mod_err_msg_send(rv, state->request->version,
-                                  state->cxn_id, state->request);
-        }
+        (void)flow_modify_entry(entry, state->request, state->cxn_id);
     } else {
         if (state->num_matched == 0) {
             LOG_TRACE("No entries to modify, treat as add");
@@ -615,19 +802,48 @@ ind_core_flow_modify_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 }
 
 /**
- * Handle a flow_modify_strict message
- * @param cxn_id Connection handler for the owning connection
- * @param _obj Generic type object for the message to be coerced
- * @returns Error code
- *
- * Checks that only one entry in local table matches.  See modify_handler
- * above for more info.
+ * Modify the flows matching a flow_modify before returning
+ * @returns The first error, already reported to the connection
  */
+static indigo_error_t
+flow_modify_now(of_flow_modify_t *obj, indigo_cxn_id_t cxn_id)
+{
+    indigo_error_t rv, first_rv = INDIGO_ERROR_NONE;
+    of_meta_match_t query;
+    ft_iterator_t iter;
+    ft_entry_t *entry;
+    int num_matched = 0;
 
-void
-ind_core_flow_modify_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+    rv = flow_mod_setup_query(obj, &query, OF_MATCH_NON_STRICT, 1);
+    if (rv != INDIGO_ERROR_NONE) {
+        return rv;
+    }
+
+    ft_iterator_init(&iter, ind_core_ft, &query);
+    while ((entry = ft_iterator_next(&iter)) != NULL) {
+        num_matched++;
+        rv = flow_modify_entry(entry, obj, cxn_id);
+        if (rv != INDIGO_ERROR_NONE && first_rv == INDIGO_ERROR_NONE) {
+            first_rv = rv;
+        }
+    }
+    ft_iterator_cleanup(&iter);
+
+    if (num_matched == 0) {
+        LOG_TRACE("No entries to modify, treat as add");
+        return flow_add(obj, cxn_id);
+    }
+
+    return first_rv;
+}
+
+/**
+ * Modify the flow strictly matching a flow_modify_strict
+ * @returns Error code, already reported to the connection
+ */
+static indigo_error_t
+flow_modify_strict(of_flow_modify_strict_t *obj, indigo_cxn_id_t cxn_id)
 {
-    of_flow_modify_strict_t *obj = _obj;
     indigo_error_t rv;
     of_meta_match_t query;
     ft_entry_t *entry;
@@ -636,31 +852,33 @@ ind_core_flow_modify_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     rv = flow_mod_setup_query(obj, &query, OF_MATCH_STRICT, 1);
     if (rv != INDIGO_ERROR_NONE) {
         /* TODO send error */
-        return;
+        return rv;
     }
 
     rv = ft_strict_match(ind_core_ft, &query, &entry);
     if (rv == INDIGO_ERROR_NOT_FOUND) {
         LOG_TRACE("No entries to modify strict, treat as add.");
         /* OpenFlow 1.0.0, section 4.6, page 14.  Treat as an add */
-        ind_core_flow_add_handler(_obj, cxn_id);
-        return;
+        return flow_add(obj, cxn_id);
     }
 
-    ind_core_table_t *table = ind_core_table_get(entry->table_id);
-    if (table != NULL) {
-        rv = table->ops->entry_modify(table->priv, entry->priv, obj);
-    } else {
-        rv = indigo_fwd_flow_modify(entry->id, obj);
-    }
+    return flow_modify_entry(entry, obj, cxn_id);
+}
 
-    if (rv == INDIGO_ERROR_NONE) {
-        ft_entry_modify_effects(ind_core_ft, entry, obj);
-    } else {
-        LOG_ERROR("Error from Forwarding while modifying flow: %d",
-                  indigo_strerror(rv));
-        flow_mod_err_msg_send(rv, obj->version, cxn_id, obj);
-    }
+/**
+ * Handle a flow_modify_strict message
+ * @param cxn_id Connection handler for the owning connection
+ * @param _obj Generic type object for the message to be coerced
+ * @returns Error code
+ *
+ * Checks that only one entry in local table matches.  See modify_handler
+ * above for more info.
+ */
+
+void
+ind_core_flow_modify_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+{
+    (void)flow_modify_strict(_obj, cxn_id);
 }
 
 /****************************************************************/
@@ -716,16 +934,38 @@ ind_core_flow_delete_handler(of_object_t *obj, indigo_cxn_id_t cxn_id)
 }
 
 /**
- * Handle a flow_delete_strict message
- * @param cxn_id Connection handler for the owning connection
- * @param _obj Generic type object for the message to be coerced
+ * Delete the flows matching a flow_delete before returning
  * @returns Error code
  */
+static indigo_error_t
+flow_delete_now(of_flow_delete_t *obj)
+{
+    indigo_error_t rv;
+    of_meta_match_t query;
+    ft_iterator_t iter;
+    ft_entry_t *entry;
 
-void
-ind_core_flow_delete_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+    rv = flow_mod_setup_query(obj, &query, OF_MATCH_NON_STRICT, 0);
+    if (rv != INDIGO_ERROR_NONE) {
+        return rv;
+    }
+
+    ft_iterator_init(&iter, ind_core_ft, &query);
+    while ((entry = ft_iterator_next(&iter)) != NULL) {
+        ind_core_flow_entry_delete(entry, INDIGO_FLOW_REMOVED_DELETE);
+    }
+    ft_iterator_cleanup(&iter);
+
+    return INDIGO_ERROR_NONE;
+}
+
+/**
+ * Delete the flow strictly matching a flow_delete_strict
+ * @returns Error code
+ */
+static indigo_error_t
+flow_delete_strict(of_flow_delete_strict_t *obj)
 {
-    of_flow_delete_strict_t *obj = _obj;
     int rv;
     of_meta_match_t query;
     ft_entry_t *entry;
@@ -733,12 +973,117 @@ ind_core_flow_delete_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
     rv = flow_mod_setup_query((of_flow_modify_t *)obj, &query, OF_MATCH_STRICT, 0);
     if (rv != INDIGO_ERROR_NONE) {
         /* TODO send error */
-        return;
+        return rv;
     }
 
     if (ft_strict_match(ind_core_ft, &query, &entry) == INDIGO_ERROR_NONE) {
         ind_core_flow_entry_delete(entry, INDIGO_FLOW_REMOVED_DELETE);
     }
+
+    return INDIGO_ERROR_NONE;
+}
+
+/**
+ * Handle a flow_delete_strict message
+ * @param cxn_id Connection handler for the owning connection
+ * @param _obj Generic type object for the message to be coerced
+ * @returns Error code
+ */
+
+void
+ind_core_flow_delete_strict_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+{
+    (void)flow_delete_strict(_obj);
+}
+
+/**
+ * Check a flow_mod before it is applied
+ * @param obj The flow_add, flow_modify(_strict) or flow_delete(_strict)
+ * @param cxn_id Connection handler for the owning connection
+ * @returns Error code, already reported to the connection
+ *
+ * Catches the errors that do not depend on the flowtable, including
+ * flows forwarding cannot translate, so they can be reported as soon as
+ * a bundle stages the flow_mod.
+ */
+
+indigo_error_t
+ind_core_flow_mod_validate(of_object_t *_obj, indigo_cxn_id_t cxn_id)
+{
+    of_flow_modify_t *obj = _obj;
+    of_meta_match_t query;
+    indigo_error_t rv;
+    uint16_t flags, idle_timeout, hard_timeout;
+    of_version_t ver = obj->version;
+
+    rv = flow_mod_setup_query(obj, &query, OF_MATCH_NON_STRICT, 1);
+    if (rv != INDIGO_ERROR_NONE) {
+        flow_mod_err_msg_send(INDIGO_ERROR_BAD_MATCH, ver, cxn_id, obj);
+        return rv;
+    }
+
+    /* Modifies and deletes only touch flows that already exist */
+    if (obj->object_id != OF_FLOW_ADD) {
+        return INDIGO_ERROR_NONE;
+    }
+
+    of_flow_modify_flags_get(obj, &flags);
+    of_flow_modify_idle_timeout_get(obj, &idle_timeout);
+    of_flow_modify_hard_timeout_get(obj, &hard_timeout);
+
+    if ((flags & OF_FLOW_MOD_FLAG_EMERG_BY_VERSION(ver)) &&
+        (idle_timeout != 0 || hard_timeout != 0)) {
+        LOG_TRACE("Attempted to set timeout on an emergency flow");
+        indigo_cxn_send_error_reply(
+                cxn_id, obj,
+                OF_ERROR_TYPE_FLOW_MOD_FAILED_BY_VERSION(ver),
+                OF_FLOW_MOD_FAILED_BAD_EMERG_TIMEOUT_BY_VERSION(ver));
+        return INDIGO_ERROR_PARAM;
+    }
+
+    /* Flows in tables registered with the state manager are not translated */
+    if (query.table_id != TABLE_ID_ANY &&
+            ind_core_table_get(query.table_id) != NULL) {
+        return INDIGO_ERROR_NONE;
+    }
+
+    rv = indigo_fwd_flow_validate(obj);
+    if (rv != INDIGO_ERROR_NONE) {
+        LOG_TRACE("Forwarding cannot create flow: %s", indigo_strerror(rv));
+        flow_mod_err_msg_send(rv, ver, cxn_id, obj);
+    }
+
+    return rv;
+}
+
+/**
+ * Apply a flow_mod before returning
+ * @param obj The flow_add, flow_modify(_strict) or flow_delete(_strict)
+ * @param cxn_id Connection handler for the owning connection
+ * @returns The first error, already reported to the connection
+ *
+ * Unlike the handlers, non-strict modifies and deletes visit every
+ * matching flow before this returns. Flow adds forwarding queues still
+ * complete later, through indigo_core_flow_create_complete.
+ */
+
+indigo_error_t
+ind_core_flow_mod_apply(of_object_t *obj, indigo_cxn_id_t cxn_id)
+{
+    switch (obj->object_id) {
+    case OF_FLOW_ADD:
+        return flow_add(obj, cxn_id);
+    case OF_FLOW_MODIFY:
+        return flow_modify_now(obj, cxn_id);
+    case OF_FLOW_MODIFY_STRICT:
+        return flow_modify_strict(obj, cxn_id);
+    case OF_FLOW_DELETE:
+        return flow_delete_now(obj);
+    case OF_FLOW_DELETE_STRICT:
+        return flow_delete_strict(obj);
+    default:
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
 }
 
 
@@ -777,77 +1122,76 @@ ind_core_get_config_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 
 /****************************************************************/
 
+/*
+ * Flow stats sweeps
+ *
+ * Controllers and monitoring apps poll flow stats periodically, and each
+ * counter read is a call to forwarding. Requests are served by sweeps of
+ * the flowtable that read the counters of each flow once and append them
+ * to the reply of every request matching the flow.
+ *
+ * Two queries overlap if they name the same table, or one of them every
+ * table, and some cookie passes both cookie masks. Sweeps with overlapping
+ * queries would read the same counters, so they do not run at the same
+ * time. A request whose query overlaps a pending sweep joins it. One that
+ * overlaps only a running sweep starts a pending sweep, which runs once
+ * no overlapping sweep is running, so every request sees all of its flows.
+ * A request that overlaps no sweep starts its own sweep at once.
+ *
+ * The query of a sweep covers the queries of all its requests; each
+ * request filters the flows with its own.
+ */
+
 struct ind_core_flow_stats_state {
+    list_links_t links;
     indigo_cxn_id_t cxn_id;
     of_flow_stats_request_t *req;
+    of_meta_match_t query;
     indigo_time_t current_time;
     of_flow_stats_reply_t *reply;
 };
 
-static void
-ind_core_flow_stats_iter(void *cookie, ft_entry_t *entry)
-{
-    struct ind_core_flow_stats_state *state = cookie;
-    uint32_t secs, nsecs;
-    indigo_error_t rv;
+struct ind_core_flow_stats_sweep {
+    list_links_t links;
+    list_head_t requests;
+    of_meta_match_t query;
+    bool running;
+};
 
-    /* Allocate a reply if we don't already have one. */
-    if (state->reply == NULL) {
-        uint32_t xid;
+/* Running sweeps, and pending sweeps in the order they were created */
+static LIST_DEFINE(flow_stats_sweeps);
+static ind_core_flow_stats_sweep_stats_t flow_stats_sweep_stats;
 
-        state->reply = of_flow_stats_reply_new(state->req->version);
-        if (state->reply == NULL) {
-            LOG_ERROR("Failed to allocate of_flow_stats_reply.");
-            if (entry == NULL) {
-                /* This is the last callback, so need to clean up
-                 * before returning. */
-                of_flow_stats_request_delete(state->req);
-                aim_free(state);
-            }
-            return;
-        }
+/* Allocate a reply if we don't already have one */
+static bool
+flow_stats_reply_alloc(struct ind_core_flow_stats_state *state)
+{
+    uint32_t xid;
 
-        of_flow_stats_request_xid_get(state->req, &xid);
-        of_flow_stats_reply_xid_set(state->reply, xid);
-        of_flow_stats_reply_flags_set(state->reply, 1);
+    if (state->reply != NULL) {
+        return true;
     }
 
-    if (entry == NULL) {
-        /* Send last reply */
-        of_flow_stats_reply_flags_set(state->reply, 0);
-        indigo_cxn_send_controller_message(state->cxn_id, state->reply);
-
-        /* Clean up state */
-        of_flow_stats_request_delete(state->req);
-        aim_free(state);
-        return;
+    state->reply = of_flow_stats_reply_new(state->req->version);
+    if (state->reply == NULL) {
+        LOG_ERROR("Failed to allocate of_flow_stats_reply.");
+        return false;
     }
 
-    indigo_fi_flow_stats_t flow_stats = {
-        .flow_id = entry->id,
-        .duration_ns = 0,
-        .packets = -1,
-        .bytes = -1,
-    };
+    of_flow_stats_request_xid_get(state->req, &xid);
+    of_flow_stats_reply_xid_set(state->reply, xid);
+    of_flow_stats_reply_flags_set(state->reply, 1);
 
-    ind_core_table_t *table = ind_core_table_get(entry->table_id);
-    if (table != NULL) {
-        rv = table->ops->entry_stats_get(table->priv, entry->priv, &flow_stats);
-    } else {
-        rv = indigo_fwd_flow_stats_get(entry->id, &flow_stats);
-    }
+    return true;
+}
 
-    if (rv != INDIGO_ERROR_NONE) {
-        LOG_ERROR("Failed to get stats for flow "INDIGO_FLOW_ID_PRINTF_FORMAT": %s",
-                  entry->id, indigo_strerror(rv));
-        return;
-    }
+static void
+flow_stats_entry_append(struct ind_core_flow_stats_state *state,
+                        ft_entry_t *entry, indigo_fi_flow_stats_t *flow_stats)
+{
+    uint32_t secs, nsecs;
 
-    /* Skip entry if stats request version is not equal to entry version */
-    if (state->req->version != entry->effects.actions->version) {
-        LOG_TRACE("Stats request version (%d) differs from entry version (%d). "
-                  "Entry is skipped.",
-                  state->req->version, entry->effects.actions->version);
+    if (!flow_stats_reply_alloc(state)) {
         return;
     }
 
@@ -898,8 +1242,8 @@ ind_core_flow_stats_iter(void *cookie, ft_entry_t *entry)
         of_flow_stats_entry_table_id_set(&stats_entry, entry->table_id);
         of_flow_stats_entry_duration_sec_set(&stats_entry, secs);
         of_flow_stats_entry_duration_nsec_set(&stats_entry, nsecs);
-        of_flow_stats_entry_packet_count_set(&stats_entry, flow_stats.packets);
-        of_flow_stats_entry_byte_count_set(&stats_entry, flow_stats.bytes);
+        of_flow_stats_entry_packet_count_set(&stats_entry, flow_stats->packets);
+        of_flow_stats_entry_byte_count_set(&stats_entry, flow_stats->bytes);
     }
 
     if (state->reply->length > (1 << 15)) { /* Last object would get too big */
@@ -908,6 +1252,202 @@ ind_core_flow_stats_iter(void *cookie, ft_entry_t *entry)
     }
 }
 
+/* Send the last reply and clean up */
+static void
+flow_stats_request_finish(struct ind_core_flow_stats_state *state)
+{
+    if (flow_stats_reply_alloc(state)) {
+        of_flow_stats_reply_flags_set(state->reply, 0);
+        indigo_cxn_send_controller_message(state->cxn_id, state->reply);
+    }
+
+    of_flow_stats_request_delete(state->req);
+    aim_free(state);
+}
+
+static void flow_stats_sweeps_start_pending(void);
+
+static void
+flow_stats_sweep_iter(void *cookie, ft_entry_t *entry)
+{
+    struct ind_core_flow_stats_sweep *sweep = cookie;
+    struct ind_core_flow_stats_state *state;
+    indigo_fi_flow_stats_t flow_stats;
+    ind_core_table_t *table;
+    list_links_t *cur, *next;
+    indigo_error_t rv;
+    bool fetched = false;
+    int requests = 0;
+
+    if (entry == NULL) {
+        LIST_FOREACH_SAFE(&sweep->requests, cur, next) {
+            state = container_of(cur, links, struct ind_core_flow_stats_state);
+            flow_stats_request_finish(state);
+        }
+        list_remove(&sweep->links);
+        aim_free(sweep);
+
+        flow_stats_sweeps_start_pending();
+        return;
+    }
+
+    table = ind_core_table_get(entry->table_id);
+
+    LIST_FOREACH(&sweep->requests, cur) {
+        state = container_of(cur, links, struct ind_core_flow_stats_state);
+
+        /* Skip entry if stats request version is not equal to entry version */
+        if (state->req->version != entry->effects.actions->version ||
+                !ft_entry_meta_match(&state->query, entry)) {
+            continue;
+        }
+
+        if (!fetched) {
+            flow_stats.flow_id = entry->id;
+            flow_stats.duration_ns = 0;
+            flow_stats.packets = -1;
+            flow_stats.bytes = -1;
+
+            if (table != NULL) {
+                rv = table->ops->entry_stats_get(table->priv, entry->priv,
+                                                 &flow_stats);
+            } else {
+                rv = indigo_fwd_flow_stats_get(entry->id, &flow_stats);
+                flow_stats_sweep_stats.rpcs++;
+            }
+
+            if (rv != INDIGO_ERROR_NONE) {
+                LOG_ERROR("Failed to get stats for flow "INDIGO_FLOW_ID_PRINTF_FORMAT": %s",
+                          entry->id, indigo_strerror(rv));
+                return;
+            }
+            if (table == NULL) {
+                ft_entry_counters_update(ind_core_ft, entry, flow_stats.packets,
+                                         flow_stats.bytes);
+            }
+            fetched = true;
+        }
+
+        flow_stats_entry_append(state, entry, &flow_stats);
+        requests++;
+    }
+
+    if (table == NULL && requests > 1) {
+        flow_stats_sweep_stats.rpcs_saved += requests - 1;
+    }
+}
+
+static void
+flow_stats_sweep_start(struct ind_core_flow_stats_sweep *sweep)
+{
+    struct ind_core_flow_stats_state *state;
+    list_links_t *cur, *next;
+    indigo_time_t now = INDIGO_CURRENT_TIME;
+    indigo_error_t rv;
+
+    LIST_FOREACH(&sweep->requests, cur) {
+        state = container_of(cur, links, struct ind_core_flow_stats_state);
+        state->current_time = now;
+    }
+
+    rv = ft_spawn_iter_task(ind_core_ft, &sweep->query, flow_stats_sweep_iter,
+                            sweep, IND_SOC_DEFAULT_PRIORITY);
+    if (rv != INDIGO_ERROR_NONE) {
+        LOG_ERROR("Failed to start flow stats iter: %s", indigo_strerror(rv));
+        LIST_FOREACH_SAFE(&sweep->requests, cur, next) {
+            state = container_of(cur, links, struct ind_core_flow_stats_state);
+            of_object_delete(state->req);
+            aim_free(state);
+        }
+        list_remove(&sweep->links);
+        aim_free(sweep);
+        return;
+    }
+
+    sweep->running = true;
+    flow_stats_sweep_stats.sweeps++;
+}
+
+/* Whether some flow could match both queries */
+static bool
+flow_stats_query_overlap(const of_meta_match_t *a, const of_meta_match_t *b)
+{
+    if (a->table_id != b->table_id &&
+            a->table_id != TABLE_ID_ANY && b->table_id != TABLE_ID_ANY) {
+        return false;
+    }
+
+    return ((a->cookie ^ b->cookie) & a->cookie_mask & b->cookie_mask) == 0;
+}
+
+/* Find a running or pending sweep whose query overlaps the given one */
+static struct ind_core_flow_stats_sweep *
+flow_stats_sweep_find(const of_meta_match_t *query, bool running)
+{
+    struct ind_core_flow_stats_sweep *sweep;
+    list_links_t *cur;
+
+    LIST_FOREACH(&flow_stats_sweeps, cur) {
+        sweep = container_of(cur, links, struct ind_core_flow_stats_sweep);
+        if (sweep->running == running &&
+                flow_stats_query_overlap(&sweep->query, query)) {
+            return sweep;
+        }
+    }
+
+    return NULL;
+}
+
+/* Start the pending sweeps that no running sweep overlaps */
+static void
+flow_stats_sweeps_start_pending(void)
+{
+    struct ind_core_flow_stats_sweep *sweep;
+    list_links_t *cur, *next;
+
+    LIST_FOREACH_SAFE(&flow_stats_sweeps, cur, next) {
+        sweep = container_of(cur, links, struct ind_core_flow_stats_sweep);
+        if (!sweep->running &&
+                flow_stats_sweep_find(&sweep->query, true) == NULL) {
+            flow_stats_sweep_start(sweep);
+        }
+    }
+}
+
+/* Add a request to a sweep, widening its query to cover the request's */
+static void
+flow_stats_sweep_join(struct ind_core_flow_stats_sweep *sweep,
+                      struct ind_core_flow_stats_state *state)
+{
+    of_version_t version;
+
+    if (list_empty(&sweep->requests)) {
+        sweep->query = state->query;
+    } else if (memcmp(&sweep->query, &state->query, sizeof(sweep->query))) {
+        if (sweep->query.table_id != state->query.table_id) {
+            sweep->query.table_id = TABLE_ID_ANY;
+        }
+        /* Keep only the cookie bits both queries fix to the same value */
+        sweep->query.cookie_mask &= state->query.cookie_mask &
+            ~(sweep->query.cookie ^ state->query.cookie);
+        sweep->query.cookie &= sweep->query.cookie_mask;
+        version = sweep->query.match.version;
+        INDIGO_MEM_CLEAR(&sweep->query.match, sizeof(sweep->query.match));
+        sweep->query.match.version = version;
+        sweep->query.out_port = OF_PORT_DEST_WILDCARD;
+        sweep->query.check_out_group = 0;
+    }
+
+    list_push(&sweep->requests, &state->links);
+    flow_stats_sweep_stats.requests++;
+}
+
+void
+ind_core_flow_stats_sweep_stats_get(ind_core_flow_stats_sweep_stats_t *stats)
+{
+    *stats = flow_stats_sweep_stats;
+}
+
 /**
  * Handle a flow_stats_request message
  * @param _obj Generic type object for the message to be coerced
@@ -919,43 +1459,52 @@ void
 ind_core_flow_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 {
     of_flow_stats_request_t *obj = _obj;
-    of_meta_match_t query;
     struct ind_core_flow_stats_state *state;
-    indigo_error_t rv;
+    struct ind_core_flow_stats_sweep *sweep;
+
+    state = aim_zmalloc(sizeof(*state));
 
     /* Set up the query structure */
-    INDIGO_MEM_SET(&query, 0, sizeof(query));
-    if (of_flow_stats_request_match_get(obj, &(query.match)) < 0) {
+    if (of_flow_stats_request_match_get(obj, &state->query.match) < 0) {
         LOG_ERROR("Failed to get flow stats match.");
+        aim_free(state);
         return;
     }
-    of_flow_stats_request_out_port_get(obj, &(query.out_port));
-    of_flow_stats_request_table_id_get(obj, &(query.table_id));
+    of_flow_stats_request_out_port_get(obj, &state->query.out_port);
+    of_flow_stats_request_table_id_get(obj, &state->query.table_id);
     if (obj->version >= OF_VERSION_1_1) {
-        of_flow_stats_request_cookie_get(obj, &query.cookie);
-        of_flow_stats_request_cookie_mask_get(obj, &query.cookie_mask);
+        of_flow_stats_request_cookie_get(obj, &state->query.cookie);
+        of_flow_stats_request_cookie_mask_get(obj, &state->query.cookie_mask);
+        of_flow_stats_request_out_group_get(obj, &state->query.out_group);
+        state->query.check_out_group = state->query.out_group != OF_GROUP_ANY;
     }
 
     /* Non strict; do not check priority or overlap */
-    query.mode = OF_MATCH_NON_STRICT;
+    state->query.mode = OF_MATCH_NON_STRICT;
 
-    state = aim_malloc(sizeof(*state));
     state->req = ind_core_dup_tracking(obj, cxn_id);
     state->cxn_id = cxn_id;
-    state->current_time = INDIGO_CURRENT_TIME;
-    state->reply = NULL;
 
-    rv = ft_spawn_iter_task(ind_core_ft, &query, ind_core_flow_stats_iter,
-                            state, IND_SOC_DEFAULT_PRIORITY);
-    if (rv != INDIGO_ERROR_NONE) {
-        LOG_ERROR("Failed to start flow stats iter: %s", indigo_strerror(rv));
-        of_object_delete(state->req);
-        aim_free(state);
+    if ((sweep = flow_stats_sweep_find(&state->query, false)) != NULL) {
+        flow_stats_sweep_join(sweep, state);
+        return;
+    }
+
+    sweep = aim_zmalloc(sizeof(*sweep));
+    list_init(&sweep->requests);
+    list_push(&flow_stats_sweeps, &sweep->links);
+    flow_stats_sweep_join(sweep, state);
+
+    /* Wait for a running sweep that could read the same counters */
+    if (flow_stats_sweep_find(&state->query, true) == NULL) {
+        flow_stats_sweep_start(sweep);
     }
 }
 
 /****************************************************************/
 
+static ind_core_aggregate_stats_paths_t aggregate_stats_paths;
+
 struct ind_core_aggregate_stats_state {
     uint64_t packets;
     uint64_t bytes;
@@ -990,6 +1539,10 @@ ind_core_aggregate_stats_iter(void *cookie, ft_entry_t *entry)
                       entry->id, indigo_strerror(rv));
             return;
         }
+        if (table == NULL) {
+            ft_entry_counters_update(ind_core_ft, entry, flow_stats.packets,
+                                     flow_stats.bytes);
+        }
 
         state->bytes += flow_stats.bytes;
         state->packets += flow_stats.packets;
@@ -1013,6 +1566,52 @@ ind_core_aggregate_stats_iter(void *cookie, ft_entry_t *entry)
     }
 }
 
+/*
+ * Answer an aggregate stats query from the cookie index totals
+ *
+ * Only queries on the table and a cookie prefix alone can be answered
+ * this way, and only for tables whose counters forwarding reports and
+ * keeps current in the background. The counters are as old as its last
+ * pass over the table; otherwise the iterator task reads every flow.
+ */
+static bool
+aggregate_stats_from_totals(of_meta_match_t *query, ft_cookie_totals_t *totals)
+{
+    static const of_match_fields_t zero_masks;
+    ft_table_t *table;
+    int table_id, first, last;
+
+    if (memcmp(&query->match.masks, &zero_masks, sizeof(zero_masks)) != 0 ||
+            query->out_port != OF_PORT_DEST_WILDCARD ||
+            query->check_out_group) {
+        return false;
+    }
+
+    if (query->table_id == TABLE_ID_ANY) {
+        first = 0;
+        last = FT_MAX_TABLES - 1;
+    } else {
+        first = last = query->table_id;
+    }
+
+    INDIGO_MEM_SET(totals, 0, sizeof(*totals));
+    for (table_id = first; table_id <= last; table_id++) {
+        table = FT_TABLE(ind_core_ft, table_id);
+        if (list_empty(&table->entries)) {
+            continue;
+        }
+
+        if (ind_core_table_get(table_id) != NULL ||
+                indigo_fwd_table_counters_sync(table_id) != INDIGO_ERROR_NONE ||
+                !ft_cookie_totals(&table->cookies, query->cookie,
+                                  query->cookie_mask, totals)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 /**
  * Handle a aggregate_stats_request message
  * @param cxn_id Connection handler for the owning connection
@@ -1027,6 +1626,7 @@ ind_core_aggregate_stats_request_handler(of_object_t *_obj,
     of_aggregate_stats_request_t *obj = _obj;
     of_meta_match_t query;
     struct ind_core_aggregate_stats_state *state;
+    ft_cookie_totals_t totals;
     indigo_error_t rv;
 
     /* Set up the query structure */
@@ -1040,6 +1640,8 @@ ind_core_aggregate_stats_request_handler(of_object_t *_obj,
     if (obj->version >= OF_VERSION_1_1) {
         of_aggregate_stats_request_cookie_get(obj, &query.cookie);
         of_aggregate_stats_request_cookie_mask_get(obj, &query.cookie_mask);
+        of_aggregate_stats_request_out_group_get(obj, &query.out_group);
+        query.check_out_group = query.out_group != OF_GROUP_ANY;
     }
 
     /* Non strict; do not check priority or overlap */
@@ -1052,6 +1654,16 @@ ind_core_aggregate_stats_request_handler(of_object_t *_obj,
     state->bytes = 0;
     state->flows = 0;
 
+    if (aggregate_stats_from_totals(&query, &totals)) {
+        aggregate_stats_paths.totals++;
+        state->packets = totals.packets;
+        state->bytes = totals.bytes;
+        state->flows = totals.flows;
+        ind_core_aggregate_stats_iter(state, NULL);
+        return;
+    }
+
+    aggregate_stats_paths.iterated++;
     rv = ft_spawn_iter_task(ind_core_ft, &query, ind_core_aggregate_stats_iter,
                             state, IND_SOC_DEFAULT_PRIORITY);
     if (rv != INDIGO_ERROR_NONE) {
@@ -1062,6 +1674,40 @@ ind_core_aggregate_stats_request_handler(of_object_t *_obj,
     }
 }
 
+void
+ind_core_aggregate_stats_paths_get(ind_core_aggregate_stats_paths_t *paths)
+{
+    *paths = aggregate_stats_paths;
+}
+
+/**
+ * Free entries in a table, as tracked against its forwarding capacity
+ */
+indigo_error_t
+indigo_core_table_headroom_get(uint8_t table_id, uint32_t *headroom)
+{
+    if (FT_TABLE(ind_core_ft, table_id)->max_entries == 0) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+
+    *headroom = ft_table_headroom(ind_core_ft, table_id);
+    return INDIGO_ERROR_NONE;
+}
+
+/**
+ * Record counters reported by forwarding for the aggregate stats totals
+ */
+void
+indigo_core_flow_counters_update(indigo_cookie_t flow_id,
+                                 uint64_t packets, uint64_t bytes)
+{
+    ft_entry_t *entry = ft_lookup(ind_core_ft, flow_id);
+
+    if (entry != NULL) {
+        ft_entry_counters_update(ind_core_ft, entry, packets, bytes);
+    }
+}
+
 /****************************************************************/
 
 /**
@@ -1101,6 +1747,39 @@ ind_core_desc_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
 
 /****************************************************************/
 
+/**
+ * Fill in the counts the flowtable tracks for each table in the reply
+ *
+ * The active count is kept on add and delete. The matched count is the
+ * packets last reported for the table's flows, plus those of the flows
+ * removed from it.
+ */
+
+static void
+table_stats_fill(of_table_stats_reply_t *reply)
+{
+    of_list_table_stats_entry_t list;
+    of_table_stats_entry_t entry;
+    ft_cookie_totals_t totals;
+    ft_table_t *table;
+    uint8_t table_id;
+    int rv;
+
+    of_table_stats_reply_entries_bind(reply, &list);
+    OF_LIST_TABLE_STATS_ENTRY_ITER(&list, &entry, rv) {
+        of_table_stats_entry_table_id_get(&entry, &table_id);
+        table = FT_TABLE(ind_core_ft, table_id);
+
+        INDIGO_MEM_SET(&totals, 0, sizeof(totals));
+        (void)ft_cookie_totals(&table->cookies, 0, 0, &totals);
+
+        of_table_stats_entry_active_count_set(&entry,
+                                              table->status.current_count);
+        of_table_stats_entry_matched_count_set(&entry,
+            totals.packets + table->status.removed_packets);
+    }
+}
+
 /**
  * Handle a table_stats_request message
  * @param cxn_id Connection handler for the owning connection
@@ -1122,6 +1801,8 @@ ind_core_table_stats_request_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
         return;
     }
 
+    table_stats_fill(reply);
+
     indigo_cxn_send_controller_message(cxn_id, reply);
 }
 
@@ -1317,6 +1998,8 @@ ind_core_set_config_handler(of_object_t *_obj, indigo_cxn_id_t cxn_id)
  * Otherwise, if either module responds with an error other than
  * supported, behavior is TBD.
  *
+ * Bundle messages are handled by the state manager itself; see bundle.c.
+ *
  */
 
 void
@@ -1326,6 +2009,10 @@ ind_core_experimenter_handler(of_object_t *obj, indigo_cxn_id_t cxn_id)
     indigo_error_t port_rv;
     indigo_error_t rv = INDIGO_ERROR_NONE;
 
+    if (ind_core_bundle_handler(obj, cxn_id)) {
+        return;
+    }
+
     /* Handle object of type of_experimenter_t */
     if ((fwd_rv = indigo_fwd_experimenter(obj, cxn_id)) < 0) {
         LOG_TRACE("Error from fwd_experimenter: %s", indigo_strerror(fwd_rv));
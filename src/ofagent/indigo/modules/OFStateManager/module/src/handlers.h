@@ -66,6 +66,12 @@ extern void ind_core_flow_delete_handler(
 extern void ind_core_flow_delete_strict_handler(
     of_object_t *_obj,
     indigo_cxn_id_t cxn);
+extern indigo_error_t ind_core_flow_mod_validate(
+    of_object_t *_obj,
+    indigo_cxn_id_t cxn_id);
+extern indigo_error_t ind_core_flow_mod_apply(
+    of_object_t *obj,
+    indigo_cxn_id_t cxn_id);
 extern void ind_core_get_config_request_handler(
     of_object_t *_obj,
     indigo_cxn_id_t cxn);
@@ -210,4 +216,24 @@ void ind_core_bsn_gentable_bucket_stats_request_handler(
     of_object_t *_obj,
     indigo_cxn_id_t cxn_id);
 
+/* Flow stats requests served by shared flowtable sweeps */
+typedef struct ind_core_flow_stats_sweep_stats_s {
+    uint64_t sweeps;        /* Sweeps of the flowtable */
+    uint64_t requests;      /* Flow stats requests served */
+    uint64_t rpcs;          /* Flow counters read from forwarding */
+    uint64_t rpcs_saved;    /* Reads shared with another request */
+} ind_core_flow_stats_sweep_stats_t;
+
+void ind_core_flow_stats_sweep_stats_get(
+    ind_core_flow_stats_sweep_stats_t *stats);
+
+/* How aggregate stats requests were answered */
+typedef struct ind_core_aggregate_stats_paths_s {
+    uint64_t totals;        /* From the cookie index totals */
+    uint64_t iterated;      /* By reading every matching flow */
+} ind_core_aggregate_stats_paths_t;
+
+void ind_core_aggregate_stats_paths_get(
+    ind_core_aggregate_stats_paths_t *paths);
+
 #endif /* _OF_STATE_HANDLERS_H_ */
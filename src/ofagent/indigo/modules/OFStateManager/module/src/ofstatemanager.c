@@ -42,6 +42,7 @@
 #include "expiration.h"
 #include "listener.h"
 #include "table.h"
+#include "bundle.h"
 
 static void
 process_flow_removal(ft_entry_t *entry,
@@ -535,10 +536,39 @@ indigo_core_dpid_get(of_dpid_t *dpid)
 
 #define INIT_STR(var, val) INDIGO_MEM_COPY(&(var), (val), sizeof(val))
 
+/* Bound on the flowtable index sizes taken from forwarding capacities */
+#define IND_CORE_CAPACITY_BUCKETS_MAX (256 * 1024)
+
+/*
+ * Ask forwarding for the capacity of each table. Tables it does not
+ * report get a max_entries of 0. Returns the total capacity.
+ */
+static uint32_t
+table_capacities_get(uint32_t *max_entries, uint32_t *used_entries)
+{
+    uint32_t total = 0;
+    int table_id;
+
+    for (table_id = 0; table_id < FT_MAX_TABLES; table_id++) {
+        if (indigo_fwd_table_capacity_get(table_id, &max_entries[table_id],
+                                          &used_entries[table_id])
+                != INDIGO_ERROR_NONE) {
+            max_entries[table_id] = used_entries[table_id] = 0;
+        }
+        total += max_entries[table_id];
+    }
+
+    return total;
+}
+
 indigo_error_t
 ind_core_init(ind_core_config_t *config)
 {
     ft_config_t ft_config;
+    uint32_t max_entries[FT_MAX_TABLES];
+    uint32_t used_entries[FT_MAX_TABLES];
+    uint32_t capacity;
+    int table_id;
 
     INDIGO_MEM_COPY(&ind_core_config, config, sizeof(*config));
 
@@ -562,10 +592,17 @@ ind_core_init(ind_core_config_t *config)
     INIT_STR(ind_core_of_config.desc_stats.serial_num,
              IND_CORE_SERIAL_NUM_DEFAULT);
 
-    /* Create flow table */
+    /* Create flow table, sized for what forwarding can hold */
+    capacity = table_capacities_get(max_entries, used_entries);
     if (config->max_flowtable_entries == 0) {
-        /* Default value */
-        config->max_flowtable_entries = 16384;
+        if (capacity > 0) {
+            config->max_flowtable_entries =
+                capacity < IND_CORE_CAPACITY_BUCKETS_MAX ?
+                capacity : IND_CORE_CAPACITY_BUCKETS_MAX;
+        } else {
+            /* Default value */
+            config->max_flowtable_entries = 16384;
+        }
     }
     ft_config.strict_match_bucket_count = config->max_flowtable_entries;
     ft_config.flow_id_bucket_count = config->max_flowtable_entries;
@@ -575,6 +612,14 @@ ind_core_init(ind_core_config_t *config)
         return INDIGO_ERROR_RESOURCE;
     }
 
+    for (table_id = 0; table_id < FT_MAX_TABLES; table_id++) {
+        if (max_entries[table_id] > 0) {
+            ft_table_capacity_set(ind_core_ft, table_id,
+                                  max_entries[table_id],
+                                  used_entries[table_id]);
+        }
+    }
+
     ind_core_connection_count = 0;
 
     ind_core_group_init();
@@ -584,6 +629,8 @@ ind_core_init(ind_core_config_t *config)
 
     ind_core_test_gentable_init();
 
+    ind_core_bundle_init();
+
     ind_core_init_done = 1;
 
     return INDIGO_ERROR_NONE;
@@ -617,8 +664,12 @@ ind_core_flow_entry_delete(ft_entry_t *entry, indigo_fi_flow_removed_t reason)
     ind_core_table_t *table = ind_core_table_get(entry->table_id);
     if (table != NULL) {
         rv = table->ops->entry_delete(table->priv, entry->priv, &flow_stats);
-    } else {
+    } else if ((entry->flags & OF_FLOW_MOD_FLAG_SEND_FLOW_REM) &&
+               reason != INDIGO_FLOW_REMOVED_OVERWRITE) {
         rv = indigo_fwd_flow_delete(entry->id, &flow_stats);
+    } else {
+        /* No flow_removed message, so forwarding can skip the stats */
+        rv = indigo_fwd_flow_delete(entry->id, NULL);
     }
 
     if (rv != INDIGO_ERROR_NONE) {
@@ -646,6 +697,13 @@ process_flow_removal(ft_entry_t *entry,
         }
     }
 
+    /* Count the final packets in the table's matched count */
+    if (final_stats->packets != (uint64_t)-1) {
+        ft_entry_counters_update(ind_core_ft, entry, final_stats->packets,
+                                 final_stats->bytes);
+    }
+
+    ind_core_bundle_flow_changing(entry);
     ft_delete(ind_core_ft, entry);
 
     LOG_TRACE("Flow table now has %d entries",
@@ -742,6 +800,8 @@ ind_core_finish(void)
         ind_core_enable_set(0);
     }
 
+    ind_core_bundle_finish();
+
     ft_destroy(ind_core_ft);
 
     ind_core_test_gentable_finish();
@@ -968,6 +1028,22 @@ indigo_core_connection_count_notify(int new_count)
     }
 }
 
+/**
+ * Notify state manager that a barrier is waiting on a connection
+ *
+ * Flow adds still queued in forwarding are submitted so the barrier
+ * does not wait out the batching delay.
+ */
+void
+indigo_core_barrier_notify(indigo_cxn_id_t cxn_id)
+{
+    if (!ind_core_init_done) {
+        return;
+    }
+
+    indigo_fwd_flush();
+}
+
 
 void
 indigo_core_port_status_update(of_port_status_t *of_port_status)
@@ -1056,12 +1132,86 @@ ind_core_ft_show(aim_pvs_t* pvs)
     }
 }
 
+static void
+ind_core_ft_hash_stats(aim_pvs_t *pvs, const char *name, ft_hash_t *hash)
+{
+    uint32_t load = hash->count * 100 / hash->buckets_size;
+
+    aim_printf(pvs, "  %s hash:\n", name);
+    aim_printf(pvs, "    Buckets:      %u\n", hash->buckets_size);
+    aim_printf(pvs, "    Load factor:  %u.%02u\n", load / 100, load % 100);
+    if (ft_hash_rehashing(hash)) {
+        aim_printf(pvs, "    Rehash:       %u -> %u buckets, %u/%u moved\n",
+                   hash->old_buckets_size, hash->buckets_size,
+                   hash->rehash_idx, hash->old_buckets_size);
+    } else {
+        aim_printf(pvs, "    Rehash:       idle\n");
+    }
+}
+
+static void
+ind_core_ft_id_map_stats(aim_pvs_t *pvs, const char *name, ft_id_map_t *map)
+{
+    uint32_t load = map->table.used * 100 / map->table.size;
+
+    aim_printf(pvs, "  %s map:\n", name);
+    aim_printf(pvs, "    Slots:        %u\n", map->table.size);
+    aim_printf(pvs, "    Load factor:  %u.%02u\n", load / 100, load % 100);
+    aim_printf(pvs, "    Tombstones:   %u\n", map->table.deleted);
+    if (ft_id_map_rehashing(map)) {
+        aim_printf(pvs, "    Rehash:       %u/%u groups (from %u slots)\n",
+                   map->rehash_idx,
+                   map->old_table.size / FT_ID_MAP_GROUP_SIZE,
+                   map->old_table.size);
+    } else {
+        aim_printf(pvs, "    Rehash:       idle\n");
+    }
+}
+
+static void
+ind_core_ft_slab_stats(aim_pvs_t *pvs, const char *name, ft_slab_t *slab)
+{
+    uint32_t capacity = ft_slab_capacity(slab);
+
+    aim_printf(pvs, "    %-14s %u/%u objects (%u%%), %u pages of %u bytes\n",
+               name, slab->in_use, capacity,
+               capacity ? slab->in_use * 100 / capacity : 0,
+               slab->num_pages, FT_SLAB_PAGE_BYTES);
+}
+
+static void
+ind_core_ft_table_stats(aim_pvs_t *pvs, int table_id, ft_table_t *table)
+{
+    aim_printf(pvs, "    %3d: %d flows, %d adds, %d deletes, %d updates, "
+               "%d tuples, %u cookies\n",
+               table_id, table->status.current_count,
+               (int)table->status.adds, (int)table->status.deletes,
+               (int)table->status.updates, list_length(&table->tuples),
+               table->cookies.count);
+    if (table->max_entries > 0) {
+        aim_printf(pvs, "         capacity %u, %u reserved, headroom %u, "
+                   "%d rejected full\n",
+                   table->max_entries, table->reserved_entries,
+                   ft_table_headroom(ind_core_ft, table_id),
+                   (int)table->status.table_full_errors);
+    }
+}
+
 void
 ind_core_ft_stats(aim_pvs_t *pvs)
 {
+    ind_core_flow_stats_sweep_stats_t sweep_stats;
+    ind_core_aggregate_stats_paths_t aggregate_paths;
     ft_instance_t ft;
+    int i, tuples = 0;
+    uint32_t cookies = 0;
 
     ft = ind_core_ft;
+    for (i = 0; i < FT_MAX_TABLES; i++) {
+        tuples += list_length(&ft->tables[i].tuples);
+        cookies += ft->tables[i].cookies.count;
+    }
+
     aim_printf(pvs, "Flow table stats:\n");
     aim_printf(pvs, "  Current count:  %d\n", ft->status.current_count);
     aim_printf(pvs, "  Adds:           %d\n", (int)ft->status.adds);
@@ -1073,6 +1223,45 @@ ind_core_ft_stats(aim_pvs_t *pvs)
                (int)ft->status.table_full_errors);
     aim_printf(pvs, "  Fwd Add Errors: %d\n",
                (int)ft->status.forwarding_add_errors);
+    ind_core_ft_hash_stats(pvs, "Strict match", &ft->strict_match_hash);
+    ind_core_ft_id_map_stats(pvs, "Flow ID", &ft->flow_id_map);
+    aim_printf(pvs, "  Tuples:         %d\n", tuples);
+    aim_printf(pvs, "  Overlap parts:  %u\n", ft->overlap.count);
+    aim_printf(pvs, "  Cookies:        %u\n", cookies);
+    aim_printf(pvs, "  Effects:        %u (%u refs)\n",
+               ft->effects.count, ft->effects.refs);
+    aim_printf(pvs, "  Out ports/groups: %u\n", ft->effects.out_count);
+
+    ind_core_flow_stats_sweep_stats_get(&sweep_stats);
+    aim_printf(pvs, "  Stats sweeps:   %" PRIu64 " for %" PRIu64 " requests, "
+               "%" PRIu64 " reads, %" PRIu64 " saved\n",
+               sweep_stats.sweeps, sweep_stats.requests,
+               sweep_stats.rpcs, sweep_stats.rpcs_saved);
+
+    ind_core_aggregate_stats_paths_get(&aggregate_paths);
+    aim_printf(pvs, "  Aggregates:     %" PRIu64 " from totals, %" PRIu64 " iterated\n",
+               aggregate_paths.totals, aggregate_paths.iterated);
+
+    aim_printf(pvs, "  Slabs:\n");
+    ind_core_ft_slab_stats(pvs, "entry", &ft->entry_slab);
+    ind_core_ft_slab_stats(pvs, "cookie", &ft->cookie_slab);
+    for (i = 0; i < FT_ARENA_NUM_CLASSES; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "effects %u",
+                 FT_ARENA_MIN_CLASS_BYTES << i);
+        ind_core_ft_slab_stats(pvs, name, &ft->effects.arena.classes[i]);
+    }
+    aim_printf(pvs, "    %-14s %u\n", "effects large",
+               ft->effects.arena.large_in_use);
+
+    aim_printf(pvs, "  Tables:\n");
+    for (i = 0; i < FT_MAX_TABLES; i++) {
+        ft_table_t *table = FT_TABLE(ft, i);
+        if (table->status.current_count > 0 || table->status.adds > 0 ||
+                table->max_entries > 0) {
+            ind_core_ft_table_stats(pvs, i, table);
+        }
+    }
 }
 
 
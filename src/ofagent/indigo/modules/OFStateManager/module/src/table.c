@@ -39,10 +39,8 @@ void indigo_core_table_register(uint8_t table_id, const char *name,
 
     list_links_t *cur, *next;
     ft_entry_t *entry;
-    FT_ITER(ind_core_ft, entry, cur, next) {
-        if (entry->table_id == table_id) {
-            ind_core_flow_entry_delete(entry, OF_FLOW_REMOVED_REASON_DELETE);
-        }
+    FT_TABLE_ITER(ind_core_ft, table_id, entry, cur, next) {
+        ind_core_flow_entry_delete(entry, OF_FLOW_REMOVED_REASON_DELETE);
     }
 
     ind_core_table_t *table = aim_zmalloc(sizeof(*table));
@@ -63,10 +61,8 @@ void indigo_core_table_unregister(uint8_t table_id)
 
     list_links_t *cur, *next;
     ft_entry_t *entry;
-    FT_ITER(ind_core_ft, entry, cur, next) {
-        if (entry->table_id == table_id) {
-            ind_core_flow_entry_delete(entry, OF_FLOW_REMOVED_REASON_DELETE);
-        }
+    FT_TABLE_ITER(ind_core_ft, table_id, entry, cur, next) {
+        ind_core_flow_entry_delete(entry, OF_FLOW_REMOVED_REASON_DELETE);
     }
 
     aim_free(table->name);
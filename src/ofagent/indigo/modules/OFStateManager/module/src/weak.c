@@ -62,6 +62,57 @@ indigo_fwd_flow_create(
     return INDIGO_ERROR_BAD_TABLE_ID;
 }
 
+WEAK indigo_error_t
+indigo_fwd_flow_validate(
+    of_flow_add_t *flow_add)
+{
+    /* Errors are reported by flow_create instead */
+    return INDIGO_ERROR_NONE;
+}
+
+WEAK void
+indigo_fwd_flow_release(
+    of_flow_add_t *flow_add)
+{
+    /* Nothing is kept by validate */
+}
+
+WEAK indigo_error_t
+indigo_fwd_bundle_begin(void)
+{
+    /* Bundles make their changes as they are applied */
+    return INDIGO_ERROR_NOT_SUPPORTED;
+}
+
+WEAK indigo_error_t
+indigo_fwd_bundle_commit(void)
+{
+    return INDIGO_ERROR_NONE;
+}
+
+WEAK void
+indigo_fwd_bundle_abort(void)
+{
+}
+
+WEAK indigo_error_t
+indigo_fwd_table_counters_sync(
+    uint8_t table_id)
+{
+    /* Aggregate stats read every flow */
+    return INDIGO_ERROR_NOT_SUPPORTED;
+}
+
+WEAK indigo_error_t
+indigo_fwd_table_capacity_get(
+    uint8_t table_id,
+    uint32_t *max_entries,
+    uint32_t *used_entries)
+{
+    /* Tables are not checked for space before adds */
+    return INDIGO_ERROR_NOT_SUPPORTED;
+}
+
 WEAK indigo_error_t
 indigo_fwd_flow_modify(
     indigo_cookie_t flow_id,
@@ -94,4 +145,20 @@ indigo_fwd_flow_hit_status_get(
     return INDIGO_ERROR_BAD_TABLE_ID;
 }
 
+WEAK indigo_error_t
+indigo_fwd_flow_hit_status_get_bulk(
+    int num_flows,
+    const indigo_cookie_t *flow_ids,
+    bool *hit_status,
+    indigo_error_t *results)
+{
+    return INDIGO_ERROR_NOT_SUPPORTED;
+}
+
+WEAK void
+indigo_fwd_flush(void)
+{
+    /* Nothing is queued if flow_create never returns pending */
+}
+
 #endif
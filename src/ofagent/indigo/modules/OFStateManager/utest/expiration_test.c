@@ -0,0 +1,174 @@
+/****************************************************************
+ *
+ *        Copyright 2014, Big Switch Networks, Inc.
+ *
+ * Licensed under the Eclipse Public License, Version 1.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *        http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the
+ * License.
+ *
+ ****************************************************************/
+
+#define AIM_LOG_MODULE_NAME ofstatemanager_utest
+#include <AIM/aim_log.h>
+
+#include <OFStateManager/ofstatemanager.h>
+#include <OFStateManager/ofstatemanager_config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <loci/loci.h>
+#include <locitest/unittest.h>
+#include <locitest/test_common.h>
+
+#include <ft_entry.h>
+#include <expiration.h>
+
+#define NUM_FLOWS (1000*1000)
+
+/* Step between drains, in seconds */
+#define DRAIN_STEP 600
+
+/*
+ * Set up a fake entry that expires after the given number of seconds.
+ * Odd entries use an idle timeout, even entries a hard timeout.
+ */
+static void
+setup_entry(ft_entry_t *entry, int idx, indigo_time_t now, uint16_t timeout)
+{
+    entry->id = idx;
+    entry->insert_time = now;
+    entry->last_counter_change = now;
+    if (idx & 1) {
+        entry->idle_timeout = timeout;
+    } else {
+        entry->hard_timeout = timeout;
+    }
+}
+
+static int
+test_expiration_order(void)
+{
+    ft_entry_t entries[8];
+    ft_entry_t *entry;
+    indigo_time_t now = INDIGO_CURRENT_TIME;
+    int reason;
+    int i;
+
+    memset(entries, 0, sizeof(entries));
+
+    for (i = 0; i < AIM_ARRAYSIZE(entries); i++) {
+        setup_entry(&entries[i], i, now, (AIM_ARRAYSIZE(entries) - i) * 30);
+        ind_core_expiration_add(&entries[i]);
+    }
+
+    /* Cancel one, re-arm another further out */
+    ind_core_expiration_remove(&entries[3]);
+    ind_core_expiration_remove(&entries[7]);
+    entries[7].last_counter_change = now + 500*1000;
+    ind_core_expiration_add(&entries[7]);
+
+    /* Nothing expires early */
+    TEST_ASSERT(ind_core_expiration_next(now + 29*1000, &reason) == NULL);
+
+    for (i = AIM_ARRAYSIZE(entries) - 1; i >= 0; i--) {
+        if (i == 3 || i == 7) {
+            continue;
+        }
+        entry = ind_core_expiration_next(now + (AIM_ARRAYSIZE(entries) - i) * 30 * 1000, &reason);
+        TEST_ASSERT(entry == &entries[i]);
+        TEST_ASSERT(reason == (i & 1 ? OF_FLOW_REMOVED_REASON_IDLE_TIMEOUT :
+                                       OF_FLOW_REMOVED_REASON_HARD_TIMEOUT));
+
+        /* Not removed, so it is retried on the next tick only */
+        TEST_ASSERT(ind_core_expiration_next(now + (AIM_ARRAYSIZE(entries) - i) * 30 * 1000, &reason) == NULL);
+        ind_core_expiration_remove(entry);
+    }
+
+    entry = ind_core_expiration_next(now + 530*1000, &reason);
+    TEST_ASSERT(entry == &entries[7]);
+    ind_core_expiration_remove(entry);
+
+    TEST_ASSERT(ind_core_expiration_next(now + 100000*1000, &reason) == NULL);
+
+    return TEST_PASS;
+}
+
+/*
+ * Insert and expire a million flows with timeouts spread over the full
+ * 16-bit range, reporting the time taken by each phase.
+ */
+static int
+test_expiration_benchmark(void)
+{
+    ft_entry_t *entries;
+    ft_entry_t *entry;
+    indigo_time_t now = INDIGO_CURRENT_TIME;
+    indigo_time_t drain_time;
+    indigo_time_t start;
+    int reason;
+    int count = 0;
+    int i;
+
+    entries = aim_zmalloc(sizeof(*entries) * NUM_FLOWS);
+
+    start = INDIGO_CURRENT_TIME;
+    for (i = 0; i < NUM_FLOWS; i++) {
+        setup_entry(&entries[i], i, now, 1 + (i * 7919u) % 65535);
+        ind_core_expiration_add(&entries[i]);
+    }
+    printf("expiration: inserted %d flows in %"PRIu64" ms\n",
+           NUM_FLOWS, INDIGO_CURRENT_TIME - start);
+
+    start = INDIGO_CURRENT_TIME;
+    for (i = 1; i < NUM_FLOWS; i += 2) {
+        entries[i].last_counter_change = now + 1000;
+        ind_core_expiration_remove(&entries[i]);
+        ind_core_expiration_add(&entries[i]);
+    }
+    printf("expiration: re-armed %d flows in %"PRIu64" ms\n",
+           NUM_FLOWS / 2, INDIGO_CURRENT_TIME - start);
+
+    start = INDIGO_CURRENT_TIME;
+    for (drain_time = now; count < NUM_FLOWS; drain_time += DRAIN_STEP*1000) {
+        TEST_ASSERT(drain_time <= now + (65536 + DRAIN_STEP)*1000);
+        while ((entry = ind_core_expiration_next(drain_time, &reason)) != NULL) {
+            indigo_time_t expiration_time;
+            if (entry->hard_timeout) {
+                expiration_time = entry->insert_time + entry->hard_timeout*1000;
+            } else {
+                expiration_time = entry->last_counter_change + entry->idle_timeout*1000;
+            }
+            TEST_ASSERT(expiration_time <= drain_time);
+            TEST_ASSERT(expiration_time > drain_time - DRAIN_STEP*1000);
+            ind_core_expiration_remove(entry);
+            count++;
+        }
+    }
+    printf("expiration: expired %d flows in %"PRIu64" ms\n",
+           count, INDIGO_CURRENT_TIME - start);
+
+    aim_free(entries);
+
+    return TEST_PASS;
+}
+
+int
+test_expiration(void)
+{
+    RUN_TEST(expiration_order);
+    RUN_TEST(expiration_benchmark);
+
+    return TEST_PASS;
+}
@@ -39,6 +39,8 @@
 
 #include <unistd.h>
 #include <ft.h>
+#include <bundle.h>
+#include <handlers.h>
 
 #include <loci/loci.h>
 #include <locitest/unittest.h>
@@ -52,6 +54,9 @@ int test_gentable(void);
 /* Defined in table_test.c */
 int test_table(void);
 
+/* Defined in expiration_test.c */
+int test_expiration(void);
+
 /* Must be an even number */
 #define TEST_FLOW_COUNT 1000
 
@@ -89,12 +94,59 @@ static void message_deleted(of_object_t *obj);
 /****************************************************************
  * Stubs
  ****************************************************************/
+/* Count flow calls to forwarding */
+static int fwd_create_calls;
+static int fwd_modify_calls;
+static int fwd_delete_calls;
+static int fwd_delete_stats_calls;   /* Deletes asking for final stats */
+
+/*
+ * When fwd_bundle_staging is set, forwarding stages the flow changes of a
+ * bundle commit and makes them at its end, failing with fwd_bundle_error
+ */
+static bool fwd_bundle_staging;
+static bool fwd_bundle_active;
+static indigo_error_t fwd_bundle_error = INDIGO_ERROR_NONE;
+static int fwd_bundle_staged;       /* Changes staged by the last commit */
+static int fwd_bundle_aborts;
+
+indigo_error_t
+indigo_fwd_bundle_begin(void)
+{
+    if (!fwd_bundle_staging) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+    fwd_bundle_active = true;
+    fwd_bundle_staged = 0;
+    return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t
+indigo_fwd_bundle_commit(void)
+{
+    fwd_bundle_active = false;
+    return fwd_bundle_error;
+}
+
+void
+indigo_fwd_bundle_abort(void)
+{
+    fwd_bundle_active = false;
+    fwd_bundle_aborts++;
+}
+
+indigo_error_t modify_error = INDIGO_ERROR_NONE;
+
 indigo_error_t
 indigo_fwd_flow_modify(indigo_cookie_t flow_id,
                        of_flow_modify_t *flow_modify)
 {
     AIM_LOG_VERBOSE("flow modify called\n");
-    return INDIGO_ERROR_NONE;
+    fwd_modify_calls++;
+    if (fwd_bundle_active) {
+        fwd_bundle_staged++;
+    }
+    return modify_error;
 }
 
 indigo_error_t create_error = INDIGO_ERROR_NONE;
@@ -103,12 +155,70 @@ indigo_error_t create_error = INDIGO_ERROR_NONE;
    if (create_error == INDIGO_ERROR_NONE) \
        TEST_ASSERT((status)->current_count == (count))
 
+/*
+ * When flow_create_pending is set, flow adds are queued and completed from
+ * a timer or a flush, like a batching forwarding layer would
+ */
+#define PENDING_FLOWS_MAX (10 * TEST_FLOW_COUNT)
+static bool flow_create_pending;
+static int pending_fail_every;   /* Fail flow IDs divisible by this */
+static int pending_failures;
+static bool pending_in_order = true;
+static indigo_cookie_t pending_flows[PENDING_FLOWS_MAX];
+static int pending_flow_count;
+static indigo_cookie_t last_completed_flow;
+
+static void
+pending_flows_complete(void *cookie)
+{
+    indigo_error_t rv;
+    indigo_cookie_t flow_id;
+    int i;
+
+    for (i = 0; i < pending_flow_count; i++) {
+        flow_id = pending_flows[i];
+        if (flow_id <= last_completed_flow) {
+            pending_in_order = false;
+        }
+        last_completed_flow = flow_id;
+
+        rv = INDIGO_ERROR_NONE;
+        if (pending_fail_every && flow_id % pending_fail_every == 0) {
+            rv = INDIGO_ERROR_TABLE_FULL;
+            pending_failures++;
+        }
+        indigo_core_flow_create_complete(flow_id, rv, 0);
+    }
+
+    pending_flow_count = 0;
+    ind_soc_timer_event_unregister(pending_flows_complete, NULL);
+}
+
+void
+indigo_fwd_flush(void)
+{
+    if (pending_flow_count > 0) {
+        pending_flows_complete(NULL);
+    }
+}
+
 indigo_error_t
 indigo_fwd_flow_create(indigo_cookie_t flow_id,
                        of_flow_add_t *flow_add,
                        uint8_t *table_id)
 {
     AIM_LOG_VERBOSE("flow create called\n");
+    fwd_create_calls++;
+    if (fwd_bundle_active) {
+        fwd_bundle_staged++;
+    } else if (flow_create_pending) {
+        assert(pending_flow_count < PENDING_FLOWS_MAX);
+        if (pending_flow_count == 0) {
+            ind_soc_timer_event_register(pending_flows_complete, NULL, 1);
+        }
+        pending_flows[pending_flow_count++] = flow_id;
+        return INDIGO_ERROR_PENDING;
+    }
     *table_id = 0;
     return INDIGO_ERROR_NONE;
 }
@@ -118,8 +228,17 @@ indigo_error_t
 indigo_fwd_table_stats_get(of_table_stats_request_t *request,
                            of_table_stats_reply_t **reply)
 {
+    of_list_table_stats_entry_t list;
+    of_table_stats_entry_t entry;
+
     AIM_LOG_VERBOSE("table stats get called\n");
     *reply = of_table_stats_reply_new(request->version);
+
+    /* Forwarding only lists the table; the counts come from the core */
+    of_table_stats_reply_entries_bind(*reply, &list);
+    of_table_stats_entry_init(&entry, request->version, -1, 1);
+    (void)of_list_table_stats_entry_append_bind(&list, &entry);
+    of_table_stats_entry_table_id_set(&entry, 0);
     return INDIGO_ERROR_NONE;
 }
 
@@ -130,28 +249,83 @@ indigo_fwd_flow_delete(indigo_cookie_t flow_id,
                        indigo_fi_flow_stats_t *flow_stats)
 {
     AIM_LOG_VERBOSE("flow delete called\n");
-    memset(flow_stats, 0, sizeof(*flow_stats));
+    fwd_delete_calls++;
+    if (fwd_bundle_active) {
+        fwd_bundle_staged++;
+    }
+    if (flow_stats != NULL) {
+        fwd_delete_stats_calls++;
+        memset(flow_stats, 0, sizeof(*flow_stats));
+    }
     return INDIGO_ERROR_NONE;
 }
 
+static int fwd_flow_stats_calls;
+
 indigo_error_t indigo_fwd_flow_stats_get(
     indigo_cookie_t flow_id,
     indigo_fi_flow_stats_t *flow_stats)
 {
     AIM_LOG_VERBOSE("flow stats get called\n");
+    fwd_flow_stats_calls++;
     memset(flow_stats, 0, sizeof(*flow_stats));
     return INDIGO_ERROR_NONE;
 }
 
+/*
+ * Whether forwarding can bring the aggregate stats totals up to date, and
+ * whether the totals it has reported have gone stale
+ */
+static bool table_counters_sync_supported;
+static bool table_counters_stale;
+static int table_counters_sync_calls;
+
+indigo_error_t
+indigo_fwd_table_counters_sync(uint8_t table_id)
+{
+    table_counters_sync_calls++;
+    if (!table_counters_sync_supported) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+    return table_counters_stale ? INDIGO_ERROR_PENDING : INDIGO_ERROR_NONE;
+}
+
+/* Count hit status round trips to forwarding */
+static int hit_status_calls;
+static int hit_status_bulk_calls;
+static bool hit_status_bulk_supported = true;
+
 indigo_error_t
 indigo_fwd_flow_hit_status_get(indigo_cookie_t flow_id,
                                bool *is_hit)
 {
     AIM_LOG_VERBOSE("flow hit status get called\n");
+    hit_status_calls++;
     *is_hit = 0;
     return INDIGO_ERROR_NONE;
 }
 
+indigo_error_t
+indigo_fwd_flow_hit_status_get_bulk(int num_flows,
+                                    const indigo_cookie_t *flow_ids,
+                                    bool *hit_status,
+                                    indigo_error_t *results)
+{
+    int i;
+
+    if (!hit_status_bulk_supported) {
+        return INDIGO_ERROR_NOT_SUPPORTED;
+    }
+
+    AIM_LOG_VERBOSE("flow hit status get bulk called for %d flows\n", num_flows);
+    hit_status_bulk_calls++;
+    for (i = 0; i < num_flows; i++) {
+        hit_status[i] = 0;
+        results[i] = INDIGO_ERROR_NONE;
+    }
+    return INDIGO_ERROR_NONE;
+}
+
 indigo_error_t
 indigo_fwd_packet_out(of_packet_out_t *of_packet_out)
 {
@@ -181,15 +355,27 @@ ind_cxn_reset(indigo_cxn_id_t cxn_id)
     return;
 }
 
+static int error_reply_count;
+static uint16_t last_error_code;
+
 void
 indigo_cxn_send_error_reply(indigo_cxn_id_t cxn_id, of_object_t *orig,
                             uint16_t type, uint16_t code)
 {
     AIM_LOG_VERBOSE("Send error msg called for cxn id %d\n",
                       cxn_id);
+    error_reply_count++;
+    last_error_code = code;
 }
 
 static int controller_message_counters[OF_MESSAGE_OBJECT_COUNT];
+static uint16_t last_experimenter_error;
+static int flow_stats_entries;
+static uint64_t aggregate_flows;
+static uint64_t aggregate_packets;
+static uint64_t aggregate_bytes;
+static uint32_t table_stats_active;
+static uint64_t table_stats_matched;
 
 void
 indigo_cxn_send_controller_message(indigo_cxn_id_t cxn_id, of_object_t *obj)
@@ -197,9 +383,58 @@ indigo_cxn_send_controller_message(indigo_cxn_id_t cxn_id, of_object_t *obj)
     AIM_LOG_VERBOSE("Send msg called for cxn id %d, obj type %d\n",
                       cxn_id, obj->object_id);
     controller_message_counters[obj->object_id]++;
+    if (obj->object_id == OF_EXPERIMENTER_ERROR_MSG) {
+        of_experimenter_error_msg_subtype_get(obj, &last_experimenter_error);
+    } else if (obj->object_id == OF_FLOW_STATS_REPLY) {
+        of_list_flow_stats_entry_t list;
+        of_flow_stats_entry_t entry;
+        int rv;
+
+        of_flow_stats_reply_entries_bind(obj, &list);
+        OF_LIST_FLOW_STATS_ENTRY_ITER(&list, &entry, rv) {
+            flow_stats_entries++;
+        }
+    } else if (obj->object_id == OF_AGGREGATE_STATS_REPLY) {
+        uint32_t flows;
+
+        of_aggregate_stats_reply_flow_count_get(obj, &flows);
+        of_aggregate_stats_reply_packet_count_get(obj, &aggregate_packets);
+        of_aggregate_stats_reply_byte_count_get(obj, &aggregate_bytes);
+        aggregate_flows = flows;
+    } else if (obj->object_id == OF_TABLE_STATS_REPLY) {
+        of_list_table_stats_entry_t list;
+        of_table_stats_entry_t entry;
+        int rv;
+
+        of_table_stats_reply_entries_bind(obj, &list);
+        OF_LIST_TABLE_STATS_ENTRY_ITER(&list, &entry, rv) {
+            of_table_stats_entry_active_count_get(&entry, &table_stats_active);
+            of_table_stats_entry_matched_count_get(&entry, &table_stats_matched);
+        }
+    }
     of_object_delete(obj);
 }
 
+static indigo_cxn_status_change_f cxn_status_handler;
+
+indigo_error_t
+indigo_cxn_status_change_register(indigo_cxn_status_change_f handler,
+                                  void *cookie)
+{
+    cxn_status_handler = handler;
+    return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t
+indigo_cxn_status_change_unregister(indigo_cxn_status_change_f handler,
+                                    void *cookie)
+{
+    if (cxn_status_handler == handler) {
+        cxn_status_handler = NULL;
+    }
+    return INDIGO_ERROR_NONE;
+}
+
 static int async_message_counters[OF_MESSAGE_OBJECT_COUNT];
 
 void
@@ -433,13 +668,29 @@ depopulate_table(ft_instance_t ft)
     return 0;
 }
 
+/* Count the entries in both bucket arrays of a hash index */
+static int
+hash_count(ft_hash_t *hash)
+{
+    int count = 0;
+    uint32_t idx;
+
+    for (idx = 0; idx < hash->buckets_size; idx++) {
+        count += list_length(&hash->buckets[idx]);
+    }
+    for (idx = 0; idx < hash->old_buckets_size; idx++) {
+        count += list_length(&hash->old_buckets[idx]);
+    }
+
+    return count;
+}
+
 static int
 check_bucket_counts(ft_instance_t ft, int expected)
 {
     int count = 0;
     ft_entry_t *_entry;
     list_links_t *cur, *next;
-    int idx;
 
     FT_ITER(ft, _entry, cur, next) {
         (void)_entry;
@@ -448,17 +699,8 @@ check_bucket_counts(ft_instance_t ft, int expected)
     TEST_ASSERT(count == expected);
 
     /* Check the buckets */
-    count = 0;
-    for (idx = 0; idx < ft->config.flow_id_bucket_count; idx++) {
-        count += list_length(&ft->flow_id_buckets[idx]);
-    }
-    TEST_ASSERT(count == expected);
-
-    count = 0;
-    for (idx = 0; idx < ft->config.strict_match_bucket_count; idx++) {
-        count += list_length(&ft->strict_match_buckets[idx]);
-    }
-    TEST_ASSERT(count == expected);
+    TEST_ASSERT(ft_id_map_count(&ft->flow_id_map) == expected);
+    TEST_ASSERT(hash_count(&ft->strict_match_hash) == expected);
 
     return 0;
 }
@@ -857,6 +1099,47 @@ test_ft_iterator(void)
         ft_iterator_cleanup(&iter);
     }
 
+    /* Deleting a non-matching entry the iterator points at must not skip the next one */
+    {
+        /* Not narrowed by any index, so the iterator walks every entry */
+        of_meta_match_t query;
+        ft_iterator_t iter;
+        memset(&query, 0, sizeof(query));
+        query.mode = OF_MATCH_NON_STRICT;
+        query.check_priority = 1;
+        query.priority = entries[2]->priority;
+        query.out_port = OF_PORT_DEST_WILDCARD;
+        query.table_id = TABLE_ID_ANY;
+        TEST_ASSERT(entries[0]->priority != query.priority);
+        TEST_ASSERT(entries[1]->priority != query.priority);
+        ft_delete(ft, entries[0]);
+        TEST_OK(add_flow(ft, 0, &entries[0]));
+        /* Order is now 1, 2, 0 */
+        ft_iterator_init(&iter, ft, &query);
+        TEST_ASSERT(ft_iterator_next(&iter) == entries[2]);
+        ft_delete(ft, entries[0]);
+        TEST_ASSERT(ft_iterator_next(&iter) == NULL);
+        TEST_OK(add_flow(ft, 0, &entries[0]));
+        ft_iterator_cleanup(&iter);
+
+        ft_delete(ft, entries[1]);
+        ft_delete(ft, entries[2]);
+        TEST_OK(add_flow(ft, 1, &entries[1]));
+        TEST_OK(add_flow(ft, 2, &entries[2]));
+        /* Order is now 0, 1, 2 and the iterator starts at 0 */
+        ft_iterator_init(&iter, ft, &query);
+        ft_delete(ft, entries[0]);
+        ft_delete(ft, entries[1]);
+        TEST_ASSERT(ft_iterator_next(&iter) == entries[2]);
+        TEST_ASSERT(ft_iterator_next(&iter) == NULL);
+        TEST_OK(add_flow(ft, 0, &entries[0]));
+        TEST_OK(add_flow(ft, 1, &entries[1]));
+        ft_iterator_cleanup(&iter);
+
+        ft_delete(ft, entries[2]);
+        TEST_OK(add_flow(ft, 2, &entries[2]));
+    }
+
     /* Check query by cookie */
     /* Wildcards lowest cookie bit, so cookies 0 and 1 match while 2 does not */
     {
@@ -896,90 +1179,1109 @@ test_ft_iterator(void)
     return TEST_PASS;
 }
 
-struct iter_task_state {
-    ft_instance_t ft;
-    int finished;
-    int entries_seen;
-};
+/* Instructions with a single apply-actions output to port */
+static int
+output_instructions(of_version_t version, of_port_no_t port,
+                    of_list_instruction_t **instructions_p)
+{
+    of_list_instruction_t *instructions;
+    of_instruction_apply_actions_t *apply;
+    of_list_action_t *actions;
+    of_action_output_t *output;
+
+    output = of_action_output_new(version);
+    of_action_output_port_set(output, port);
+    actions = of_list_action_new(version);
+    of_list_append(actions, output);
+    apply = of_instruction_apply_actions_new(version);
+    TEST_OK(of_instruction_apply_actions_actions_set(apply, actions));
+    instructions = of_list_instruction_new(version);
+    of_list_append(instructions, apply);
+
+    of_object_delete(output);
+    of_object_delete(actions);
+    of_object_delete(apply);
+
+    *instructions_p = instructions;
+    return 0;
+}
 
-static void
-iter_task_cb(void *cookie, ft_entry_t *entry)
+/* Add an OF 1.3 flow with the given table and match */
+static int
+add_match_flow(ft_instance_t ft, int id, uint8_t table_id, uint16_t priority,
+               of_match_t *match, ft_entry_t **entry_p)
 {
-    struct iter_task_state *state = cookie;
-    if (entry != NULL) {
-        state->finished = 0;
-        state->entries_seen++;
-        ft_delete(state->ft, entry);
-    } else {
-        state->finished = 1;
+    of_flow_add_t *flow_add;
+    of_list_instruction_t *instructions;
+
+    flow_add = of_flow_add_new(OF_VERSION_1_3);
+    of_flow_add_flags_set(flow_add, 0);
+    of_flow_add_cookie_set(flow_add, id);
+    of_flow_add_priority_set(flow_add, priority);
+    of_flow_add_table_id_set(flow_add, table_id);
+    TEST_OK(of_flow_add_match_set(flow_add, match));
+    TEST_OK(output_instructions(OF_VERSION_1_3, id, &instructions));
+    TEST_OK(of_flow_add_instructions_set(flow_add, instructions));
+    of_object_delete(instructions);
+    TEST_INDIGO_OK(ft_add(ft, id, flow_add, entry_p));
+    TEST_ASSERT((*entry_p)->table_id == table_id);
+    of_object_delete(flow_add);
+    return 0;
+}
+
+/* Check that the iterator returns exactly the flows matched by a full scan */
+static int
+check_iterator_query(ft_instance_t ft, of_meta_match_t *query, int expected)
+{
+    ft_iterator_t iter;
+    ft_entry_t *entry;
+    int count = 0;
+
+    ft_iterator_init(&iter, ft, query);
+    while ((entry = ft_iterator_next(&iter)) != NULL) {
+        TEST_ASSERT(ft_entry_meta_match(query, entry));
+        count++;
     }
+    ft_iterator_cleanup(&iter);
+
+    TEST_ASSERT(count == count_matching(ft, query));
+    TEST_ASSERT(count == expected);
+
+    return 0;
 }
 
 static int
-test_ft_iter_task(void)
+tuple_count(ft_instance_t ft)
+{
+    list_links_t *cur;
+    int count = 0;
+    int table_id;
+
+    for (table_id = 0; table_id < FT_MAX_TABLES; table_id++) {
+        LIST_FOREACH(&FT_TABLE(ft, table_id)->tuples, cur) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/*
+ * Flows in three mask shapes, each in two tables:
+ *   vlan
+ *   vlan + in_port
+ *   in_port
+ */
+#define TUPLE_TEST_VLANS 8
+#define TUPLE_TEST_PORTS 4
+
+static int
+test_ft_tuple(void)
 {
     ft_instance_t ft;
     ft_config_t config = {
-        1024, /* strict_match buckets */
-        1024, /* flow_id buckets */
+        16, /* strict_match buckets */
+        16, /* flow_id buckets */
     };
-    of_flow_add_t *flow_add1, *flow_add2;
-    ft_entry_t *entry1, *entry2;
-    struct iter_task_state state;
+    of_match_t match;
+    of_meta_match_t query;
+    ft_entry_t *entry, *vlan_entry = NULL;
+    ft_iterator_t iter;
+    int id = 0;
+    int table_id, vlan, port;
 
     ft = ft_create(&config);
 
-    flow_add1 = of_flow_add_new(OF_VERSION_1_0);
-    of_flow_add_OF_VERSION_1_0_populate(flow_add1, 1);
-    of_flow_add_flags_set(flow_add1, 0);
+    for (table_id = 0; table_id < 2; table_id++) {
+        for (vlan = 1; vlan <= TUPLE_TEST_VLANS; vlan++) {
+            memset(&match, 0, sizeof(match));
+            match.version = OF_VERSION_1_3;
+            match.fields.vlan_vid = 0x1000 | vlan;
+            match.masks.vlan_vid = 0x1fff;
+            TEST_OK(add_match_flow(ft, id++, table_id, 1000, &match, &entry));
+            if (vlan == 3 && table_id == 0) {
+                vlan_entry = entry;
+            }
 
-    flow_add2 = of_flow_add_new(OF_VERSION_1_0);
-    of_flow_add_OF_VERSION_1_0_populate(flow_add2, 2);
-    of_flow_add_flags_set(flow_add2, 0);
+            for (port = 1; port <= TUPLE_TEST_PORTS; port++) {
+                match.fields.in_port = port;
+                match.masks.in_port = 0xffffffff;
+                TEST_OK(add_match_flow(ft, id++, table_id, 1000, &match, &entry));
+            }
+        }
 
-    TEST_INDIGO_OK(ft_add(ft, 1, flow_add1, &entry1));
-    TEST_INDIGO_OK(ft_add(ft, 2, flow_add2, &entry2));
+        for (port = 1; port <= TUPLE_TEST_PORTS; port++) {
+            memset(&match, 0, sizeof(match));
+            match.version = OF_VERSION_1_3;
+            match.fields.in_port = port;
+            match.masks.in_port = 0xffffffff;
+            TEST_OK(add_match_flow(ft, id++, table_id, 1000, &match, &entry));
+        }
+    }
 
-    state = (struct iter_task_state) { .ft = ft, .finished = -1, .entries_seen = 0 };
-    ft_spawn_iter_task(ft, NULL, iter_task_cb, &state, IND_SOC_DEFAULT_PRIORITY);
-    TEST_ASSERT(state.finished == -1);
-    TEST_ASSERT(state.entries_seen == 0);
-    TEST_ASSERT(ft->status.current_count == 2);
-    while (state.finished != 1) {
-        ind_soc_select_and_run(0);
+    TEST_ASSERT(vlan_entry != NULL);
+    TEST_ASSERT(tuple_count(ft) == 6);
+
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_NON_STRICT;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.table_id = TABLE_ID_ANY;
+
+    /* Everything */
+    TEST_OK(check_iterator_query(ft, &query, id));
+
+    /* One table */
+    query.table_id = 1;
+    TEST_OK(check_iterator_query(ft, &query, id / 2));
+
+    /* One VLAN: the vlan tuple by hash, the vlan + in_port tuple by scan */
+    query.table_id = TABLE_ID_ANY;
+    query.match = vlan_entry->match;
+    TEST_OK(check_iterator_query(ft, &query, 2 * (1 + TUPLE_TEST_PORTS)));
+
+    query.table_id = 0;
+    TEST_OK(check_iterator_query(ft, &query, 1 + TUPLE_TEST_PORTS));
+
+    /* Strict only visits the tuple with the same masks */
+    query.mode = OF_MATCH_STRICT;
+    query.priority = 1000;
+    TEST_OK(check_iterator_query(ft, &query, 1));
+
+    /* Change the table while an iterator is positioned on the entry */
+    query.mode = OF_MATCH_NON_STRICT;
+    query.table_id = 0;
+    ft_iterator_init(&iter, ft, &query);
+    ft_entry_set_table_id(ft, vlan_entry, 2);
+    TEST_ASSERT(tuple_count(ft) == 7);
+    TEST_ASSERT(vlan_entry->tuple->table_id == 2);
+    while ((entry = ft_iterator_next(&iter)) != NULL) {
+        TEST_ASSERT(entry != vlan_entry);
+        ft_delete(ft, entry);
     }
-    TEST_ASSERT(state.finished == 1);
-    TEST_ASSERT(state.entries_seen == 2);
+    ft_iterator_cleanup(&iter);
+    TEST_ASSERT(count_matching(ft, &query) == 0);
+
+    query.table_id = 2;
+    TEST_OK(check_iterator_query(ft, &query, 1));
+
+    /* Empty tuples are freed */
+    query.match.masks = (of_match_fields_t) { 0 };
+    query.table_id = TABLE_ID_ANY;
+    ft_iterator_init(&iter, ft, &query);
+    while ((entry = ft_iterator_next(&iter)) != NULL) {
+        ft_delete(ft, entry);
+    }
+    ft_iterator_cleanup(&iter);
+    TEST_ASSERT(tuple_count(ft) == 0);
     TEST_ASSERT(ft->status.current_count == 0);
 
     ft_destroy(ft);
-    of_object_delete(flow_add1);
-    of_object_delete(flow_add2);
 
     return TEST_PASS;
 }
 
+/*
+ * Delete one VLAN from a large table through the tuple index and compare
+ * with a full scan of the same table.
+ */
+#define TUPLE_BENCH_FLOWS 500000
+
 static int
-test_hello(void)
+test_ft_tuple_benchmark(void)
 {
-    of_hello_t *hello;
+    ft_instance_t ft;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    of_match_t match;
+    of_meta_match_t query;
+    ft_entry_t *entry;
+    ft_iterator_t iter;
+    indigo_time_t start;
+    int i, count, scanned;
+    list_links_t *cur, *next;
 
-    hello = of_hello_new(OF_VERSION_1_0);
-    indigo_core_receive_controller_message(0, hello);
-    of_object_delete(hello);
+    ft = ft_create(&config);
 
-    return TEST_PASS;
-}
+    /* Mostly L2 flows on in_port + eth_dst, plus one flow per VLAN */
+    for (i = 0; i < TUPLE_BENCH_FLOWS; i++) {
+        memset(&match, 0, sizeof(match));
+        match.version = OF_VERSION_1_3;
+        if (i % 128 == 0) {
+            match.fields.vlan_vid = 0x1000 | ((i / 128) % 4096);
+            match.masks.vlan_vid = 0x1fff;
+        } else {
+            match.fields.in_port = i % 48;
+            match.masks.in_port = 0xffffffff;
+            match.fields.eth_dst.addr[2] = i >> 16;
+            match.fields.eth_dst.addr[3] = i >> 8;
+            match.fields.eth_dst.addr[4] = i;
+            memset(&match.masks.eth_dst, 0xff, sizeof(match.masks.eth_dst));
+        }
+        TEST_OK(add_match_flow(ft, i, 0, 1000, &match, &entry));
+    }
 
-static int
-test_packet_out(void)
-{
-    of_packet_out_t *pkt_out;
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_NON_STRICT;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.table_id = TABLE_ID_ANY;
+    query.match.version = OF_VERSION_1_3;
+    query.match.fields.vlan_vid = 0x1000 | 10;
+    query.match.masks.vlan_vid = 0x1fff;
 
-    pkt_out = of_packet_out_new(OF_VERSION_1_0);
-    /* Could add params, but core doesn't do anything with them */
-    indigo_core_receive_controller_message(0, pkt_out);
-    of_object_delete(pkt_out);
+    start = INDIGO_CURRENT_TIME;
+    scanned = 0;
+    FT_ITER(ft, entry, cur, next) {
+        scanned += ft_entry_meta_match(&query, entry);
+    }
+    printf("Scanned %d flows for VLAN 10 in %d ms\n",
+           TUPLE_BENCH_FLOWS, (int)(INDIGO_CURRENT_TIME - start));
+
+    start = INDIGO_CURRENT_TIME;
+    count = 0;
+    ft_iterator_init(&iter, ft, &query);
+    while ((entry = ft_iterator_next(&iter)) != NULL) {
+        ft_delete(ft, entry);
+        count++;
+    }
+    ft_iterator_cleanup(&iter);
+    printf("Deleted %d flows for VLAN 10 in %d ms\n",
+           count, (int)(INDIGO_CURRENT_TIME - start));
+
+    TEST_ASSERT(count == scanned);
+    TEST_ASSERT(count == TUPLE_BENCH_FLOWS / 128 / 4096 + 1);
+    TEST_ASSERT(count_matching(ft, &query) == 0);
+
+    ft_destroy(ft);
+
+    return TEST_PASS;
+}
+
+/*
+ * ACL style flow: IPv4 source prefix, optionally with a TCP port. The
+ * prefix length and port vary so that some flows overlap.
+ */
+static void
+acl_match(of_match_t *match, int i, int num_prefixes)
+{
+    memset(match, 0, sizeof(*match));
+    match->version = OF_VERSION_1_3;
+    match->fields.eth_type = 0x0800;
+    match->masks.eth_type = 0xffff;
+    match->fields.ip_proto = 6;
+    match->masks.ip_proto = 0xff;
+    match->fields.ipv4_src = 0x0a000000 | ((i % num_prefixes) << 8) | (i & 0xff);
+    match->masks.ipv4_src = (i % 3 == 0) ? 0xffffff00 : 0xffffffff;
+    match->fields.ipv4_src &= match->masks.ipv4_src;
+    if (i % 5 != 0) {
+        match->fields.tcp_dst = 1000 + i % 7;
+        match->masks.tcp_dst = 0xffff;
+    }
+}
+
+static void
+acl_overlap_query(of_meta_match_t *query, of_match_t *match, uint16_t priority)
+{
+    memset(query, 0, sizeof(*query));
+    query->mode = OF_MATCH_OVERLAP;
+    query->table_id = 0;
+    query->check_priority = 1;
+    query->priority = priority;
+    query->out_port = OF_PORT_DEST_WILDCARD;
+    query->match = *match;
+}
+
+/*
+ * Add ACL flows with overlap checking, comparing the overlap index with a
+ * full scan.
+ */
+static int
+test_ft_overlap(void)
+{
+    ft_instance_t ft;
+    ft_config_t config = {
+        16, /* strict_match buckets */
+        16, /* flow_id buckets */
+    };
+    const int num_flows = 3000;
+    of_match_t match;
+    of_meta_match_t query;
+    ft_entry_t *entry, *scan_entry;
+    int i, table_id, added = 0, overlaps = 0;
+    indigo_error_t rv;
+
+    ft = ft_create(&config);
+
+    for (i = 0; i < num_flows; i++) {
+        uint16_t priority = 100 + i % 3;
+        acl_match(&match, i * 7, 50);
+        acl_overlap_query(&query, &match, priority);
+
+        rv = ft_overlap_match(ft, &query, &entry);
+        TEST_ASSERT(rv == first_match(ft, &query, &scan_entry));
+        if (rv == INDIGO_ERROR_NONE) {
+            TEST_ASSERT(ft_entry_meta_match(&query, entry));
+            overlaps++;
+            continue;
+        }
+
+        table_id = i % 2;
+        TEST_OK(add_match_flow(ft, i, table_id, priority, &match, &entry));
+        added++;
+        if (table_id != 0) {
+            /* Flows move between tables when forwarding picks another one */
+            ft_entry_set_table_id(ft, entry, 0);
+        }
+    }
+
+    TEST_ASSERT(added > 0);
+    TEST_ASSERT(overlaps > 0);
+
+    /* Nothing overlaps once the flows are deleted */
+    for (i = 0; i < num_flows; i++) {
+        if ((entry = ft_lookup(ft, i)) != NULL) {
+            ft_delete(ft, entry);
+        }
+    }
+    TEST_ASSERT(ft->overlap.count == 0);
+    TEST_ASSERT(ft_overlap_match(ft, &query, &entry) == INDIGO_ERROR_NOT_FOUND);
+
+    ft_destroy(ft);
+
+    return TEST_PASS;
+}
+
+#define OVERLAP_BENCH_FLOWS 50000
+
+static int
+test_ft_overlap_benchmark(void)
+{
+    ft_instance_t ft;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    of_match_t match;
+    of_meta_match_t query;
+    ft_entry_t *entry;
+    indigo_time_t start;
+    int i, added = 0;
+
+    ft = ft_create(&config);
+
+    start = INDIGO_CURRENT_TIME;
+    for (i = 0; i < OVERLAP_BENCH_FLOWS; i++) {
+        uint16_t priority = 100 + i % 4;
+        acl_match(&match, i, 4096);
+        acl_overlap_query(&query, &match, priority);
+        if (ft_overlap_match(ft, &query, &entry) == INDIGO_ERROR_NONE) {
+            continue;
+        }
+        TEST_OK(add_match_flow(ft, i, 0, priority, &match, &entry));
+        added++;
+    }
+    printf("Added %d of %d overlap checked ACL flows in %d ms\n",
+           added, OVERLAP_BENCH_FLOWS, (int)(INDIGO_CURRENT_TIME - start));
+
+    TEST_ASSERT(ft->status.current_count == added);
+
+    ft_destroy(ft);
+
+    return TEST_PASS;
+}
+
+static int
+test_ft_slab(void)
+{
+    ft_slab_t slab;
+    ft_arena_t arena;
+    const int num_objs = 10000;
+    void **objs;
+    void *large;
+    int i;
+
+    objs = aim_zmalloc(sizeof(*objs) * num_objs);
+
+    ft_slab_init(&slab, "test", 100);
+    for (i = 0; i < num_objs; i++) {
+        objs[i] = ft_slab_alloc(&slab);
+        TEST_ASSERT(((uintptr_t)objs[i] & 15) == 0);
+        memset(objs[i], i & 0xff, 100);
+    }
+    TEST_ASSERT(slab.in_use == num_objs);
+    TEST_ASSERT(ft_slab_capacity(&slab) >= num_objs);
+    TEST_ASSERT(ft_slab_capacity(&slab) < num_objs + slab.objs_per_page);
+
+    /* Objects don't overlap */
+    for (i = 0; i < num_objs; i++) {
+        TEST_ASSERT(((uint8_t *)objs[i])[99] == (i & 0xff));
+    }
+
+    /* Freed objects are reused before new pages are allocated */
+    for (i = 0; i < num_objs; i += 2) {
+        ft_slab_free(objs[i]);
+    }
+    TEST_ASSERT(slab.in_use == num_objs / 2);
+    for (i = 0; i < num_objs; i += 2) {
+        objs[i] = ft_slab_alloc(&slab);
+    }
+    TEST_ASSERT(ft_slab_capacity(&slab) < num_objs + slab.objs_per_page);
+
+    /* Empty pages are released, except for one spare */
+    for (i = 0; i < num_objs; i++) {
+        ft_slab_free(objs[i]);
+    }
+    TEST_ASSERT(slab.in_use == 0);
+    TEST_ASSERT(slab.num_pages == 1);
+    ft_slab_cleanup(&slab);
+
+    /* Arena size classes and the heap fallback */
+    ft_arena_init(&arena);
+    objs[0] = ft_arena_alloc(&arena, 1);
+    objs[1] = ft_arena_alloc(&arena, 64);
+    objs[2] = ft_arena_alloc(&arena, 65);
+    objs[3] = ft_arena_alloc(&arena, 4096);
+    large = ft_arena_alloc(&arena, 4097);
+    TEST_ASSERT(arena.classes[0].in_use == 2);
+    TEST_ASSERT(arena.classes[1].in_use == 1);
+    TEST_ASSERT(arena.classes[FT_ARENA_NUM_CLASSES - 1].in_use == 1);
+    TEST_ASSERT(arena.large_in_use == 1);
+    memset(large, 0, 4097);
+    for (i = 0; i < 4; i++) {
+        ft_arena_free(&arena, objs[i]);
+    }
+    ft_arena_free(&arena, large);
+    TEST_ASSERT(arena.classes[0].in_use == 0);
+    TEST_ASSERT(arena.large_in_use == 0);
+    ft_arena_cleanup(&arena);
+
+    aim_free(objs);
+
+    return TEST_PASS;
+}
+
+/*
+ * Replace a window of flows over and over, as a controller doing steady
+ * flow-mod churn would.
+ */
+#define CHURN_BENCH_FLOWS 10000
+#define CHURN_BENCH_ROUNDS 20
+
+static int
+test_ft_churn_benchmark(void)
+{
+    ft_instance_t ft;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    of_flow_add_t *flow_add;
+    of_list_instruction_t *instructions;
+    of_match_t match;
+    ft_entry_t *entry;
+    indigo_time_t start;
+    int i, round;
+
+    ft = ft_create(&config);
+
+    memset(&match, 0, sizeof(match));
+    match.version = OF_VERSION_1_3;
+    match.fields.in_port = 1;
+    match.masks.in_port = 0xffffffff;
+
+    flow_add = of_flow_add_new(OF_VERSION_1_3);
+    of_flow_add_flags_set(flow_add, 0);
+    of_flow_add_priority_set(flow_add, 1000);
+    TEST_OK(of_flow_add_match_set(flow_add, &match));
+    TEST_OK(output_instructions(OF_VERSION_1_3, 2, &instructions));
+    TEST_OK(of_flow_add_instructions_set(flow_add, instructions));
+    of_object_delete(instructions);
+
+    start = INDIGO_CURRENT_TIME;
+    for (round = 0; round < CHURN_BENCH_ROUNDS; round++) {
+        for (i = 0; i < CHURN_BENCH_FLOWS; i++) {
+            indigo_flow_id_t id = round * CHURN_BENCH_FLOWS + i;
+            TEST_INDIGO_OK(ft_add(ft, id, flow_add, &entry));
+            if (round > 0) {
+                ft_delete(ft, ft_lookup(ft, id - CHURN_BENCH_FLOWS));
+            }
+        }
+    }
+    printf("Churned %d flows in %d ms\n",
+           CHURN_BENCH_FLOWS * CHURN_BENCH_ROUNDS,
+           (int)(INDIGO_CURRENT_TIME - start));
+
+    TEST_ASSERT(ft->entry_slab.in_use == CHURN_BENCH_FLOWS);
+    TEST_ASSERT(ft_slab_capacity(&ft->entry_slab) <
+                CHURN_BENCH_FLOWS + 2 * ft->entry_slab.objs_per_page);
+
+    ft_destroy(ft);
+    of_object_delete(flow_add);
+
+    return TEST_PASS;
+}
+
+static int
+test_ft_effects(void)
+{
+    ft_instance_t ft;
+    ft_config_t config = {
+        16, /* strict_match buckets */
+        16, /* flow_id buckets */
+    };
+    const int num_ports = 4;
+    const int num_flows = 1000;
+    of_flow_add_t *flow_adds[4];
+    of_list_instruction_t *instructions;
+    of_match_t match;
+    ft_entry_t *entry, *other;
+    int i;
+
+    ft = ft_create(&config);
+
+    memset(&match, 0, sizeof(match));
+    match.version = OF_VERSION_1_3;
+    match.masks.in_port = 0xffffffff;
+
+    for (i = 0; i < num_ports; i++) {
+        flow_adds[i] = of_flow_add_new(OF_VERSION_1_3);
+        of_flow_add_flags_set(flow_adds[i], 0);
+        TEST_OK(output_instructions(OF_VERSION_1_3, i + 1, &instructions));
+        TEST_OK(of_flow_add_instructions_set(flow_adds[i], instructions));
+        of_object_delete(instructions);
+    }
+
+    /* Flows with the same instructions share them */
+    for (i = 0; i < num_flows; i++) {
+        match.fields.in_port = i;
+        TEST_OK(of_flow_add_match_set(flow_adds[i & 3], &match));
+        TEST_INDIGO_OK(ft_add(ft, i, flow_adds[i & 3], &entry));
+    }
+    TEST_ASSERT(ft->effects.count == num_ports);
+    TEST_ASSERT(ft->effects.refs == num_flows);
+
+    entry = ft_lookup(ft, 0);
+    other = ft_lookup(ft, num_ports);
+    TEST_ASSERT(entry->effects.instructions == other->effects.instructions);
+    TEST_ASSERT(entry->effects.instructions !=
+                ft_lookup(ft, 1)->effects.instructions);
+
+    /* Modify swaps the reference without touching the other flows */
+    TEST_INDIGO_OK(ft_entry_modify_effects(ft, entry, flow_adds[1]));
+    TEST_ASSERT(entry->effects.instructions ==
+                ft_lookup(ft, 1)->effects.instructions);
+    TEST_ASSERT(other->effects.instructions != entry->effects.instructions);
+    TEST_ASSERT(ft->effects.count == num_ports);
+    TEST_ASSERT(ft->effects.refs == num_flows);
+
+    /* Modify to the same effects */
+    TEST_INDIGO_OK(ft_entry_modify_effects(ft, entry, flow_adds[1]));
+    TEST_ASSERT(ft->effects.refs == num_flows);
+
+    /* The last reference frees the shared copy */
+    for (i = 0; i < num_flows; i++) {
+        if ((i & 3) != 0) {
+            ft_delete(ft, ft_lookup(ft, i));
+        }
+    }
+    TEST_ASSERT(ft->effects.count == 2);
+    for (i = 0; i < num_flows; i += 4) {
+        ft_delete(ft, ft_lookup(ft, i));
+    }
+    TEST_ASSERT(ft->effects.count == 0);
+    TEST_ASSERT(ft->effects.refs == 0);
+
+    ft_destroy(ft);
+    for (i = 0; i < num_ports; i++) {
+        of_object_delete(flow_adds[i]);
+    }
+
+    return TEST_PASS;
+}
+
+/* Instructions outputting to a port and a group */
+static int
+output_group_instructions(of_version_t version, of_port_no_t port,
+                          uint32_t group_id,
+                          of_list_instruction_t **instructions_p)
+{
+    of_list_instruction_t *instructions;
+    of_instruction_apply_actions_t *apply;
+    of_list_action_t *actions;
+    of_action_output_t *output;
+    of_action_group_t *group;
+
+    output = of_action_output_new(version);
+    of_action_output_port_set(output, port);
+    group = of_action_group_new(version);
+    of_action_group_group_id_set(group, group_id);
+    actions = of_list_action_new(version);
+    of_list_append(actions, output);
+    of_list_append(actions, group);
+    /* Duplicate outputs are only indexed once */
+    of_list_append(actions, output);
+    apply = of_instruction_apply_actions_new(version);
+    TEST_OK(of_instruction_apply_actions_actions_set(apply, actions));
+    instructions = of_list_instruction_new(version);
+    of_list_append(instructions, apply);
+
+    of_object_delete(output);
+    of_object_delete(group);
+    of_object_delete(actions);
+    of_object_delete(apply);
+
+    *instructions_p = instructions;
+    return 0;
+}
+
+static int
+test_ft_out_index(void)
+{
+    ft_instance_t ft;
+    ft_config_t config = {
+        16, /* strict_match buckets */
+        16, /* flow_id buckets */
+    };
+    const int num_flows = 1000;
+    of_flow_add_t *flow_adds[8];
+    of_list_instruction_t *instructions;
+    of_match_t match;
+    of_meta_match_t query;
+    ft_iterator_t iter;
+    ft_entry_t *entry;
+    int i, deleted;
+
+    ft = ft_create(&config);
+
+    memset(&match, 0, sizeof(match));
+    match.version = OF_VERSION_1_3;
+    match.masks.in_port = 0xffffffff;
+
+    /* Ports 1 to 4 and groups 0 and 1 */
+    for (i = 0; i < 8; i++) {
+        of_port_no_t port = (i & 3) + 1;
+        flow_adds[i] = of_flow_add_new(OF_VERSION_1_3);
+        of_flow_add_flags_set(flow_adds[i], 0);
+        TEST_OK(output_group_instructions(OF_VERSION_1_3, port, i / 4,
+                                          &instructions));
+        TEST_OK(of_flow_add_instructions_set(flow_adds[i], instructions));
+        of_object_delete(instructions);
+    }
+
+    for (i = 0; i < num_flows; i++) {
+        match.fields.in_port = i;
+        TEST_OK(of_flow_add_match_set(flow_adds[i & 7], &match));
+        TEST_INDIGO_OK(ft_add(ft, i, flow_adds[i & 7], &entry));
+    }
+    TEST_ASSERT(ft->effects.out_count == 6);
+
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_NON_STRICT;
+    query.table_id = TABLE_ID_ANY;
+    query.out_port = 2;
+    TEST_OK(check_iterator_query(ft, &query, num_flows / 4));
+    query.out_port = 99;
+    TEST_OK(check_iterator_query(ft, &query, 0));
+
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.check_out_group = 1;
+    query.out_group = 1;
+    TEST_OK(check_iterator_query(ft, &query, num_flows / 2));
+
+    /* Both filters apply */
+    query.out_port = 3;
+    TEST_OK(check_iterator_query(ft, &query, num_flows / 8));
+    query.check_out_group = 0;
+
+    /* Modify moves the flow to the other port */
+    TEST_INDIGO_OK(ft_entry_modify_effects(ft, ft_lookup(ft, 0), flow_adds[1]));
+    query.out_port = 1;
+    TEST_OK(check_iterator_query(ft, &query, num_flows / 4 - 1));
+    query.out_port = 2;
+    TEST_OK(check_iterator_query(ft, &query, num_flows / 4 + 1));
+
+    /* Delete by out_port, as on port down */
+    deleted = 0;
+    ft_iterator_init(&iter, ft, &query);
+    while ((entry = ft_iterator_next(&iter)) != NULL) {
+        ft_delete(ft, entry);
+        deleted++;
+    }
+    ft_iterator_cleanup(&iter);
+    TEST_ASSERT(deleted == num_flows / 4 + 1);
+    TEST_ASSERT(ft->status.current_count == num_flows - deleted);
+    TEST_OK(check_iterator_query(ft, &query, 0));
+    TEST_ASSERT(ft_effects_find_key(&ft->effects, FT_EFFECTS_OUT_PORT, 2) == NULL);
+
+    for (i = 0; i < num_flows; i++) {
+        if ((entry = ft_lookup(ft, i)) != NULL) {
+            ft_delete(ft, entry);
+        }
+    }
+    TEST_ASSERT(ft->effects.out_count == 0);
+
+    ft_destroy(ft);
+    for (i = 0; i < 8; i++) {
+        of_object_delete(flow_adds[i]);
+    }
+
+    return TEST_PASS;
+}
+
+/*
+ * Cookies with an application id in the top 16 bits and a tenant in bits
+ * 16-31, as a controller would use them
+ */
+static int
+check_cookie_totals(ft_instance_t ft, uint64_t cookie, uint64_t mask)
+{
+    ft_cookie_totals_t totals, expected;
+    of_meta_match_t query;
+    ft_entry_t *entry;
+    list_links_t *cur, *next;
+    int i;
+
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_NON_STRICT;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.table_id = TABLE_ID_ANY;
+    query.cookie = cookie;
+    query.cookie_mask = mask;
+
+    memset(&expected, 0, sizeof(expected));
+    FT_ITER(ft, entry, cur, next) {
+        if (ft_entry_meta_match(&query, entry)) {
+            expected.flows++;
+            expected.packets += entry->packets;
+            expected.bytes += entry->bytes;
+        }
+    }
+
+    memset(&totals, 0, sizeof(totals));
+    for (i = 0; i < FT_MAX_TABLES; i++) {
+        TEST_ASSERT(ft_cookie_totals(&FT_TABLE(ft, i)->cookies,
+                                     cookie, mask, &totals));
+    }
+    TEST_ASSERT(totals.flows == expected.flows);
+    TEST_ASSERT(totals.packets == expected.packets);
+    TEST_ASSERT(totals.bytes == expected.bytes);
+
+    return 0;
+}
+
+#define COOKIE_APP(_app) ((uint64_t)(_app) << 48)
+#define COOKIE_TENANT(_tenant) ((uint64_t)(_tenant) << 16)
+
+static int
+test_ft_cookie(void)
+{
+    ft_instance_t ft;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    const int num_flows = 20000;
+    of_flow_add_t *flow_add;
+    of_list_instruction_t *instructions;
+    of_meta_match_t query;
+    ft_iterator_t iter;
+    ft_entry_t *entry;
+    of_match_t match;
+    uint64_t cookie;
+    int i, deleted;
+
+    ft = ft_create(&config);
+
+    memset(&match, 0, sizeof(match));
+    match.version = OF_VERSION_1_3;
+
+    match.masks.in_port = 0xffffffff;
+
+    flow_add = of_flow_add_new(OF_VERSION_1_3);
+    of_flow_add_flags_set(flow_add, 0);
+    TEST_OK(output_instructions(OF_VERSION_1_3, 1, &instructions));
+    TEST_OK(of_flow_add_instructions_set(flow_add, instructions));
+    of_object_delete(instructions);
+
+    for (i = 0; i < num_flows; i++) {
+        /* Pairs of flows share a cookie */
+        cookie = COOKIE_APP(i % 5) | COOKIE_TENANT(i / 2 % 100) | (i / 2);
+        match.fields.in_port = i;
+        TEST_OK(of_flow_add_match_set(flow_add, &match));
+        of_flow_add_cookie_set(flow_add, cookie);
+        TEST_INDIGO_OK(ft_add(ft, i, flow_add, &entry));
+    }
+    of_object_delete(flow_add);
+
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_NON_STRICT;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.table_id = TABLE_ID_ANY;
+
+    /* One application */
+    query.cookie = COOKIE_APP(3);
+    query.cookie_mask = COOKIE_APP(0xffff);
+    TEST_OK(check_iterator_query(ft, &query, num_flows / 5));
+
+    /* One tenant of one application */
+    query.cookie = COOKIE_APP(2) | COOKIE_TENANT(42);
+    query.cookie_mask = COOKIE_APP(0xffff) | COOKIE_TENANT(0xffff);
+    TEST_OK(check_iterator_query(ft, &query, count_matching(ft, &query)));
+
+    /* One tenant across applications, in a table */
+    query.cookie = COOKIE_TENANT(7);
+    query.cookie_mask = COOKIE_TENANT(0xffff);
+    query.table_id = 0;
+    TEST_OK(check_iterator_query(ft, &query, num_flows / 100));
+    query.table_id = TABLE_ID_ANY;
+
+    /* Single low bit, and an exact cookie */
+    query.cookie = 1;
+    query.cookie_mask = 1;
+    TEST_OK(check_iterator_query(ft, &query, num_flows / 2));
+    query.cookie = COOKIE_APP(1) | COOKIE_TENANT(3) | 3;
+    query.cookie_mask = ~(uint64_t)0;
+    TEST_OK(check_iterator_query(ft, &query, 1));
+    query.cookie = 0x123456789;
+    TEST_OK(check_iterator_query(ft, &query, 0));
+
+    /* Running totals for prefix masks */
+    for (i = 0; i < num_flows; i++) {
+        ft_entry_counters_update(ft, ft_lookup(ft, i), i, i * 100);
+    }
+    TEST_OK(check_cookie_totals(ft, 0, 0));
+    TEST_OK(check_cookie_totals(ft, COOKIE_APP(3), COOKIE_APP(0xffff)));
+    TEST_OK(check_cookie_totals(ft, COOKIE_APP(2) | COOKIE_TENANT(42),
+                                ~(uint64_t)0xffff));
+    TEST_OK(check_cookie_totals(ft, COOKIE_APP(1) | COOKIE_TENANT(3) | 3,
+                                ~(uint64_t)0));
+    TEST_OK(check_cookie_totals(ft, 0x123456789, ~(uint64_t)0));
+    ft_entry_counters_update(ft, ft_lookup(ft, 17), 5, 500);
+    ft_entry_set_table_id(ft, ft_lookup(ft, 18), 1);
+    TEST_OK(check_cookie_totals(ft, 0, 0));
+    TEST_OK(check_cookie_totals(ft, COOKIE_APP(2), COOKIE_APP(0xffff)));
+    {
+        /* Non-prefix masks are left to the iterator */
+        ft_cookie_totals_t totals = { 0 };
+        TEST_ASSERT(!ft_cookie_totals(&FT_TABLE(ft, 0)->cookies,
+                                      COOKIE_TENANT(7), COOKIE_TENANT(0xffff),
+                                      &totals));
+        TEST_ASSERT(totals.flows == 0);
+    }
+
+    /* Delete by cookie, removing leaves while iterating */
+    query.cookie = COOKIE_APP(4);
+    query.cookie_mask = COOKIE_APP(0xffff);
+    deleted = 0;
+    ft_iterator_init(&iter, ft, &query);
+    while ((entry = ft_iterator_next(&iter)) != NULL) {
+        ft_delete(ft, entry);
+        deleted++;
+    }
+    ft_iterator_cleanup(&iter);
+    TEST_ASSERT(deleted == num_flows / 5);
+    TEST_OK(check_iterator_query(ft, &query, 0));
+    query.cookie = 0;
+    query.cookie_mask = 1;
+    TEST_OK(check_iterator_query(ft, &query, count_matching(ft, &query)));
+    TEST_OK(check_cookie_totals(ft, 0, 0));
+    TEST_OK(check_cookie_totals(ft, COOKIE_APP(1), COOKIE_APP(0xffff)));
+
+    for (i = 0; i < num_flows; i++) {
+        if ((entry = ft_lookup(ft, i)) != NULL) {
+            ft_delete(ft, entry);
+        }
+    }
+    for (i = 0; i < FT_MAX_TABLES; i++) {
+        TEST_ASSERT(FT_TABLE(ft, i)->cookies.count == 0);
+    }
+    TEST_ASSERT(ft->cookie_slab.in_use == 0);
+
+    ft_destroy(ft);
+
+    return TEST_PASS;
+}
+
+struct iter_task_state {
+    ft_instance_t ft;
+    int finished;
+    int entries_seen;
+};
+
+static void
+iter_task_cb(void *cookie, ft_entry_t *entry)
+{
+    struct iter_task_state *state = cookie;
+    if (entry != NULL) {
+        state->finished = 0;
+        state->entries_seen++;
+        ft_delete(state->ft, entry);
+    } else {
+        state->finished = 1;
+    }
+}
+
+static int
+test_ft_iter_task(void)
+{
+    ft_instance_t ft;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    of_flow_add_t *flow_add1, *flow_add2;
+    ft_entry_t *entry1, *entry2;
+    struct iter_task_state state;
+
+    ft = ft_create(&config);
+
+    flow_add1 = of_flow_add_new(OF_VERSION_1_0);
+    of_flow_add_OF_VERSION_1_0_populate(flow_add1, 1);
+    of_flow_add_flags_set(flow_add1, 0);
+
+    flow_add2 = of_flow_add_new(OF_VERSION_1_0);
+    of_flow_add_OF_VERSION_1_0_populate(flow_add2, 2);
+    of_flow_add_flags_set(flow_add2, 0);
+
+    TEST_INDIGO_OK(ft_add(ft, 1, flow_add1, &entry1));
+    TEST_INDIGO_OK(ft_add(ft, 2, flow_add2, &entry2));
+
+    state = (struct iter_task_state) { .ft = ft, .finished = -1, .entries_seen = 0 };
+    ft_spawn_iter_task(ft, NULL, iter_task_cb, &state, IND_SOC_DEFAULT_PRIORITY);
+    TEST_ASSERT(state.finished == -1);
+    TEST_ASSERT(state.entries_seen == 0);
+    TEST_ASSERT(ft->status.current_count == 2);
+    while (state.finished != 1) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(state.finished == 1);
+    TEST_ASSERT(state.entries_seen == 2);
+    TEST_ASSERT(ft->status.current_count == 0);
+
+    ft_destroy(ft);
+    of_object_delete(flow_add1);
+    of_object_delete(flow_add2);
+
+    return TEST_PASS;
+}
+
+/*
+ * Flows spread over five tables. Queries for one table, and iter tasks
+ * spawned for one, only visit that table's partition.
+ */
+static int
+test_ft_tables(void)
+{
+    ft_instance_t ft;
+    ft_config_t config = {
+        1024, /* strict_match buckets */
+        1024, /* flow_id buckets */
+    };
+    static const uint8_t table_ids[] = { 10, 20, 30, 50, 60 };
+    const int num_tables = sizeof(table_ids) / sizeof(table_ids[0]);
+    const int per_table = 200;
+    of_meta_match_t query;
+    struct iter_task_state state;
+    ft_entry_t *entry, *moved;
+    list_links_t *cur, *next;
+    of_match_t match;
+    int i, t, count;
+
+    ft = ft_create(&config);
+
+    memset(&match, 0, sizeof(match));
+    match.version = OF_VERSION_1_3;
+    match.masks.in_port = 0xffffffff;
+
+    for (t = 0; t < num_tables; t++) {
+        for (i = 0; i < per_table; i++) {
+            match.fields.in_port = i;
+            TEST_OK(add_match_flow(ft, t * per_table + i + 1, table_ids[t],
+                                   1000, &match, &entry));
+        }
+    }
+
+    for (t = 0; t < num_tables; t++) {
+        TEST_ASSERT(FT_TABLE(ft, table_ids[t])->status.current_count == per_table);
+        TEST_ASSERT(FT_TABLE(ft, table_ids[t])->status.adds == per_table);
+    }
+    TEST_ASSERT(FT_TABLE(ft, 0)->status.current_count == 0);
+    TEST_ASSERT(ft->status.current_count == num_tables * per_table);
+
+    memset(&query, 0, sizeof(query));
+    query.mode = OF_MATCH_NON_STRICT;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.table_id = 30;
+    TEST_OK(check_iterator_query(ft, &query, per_table));
+    query.table_id = 40;
+    TEST_OK(check_iterator_query(ft, &query, 0));
+    query.table_id = TABLE_ID_ANY;
+    TEST_OK(check_iterator_query(ft, &query, num_tables * per_table));
+
+    /* Cookie queries within and across tables */
+    query.cookie = 1;
+    query.cookie_mask = ~(uint64_t)0;
+    TEST_OK(check_iterator_query(ft, &query, 1));
+    query.table_id = 20;
+    TEST_OK(check_iterator_query(ft, &query, 0));
+    query.cookie = per_table + 1;
+    TEST_OK(check_iterator_query(ft, &query, 1));
+    query.cookie_mask = 0;
+
+    /* Moving a flow moves its counts */
+    moved = ft_lookup(ft, 1);
+    ft_entry_set_table_id(ft, moved, 20);
+    TEST_ASSERT(FT_TABLE(ft, 10)->status.current_count == per_table - 1);
+    TEST_ASSERT(FT_TABLE(ft, 20)->status.current_count == per_table + 1);
+    TEST_OK(check_iterator_query(ft, &query, per_table + 1));
+
+    count = 0;
+    FT_TABLE_ITER(ft, 20, entry, cur, next) {
+        TEST_ASSERT(entry->table_id == 20);
+        count++;
+    }
+    TEST_ASSERT(count == per_table + 1);
+
+    /* Only table 50 is visited and emptied */
+    query.table_id = 50;
+    state = (struct iter_task_state) { .ft = ft, .finished = -1, .entries_seen = 0 };
+    ft_spawn_iter_task(ft, &query, iter_task_cb, &state, IND_SOC_DEFAULT_PRIORITY);
+    while (state.finished != 1) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(state.entries_seen == per_table);
+    TEST_ASSERT(FT_TABLE(ft, 50)->status.current_count == 0);
+    TEST_ASSERT(FT_TABLE(ft, 60)->status.current_count == per_table);
+    TEST_ASSERT(list_empty(&FT_TABLE(ft, 50)->entries));
+    TEST_ASSERT(ft->status.current_count == (num_tables - 1) * per_table);
+
+    ft_destroy(ft);
+
+    return TEST_PASS;
+}
+
+static int
+test_hello(void)
+{
+    of_hello_t *hello;
+
+    hello = of_hello_new(OF_VERSION_1_0);
+    indigo_core_receive_controller_message(0, hello);
+    of_object_delete(hello);
+
+    return TEST_PASS;
+}
+
+static int
+test_packet_out(void)
+{
+    of_packet_out_t *pkt_out;
+
+    pkt_out = of_packet_out_new(OF_VERSION_1_0);
+    /* Could add params, but core doesn't do anything with them */
+    indigo_core_receive_controller_message(0, pkt_out);
+    of_object_delete(pkt_out);
 
     return TEST_PASS;
 }
@@ -1048,99 +2350,736 @@ test_desc_strings(void)
     TEST_INDIGO_OK(ind_core_dp_desc_get(desc_get));
     TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
 
-    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
-    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
-    TEST_INDIGO_OK(ind_core_mfr_desc_set(desc_set));
-    TEST_INDIGO_OK(ind_core_mfr_desc_get(desc_get));
-    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+    INDIGO_MEM_SET(desc_set, 0xee, OF_DESC_STR_LEN);
+    INDIGO_MEM_CLEAR(desc_get, OF_DESC_STR_LEN);
+    TEST_INDIGO_OK(ind_core_mfr_desc_set(desc_set));
+    TEST_INDIGO_OK(ind_core_mfr_desc_get(desc_get));
+    TEST_ASSERT(INDIGO_MEM_COMPARE(desc_set, desc_get, OF_DESC_STR_LEN) == 0);
+
+    return TEST_PASS;
+}
+
+static int
+delete_all_entries(ft_instance_t ft)
+{
+    of_flow_delete_t *flow_del;
+    of_match_t match;
+
+    INDIGO_MEM_CLEAR(&match, sizeof(match));
+    flow_del = of_flow_delete_new(OF_VERSION_1_0);
+    TEST_ASSERT(flow_del != NULL);
+    of_flow_delete_out_port_set(flow_del, OF_PORT_DEST_WILDCARD);
+    TEST_OK(of_flow_delete_match_set(flow_del, &match));
+    handle_message(flow_del);
+    TEST_INDIGO_OK(do_barrier());
+
+    TEST_OK(depopulate_table(ft));
+
+    return TEST_PASS;
+}
+
+/* Add n flows, delete them all */
+int
+test_simple_add_del(void)
+{
+    of_flow_add_t *flow_add;
+    ft_status_t *status;
+    int idx;
+
+    status = FT_STATUS(ind_core_ft);
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        of_flow_add_flags_set(flow_add, 0);
+        handle_message(flow_add);
+        TEST_INDIGO_OK(do_barrier());
+        CHECK_FLOW_COUNT(status, idx + 1);
+    }
+
+    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
+    TEST_ASSERT(status->current_count == 0);
+
+    return TEST_PASS;
+}
+
+/* Add n flows, delete one by one */
+int
+test_exact_add_del(void)
+{
+    of_flow_add_t *flow_add_keep[TEST_FLOW_COUNT];
+    of_flow_add_t *flow_add;
+    of_flow_delete_t *flow_del;
+    ft_status_t *status;
+    int idx;
+    of_match_t match;
+    uint16_t prio;
+
+    status = FT_STATUS(ind_core_ft);
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        of_flow_add_flags_set(flow_add, 0);
+        flow_add_keep[idx] = of_object_dup(flow_add);
+        handle_message(flow_add);
+        TEST_INDIGO_OK(do_barrier());
+        CHECK_FLOW_COUNT(status, idx + 1);
+    }
+
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        INDIGO_MEM_CLEAR(&match, sizeof(match));
+        /* Match the source mac addr which should be diff for each entry */
+        TEST_OK(of_flow_add_match_get(flow_add_keep[idx], &match));
+        of_flow_add_priority_get(flow_add_keep[idx], &prio);
+        flow_del = of_flow_delete_strict_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_del != NULL);
+        of_flow_delete_strict_out_port_set(flow_del, OF_PORT_DEST_WILDCARD);
+        of_flow_delete_strict_priority_set(flow_del, prio);
+        TEST_OK(of_flow_delete_strict_match_set(flow_del, &match));
+        handle_message(flow_del);
+        TEST_INDIGO_OK(do_barrier());
+        CHECK_FLOW_COUNT(status, TEST_FLOW_COUNT - (idx + 1));
+        of_flow_add_delete(flow_add_keep[idx]);
+    }
+    TEST_ASSERT(status->current_count == 0);
+
+    return TEST_PASS;
+}
+
+/*
+ * Add flows with a 1 second idle timeout and let them all expire, counting
+ * the hit status calls made to forwarding for each expired flow.
+ */
+static int
+expire_idle_flows(bool bulk, int *calls)
+{
+    of_flow_add_t *flow_add;
+    ft_status_t *status;
+    indigo_time_t start;
+    int idx;
+
+    status = FT_STATUS(ind_core_ft);
+    hit_status_bulk_supported = bulk;
+    hit_status_calls = 0;
+    hit_status_bulk_calls = 0;
+
+    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        of_flow_add_flags_set(flow_add, 0);
+        of_flow_add_idle_timeout_set(flow_add, 1);
+        of_flow_add_hard_timeout_set(flow_add, 0);
+        handle_message(flow_add);
+    }
+    TEST_INDIGO_OK(do_barrier());
+    CHECK_FLOW_COUNT(status, TEST_FLOW_COUNT);
+
+    start = INDIGO_CURRENT_TIME;
+    while (status->current_count > 0) {
+        TEST_ASSERT(INDIGO_CURRENT_TIME - start < 10 * 1000);
+        ind_soc_select_and_run(100);
+    }
+
+    *calls = hit_status_calls + hit_status_bulk_calls;
+    printf("expiration: %d idle flows expired with %d hit status %s calls, "
+           "%.3f per flow\n", TEST_FLOW_COUNT, *calls,
+           bulk ? "bulk" : "single", (double)*calls / TEST_FLOW_COUNT);
+
+    hit_status_bulk_supported = true;
+    return 0;
+}
+
+static int
+test_idle_expiration_benchmark(void)
+{
+    int single_calls, bulk_calls;
+
+    TEST_OK(expire_idle_flows(false, &single_calls));
+    TEST_ASSERT(single_calls == TEST_FLOW_COUNT);
+
+    TEST_OK(expire_idle_flows(true, &bulk_calls));
+    TEST_ASSERT(bulk_calls > 0);
+    TEST_ASSERT(bulk_calls * 100 <= TEST_FLOW_COUNT);
+
+    return TEST_PASS;
+}
+
+/*
+ * Add flows back to back and wait on a barrier, with forwarding completing
+ * them synchronously or later from the event loop. Returns adds per second.
+ */
+static int
+add_flows_timed(int count, bool pending, double *rate)
+{
+    of_flow_add_t *flow_add;
+    ft_status_t *status;
+    indigo_time_t start, elapsed;
+    int idx;
+
+    status = FT_STATUS(ind_core_ft);
+    flow_create_pending = pending;
+
+    start = INDIGO_CURRENT_TIME;
+    for (idx = 0; idx < count; idx++) {
+        flow_add = of_flow_add_new(OF_VERSION_1_0);
+        TEST_ASSERT(flow_add != NULL);
+        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
+        of_flow_add_flags_set(flow_add, 0);
+        handle_message(flow_add);
+    }
+    TEST_INDIGO_OK(do_barrier());
+    elapsed = INDIGO_CURRENT_TIME - start;
+
+    *rate = count * 1000.0 / (elapsed > 0 ? elapsed : 1);
+    printf("flow add: %d %s adds in %d ms, %.0f adds/s\n", count,
+           pending ? "pending" : "synchronous", (int)elapsed, *rate);
+
+    flow_create_pending = false;
+    TEST_ASSERT(pending_flow_count == 0);
+    TEST_ASSERT(status->current_count == count - pending_failures);
+
+    return 0;
+}
+
+static int
+test_flow_add_batching(void)
+{
+    const int count = PENDING_FLOWS_MAX;
+    of_flow_add_t *flow_add;
+    ft_status_t *status;
+    double sync_rate, pending_rate;
+
+    status = FT_STATUS(ind_core_ft);
+
+    TEST_OK(add_flows_timed(count, false, &sync_rate));
+    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
+
+    /* Failed adds are reported and removed */
+    pending_failures = 0;
+    pending_fail_every = 7;
+    error_reply_count = 0;
+    pending_in_order = true;
+    last_completed_flow = 0;
+    TEST_OK(add_flows_timed(count, true, &pending_rate));
+    TEST_ASSERT(pending_in_order);
+    TEST_ASSERT(pending_failures > 0);
+    TEST_ASSERT(error_reply_count == pending_failures);
+    TEST_ASSERT(status->forwarding_add_errors >= pending_failures);
+    TEST_ASSERT(outstanding_op_cnt == 0);
+    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
+    pending_fail_every = 0;
+    pending_failures = 0;
+
+    /* A barrier flushes the queue rather than waiting for the timer */
+    flow_create_pending = true;
+    flow_add = of_flow_add_new(OF_VERSION_1_0);
+    TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, 1) != 0);
+    handle_message(flow_add);
+    TEST_ASSERT(pending_flow_count == 1);
+    TEST_ASSERT(outstanding_op_cnt == 1);
+    indigo_core_barrier_notify(0);
+    TEST_ASSERT(pending_flow_count == 0);
+    TEST_ASSERT(outstanding_op_cnt == 0);
+    TEST_ASSERT(status->current_count == 1);
+    flow_create_pending = false;
+    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
+
+    return TEST_PASS;
+}
+
+/* Make an OF 1.3 flow_add on in_port idx + 1, outputting to port */
+static of_flow_add_t *
+replace_flow_new(int idx, of_port_no_t port, uint64_t cookie, uint16_t flags,
+                 uint16_t idle_timeout)
+{
+    of_flow_add_t *flow_add;
+    of_list_instruction_t *instructions;
+    of_match_t match;
+
+    INDIGO_MEM_CLEAR(&match, sizeof(match));
+    match.version = OF_VERSION_1_3;
+    match.fields.in_port = idx + 1;
+    OF_MATCH_MASK_IN_PORT_EXACT_SET(&match);
+
+    flow_add = of_flow_add_new(OF_VERSION_1_3);
+    of_flow_add_flags_set(flow_add, flags);
+    of_flow_add_cookie_set(flow_add, cookie);
+    of_flow_add_priority_set(flow_add, 100);
+    of_flow_add_table_id_set(flow_add, 0);
+    of_flow_add_idle_timeout_set(flow_add, idle_timeout);
+    if (of_flow_add_match_set(flow_add, &match) < 0 ||
+            output_instructions(OF_VERSION_1_3, port, &instructions) < 0) {
+        of_object_delete(flow_add);
+        return NULL;
+    }
+    if (of_flow_add_instructions_set(flow_add, instructions) < 0) {
+        of_object_delete(flow_add);
+        flow_add = NULL;
+    }
+    of_object_delete(instructions);
+
+    return flow_add;
+}
+
+/* Add the flow through the message handler */
+static int
+send_replace_flow(int idx, of_port_no_t port, uint64_t cookie, uint16_t flags,
+                  uint16_t idle_timeout)
+{
+    of_flow_add_t *flow_add;
+
+    TEST_ASSERT((flow_add = replace_flow_new(idx, port, cookie, flags,
+                                             idle_timeout)) != NULL);
+    handle_message(flow_add);
+
+    return 0;
+}
+
+/* Add the same flows again and count the forwarding calls made */
+static int
+readd_flows(int count, of_port_no_t port, uint64_t cookie, uint16_t flags,
+            int *calls)
+{
+    int idx;
+
+    fwd_create_calls = fwd_modify_calls = fwd_delete_calls = 0;
+    fwd_delete_stats_calls = 0;
+    for (idx = 0; idx < count; idx++) {
+        TEST_OK(send_replace_flow(idx, port, cookie, flags, 0));
+    }
+    TEST_INDIGO_OK(do_barrier());
+    *calls = fwd_create_calls + fwd_modify_calls + fwd_delete_calls;
+
+    return 0;
+}
+
+/*
+ * A flow add overwriting a flow in the same table replaces it in place,
+ * keeping its flow ID
+ */
+static int
+test_flow_add_replace(void)
+{
+    const int count = TEST_FLOW_COUNT;
+    ft_status_t *status;
+    ft_entry_t *entry;
+    of_meta_match_t query;
+    indigo_time_t start;
+    uint64_t adds, deletes;
+    int calls, readd_calls;
+
+    status = FT_STATUS(ind_core_ft);
+
+    TEST_OK(readd_flows(count, 1, 0x10, 0, &calls));
+    TEST_ASSERT(status->current_count == count);
+    adds = status->adds;
+    deletes = status->deletes;
+
+    /* Identical flows need no forwarding calls */
+    TEST_OK(readd_flows(count, 1, 0x10, 0, &calls));
+    TEST_ASSERT(calls == 0);
+
+    /* New effects are a single modify; the new cookie is indexed */
+    TEST_OK(readd_flows(count, 2, 0x20, 0, &calls));
+    TEST_ASSERT(fwd_modify_calls == count);
+    TEST_ASSERT(calls == count);
+    TEST_ASSERT(status->adds == adds);
+    TEST_ASSERT(status->deletes == deletes);
+    TEST_ASSERT(status->current_count == count);
+    TEST_ASSERT(FT_TABLE(ind_core_ft, 0)->cookies.count == 1);
+
+    INDIGO_MEM_CLEAR(&query, sizeof(query));
+    query.mode = OF_MATCH_NON_STRICT;
+    query.table_id = TABLE_ID_ANY;
+    query.cookie = 0x20;
+    query.cookie_mask = ~0ULL;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    TEST_OK(check_iterator_query(ind_core_ft, &query, count));
+    readd_calls = calls;
+
+    /* Forwarding failing the modify falls back to delete and add */
+    modify_error = INDIGO_ERROR_UNKNOWN;
+    TEST_OK(readd_flows(count, 3, 0x20, 0, &calls));
+    modify_error = INDIGO_ERROR_NONE;
+    TEST_ASSERT(fwd_create_calls == count);
+    TEST_ASSERT(fwd_delete_calls == count);
+    TEST_ASSERT(fwd_delete_stats_calls == 0);
+    TEST_ASSERT(status->adds == adds + count);
+    TEST_ASSERT(status->current_count == count);
+
+    /* So does resetting the counters */
+    TEST_OK(readd_flows(count, 3, 0x20, OF_FLOW_MOD_FLAG_RESET_COUNTS, &calls));
+    TEST_ASSERT(fwd_modify_calls == 0);
+    TEST_ASSERT(fwd_create_calls == count);
+    TEST_ASSERT(fwd_delete_calls == count);
+    printf("replace: %d re-added flows with new effects, %d forwarding calls "
+           "in place, %d with delete and add\n", count, readd_calls, calls);
+
+    /* A new idle timeout is modified in and the flow expires */
+    TEST_OK(send_replace_flow(0, 3, 0x20, 0, 1));
+    TEST_INDIGO_OK(do_barrier());
+    query.mode = OF_MATCH_STRICT;
+    query.match.version = OF_VERSION_1_3;
+    query.match.fields.in_port = 1;
+    OF_MATCH_MASK_IN_PORT_EXACT_SET(&query.match);
+    query.priority = 100;
+    query.table_id = 0;
+    query.cookie_mask = 0;
+    TEST_INDIGO_OK(ft_strict_match(ind_core_ft, &query, &entry));
+    TEST_ASSERT(entry->idle_timeout == 1);
+    TEST_ASSERT(fwd_modify_calls == 1);
+    start = INDIGO_CURRENT_TIME;
+    while (status->current_count == count) {
+        TEST_ASSERT(INDIGO_CURRENT_TIME - start < 10 * 1000);
+        ind_soc_select_and_run(100);
+    }
+    TEST_ASSERT(status->current_count == count - 1);
+
+    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
+
+    return TEST_PASS;
+}
+
+/* Send a bundle control message */
+static void
+send_bundle_ctrl(uint32_t bundle_id, uint16_t type, uint16_t flags)
+{
+    of_experimenter_t *exp;
+    uint8_t buf[8];
+    of_octets_t data = { .data = buf, .bytes = sizeof(buf) };
+
+    buf[0] = bundle_id >> 24;
+    buf[1] = bundle_id >> 16;
+    buf[2] = bundle_id >> 8;
+    buf[3] = bundle_id;
+    buf[4] = type >> 8;
+    buf[5] = type;
+    buf[6] = flags >> 8;
+    buf[7] = flags;
+
+    exp = of_experimenter_new(OF_VERSION_1_3);
+    of_experimenter_xid_set(exp, type);
+    of_experimenter_experimenter_set(exp, IND_CORE_BUNDLE_EXPERIMENTER);
+    of_experimenter_subtype_set(exp, IND_CORE_BUNDLE_CTRL);
+    AIM_TRUE_OR_DIE(of_experimenter_data_set(exp, &data) == 0);
+    handle_message(exp);
+}
+
+/* Add msg to a bundle and delete it; xid_delta makes the xids differ */
+static void
+send_bundle_add(uint32_t bundle_id, uint16_t flags, of_object_t *msg,
+                uint32_t xid, int xid_delta)
+{
+    of_experimenter_t *exp;
+    uint8_t buf[8 + 256];
+    of_octets_t data = { .data = buf, .bytes = 8 + msg->length };
+
+    AIM_TRUE_OR_DIE(msg->length <= 256);
+
+    INDIGO_MEM_CLEAR(buf, 8);
+    buf[0] = bundle_id >> 24;
+    buf[1] = bundle_id >> 16;
+    buf[2] = bundle_id >> 8;
+    buf[3] = bundle_id;
+    buf[6] = flags >> 8;
+    buf[7] = flags;
+    INDIGO_MEM_COPY(buf + 8, OF_OBJECT_BUFFER_INDEX(msg, 0), msg->length);
+    of_object_delete(msg);
+    buf[12] = (xid + xid_delta) >> 24;
+    buf[13] = (xid + xid_delta) >> 16;
+    buf[14] = (xid + xid_delta) >> 8;
+    buf[15] = xid + xid_delta;
+
+    exp = of_experimenter_new(OF_VERSION_1_3);
+    of_experimenter_xid_set(exp, xid);
+    of_experimenter_experimenter_set(exp, IND_CORE_BUNDLE_EXPERIMENTER);
+    of_experimenter_subtype_set(exp, IND_CORE_BUNDLE_ADD);
+    AIM_TRUE_OR_DIE(of_experimenter_data_set(exp, &data) == 0);
+    handle_message(exp);
+}
+
+/* Count the flows on in_port idx + 1 for idx in [start, end) */
+static int
+count_replace_flows(int start, int end, uint64_t cookie)
+{
+    of_meta_match_t query;
+    ft_entry_t *entry;
+    int idx, found = 0;
+
+    INDIGO_MEM_CLEAR(&query, sizeof(query));
+    query.mode = OF_MATCH_STRICT;
+    query.table_id = 0;
+    query.priority = 100;
+    query.cookie = cookie;
+    query.cookie_mask = ~0ULL;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.match.version = OF_VERSION_1_3;
+    OF_MATCH_MASK_IN_PORT_EXACT_SET(&query.match);
+    for (idx = start; idx < end; idx++) {
+        query.match.fields.in_port = idx + 1;
+        if (ft_strict_match(ind_core_ft, &query, &entry) == INDIGO_ERROR_NONE) {
+            found++;
+        }
+    }
+
+    return found;
+}
 
-    return TEST_PASS;
+/* Find the flow on in_port idx + 1, whatever its cookie */
+static ft_entry_t *
+replace_flow_lookup(int idx)
+{
+    of_meta_match_t query;
+    ft_entry_t *entry;
+
+    INDIGO_MEM_CLEAR(&query, sizeof(query));
+    query.mode = OF_MATCH_STRICT;
+    query.table_id = 0;
+    query.priority = 100;
+    query.out_port = OF_PORT_DEST_WILDCARD;
+    query.match.version = OF_VERSION_1_3;
+    query.match.fields.in_port = idx + 1;
+    OF_MATCH_MASK_IN_PORT_EXACT_SET(&query.match);
+    if (ft_strict_match(ind_core_ft, &query, &entry) != INDIGO_ERROR_NONE) {
+        return NULL;
+    }
+
+    return entry;
 }
 
-static int
-delete_all_entries(ft_instance_t ft)
+/* Make a flow_delete_strict for the flow on in_port idx + 1 */
+static of_flow_delete_strict_t *
+replace_flow_delete_new(int idx)
 {
-    of_flow_delete_t *flow_del;
+    of_flow_delete_strict_t *flow_delete;
     of_match_t match;
 
     INDIGO_MEM_CLEAR(&match, sizeof(match));
-    flow_del = of_flow_delete_new(OF_VERSION_1_0);
-    TEST_ASSERT(flow_del != NULL);
-    of_flow_delete_out_port_set(flow_del, OF_PORT_DEST_WILDCARD);
-    TEST_OK(of_flow_delete_match_set(flow_del, &match));
-    handle_message(flow_del);
-    TEST_INDIGO_OK(do_barrier());
-
-    TEST_OK(depopulate_table(ft));
+    match.version = OF_VERSION_1_3;
+    match.fields.in_port = idx + 1;
+    OF_MATCH_MASK_IN_PORT_EXACT_SET(&match);
+    flow_delete = of_flow_delete_strict_new(OF_VERSION_1_3);
+    of_flow_delete_strict_priority_set(flow_delete, 100);
+    of_flow_delete_strict_table_id_set(flow_delete, 0);
+    of_flow_delete_strict_out_port_set(flow_delete, OF_PORT_DEST_WILDCARD);
+    of_flow_delete_strict_out_group_set(flow_delete, OF_GROUP_ANY);
+    if (of_flow_delete_strict_match_set(flow_delete, &match) < 0) {
+        of_object_delete(flow_delete);
+        return NULL;
+    }
 
-    return TEST_PASS;
+    return flow_delete;
 }
 
-/* Add n flows, delete them all */
-int
-test_simple_add_del(void)
+/* Whether the flow on in_port idx + 1 has id and outputs to port */
+static bool
+replace_flow_check(int idx, indigo_flow_id_t id, of_port_no_t port)
 {
     of_flow_add_t *flow_add;
-    ft_status_t *status;
-    int idx;
+    ft_entry_t *entry;
+    bool equal;
 
-    status = FT_STATUS(ind_core_ft);
-    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
-        flow_add = of_flow_add_new(OF_VERSION_1_0);
-        TEST_ASSERT(flow_add != NULL);
-        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
-        of_flow_add_flags_set(flow_add, 0);
-        handle_message(flow_add);
-        TEST_INDIGO_OK(do_barrier());
-        CHECK_FLOW_COUNT(status, idx + 1);
+    if ((entry = ft_lookup(ind_core_ft, id)) == NULL ||
+            entry->match.fields.in_port != idx + 1) {
+        return false;
     }
 
-    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
-    TEST_ASSERT(status->current_count == 0);
+    flow_add = replace_flow_new(idx, port, 0, 0, 0);
+    equal = ft_entry_effects_equal(entry, flow_add);
+    of_object_delete(flow_add);
 
-    return TEST_PASS;
+    return equal;
 }
 
-/* Add n flows, delete one by one */
-int
-test_exact_add_del(void)
+/*
+ * Flow_mods added to a bundle are applied together when it is committed,
+ * or not at all
+ */
+static int
+test_bundle(void)
 {
-    of_flow_add_t *flow_add_keep[TEST_FLOW_COUNT];
-    of_flow_add_t *flow_add;
-    of_flow_delete_t *flow_del;
+    const int count = 100;
+    const uint16_t flags = 0x1;     /* Atomic */
+    ind_core_bundle_stats_t stats;
     ft_status_t *status;
-    int idx;
-    of_match_t match;
-    uint16_t prio;
+    ft_entry_t *entry;
+    indigo_flow_id_t deleted_id, replaced_id;
+    int idx, replies, errors;
 
     status = FT_STATUS(ind_core_ft);
-    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
-        flow_add = of_flow_add_new(OF_VERSION_1_0);
-        TEST_ASSERT(flow_add != NULL);
-        TEST_ASSERT(of_flow_add_OF_VERSION_1_0_populate(flow_add, idx) != 0);
-        of_flow_add_flags_set(flow_add, 0);
-        flow_add_keep[idx] = of_object_dup(flow_add);
-        handle_message(flow_add);
-        TEST_INDIGO_OK(do_barrier());
-        CHECK_FLOW_COUNT(status, idx + 1);
-    }
-
-    for (idx = 0; idx < TEST_FLOW_COUNT; idx++) {
-        INDIGO_MEM_CLEAR(&match, sizeof(match));
-        /* Match the source mac addr which should be diff for each entry */
-        TEST_OK(of_flow_add_match_get(flow_add_keep[idx], &match));
-        of_flow_add_priority_get(flow_add_keep[idx], &prio);
-        flow_del = of_flow_delete_strict_new(OF_VERSION_1_0);
-        TEST_ASSERT(flow_del != NULL);
-        of_flow_delete_strict_out_port_set(flow_del, OF_PORT_DEST_WILDCARD);
-        of_flow_delete_strict_priority_set(flow_del, prio);
-        TEST_OK(of_flow_delete_strict_match_set(flow_del, &match));
-        handle_message(flow_del);
-        TEST_INDIGO_OK(do_barrier());
-        CHECK_FLOW_COUNT(status, TEST_FLOW_COUNT - (idx + 1));
-        of_flow_add_delete(flow_add_keep[idx]);
+    TEST_ASSERT(status->current_count == 0);
+    replies = controller_message_counters[OF_EXPERIMENTER];
+    errors = controller_message_counters[OF_EXPERIMENTER_ERROR_MSG];
+
+    /* Staged flows are only validated until the commit */
+    fwd_create_calls = 0;
+    send_bundle_ctrl(1, IND_CORE_BUNDLE_OPEN_REQUEST, flags);
+    TEST_ASSERT(controller_message_counters[OF_EXPERIMENTER] == ++replies);
+    for (idx = 0; idx < count; idx++) {
+        send_bundle_add(1, flags, replace_flow_new(idx, 1, 0x30, 0, 0),
+                        idx, 0);
     }
     TEST_ASSERT(status->current_count == 0);
+    TEST_ASSERT(fwd_create_calls == 0);
+    send_bundle_ctrl(1, IND_CORE_BUNDLE_CLOSE_REQUEST, flags);
+    TEST_ASSERT(controller_message_counters[OF_EXPERIMENTER] == ++replies);
+
+    /* Nothing more can be added once closed */
+    send_bundle_add(1, flags, replace_flow_new(count, 1, 0x30, 0, 0), 0, 0);
+    TEST_ASSERT(last_experimenter_error == 2304);
+    TEST_ASSERT(controller_message_counters[OF_EXPERIMENTER_ERROR_MSG] ==
+                ++errors);
+
+    send_bundle_ctrl(1, IND_CORE_BUNDLE_COMMIT_REQUEST, flags);
+    TEST_ASSERT(controller_message_counters[OF_EXPERIMENTER] == ++replies);
+    TEST_ASSERT(status->current_count == count);
+    TEST_ASSERT(fwd_create_calls == count);
+    TEST_ASSERT(count_replace_flows(0, count, 0x30) == count);
+    ind_core_bundle_stats_get(&stats);
+    TEST_ASSERT(stats.commits == 1);
+    TEST_ASSERT(stats.messages == count);
+
+    /* The bundle is gone after the commit */
+    send_bundle_ctrl(1, IND_CORE_BUNDLE_COMMIT_REQUEST, flags);
+    TEST_ASSERT(last_experimenter_error == 2302);
+    TEST_ASSERT(controller_message_counters[OF_EXPERIMENTER_ERROR_MSG] ==
+                ++errors);
+
+    /*
+     * A failing flow_mod undoes the replaces, deletes and adds before it.
+     * Adding to a new bundle opens it.
+     */
+    send_bundle_add(2, flags, replace_flow_delete_new(0), 1, 0);
+    for (idx = 1; idx < 2 * count; idx++) {
+        send_bundle_add(2, flags, replace_flow_new(idx, 2, 0x40, 0, 0),
+                        idx, 0);
+    }
+    send_bundle_add(2, flags,
+                    replace_flow_new(count - 1, 3, 0x40,
+                                     OF_FLOW_MOD_FLAG_CHECK_OVERLAP, 0),
+                    0, 0);
+    send_bundle_ctrl(2, IND_CORE_BUNDLE_COMMIT_REQUEST, flags);
+    TEST_ASSERT(last_experimenter_error == 2313);
+    TEST_ASSERT(status->current_count == count);
+    TEST_ASSERT(count_replace_flows(0, count, 0x30) == count);
+    TEST_ASSERT(count_replace_flows(count, 2 * count, 0x40) == 0);
+    ind_core_bundle_stats_get(&stats);
+    TEST_ASSERT(stats.rollbacks == 1);
+
+    /* So does a flow add forwarding fails after it was queued */
+    flow_create_pending = true;
+    pending_fail_every = 7;
+    pending_failures = 0;
+    for (idx = count; idx < 2 * count; idx++) {
+        send_bundle_add(3, flags, replace_flow_new(idx, 2, 0x40, 0, 0),
+                        idx, 0);
+    }
+    send_bundle_ctrl(3, IND_CORE_BUNDLE_COMMIT_REQUEST, flags);
+    flow_create_pending = false;
+    pending_fail_every = 0;
+    TEST_ASSERT(pending_failures > 0);
+    TEST_ASSERT(pending_flow_count == 0);
+    TEST_ASSERT(last_experimenter_error == 2313);
+    TEST_ASSERT(status->current_count == count);
+    TEST_ASSERT(count_replace_flows(count, 2 * count, 0x40) == 0);
+    TEST_ASSERT(outstanding_op_cnt == 0);
+    ind_core_bundle_stats_get(&stats);
+    TEST_ASSERT(stats.rollbacks == 2);
+    errors = controller_message_counters[OF_EXPERIMENTER_ERROR_MSG];
+
+    /* Messages are checked as they are added */
+    send_bundle_add(4, flags, replace_flow_new(count, 2, 0x40, 0, 0), 1, 1);
+    TEST_ASSERT(last_experimenter_error == 2309);
+    send_bundle_add(4, flags, of_echo_request_new(OF_VERSION_1_3), 1, 0);
+    TEST_ASSERT(last_experimenter_error == 2310);
+    send_bundle_add(4, 0, replace_flow_new(count, 2, 0x40, 0, 0), 1, 0);
+    TEST_ASSERT(last_experimenter_error == 2307);
+    TEST_ASSERT(controller_message_counters[OF_EXPERIMENTER_ERROR_MSG] ==
+                errors + 3);
+
+    /* Discarded bundles change nothing */
+    send_bundle_add(4, flags, replace_flow_new(count, 2, 0x40, 0, 0), 1, 0);
+    send_bundle_ctrl(4, IND_CORE_BUNDLE_DISCARD_REQUEST, flags);
+    send_bundle_ctrl(4, IND_CORE_BUNDLE_COMMIT_REQUEST, flags);
+    TEST_ASSERT(last_experimenter_error == 2302);
+
+    /* As are the bundles of a connection that closes */
+    TEST_ASSERT(cxn_status_handler != NULL);
+    send_bundle_add(5, flags, replace_flow_new(count, 2, 0x40, 0, 0), 1, 0);
+    cxn_status_handler(0, NULL, INDIGO_CXN_S_CLOSING, NULL);
+    send_bundle_ctrl(5, IND_CORE_BUNDLE_COMMIT_REQUEST, flags);
+    TEST_ASSERT(last_experimenter_error == 2302);
+    TEST_ASSERT(status->current_count == count);
+    ind_core_bundle_stats_get(&stats);
+    TEST_ASSERT(stats.discards == 2);
+
+    /*
+     * Forwarding that stages the changes is told to make them only once
+     * every flow_mod applied. If the commit fails, the flowtable is put
+     * back without calling forwarding and the flows keep their IDs.
+     */
+    fwd_bundle_staging = true;
+    replies = controller_message_counters[OF_EXPERIMENTER];
+    TEST_ASSERT((entry = replace_flow_lookup(0)) != NULL);
+    deleted_id = entry->id;
+    TEST_ASSERT((entry = replace_flow_lookup(1)) != NULL);
+    replaced_id = entry->id;
+    send_bundle_add(6, flags, replace_flow_delete_new(0), 1, 0);
+    for (idx = 1; idx < 2 * count; idx++) {
+        send_bundle_add(6, flags, replace_flow_new(idx, 2, 0x30, 0, 0),
+                        idx, 0);
+    }
+    send_bundle_add(6, flags,
+                    replace_flow_new(count - 1, 3, 0x40,
+                                     OF_FLOW_MOD_FLAG_CHECK_OVERLAP, 0),
+                    0, 0);
+    fwd_create_calls = fwd_modify_calls = fwd_delete_calls = 0;
+    send_bundle_ctrl(6, IND_CORE_BUNDLE_COMMIT_REQUEST, flags);
+    TEST_ASSERT(last_experimenter_error == 2313);
+    TEST_ASSERT(fwd_bundle_aborts == 1);
+    TEST_ASSERT(fwd_bundle_staged == 1 + (count - 1) + count);
+    TEST_ASSERT(fwd_create_calls + fwd_modify_calls + fwd_delete_calls ==
+                fwd_bundle_staged);
+    TEST_ASSERT(status->current_count == count);
+    TEST_ASSERT(replace_flow_check(0, deleted_id, 1));
+    TEST_ASSERT(replace_flow_check(1, replaced_id, 1));
+    TEST_ASSERT(count_replace_flows(0, count, 0x30) == count);
+    TEST_ASSERT(count_replace_flows(count, 2 * count, 0x30) == 0);
+
+    /* Likewise if forwarding fails to make the staged changes */
+    fwd_bundle_error = INDIGO_ERROR_TABLE_FULL;
+    send_bundle_add(7, flags, replace_flow_delete_new(0), 1, 0);
+    for (idx = count; idx < 2 * count; idx++) {
+        send_bundle_add(7, flags, replace_flow_new(idx, 2, 0x40, 0, 0),
+                        idx, 0);
+    }
+    send_bundle_ctrl(7, IND_CORE_BUNDLE_COMMIT_REQUEST, flags);
+    fwd_bundle_error = INDIGO_ERROR_NONE;
+    TEST_ASSERT(last_experimenter_error == 2313);
+    TEST_ASSERT(fwd_bundle_aborts == 1);
+    TEST_ASSERT(status->current_count == count);
+    TEST_ASSERT(replace_flow_check(0, deleted_id, 1));
+    TEST_ASSERT(count_replace_flows(count, 2 * count, 0x40) == 0);
+    ind_core_bundle_stats_get(&stats);
+    TEST_ASSERT(stats.rollbacks == 4);
+
+    send_bundle_add(8, flags, replace_flow_delete_new(0), 1, 0);
+    for (idx = count; idx < 2 * count; idx++) {
+        send_bundle_add(8, flags, replace_flow_new(idx, 2, 0x40, 0, 0),
+                        idx, 0);
+    }
+    send_bundle_ctrl(8, IND_CORE_BUNDLE_COMMIT_REQUEST, flags);
+    TEST_ASSERT(controller_message_counters[OF_EXPERIMENTER] == ++replies);
+    TEST_ASSERT(ft_lookup(ind_core_ft, deleted_id) == NULL);
+    TEST_ASSERT(count_replace_flows(count, 2 * count, 0x40) == count);
+    ind_core_bundle_stats_get(&stats);
+    TEST_ASSERT(stats.commits == 2);
+    fwd_bundle_staging = false;
+    ind_core_bundle_stats(&aim_pvs_stdout);
+
+    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
 
     return TEST_PASS;
 }
@@ -1240,9 +3179,334 @@ test_modify_strict(void)
 }
 
 
+/* Request stats for the flows in the table with the given cookie */
+static int
+send_flow_stats_request(uint8_t table_id, uint64_t cookie,
+                        uint64_t cookie_mask)
+{
+    of_flow_stats_request_t *req;
+    of_match_t match;
+
+    INDIGO_MEM_CLEAR(&match, sizeof(match));
+    match.version = OF_VERSION_1_3;
+
+    req = of_flow_stats_request_new(OF_VERSION_1_3);
+    TEST_ASSERT(req != NULL);
+    of_flow_stats_request_table_id_set(req, table_id);
+    of_flow_stats_request_out_port_set(req, OF_PORT_DEST_WILDCARD);
+    of_flow_stats_request_out_group_set(req, OF_GROUP_ANY);
+    of_flow_stats_request_cookie_set(req, cookie);
+    of_flow_stats_request_cookie_mask_set(req, cookie_mask);
+    TEST_OK(of_flow_stats_request_match_set(req, &match));
+    handle_message(req);
+
+    return 0;
+}
+
+/* Flow stats requests arriving together share flowtable sweeps */
 int
 test_flow_stats(void)
 {
+    const int count = 100;
+    ind_core_flow_stats_sweep_stats_t stats, before;
+    int idx, replies;
+
+    for (idx = 0; idx < count; idx++) {
+        uint64_t cookie = (idx & 1) ? 0x1 : 0x2;
+        TEST_OK(send_replace_flow(idx, 1, cookie, 0, 0));
+    }
+    TEST_INDIGO_OK(do_barrier());
+
+    ind_core_flow_stats_sweep_stats_get(&before);
+    replies = controller_message_counters[OF_FLOW_STATS_REPLY];
+    fwd_flow_stats_calls = 0;
+    flow_stats_entries = 0;
+
+    /*
+     * The first request starts a sweep of every flow. The next two overlap
+     * it, so they share a pending sweep and read each of their flows'
+     * counters once.
+     */
+    TEST_OK(send_flow_stats_request(TABLE_ID_ANY, 0, 0));
+    TEST_OK(send_flow_stats_request(TABLE_ID_ANY, 0x1, ~0ULL));
+    TEST_OK(send_flow_stats_request(0, 0x1, ~0ULL));
+    ind_core_flow_stats_sweep_stats_get(&stats);
+    TEST_ASSERT(stats.sweeps == before.sweeps + 1);
+    TEST_INDIGO_OK(do_barrier());
+
+    TEST_ASSERT(controller_message_counters[OF_FLOW_STATS_REPLY] ==
+                replies + 3);
+    TEST_ASSERT(flow_stats_entries == count + 2 * (count / 2));
+    TEST_ASSERT(fwd_flow_stats_calls == count + count / 2);
+    ind_core_flow_stats_sweep_stats_get(&stats);
+    TEST_ASSERT(stats.sweeps == before.sweeps + 2);
+    TEST_ASSERT(stats.requests == before.requests + 3);
+    TEST_ASSERT(stats.rpcs_saved == before.rpcs_saved + count / 2);
+
+    /* Disjoint queries wait for the sweep they overlap, not each other */
+    ind_core_flow_stats_sweep_stats_get(&before);
+    fwd_flow_stats_calls = 0;
+    flow_stats_entries = 0;
+    TEST_OK(send_flow_stats_request(TABLE_ID_ANY, 0, 0));
+    TEST_OK(send_flow_stats_request(TABLE_ID_ANY, 0x1, ~0ULL));
+    TEST_OK(send_flow_stats_request(TABLE_ID_ANY, 0x2, ~0ULL));
+    ind_core_flow_stats_sweep_stats_get(&stats);
+    TEST_ASSERT(stats.sweeps == before.sweeps + 1);
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(flow_stats_entries == 2 * count);
+    TEST_ASSERT(fwd_flow_stats_calls == 2 * count);
+    ind_core_flow_stats_sweep_stats_get(&stats);
+    TEST_ASSERT(stats.sweeps == before.sweeps + 3);
+
+    /* Disjoint queries run their own sweeps at once */
+    ind_core_flow_stats_sweep_stats_get(&before);
+    fwd_flow_stats_calls = 0;
+    flow_stats_entries = 0;
+    TEST_OK(send_flow_stats_request(0, 0x1, ~0ULL));
+    TEST_OK(send_flow_stats_request(0, 0x2, ~0ULL));
+    TEST_OK(send_flow_stats_request(1, 0, 0));
+    ind_core_flow_stats_sweep_stats_get(&stats);
+    TEST_ASSERT(stats.sweeps == before.sweeps + 3);
+    /* This one overlaps the running sweep for cookie 0x1 */
+    TEST_OK(send_flow_stats_request(TABLE_ID_ANY, 0x1, 0x1));
+    ind_core_flow_stats_sweep_stats_get(&stats);
+    TEST_ASSERT(stats.sweeps == before.sweeps + 3);
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(controller_message_counters[OF_FLOW_STATS_REPLY] ==
+                replies + 10);
+    TEST_ASSERT(flow_stats_entries == 2 * (count / 2) + count / 2);
+    TEST_ASSERT(fwd_flow_stats_calls == count + count / 2);
+    ind_core_flow_stats_sweep_stats_get(&stats);
+    TEST_ASSERT(stats.sweeps == before.sweeps + 4);
+
+    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
+
+    return TEST_PASS;
+}
+
+/* Request aggregate stats for the flows with the given cookie and in_port */
+static int
+send_aggregate_stats_request(uint64_t cookie, uint64_t cookie_mask,
+                             of_port_no_t in_port)
+{
+    of_aggregate_stats_request_t *req;
+    of_match_t match;
+
+    INDIGO_MEM_CLEAR(&match, sizeof(match));
+    match.version = OF_VERSION_1_3;
+    if (in_port != 0) {
+        match.fields.in_port = in_port;
+        match.masks.in_port = 0xffffffff;
+    }
+
+    req = of_aggregate_stats_request_new(OF_VERSION_1_3);
+    TEST_ASSERT(req != NULL);
+    of_aggregate_stats_request_table_id_set(req, TABLE_ID_ANY);
+    of_aggregate_stats_request_out_port_set(req, OF_PORT_DEST_WILDCARD);
+    of_aggregate_stats_request_out_group_set(req, OF_GROUP_ANY);
+    of_aggregate_stats_request_cookie_set(req, cookie);
+    of_aggregate_stats_request_cookie_mask_set(req, cookie_mask);
+    TEST_OK(of_aggregate_stats_request_match_set(req, &match));
+    handle_message(req);
+
+    return 0;
+}
+
+/*
+ * Aggregate stats over cookie prefixes come from the running totals when
+ * forwarding can sync its counters, and from the iterator otherwise
+ */
+int
+test_aggregate_stats(void)
+{
+    const int count = 100;
+    ind_core_aggregate_stats_paths_t paths, before;
+    list_links_t *cur, *next;
+    ft_entry_t *entry;
+    uint64_t packets;
+    int idx;
+
+    for (idx = 0; idx < count; idx++) {
+        uint64_t cookie = (idx & 1) ? 0x1 : 0x2;
+        TEST_OK(send_replace_flow(idx, 1, cookie, 0, 0));
+    }
+    TEST_INDIGO_OK(do_barrier());
+
+    ind_core_aggregate_stats_paths_get(&before);
+
+    /* Forwarding cannot sync; every flow is read */
+    table_counters_sync_supported = false;
+    fwd_flow_stats_calls = 0;
+    TEST_OK(send_aggregate_stats_request(0, 0, 0));
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(fwd_flow_stats_calls == count);
+    TEST_ASSERT(aggregate_flows == count);
+
+    /* Prefix queries are answered from the totals kept by the poller */
+    FT_ITER(ind_core_ft, entry, cur, next) {
+        packets = entry->cookie == 0x1 ? 3 : 5;
+        indigo_core_flow_counters_update(entry->id, packets, packets * 100);
+    }
+
+    table_counters_sync_supported = true;
+    table_counters_sync_calls = 0;
+    fwd_flow_stats_calls = 0;
+    TEST_OK(send_aggregate_stats_request(0, 0, 0));
+    TEST_ASSERT(aggregate_flows == count);
+    TEST_ASSERT(aggregate_packets == (count / 2) * (3 + 5));
+    TEST_ASSERT(aggregate_bytes == (count / 2) * (3 + 5) * 100);
+    TEST_OK(send_aggregate_stats_request(0x1, ~0ULL, 0));
+    TEST_ASSERT(aggregate_flows == count / 2);
+    TEST_ASSERT(aggregate_packets == (count / 2) * 3);
+    TEST_ASSERT(fwd_flow_stats_calls == 0);
+    TEST_ASSERT(table_counters_sync_calls > 0);
+
+    /* A match filter needs the iterator */
+    TEST_OK(send_aggregate_stats_request(0x1, ~0ULL, 2));
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(fwd_flow_stats_calls == 1);
+    TEST_ASSERT(aggregate_flows == 1);
+
+    /*
+     * Stale totals are not served; the flows are read again, and their
+     * counters (all 0 here) replace what the totals hold
+     */
+    table_counters_stale = true;
+    fwd_flow_stats_calls = 0;
+    TEST_OK(send_aggregate_stats_request(0x1, ~0ULL, 0));
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(fwd_flow_stats_calls == count / 2);
+    TEST_ASSERT(aggregate_flows == count / 2);
+    TEST_ASSERT(aggregate_packets == 0);
+    table_counters_stale = false;
+
+    fwd_flow_stats_calls = 0;
+    TEST_OK(send_aggregate_stats_request(0x1, ~0ULL, 0));
+    TEST_ASSERT(fwd_flow_stats_calls == 0);
+    TEST_ASSERT(aggregate_packets == 0);
+    TEST_ASSERT(aggregate_bytes == 0);
+
+    ind_core_aggregate_stats_paths_get(&paths);
+    TEST_ASSERT(paths.totals == before.totals + 3);
+    TEST_ASSERT(paths.iterated == before.iterated + 3);
+
+    table_counters_sync_supported = false;
+    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
+
+    return TEST_PASS;
+}
+
+static int
+send_table_stats_request(void)
+{
+    of_table_stats_request_t *req;
+
+    req = of_table_stats_request_new(OF_VERSION_1_3);
+    TEST_ASSERT(req != NULL);
+    handle_message(req);
+
+    return 0;
+}
+
+/*
+ * Table stats take the active count from the flowtable and the matched
+ * count from the reported flow counters, which survive flow deletes
+ */
+int
+test_table_stats(void)
+{
+    const int count = 10;
+    list_links_t *cur, *next;
+    ft_entry_t *entry;
+    uint64_t removed;
+    int idx;
+
+    removed = FT_TABLE(ind_core_ft, 0)->status.removed_packets;
+
+    for (idx = 0; idx < count; idx++) {
+        TEST_OK(send_replace_flow(idx, 1, 0, 0, 0));
+    }
+    TEST_INDIGO_OK(do_barrier());
+
+    FT_ITER(ind_core_ft, entry, cur, next) {
+        indigo_core_flow_counters_update(entry->id, 7, 700);
+    }
+
+    fwd_flow_stats_calls = 0;
+    TEST_OK(send_table_stats_request());
+    TEST_ASSERT(table_stats_active == count);
+    TEST_ASSERT(table_stats_matched == removed + count * 7);
+    TEST_ASSERT(fwd_flow_stats_calls == 0);
+
+    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
+
+    TEST_OK(send_table_stats_request());
+    TEST_ASSERT(table_stats_active == 0);
+    TEST_ASSERT(table_stats_matched == removed + count * 7);
+
+    return TEST_PASS;
+}
+
+/*
+ * Adds to a table with no headroom fail as table full before reaching
+ * forwarding, and deletes make room again
+ */
+int
+test_table_capacity(void)
+{
+    const int headroom = 8;
+    ft_table_t *table = FT_TABLE(ind_core_ft, 0);
+    list_links_t *cur, *next;
+    ft_entry_t *entry;
+    uint64_t full_errors;
+    uint32_t free_entries;
+    int idx, errors;
+
+    TEST_ASSERT(indigo_core_table_headroom_get(0, &free_entries) ==
+                INDIGO_ERROR_NOT_SUPPORTED);
+
+    /* Forwarding holds entries of its own besides the flowtable's */
+    ft_table_capacity_set(ind_core_ft, 0, 64, 64 - headroom);
+    TEST_ASSERT(table->tuple_buckets == 64);
+    TEST_INDIGO_OK(indigo_core_table_headroom_get(0, &free_entries));
+    TEST_ASSERT(free_entries == headroom);
+
+    errors = error_reply_count;
+    full_errors = table->status.table_full_errors;
+    for (idx = 0; idx < headroom; idx++) {
+        TEST_OK(send_replace_flow(idx, 1, 0, 0, 0));
+    }
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(error_reply_count == errors);
+    TEST_ASSERT(ft_table_headroom(ind_core_ft, 0) == 0);
+
+    /* New tuples were sized for the table */
+    FT_ITER(ind_core_ft, entry, cur, next) {
+        TEST_ASSERT(entry->tuple->hash.min_buckets_size == 64);
+    }
+
+    /* The add is refused without a call to forwarding */
+    fwd_create_calls = 0;
+    TEST_OK(send_replace_flow(headroom, 1, 0, 0, 0));
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(fwd_create_calls == 0);
+    TEST_ASSERT(error_reply_count == errors + 1);
+    TEST_ASSERT(last_error_code ==
+                OF_FLOW_MOD_FAILED_TABLE_FULL_BY_VERSION(OF_VERSION_1_3));
+    TEST_ASSERT(table->status.table_full_errors == full_errors + 1);
+
+    /* Replacing a flow takes no more room */
+    TEST_OK(send_replace_flow(0, 2, 0, 0, 0));
+    TEST_INDIGO_OK(do_barrier());
+    TEST_ASSERT(error_reply_count == errors + 1);
+
+    TEST_ASSERT(delete_all_entries(ind_core_ft) == TEST_PASS);
+    TEST_ASSERT(ft_table_headroom(ind_core_ft, 0) == headroom);
+
+    ft_table_capacity_set(ind_core_ft, 0, 0, 0);
+    TEST_ASSERT(ft_table_headroom(ind_core_ft, 0) == UINT32_MAX);
+    TEST_ASSERT(table->tuple_buckets == 16);
+
     return TEST_PASS;
 }
 
@@ -1424,6 +3688,140 @@ test_message_listeners(void)
     return TEST_PASS;
 }
 
+/*
+ * Churn the flow ID map with interleaved inserts and removes, checking
+ * every lookup against a shadow array.
+ */
+static int
+test_ft_id_map(void)
+{
+    const int num_entries = 20000;
+    ft_entry_t *entries;
+    bool *present;
+    ft_id_map_t map;
+    int i, round;
+
+    entries = aim_zmalloc(sizeof(*entries) * num_entries);
+    present = aim_zmalloc(sizeof(*present) * num_entries);
+
+    ft_id_map_init(&map, 64);
+
+    for (i = 0; i < num_entries; i++) {
+        /* Sparse IDs so lookups of absent keys are exercised */
+        entries[i].id = (uint64_t)i * 0x10001;
+    }
+
+    for (round = 0; round < 8; round++) {
+        for (i = 0; i < num_entries; i++) {
+            int idx = (i * 7919 + round * 104729) % num_entries;
+            if (present[idx]) {
+                ft_id_map_remove(&map, &entries[idx]);
+                present[idx] = false;
+            } else if ((idx + round) % 3 != 0) {
+                ft_id_map_insert(&map, &entries[idx]);
+                present[idx] = true;
+            }
+            if (round & 1) {
+                ft_id_map_rehash_step(&map, 1);
+            }
+        }
+
+        for (i = 0; i < num_entries; i++) {
+            ft_entry_t *expected = present[i] ? &entries[i] : NULL;
+            TEST_ASSERT(ft_id_map_lookup(&map, entries[i].id) == expected);
+            TEST_ASSERT(ft_id_map_lookup(&map, entries[i].id + 1) == NULL);
+        }
+    }
+
+    for (i = 0; i < num_entries; i++) {
+        if (present[i]) {
+            ft_id_map_remove(&map, &entries[i]);
+        }
+    }
+    TEST_ASSERT(ft_id_map_count(&map) == 0);
+
+    ft_id_map_cleanup(&map);
+    aim_free(present);
+    aim_free(entries);
+
+    return TEST_PASS;
+}
+
+/*
+ * Grow the hash indexes well past their initial size, checking lookups
+ * while the rehash is in progress, then shrink them back down.
+ */
+static int
+test_ft_hash_resize(void)
+{
+    ft_instance_t ft;
+    ft_config_t config = {
+        16, /* strict_match buckets */
+        16, /* flow_id buckets */
+    };
+    const int num_flows = 4096;
+    ft_entry_t **entries;
+    ft_entry_t *entry;
+    of_meta_match_t query;
+    bool saw_rehash = false;
+    int i;
+
+    entries = aim_zmalloc(sizeof(*entries) * num_flows);
+    ft = ft_create(&config);
+    TEST_ASSERT(ft->flow_id_map.table.size == 16);
+
+    for (i = 0; i < num_flows; i++) {
+        TEST_OK(add_flow(ft, i, &entries[i]));
+        if (ft_hash_rehashing(&ft->strict_match_hash)) {
+            saw_rehash = true;
+            /* Every entry must be reachable mid-rehash */
+            TEST_ASSERT(ft_lookup(ft, i / 2) == entries[i / 2]);
+            TEST_ASSERT(check_bucket_counts(ft, i + 1) == 0);
+        }
+    }
+    TEST_ASSERT(saw_rehash);
+
+    /* Let the rehash task finish */
+    while (ft_id_map_rehashing(&ft->flow_id_map) ||
+           ft_hash_rehashing(&ft->strict_match_hash)) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(ft->rehash_task == NULL);
+    TEST_ASSERT(ft->flow_id_map.table.size >= num_flows);
+    TEST_ASSERT(ft->strict_match_hash.buckets_size >= num_flows / FT_HASH_MAX_LOAD);
+    TEST_ASSERT(check_bucket_counts(ft, num_flows) == 0);
+
+    for (i = 0; i < num_flows; i++) {
+        TEST_ASSERT(ft_lookup(ft, i) == entries[i]);
+
+        memset(&query, 0, sizeof(query));
+        query.mode = OF_MATCH_STRICT;
+        query.table_id = TABLE_ID_ANY;
+        query.out_port = OF_PORT_DEST_WILDCARD;
+        query.match = entries[i]->match;
+        query.priority = entries[i]->priority;
+        TEST_INDIGO_OK(ft_strict_match(ft, &query, &entry));
+        TEST_ASSERT(of_match_eq(&entry->match, &entries[i]->match));
+    }
+
+    /* Delete all but one flow; the indexes shrink back */
+    for (i = 0; i < num_flows - 1; i++) {
+        ft_delete(ft, entries[i]);
+    }
+    while (ft->rehash_task != NULL) {
+        ind_soc_select_and_run(0);
+    }
+    TEST_ASSERT(ft->flow_id_map.table.size == 16);
+    TEST_ASSERT(ft->strict_match_hash.buckets_size == 16);
+    TEST_ASSERT(check_bucket_counts(ft, 1) == 0);
+    TEST_ASSERT(ft_lookup(ft, num_flows - 1) == entries[num_flows - 1]);
+
+    ft_destroy(ft);
+    aim_free(entries);
+
+    return TEST_PASS;
+}
+
 int
 aim_main(int argc, char* argv[])
 {
@@ -1436,6 +3834,22 @@ aim_main(int argc, char* argv[])
     RUN_TEST(ft_hash);
     RUN_TEST(ft_iterator);
     RUN_TEST(ft_iter_task);
+    RUN_TEST(ft_hash_resize);
+    RUN_TEST(ft_id_map);
+    RUN_TEST(ft_tuple);
+    RUN_TEST(ft_tuple_benchmark);
+    RUN_TEST(ft_overlap);
+    RUN_TEST(ft_overlap_benchmark);
+    RUN_TEST(ft_slab);
+    RUN_TEST(ft_churn_benchmark);
+    RUN_TEST(ft_effects);
+    RUN_TEST(ft_out_index);
+    RUN_TEST(ft_cookie);
+    RUN_TEST(ft_tables);
+
+    if (test_expiration() != TEST_PASS) {
+        return 1;
+    }
 
     /* Init Core */
     MEMSET(&core, 0, sizeof(core));
@@ -1455,6 +3869,14 @@ aim_main(int argc, char* argv[])
     RUN_TEST(exact_add_del);
     RUN_TEST(modify);
     RUN_TEST(modify_strict);
+    RUN_TEST(idle_expiration_benchmark);
+    RUN_TEST(flow_add_batching);
+    RUN_TEST(flow_add_replace);
+    RUN_TEST(bundle);
+    RUN_TEST(flow_stats);
+    RUN_TEST(aggregate_stats);
+    RUN_TEST(table_stats);
+    RUN_TEST(table_capacity);
 
     RUN_TEST(packet_in_listeners);
     RUN_TEST(port_status_listeners);
@@ -62,6 +62,12 @@ extern indigo_error_t indigo_fwd_forwarding_features_get(
  *
  * Create a flow for the forwarding engine.
  *
+ * Forwarding may queue the flow and return INDIGO_ERROR_PENDING, in which
+ * case table_id is not set. It must then report the result later with
+ * indigo_core_flow_create_complete, once per pending flow and in the
+ * order the flows were created. Pending flows must reach the hardware in
+ * that order, and before any other operation on flows or groups.
+ *
  * Ownership of the flow_add LOXI object is maintained by the
  * caller (OF state manager).
  */
@@ -71,6 +77,74 @@ extern indigo_error_t indigo_fwd_flow_create(
     of_flow_add_t *flow_add,
     uint8_t *table_id);
 
+/**
+ * @brief Check that a flow can be created
+ * @param flow_add The LOXI flow add object
+ * @return Return code from operation
+ *
+ * Translate the flow as indigo_fwd_flow_create would, without programming
+ * it. Used to check bundled flow adds when they are staged, so errors
+ * are reported before the bundle is committed. Returning
+ * INDIGO_ERROR_NONE does not guarantee the create will succeed.
+ *
+ * Forwarding may keep the translation for an indigo_fwd_flow_create of
+ * the same flow_add object, until indigo_fwd_flow_release is called.
+ *
+ * Ownership of the flow_add LOXI object is maintained by the
+ * caller (OF state manager).
+ */
+
+extern indigo_error_t indigo_fwd_flow_validate(
+    of_flow_add_t *flow_add);
+
+/**
+ * @brief Drop what forwarding kept of a validated flow
+ * @param flow_add The LOXI flow add object passed to indigo_fwd_flow_validate
+ *
+ * Called before the flow_add object is freed, whether or not it was
+ * created.
+ */
+
+extern void indigo_fwd_flow_release(
+    of_flow_add_t *flow_add);
+
+/**
+ * @brief Stage the flow changes of a bundle
+ * @return INDIGO_ERROR_NOT_SUPPORTED if changes are made as they are called
+ *
+ * Until indigo_fwd_bundle_commit or indigo_fwd_bundle_abort, flow creates,
+ * modifies and deletes are checked and recorded but not programmed. They
+ * return as if they were made: creates do not return INDIGO_ERROR_PENDING,
+ * and deletes report the counters the flow has now.
+ */
+
+extern indigo_error_t indigo_fwd_bundle_begin(void);
+
+/**
+ * @brief Make the staged flow changes, in the order they were staged
+ * @return The first error
+ *
+ * On error, forwarding undoes the changes it made before the failing one
+ * and the staged changes are dropped.
+ */
+
+extern indigo_error_t indigo_fwd_bundle_commit(void);
+
+/**
+ * @brief Drop the staged flow changes without making them
+ */
+
+extern void indigo_fwd_bundle_abort(void);
+
+/**
+ * @brief Flush pending operations
+ *
+ * Submit any flows queued by indigo_fwd_flow_create and report their
+ * results. Called when a barrier is waiting on them.
+ */
+
+extern void indigo_fwd_flush(void);
+
 /**
  * @brief Modify an existing flow.
  * @param flow_id Flow identifier
@@ -91,9 +165,10 @@ extern indigo_error_t indigo_fwd_flow_modify(
 /**
  * @brief Flow delete
  * @param flow_id Flow identifier
- * @param [out] flow_stats Statistics for flow
+ * @param [out] flow_stats Statistics for flow, or NULL
  *
- * Delete a flow from the forwarding engine.
+ * Delete a flow from the forwarding engine.  flow_stats is NULL when
+ * the caller does not need the final statistics of the flow.
  */
 
 extern indigo_error_t indigo_fwd_flow_delete(
@@ -113,6 +188,41 @@ extern indigo_error_t indigo_fwd_flow_stats_get(
     indigo_cookie_t flow_id,
     indigo_fi_flow_stats_t *flow_stats);
 
+/**
+ * @brief Check the reported counters of a table's flows are kept current
+ * @param table_id The table
+ * @return INDIGO_ERROR_NONE if every flow of the table has been reported
+ * and forwarding keeps reporting them in the background;
+ * INDIGO_ERROR_PENDING if it has started to but has not covered the
+ * table yet; INDIGO_ERROR_NOT_SUPPORTED if counters are not reported
+ *
+ * Called before aggregate stats are answered from the counters reported
+ * through indigo_core_flow_counters_update, so the answer is as old as
+ * forwarding's last background pass. It must not read the counters
+ * itself. On any error, aggregate stats read the counters of every flow
+ * instead.
+ */
+
+extern indigo_error_t indigo_fwd_table_counters_sync(
+    uint8_t table_id);
+
+/**
+ * @brief Capacity of a flow table
+ * @param table_id The table
+ * @param [out] max_entries Most flows the table can hold
+ * @param [out] used_entries Flows the table holds now
+ * @return INDIGO_ERROR_NOT_SUPPORTED if the capacity is not known
+ *
+ * Called by the state manager at init, when it holds no flows. It then
+ * counts flows added and deleted against the capacity itself, and sizes
+ * its flowtable from the capacities.
+ */
+
+extern indigo_error_t indigo_fwd_table_capacity_get(
+    uint8_t table_id,
+    uint32_t *max_entries,
+    uint32_t *used_entries);
+
 /**
  * @brief Flow hit status
  * @param flow_id The ID of the flow whose hit status is to be retrieved
@@ -125,6 +235,27 @@ extern indigo_error_t indigo_fwd_flow_hit_status_get(
     indigo_cookie_t flow_id,
     bool *hit_status);
 
+/**
+ * @brief Bulk flow hit status
+ * @param num_flows Number of flows
+ * @param flow_ids The IDs of the flows whose hit status is to be retrieved
+ * @param [out] hit_status True for each entry hit since its status was last
+ * retrieved
+ * @param [out] results Result of the operation for each flow
+ * @return INDIGO_ERROR_NONE if the per-flow results are valid
+ *
+ * Get the hit status of several existing flows at once, so that idle
+ * timeout processing does not need a round trip per flow. Return
+ * INDIGO_ERROR_NOT_SUPPORTED if the forwarding engine does not implement
+ * this; indigo_fwd_flow_hit_status_get is then called for each flow.
+ */
+
+extern indigo_error_t indigo_fwd_flow_hit_status_get_bulk(
+    int num_flows,
+    const indigo_cookie_t *flow_ids,
+    bool *hit_status,
+    indigo_error_t *results);
+
 /**
  * @brief Table stats
  * @param table_stats_request The LOXI request
@@ -133,6 +264,10 @@ extern indigo_error_t indigo_fwd_flow_hit_status_get(
  *
  * Ownership of the table_stats_request LOXI object is maintained by the
  * caller (OF state manager).
+ *
+ * Forwarding lists its tables. The state manager then sets the active
+ * count of each from its flowtable, and the matched count from the
+ * counters reported through indigo_core_flow_counters_update.
  */
 
 extern indigo_error_t indigo_fwd_table_stats_get(
@@ -155,6 +155,62 @@ extern void indigo_core_flow_removed(
     indigo_fi_flow_removed_t reason,
     indigo_fi_flow_stats_t *stats);
 
+/**
+ * @brief Report the result of a pending flow create
+ * @param flow_id The flow passed to indigo_fwd_flow_create
+ * @param result INDIGO_ERROR_NONE if the flow was installed
+ * @param table_id Table the flow was installed in
+ *
+ * This call is made from forwarding to the state manager for each flow
+ * for which indigo_fwd_flow_create returned INDIGO_ERROR_PENDING, in the
+ * order the flows were created. It must be made from the event loop, not
+ * from within another call into forwarding.
+ *
+ * On failure the error is sent to the controller that added the flow and
+ * the flow is removed from the state manager. Barriers wait for pending
+ * flows.
+ */
+
+extern void indigo_core_flow_create_complete(
+    indigo_cookie_t flow_id,
+    indigo_error_t result,
+    uint8_t table_id);
+
+/**
+ * @brief Report the current counters of a flow
+ * @param flow_id The flow passed to indigo_fwd_flow_create
+ * @param packets Packet count
+ * @param bytes Byte count
+ *
+ * Forwarding may call this whenever it reads a flow's counters, such as
+ * from a background poller. The state manager keeps running totals per
+ * table and cookie prefix from them, to answer aggregate stats requests
+ * without reading every flow. Unknown flows are ignored. It must be made
+ * from the event loop.
+ */
+
+extern void indigo_core_flow_counters_update(
+    indigo_cookie_t flow_id,
+    uint64_t packets,
+    uint64_t bytes);
+
+/**
+ * @brief Get the number of flows that can still be added to a table
+ * @param table_id The table
+ * @param [out] headroom Free entries
+ * @return INDIGO_ERROR_NOT_SUPPORTED if forwarding did not report the
+ * table's capacity
+ *
+ * The state manager tracks each table against the capacity reported by
+ * indigo_fwd_table_capacity_get at init, counting flows on add and
+ * delete. Adds to a table with no headroom fail with a table full error
+ * before reaching forwarding.
+ */
+
+extern indigo_error_t indigo_core_table_headroom_get(
+    uint8_t table_id,
+    uint32_t *headroom);
+
 /****************************************************************
  * Asynchronous connection manager notification, disconnection mode
  ****************************************************************/
@@ -181,6 +237,18 @@ indigo_core_disconnected_mode_get(indigo_core_disconnected_mode_t *mode);
 extern void indigo_core_connection_count_notify(
     int new_count);
 
+/**
+ * @brief Notify state manager that a barrier is waiting
+ * @param cxn_id The connection that sent the barrier
+ *
+ * This call is made from the connection manager to the state manager
+ * when a barrier request arrives while operations are outstanding, so
+ * that operations held back for batching can be submitted right away.
+ */
+
+extern void indigo_core_barrier_notify(
+    indigo_cxn_id_t cxn_id);
+
 
 /**
  * @brief Returns state manager statistics.
@@ -407,6 +475,19 @@ typedef struct indigo_core_table_ops_s {
      * @param [out] hit_status True if entry hit since last time API was called
      */
     indigo_error_t (*entry_hit_status_get)(void *table_priv, void *entry_priv, bool *hit_status);
+
+    /**
+     * Retrieve and reset hit status for several entries
+     * @param table_priv Private data passed to indigo_core_table_register
+     * @param num_entries Number of entries
+     * @param entry_privs Private data returned by entry_create for each entry
+     * @param [out] hit_status True for each entry hit since last time API was called
+     * @param [out] results Result of the operation for each entry
+     * @return INDIGO_ERROR_NONE if the per-entry results are valid
+     *
+     * Optional. If NULL, entry_hit_status_get is called for each entry.
+     */
+    indigo_error_t (*entry_hit_status_get_bulk)(void *table_priv, int num_entries, void **entry_privs, bool *hit_status, indigo_error_t *results);
 } indigo_core_table_ops_t;
 
 /**
@@ -0,0 +1,278 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2013-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_flow_tables.h
+*
+* @purpose      Match rules of the OF-DPA flow tables
+*
+* @component    OF-DPA
+*
+* @comments     Each flow table is described once here; ind_ofdpa_fwd.c
+*               expands these lists into one match translator per table
+*               and the table lookup used for flow_mods. Adding a table
+*               means adding its field list and a line to each of
+*               IND_OFDPA_FLOW_MATCHES and IND_OFDPA_FLOW_TABLES.
+*
+*               Match field entries, all within flowData.<member>.match_criteria
+*               (IND_OFDPA_MF_ prefix omitted):
+*
+*               VALUE(member, field, ofField)
+*                 field = match->fields.ofField
+*               MASKED(member, field, ofField)
+*                 as VALUE, and fieldMask = match->masks.ofField
+*               VALUE_AND(member, field, ofField, mask)
+*                 field = match->fields.ofField & mask
+*               MASKED_AND(member, field, ofField, mask)
+*                 as VALUE, and fieldMask = match->masks.ofField & mask
+*               BOTH_AND(member, field, ofField, mask)
+*                 as VALUE_AND, and fieldMask = match->masks.ofField & mask
+*               MAC(member, field, ofField)
+*                 MAC address and mask
+*               IPV6(member, field, ofField)
+*                 IPv6 address only
+*               IPV6_MASKED(member, field, ofField)
+*                 IPv6 address and mask
+*               CALL(function)
+*                 function(match, flow) for fields that depend on the match
+*
+* @end
+*
+**********************************************************************/
+
+#ifndef INCLUDE_IND_OFDPA_FLOW_TABLES_H
+#define INCLUDE_IND_OFDPA_FLOW_TABLES_H
+
+#define IND_OFDPA_VID_MASK  (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK)
+#define IND_OFDPA_MDL_MASK  OFDPA_OAM_Y1731_MDL_EXACT_MASK
+
+#define IND_OFDPA_INGRESS_PORT_MATCH \
+  IND_OFDPA_MF_MASKED(ingressPortFlowEntry, inPort, in_port) \
+  IND_OFDPA_MF_MASKED(ingressPortFlowEntry, tunnelId, tunnel_id) \
+  IND_OFDPA_MF_MASKED(ingressPortFlowEntry, etherType, eth_type) \
+  IND_OFDPA_MF_MASKED(ingressPortFlowEntry, lmepId, ofdpa_lmep_id)
+
+#define IND_OFDPA_INJECTED_OAM_MATCH \
+  IND_OFDPA_MF_VALUE(injectedOamFlowEntry, lmepId, ofdpa_lmep_id)
+
+#define IND_OFDPA_VLAN_MATCH \
+  IND_OFDPA_MF_VALUE(vlanFlowEntry, inPort, in_port) \
+  IND_OFDPA_MF_BOTH_AND(vlanFlowEntry, vlanId, vlan_vid, IND_OFDPA_VID_MASK)
+
+#define IND_OFDPA_VLAN_1_MATCH \
+  IND_OFDPA_MF_VALUE(vlan1FlowEntry, inPort, in_port) \
+  IND_OFDPA_MF_VALUE_AND(vlan1FlowEntry, vlanId, vlan_vid, IND_OFDPA_VID_MASK) \
+  IND_OFDPA_MF_VALUE(vlan1FlowEntry, ovid, ofdpa_ovid)
+
+#define IND_OFDPA_MAINTENANCE_POINT_MATCH \
+  IND_OFDPA_MF_MASKED(mpFlowEntry, etherType, eth_type) \
+  IND_OFDPA_MF_MASKED_AND(mpFlowEntry, oamY1731Mdl, ofdpa_oam_y1731_mdl, IND_OFDPA_MDL_MASK) \
+  IND_OFDPA_MF_MASKED(mpFlowEntry, oamY1731Opcode, ofdpa_oam_y1731_opcode) \
+  IND_OFDPA_MF_VALUE(mpFlowEntry, inPort, in_port) \
+  IND_OFDPA_MF_BOTH_AND(mpFlowEntry, vlanId, vlan_vid, IND_OFDPA_VID_MASK) \
+  IND_OFDPA_MF_MAC(mpFlowEntry, destMac, eth_dst)
+
+#define IND_OFDPA_MPLS_L2_PORT_MATCH \
+  IND_OFDPA_MF_MASKED(mplsL2PortFlowEntry, mplsL2Port, ofdpa_mpls_l2_port) \
+  IND_OFDPA_MF_MASKED(mplsL2PortFlowEntry, etherType, eth_type) \
+  IND_OFDPA_MF_VALUE(mplsL2PortFlowEntry, tunnelId, tunnel_id)
+
+#define IND_OFDPA_TERMINATION_MAC_MATCH \
+  IND_OFDPA_MF_MASKED(terminationMacFlowEntry, inPort, in_port) \
+  IND_OFDPA_MF_VALUE(terminationMacFlowEntry, etherType, eth_type) \
+  IND_OFDPA_MF_MAC(terminationMacFlowEntry, destMac, eth_dst) \
+  IND_OFDPA_MF_MASKED_AND(terminationMacFlowEntry, vlanId, vlan_vid, IND_OFDPA_VID_MASK)
+
+#define IND_OFDPA_MPLS_MATCH \
+  IND_OFDPA_MF_VALUE(mplsFlowEntry, etherType, eth_type) \
+  IND_OFDPA_MF_VALUE(mplsFlowEntry, mplsBos, mpls_bos) \
+  IND_OFDPA_MF_VALUE(mplsFlowEntry, mplsLabel, mpls_label) \
+  IND_OFDPA_MF_MASKED(mplsFlowEntry, inPort, in_port) \
+  IND_OFDPA_MF_MASKED(mplsFlowEntry, mplsTtl, ofdpa_mpls_ttl) \
+  IND_OFDPA_MF_MASKED(mplsFlowEntry, mplsDataFirstNibble, ofdpa_mpls_data_first_nibble) \
+  IND_OFDPA_MF_MASKED(mplsFlowEntry, mplsAchChannel, ofdpa_mpls_ach_channel) \
+  IND_OFDPA_MF_MASKED(mplsFlowEntry, nextLabelIsGal, ofdpa_mpls_next_label_is_gal) \
+  IND_OFDPA_MF_MASKED(mplsFlowEntry, destIp4, ipv4_dst) \
+  IND_OFDPA_MF_IPV6_MASKED(mplsFlowEntry, destIp6, ipv6_dst) \
+  IND_OFDPA_MF_MASKED(mplsFlowEntry, ipProto, ip_proto) \
+  IND_OFDPA_MF_MASKED(mplsFlowEntry, udpSrcPort, udp_src) \
+  IND_OFDPA_MF_MASKED(mplsFlowEntry, udpDstPort, udp_dst)
+
+#define IND_OFDPA_MPLS_MAINTENANCE_POINT_MATCH \
+  IND_OFDPA_MF_VALUE(mplsMpFlowEntry, lmepId, ofdpa_lmep_id) \
+  IND_OFDPA_MF_VALUE(mplsMpFlowEntry, oamY1731Opcode, ofdpa_oam_y1731_opcode) \
+  IND_OFDPA_MF_VALUE(mplsMpFlowEntry, etherType, eth_type)
+
+#define IND_OFDPA_UNICAST_ROUTING_MATCH \
+  IND_OFDPA_MF_VALUE(unicastRoutingFlowEntry, etherType, eth_type) \
+  IND_OFDPA_MF_MASKED(unicastRoutingFlowEntry, vrf, ofdpa_vrf) \
+  IND_OFDPA_MF_MASKED(unicastRoutingFlowEntry, dstIp4, ipv4_dst) \
+  IND_OFDPA_MF_IPV6_MASKED(unicastRoutingFlowEntry, dstIp6, ipv6_dst)
+
+#define IND_OFDPA_MULTICAST_ROUTING_MATCH \
+  IND_OFDPA_MF_VALUE(multicastRoutingFlowEntry, etherType, eth_type) \
+  IND_OFDPA_MF_VALUE(multicastRoutingFlowEntry, vlanId, vlan_vid) \
+  IND_OFDPA_MF_MASKED(multicastRoutingFlowEntry, vrf, ofdpa_vrf) \
+  IND_OFDPA_MF_MASKED(multicastRoutingFlowEntry, srcIp4, ipv4_src) \
+  IND_OFDPA_MF_VALUE(multicastRoutingFlowEntry, dstIp4, ipv4_dst) \
+  IND_OFDPA_MF_IPV6_MASKED(multicastRoutingFlowEntry, srcIp6, ipv6_src) \
+  IND_OFDPA_MF_IPV6(multicastRoutingFlowEntry, dstIp6, ipv6_dst)
+
+#define IND_OFDPA_BRIDGING_MATCH \
+  IND_OFDPA_MF_MASKED_AND(bridgingFlowEntry, vlanId, vlan_vid, IND_OFDPA_VID_MASK) \
+  IND_OFDPA_MF_MASKED(bridgingFlowEntry, tunnelId, tunnel_id) \
+  IND_OFDPA_MF_MAC(bridgingFlowEntry, destMac, eth_dst)
+
+#define IND_OFDPA_L2_POLICER_MATCH \
+  IND_OFDPA_MF_VALUE(l2PolicerFlowEntry, tunnelId, tunnel_id) \
+  IND_OFDPA_MF_MASKED(l2PolicerFlowEntry, mplsL2Port, ofdpa_mpls_l2_port)
+
+#define IND_OFDPA_L2_POLICER_ACTIONS_MATCH \
+  IND_OFDPA_MF_VALUE(l2PolicerActionsFlowEntry, color, ofdpa_color) \
+  IND_OFDPA_MF_VALUE(l2PolicerActionsFlowEntry, colorActionsIndex, ofdpa_color_actions_index)
+
+#define IND_OFDPA_DSCP_TRUST_MATCH \
+  IND_OFDPA_MF_VALUE(dscpTrustFlowEntry, qosIndex, ofdpa_qos_index) \
+  IND_OFDPA_MF_VALUE(dscpTrustFlowEntry, dscpValue, ip_dscp) \
+  IND_OFDPA_MF_MASKED(dscpTrustFlowEntry, mplsL2Port, ofdpa_mpls_l2_port)
+
+#define IND_OFDPA_PCP_TRUST_MATCH \
+  IND_OFDPA_MF_VALUE(pcpTrustFlowEntry, qosIndex, ofdpa_qos_index) \
+  IND_OFDPA_MF_VALUE(pcpTrustFlowEntry, pcpValue, vlan_pcp) \
+  IND_OFDPA_MF_VALUE(pcpTrustFlowEntry, dei, ofdpa_dei) \
+  IND_OFDPA_MF_MASKED(pcpTrustFlowEntry, mplsL2Port, ofdpa_mpls_l2_port)
+
+#define IND_OFDPA_ACL_POLICY_MATCH \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, inPort, in_port) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, mplsL2Port, ofdpa_mpls_l2_port) \
+  IND_OFDPA_MF_MAC(policyAclFlowEntry, srcMac, eth_src) \
+  IND_OFDPA_MF_MAC(policyAclFlowEntry, destMac, eth_dst) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, etherType, eth_type) \
+  IND_OFDPA_MF_MASKED_AND(policyAclFlowEntry, vlanId, vlan_vid, IND_OFDPA_VID_MASK) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, vlanPcp, vlan_pcp) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, vlanDei, ofdpa_dei) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, tunnelId, tunnel_id) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, vrf, ofdpa_vrf) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, sourceIp4, ipv4_src) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, destIp4, ipv4_dst) \
+  IND_OFDPA_MF_IPV6_MASKED(policyAclFlowEntry, sourceIp6, ipv6_src) \
+  IND_OFDPA_MF_IPV6_MASKED(policyAclFlowEntry, destIp6, ipv6_dst) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, ipv4ArpSpa, arp_spa) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, ipProto, ip_proto) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, dscp, ip_dscp) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, ecn, ip_ecn) \
+  IND_OFDPA_MF_CALL(ind_ofdpa_acl_policy_l4_match_get) \
+  IND_OFDPA_MF_MASKED(policyAclFlowEntry, ipv6FlowLabel, ipv6_flabel)
+
+#define IND_OFDPA_COLOR_BASED_ACTIONS_MATCH \
+  IND_OFDPA_MF_VALUE(colorActionsFlowEntry, color, ofdpa_color) \
+  IND_OFDPA_MF_VALUE(colorActionsFlowEntry, index, ofdpa_color_actions_index)
+
+#define IND_OFDPA_EGRESS_VLAN_MATCH \
+  IND_OFDPA_MF_VALUE(egressVlanFlowEntry, outPort, onf_actset_output) \
+  IND_OFDPA_MF_VALUE(egressVlanFlowEntry, vlanId, vlan_vid) \
+  IND_OFDPA_MF_VALUE(egressVlanFlowEntry, allowVlanTranslation, ofdpa_allow_vlan_translation)
+
+#define IND_OFDPA_EGRESS_VLAN_1_MATCH \
+  IND_OFDPA_MF_VALUE(egressVlan1FlowEntry, outPort, onf_actset_output) \
+  IND_OFDPA_MF_VALUE(egressVlan1FlowEntry, vlanId, vlan_vid) \
+  IND_OFDPA_MF_VALUE(egressVlan1FlowEntry, ovid, ofdpa_ovid)
+
+#define IND_OFDPA_EGRESS_MAINTENANCE_POINT_MATCH \
+  IND_OFDPA_MF_VALUE(egressMpFlowEntry, outPort, onf_actset_output) \
+  IND_OFDPA_MF_MASKED_AND(egressMpFlowEntry, vlanId, vlan_vid, IND_OFDPA_VID_MASK) \
+  IND_OFDPA_MF_MASKED(egressMpFlowEntry, etherType, eth_type) \
+  IND_OFDPA_MF_MASKED_AND(egressMpFlowEntry, oamY1731Mdl, ofdpa_oam_y1731_mdl, IND_OFDPA_MDL_MASK) \
+  IND_OFDPA_MF_MASKED(egressMpFlowEntry, oamY1731Opcode, ofdpa_oam_y1731_opcode) \
+  IND_OFDPA_MF_MAC(egressMpFlowEntry, destMac, eth_dst)
+
+#define IND_OFDPA_EGRESS_DSCP_PCP_REMARK_MATCH \
+  IND_OFDPA_MF_MASKED(egressDscpPcpRemarkFlowEntry, etherType, eth_type) \
+  IND_OFDPA_MF_VALUE(egressDscpPcpRemarkFlowEntry, outPort, onf_actset_output) \
+  IND_OFDPA_MF_VALUE(egressDscpPcpRemarkFlowEntry, trafficClass, ofdpa_traffic_class) \
+  IND_OFDPA_MF_VALUE(egressDscpPcpRemarkFlowEntry, color, ofdpa_color)
+
+/*
+ * One entry per match translator:
+ *   M(name, allowed fields, mandatory fields, alternative mandatory fields)
+ * A flow must use only allowed fields and all of either set of mandatory
+ * fields; 0 means there is no alternative set.
+ */
+#define IND_OFDPA_FLOW_MATCHES(M) \
+  M(INGRESS_PORT,            IND_OFDPA_ING_PORT_FLOW_MATCH_BITMAP,              IND_OFDPA_ING_PORT_FLOW_MATCH_MAND_BITMAP,            0) \
+  M(INJECTED_OAM,            IND_OFDPA_INJECTED_OAM_FLOW_MATCH_BITMAP,          IND_OFDPA_INJECTED_OAM_FLOW_MATCH_MAND_BITMAP,        0) \
+  M(VLAN,                    IND_OFDPA_VLAN_FLOW_MATCH_BITMAP,                  IND_OFDPA_VLAN_FLOW_MATCH_MAND_BITMAP,                0) \
+  M(VLAN_1,                  IND_OFDPA_VLAN1_FLOW_MATCH_BITMAP,                 IND_OFDPA_VLAN1_FLOW_MATCH_MAND_BITMAP,               0) \
+  M(MAINTENANCE_POINT,       IND_OFDPA_MP_FLOW_MATCH_BITMAP,                    IND_OFDPA_MP_FLOW_MATCH_MAND_BITMAP,                  0) \
+  M(MPLS_L2_PORT,            IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_BITMAP,          IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_MAND_BITMAP,        0) \
+  M(TERMINATION_MAC,         IND_OFDPA_TERM_MAC_FLOW_MATCH_BITMAP,              IND_OFDPA_TERM_MAC_FLOW_MATCH_MAND_BITMAP,            0) \
+  M(MPLS,                    IND_OFDPA_MPLS_FLOW_MATCH_BITMAP,                  IND_OFDPA_MPLS_FLOW_MATCH_MAND_BITMAP,                0) \
+  M(MPLS_MAINTENANCE_POINT,  IND_OFDPA_MPLS_MP_FLOW_MATCH_BITMAP,               IND_OFDPA_MPLS_MP_FLOW_MATCH_MAND_BITMAP,             0) \
+  M(UNICAST_ROUTING,         IND_OFDPA_UCAST_ROUTING_FLOW_MATCH_BITMAP,         IND_OFDPA_UCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP, \
+                                                                                IND_OFDPA_UCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP) \
+  M(MULTICAST_ROUTING,       IND_OFDPA_MCAST_ROUTING_FLOW_MATCH_BITMAP,         IND_OFDPA_MCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP, \
+                                                                                IND_OFDPA_MCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP) \
+  M(BRIDGING,                IND_OFDPA_BRIDGING_FLOW_MATCH_BITMAP,              0,                                                    0) \
+  M(L2_POLICER,              IND_OFDPA_L2_POLICER_FLOW_MATCH_BITMAP,            IND_OFDPA_L2_POLICER_FLOW_MATCH_MAND_BITMAP,          0) \
+  M(L2_POLICER_ACTIONS,      IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_BITMAP,    IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_MAND_BITMAP,  0) \
+  M(DSCP_TRUST,              IND_OFDPA_DSCP_TRUST_FLOW_MATCH_BITMAP,            IND_OFDPA_DSCP_TRUST_FLOW_MATCH_MAND_BITMAP,          0) \
+  M(PCP_TRUST,               IND_OFDPA_PCP_TRUST_FLOW_MATCH_BITMAP,             IND_OFDPA_PCP_TRUST_FLOW_MATCH_MAND_BITMAP,           0) \
+  M(ACL_POLICY,              IND_OFDPA_ACL_POLICY_FLOW_MATCH_BITMAP,            0,                                                    0) \
+  M(COLOR_BASED_ACTIONS,     IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_BITMAP,   IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_MAND_BITMAP, 0) \
+  M(EGRESS_VLAN,             IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_BITMAP,           IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_MAND_BITMAP,         0) \
+  M(EGRESS_VLAN_1,           IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_BITMAP,          IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_MAND_BITMAP,        0) \
+  M(EGRESS_MAINTENANCE_POINT, IND_OFDPA_EGRESS_MP_FLOW_MATCH_BITMAP,            IND_OFDPA_EGRESS_MP_FLOW_MATCH_MAND_BITMAP,           0) \
+  M(EGRESS_DSCP_PCP_REMARK,  IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_BITMAP,   IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_MAND_BITMAP, 0)
+
+/*
+ * One entry per flow table:
+ *   T(table id, match translator name, apply, write, clear, goto)
+ * The last four say whether the table takes the Apply-Actions,
+ * Write-Actions, Clear-Actions and Goto-Table instructions. The Meter
+ * instruction is accepted, and ignored, for every table.
+ */
+#define IND_OFDPA_FLOW_TABLES(T) \
+  T(OFDPA_FLOW_TABLE_ID_INGRESS_PORT,            INGRESS_PORT,             1, 0, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_INJECTED_OAM,            INJECTED_OAM,             1, 0, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_VLAN,                    VLAN,                     1, 1, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_VLAN_1,                  VLAN_1,                   1, 1, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_MAINTENANCE_POINT,       MAINTENANCE_POINT,        1, 0, 1, 1) \
+  T(OFDPA_FLOW_TABLE_ID_MPLS_L2_PORT,            MPLS_L2_PORT,             1, 1, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_TERMINATION_MAC,         TERMINATION_MAC,          1, 0, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_MPLS_0,                  MPLS,                     1, 1, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_MPLS_1,                  MPLS,                     1, 1, 1, 1) \
+  T(OFDPA_FLOW_TABLE_ID_MPLS_2,                  MPLS,                     1, 1, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_MPLS_MAINTENANCE_POINT,  MPLS_MAINTENANCE_POINT,   1, 0, 1, 1) \
+  T(OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING,         UNICAST_ROUTING,          1, 1, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_MULTICAST_ROUTING,       MULTICAST_ROUTING,        0, 1, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_BRIDGING,                BRIDGING,                 1, 1, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_L2_POLICER,              L2_POLICER,               1, 0, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_L2_POLICER_ACTIONS,      L2_POLICER_ACTIONS,       1, 1, 1, 1) \
+  T(OFDPA_FLOW_TABLE_ID_PORT_DSCP_TRUST,         DSCP_TRUST,               1, 0, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_TUNNEL_DSCP_TRUST,       DSCP_TRUST,               1, 0, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_MPLS_DSCP_TRUST,         DSCP_TRUST,               1, 0, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_PORT_PCP_TRUST,          PCP_TRUST,                1, 0, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_TUNNEL_PCP_TRUST,        PCP_TRUST,                1, 0, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_MPLS_PCP_TRUST,          PCP_TRUST,                1, 0, 0, 1) \
+  T(OFDPA_FLOW_TABLE_ID_ACL_POLICY,              ACL_POLICY,               1, 1, 1, 0) \
+  T(OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS,     COLOR_BASED_ACTIONS,      1, 1, 1, 0) \
+  T(OFDPA_FLOW_TABLE_ID_EGRESS_VLAN,             EGRESS_VLAN,              1, 0, 1, 1) \
+  T(OFDPA_FLOW_TABLE_ID_EGRESS_VLAN_1,           EGRESS_VLAN_1,            1, 0, 1, 1) \
+  T(OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT, EGRESS_MAINTENANCE_POINT, 1, 1, 1, 0) \
+  T(OFDPA_FLOW_TABLE_ID_EGRESS_DSCP_PCP_REMARK,  EGRESS_DSCP_PCP_REMARK,   1, 1, 0, 1)
+
+#endif /* INCLUDE_IND_OFDPA_FLOW_TABLES_H */
@@ -44,6 +44,26 @@
 
 #define IND_OFDPA_NANO_SEC 1000000000
 
+/* Flow jobs queued to the driver worker thread; must be a power of 2 */
+#define IND_OFDPA_FLOW_QUEUE_SIZE       1024
+
+/* Most flows kept in the shadow of programmed flows */
+#define IND_OFDPA_FLOW_SHADOW_MAX       131072
+
+/* Most flows kept in the flow stats cache */
+#define IND_OFDPA_FLOW_STATS_MAX        IND_OFDPA_FLOW_SHADOW_MAX
+
+/* Default bound on the age of cached flow counters; 0 disables the cache */
+#define IND_OFDPA_FLOW_STATS_MAX_AGE_MS 1000
+
+/* Background counter poller: slice length and OF-DPA calls per slice */
+#define IND_OFDPA_POLL_SLICE_MS         100
+#define IND_OFDPA_POLL_BUDGET           64
+
+/* Ports and queues per port kept by the poller */
+#define IND_OFDPA_POLL_PORTS_MAX        256
+#define IND_OFDPA_POLL_QUEUES_MAX       8
+
 typedef struct indPacketOutActions_s
 {
   uint32_t outputPort;
@@ -52,6 +72,29 @@ typedef struct indPacketOutActions_s
 
 indigo_error_t indigoConvertOfdpaRv(OFDPA_ERROR_t result);
 
+/*
+ * Hash table of fixed size records keyed by flow id. Each record starts
+ * with its uint64_t flow id, which is never 0; 0 marks an empty slot.
+ */
+typedef struct ind_ofdpa_flow_map_s
+{
+  uint8_t  *slots;
+  uint32_t recordSize;
+  uint32_t minSize;             /* Slots allocated first; a power of 2 */
+  uint32_t maxCount;            /* Most records kept */
+  uint32_t size;                /* Slots; a power of 2, or 0 */
+  uint32_t count;               /* Records kept */
+} ind_ofdpa_flow_map_t;
+
+#define IND_OFDPA_FLOW_MAP_INIT(_type, _minSize, _maxCount) \
+  { NULL, sizeof(_type), (_minSize), (_maxCount), 0, 0 }
+
+void *ind_ofdpa_flow_map_find(const ind_ofdpa_flow_map_t *map, uint64_t flowId);
+int ind_ofdpa_flow_map_set(ind_ofdpa_flow_map_t *map, const void *record);
+void ind_ofdpa_flow_map_remove(ind_ofdpa_flow_map_t *map, uint64_t flowId);
+
+void ind_ofdpa_tables_init(void);
+
 /* Short hand logging macros */
 #define LOG_ERROR AIM_LOG_ERROR
 #define LOG_WARN AIM_LOG_WARN
@@ -149,6 +192,15 @@ typedef unsigned long long ind_ofdpa_fields_t;
 #define IND_ONF_ACTSET_OUTPUT                 ((unsigned long long) 1 << 53)
 //ind_ofdpa_field_t end
 
+//ind_ofdpa_inst_t start
+#define IND_OFDPA_INST_APPLY_ACTIONS          (1 <<  0)
+#define IND_OFDPA_INST_WRITE_ACTIONS          (1 <<  1)
+#define IND_OFDPA_INST_CLEAR_ACTIONS          (1 <<  2)
+#define IND_OFDPA_INST_GOTO_TABLE             (1 <<  3)
+#define IND_OFDPA_INST_METER                  (1 <<  4)
+#define IND_OFDPA_INST_OTHER                  (1 <<  5)
+//ind_ofdpa_inst_t end
+
 //ind_ofdpa_action_t start
 #define IND_OFDPA_WATCH_PORT                  (1 <<  0)
 #define IND_OFDPA_OUTPUT                      (1 <<  1)
@@ -334,6 +386,77 @@ typedef unsigned long long ind_ofdpa_fields_t;
 
 indigo_error_t indigoConvertOfdpaRv(OFDPA_ERROR_t result);
 
+indigo_error_t ind_ofdpa_flow_batch_init(void);
+void ind_ofdpa_flow_batch_finish(void);
+indigo_error_t ind_ofdpa_flow_batch_add(ofdpaFlowEntry_t *flow);
+indigo_error_t ind_ofdpa_flow_batch_delete(uint64_t flowId);
+void ind_ofdpa_flow_batch_drain(void);
+int ind_ofdpa_flow_batch_busy(void);
+
+void ind_ofdpa_flow_translation_keep(const void *flowAdd, const ofdpaFlowEntry_t *flow);
+int ind_ofdpa_flow_translation_take(const void *flowAdd, ofdpaFlowEntry_t *flow);
+int ind_ofdpa_flow_bundle_staging(void);
+OFDPA_ERROR_t ind_ofdpa_flow_bundle_get(uint64_t flowId, ofdpaFlowEntry_t *flow,
+                                        ofdpaFlowEntryStats_t *flowStats);
+void ind_ofdpa_flow_bundle_add(const ofdpaFlowEntry_t *flow);
+void ind_ofdpa_flow_bundle_modify(const ofdpaFlowEntry_t *prior,
+                                  const ofdpaFlowEntryStats_t *stats,
+                                  const ofdpaFlowEntry_t *flow);
+void ind_ofdpa_flow_bundle_delete(const ofdpaFlowEntry_t *prior,
+                                  const ofdpaFlowEntryStats_t *stats);
+
+void ind_ofdpa_flow_shadow_set(const ofdpaFlowEntry_t *flow);
+void ind_ofdpa_flow_shadow_remove(uint64_t flowId);
+int ind_ofdpa_flow_shadow_get(uint64_t flowId, ofdpaFlowEntry_t *flow);
+
+typedef struct ind_ofdpa_flow_stats_counters_s
+{
+  uint64_t hits;                /* Requests served from the cache */
+  uint64_t misses;
+  uint64_t walks;               /* Flow table walks by the poller */
+  uint64_t walkedFlows;         /* Flows read by the walks */
+  uint64_t cookieReads;         /* Flows read by cookie */
+  uint64_t maxAgeServed;        /* Oldest counters served, in ms */
+  uint32_t cached;              /* Flows in the cache */
+} ind_ofdpa_flow_stats_counters_t;
+
+OFDPA_ERROR_t ind_ofdpa_flow_stats_get(uint64_t flowId, ofdpaFlowEntryStats_t *flowStats);
+void ind_ofdpa_flow_stats_remove(uint64_t flowId);
+void ind_ofdpa_flow_stats_max_age_set(uint32_t maxAgeMs);
+uint32_t ind_ofdpa_flow_stats_max_age_get(void);
+int ind_ofdpa_flow_stats_poll(int budget, int *cycleDone);
+void ind_ofdpa_flow_stats_poll_table(uint8_t tableId);
+void ind_ofdpa_flow_stats_counters_get(ind_ofdpa_flow_stats_counters_t *counters);
+
+typedef enum
+{
+  IND_OFDPA_POLL_FLOWS = 0,
+  IND_OFDPA_POLL_PORTS,
+  IND_OFDPA_POLL_QUEUES,
+  IND_OFDPA_POLL_CLASSES,
+} ind_ofdpa_poll_class_t;
+
+typedef struct ind_ofdpa_poll_stats_s
+{
+  uint64_t rpcs;                /* OF-DPA calls made by the poller */
+  uint64_t cycles;              /* Complete passes over the class */
+  uint64_t cycleMs;             /* Length of the last complete pass */
+  uint64_t cycleRpcs;           /* Calls made in the last complete pass */
+  uint64_t served;              /* Requests served from the snapshot */
+  uint64_t onDemand;            /* Requests read from OF-DPA */
+  uint64_t maxAgeServed;        /* Oldest snapshot served, in ms */
+} ind_ofdpa_poll_stats_t;
+
+indigo_error_t ind_ofdpa_poll_init(void);
+void ind_ofdpa_poll_finish(void);
+void ind_ofdpa_poll_budget_set(uint32_t budget);
+void ind_ofdpa_poll_stats_get(ind_ofdpa_poll_class_t cls, ind_ofdpa_poll_stats_t *stats);
+void ind_ofdpa_poll_stats_log(void);
+OFDPA_ERROR_t ind_ofdpa_poll_port_stats_get(uint32_t port, ofdpaPortStats_t *portStats);
+OFDPA_ERROR_t ind_ofdpa_poll_num_queues_get(uint32_t port, uint32_t *numQueues);
+OFDPA_ERROR_t ind_ofdpa_poll_queue_stats_get(uint32_t port, uint32_t queueId,
+                                             ofdpaPortQueueStats_t *queueStats);
+
 void ind_ofdpa_port_event_receive(void);
 void ind_ofdpa_flow_event_receive(void);
 void ind_ofdpa_pkt_receive(void);
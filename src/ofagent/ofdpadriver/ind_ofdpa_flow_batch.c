@@ -0,0 +1,469 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2013-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_flow_batch.c
+*
+* @purpose      Asynchronous flow adds and deletes for the OF-DPA Driver
+*
+* @component    OF-DPA
+*
+* @comments     Translated flow adds, and deletes whose final counters
+*               nobody wants, are handed to a worker thread as ordered
+*               jobs. The worker makes the blocking OF-DPA calls so the
+*               event loop keeps serving connections and packet-ins.
+*
+*               The main thread and the worker share a single producer,
+*               single consumer ring without locks. The main thread fills
+*               slots at 'head'. The worker runs the jobs, stores each
+*               result in its slot and advances 'done'. The main thread
+*               then reaps results from 'tail', which frees the slots. Add
+*               results go to a result list and are reported to the state
+*               manager with indigo_core_flow_create_complete. Reporting
+*               only happens from the event loop: from the completion
+*               eventfd callback, or from indigo_fwd_flush. Delete results
+*               are only logged; the state manager ignores them anyway.
+*
+*               Any other call into OF-DPA first waits for the worker to
+*               drain the ring, so OF-DPA sees operations in the order the
+*               controller sent them. The wait blocks on an eventfd the
+*               worker signals; it does not spin.
+*
+* @end
+*
+**********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "indigo/forwarding.h"
+#include "indigo/of_state_manager.h"
+#include "SocketManager/socketmanager.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+
+#define IND_OFDPA_FLOW_QUEUE_MASK (IND_OFDPA_FLOW_QUEUE_SIZE - 1)
+
+typedef struct ind_ofdpa_flow_result_s
+{
+  indigo_cookie_t flowId;
+  indigo_error_t  result;
+  uint8_t         tableId;
+} ind_ofdpa_flow_result_t;
+
+typedef enum ind_ofdpa_flow_job_e
+{
+  IND_OFDPA_FLOW_JOB_ADD,
+  IND_OFDPA_FLOW_JOB_DELETE,
+} ind_ofdpa_flow_job_t;
+
+typedef struct ind_ofdpa_flow_slot_s
+{
+  ind_ofdpa_flow_job_t job;       /* Written by the main thread */
+  ofdpaFlowEntry_t flow;          /* Only the cookie is set for a delete */
+  indigo_error_t   result;        /* Written by the worker */
+} ind_ofdpa_flow_slot_t;
+
+/*
+ * Ring indexes only ever increase. head is written by the main thread,
+ * done by the worker; tail is private to the main thread.
+ */
+static ind_ofdpa_flow_slot_t ind_ofdpa_flow_queue[IND_OFDPA_FLOW_QUEUE_SIZE];
+static uint32_t ind_ofdpa_flow_queue_head;
+static uint32_t ind_ofdpa_flow_queue_done;
+static uint32_t ind_ofdpa_flow_queue_tail;
+
+/* Results reaped from the ring and not reported yet, in order */
+static ind_ofdpa_flow_result_t *ind_ofdpa_flow_results;
+static int ind_ofdpa_flow_result_count;
+static int ind_ofdpa_flow_result_size;
+
+static pthread_t ind_ofdpa_flow_worker;
+static int ind_ofdpa_flow_worker_running;
+static int ind_ofdpa_flow_worker_stop;
+static int ind_ofdpa_flow_worker_sleeping;
+static int ind_ofdpa_flow_waiting;
+static int ind_ofdpa_flow_submit_fd = -1;     /* Wakes the worker */
+static int ind_ofdpa_flow_complete_fd = -1;   /* Wakes the event loop */
+static int ind_ofdpa_flow_wait_fd = -1;       /* Wakes a waiting main thread */
+
+static void ind_ofdpa_eventfd_signal(int fd)
+{
+  uint64_t x = 1;
+
+  if (write(fd, &x, sizeof(x)) < 0)
+  {
+    /* silence warn_unused_result */
+  }
+}
+
+static void ind_ofdpa_eventfd_clear(int fd)
+{
+  uint64_t x;
+
+  if (read(fd, &x, sizeof(x)) < 0)
+  {
+    /* silence warn_unused_result */
+  }
+}
+
+static void *ind_ofdpa_flow_worker_main(void *arg)
+{
+  ind_ofdpa_flow_slot_t *slot;
+  OFDPA_ERROR_t ofdpa_rv;
+  uint32_t done, head;
+
+  done = __atomic_load_n(&ind_ofdpa_flow_queue_done, __ATOMIC_RELAXED);
+
+  while (1)
+  {
+    head = __atomic_load_n(&ind_ofdpa_flow_queue_head, __ATOMIC_ACQUIRE);
+
+    if (done == head)
+    {
+      if (__atomic_load_n(&ind_ofdpa_flow_worker_stop, __ATOMIC_ACQUIRE))
+      {
+        break;
+      }
+
+      /*
+       * Announce the sleep before the last look at head. The main thread
+       * publishes head before looking at the flag, so one of the two
+       * sees the other.
+       */
+      __atomic_store_n(&ind_ofdpa_flow_worker_sleeping, 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&ind_ofdpa_flow_queue_head, __ATOMIC_SEQ_CST) == done &&
+          !__atomic_load_n(&ind_ofdpa_flow_worker_stop, __ATOMIC_SEQ_CST))
+      {
+        ind_ofdpa_eventfd_clear(ind_ofdpa_flow_submit_fd);
+      }
+      __atomic_store_n(&ind_ofdpa_flow_worker_sleeping, 0, __ATOMIC_RELAXED);
+      continue;
+    }
+
+    while (done != head)
+    {
+      slot = &ind_ofdpa_flow_queue[done & IND_OFDPA_FLOW_QUEUE_MASK];
+
+      if (slot->job == IND_OFDPA_FLOW_JOB_ADD)
+      {
+        ofdpa_rv = ofdpaFlowAdd(&slot->flow);
+        if (ofdpa_rv != OFDPA_E_NONE)
+        {
+          LOG_TRACE("Failed to add flow. (ofdpa_rv = %d)", ofdpa_rv);
+        }
+        else
+        {
+          LOG_TRACE("Flow added successfully. (ofdpa_rv = %d)", ofdpa_rv);
+        }
+      }
+      else
+      {
+        ofdpa_rv = ofdpaFlowByCookieDelete(slot->flow.cookie);
+      }
+      slot->result = indigoConvertOfdpaRv(ofdpa_rv);
+
+      /*
+       * Publish done before looking for a waiter. The waiter raises its
+       * flag before its last look at done, so one of the two sees the
+       * other.
+       */
+      done++;
+      __atomic_store_n(&ind_ofdpa_flow_queue_done, done, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&ind_ofdpa_flow_waiting, __ATOMIC_SEQ_CST))
+      {
+        ind_ofdpa_eventfd_signal(ind_ofdpa_flow_wait_fd);
+      }
+    }
+
+    ind_ofdpa_eventfd_signal(ind_ofdpa_flow_complete_fd);
+  }
+
+  return NULL;
+}
+
+static void ind_ofdpa_flow_result_push(indigo_cookie_t flowId,
+                                       indigo_error_t result,
+                                       uint8_t tableId)
+{
+  ind_ofdpa_flow_result_t *res;
+
+  if (ind_ofdpa_flow_result_count == ind_ofdpa_flow_result_size)
+  {
+    ind_ofdpa_flow_result_size = ind_ofdpa_flow_result_size ?
+      ind_ofdpa_flow_result_size * 2 : IND_OFDPA_FLOW_QUEUE_SIZE;
+    ind_ofdpa_flow_results = realloc(ind_ofdpa_flow_results,
+                                     ind_ofdpa_flow_result_size * sizeof(*ind_ofdpa_flow_results));
+    AIM_TRUE_OR_DIE(ind_ofdpa_flow_results != NULL);
+  }
+
+  res = &ind_ofdpa_flow_results[ind_ofdpa_flow_result_count++];
+  res->flowId = flowId;
+  res->result = result;
+  res->tableId = tableId;
+}
+
+/* Move finished flows from the ring to the result list */
+static void ind_ofdpa_flow_batch_reap(void)
+{
+  ind_ofdpa_flow_slot_t *slot;
+  uint32_t done;
+
+  done = __atomic_load_n(&ind_ofdpa_flow_queue_done, __ATOMIC_ACQUIRE);
+
+  while (ind_ofdpa_flow_queue_tail != done)
+  {
+    slot = &ind_ofdpa_flow_queue[ind_ofdpa_flow_queue_tail & IND_OFDPA_FLOW_QUEUE_MASK];
+    if (slot->job == IND_OFDPA_FLOW_JOB_ADD)
+    {
+      if (slot->result == INDIGO_ERROR_NONE)
+      {
+        ind_ofdpa_flow_shadow_set(&slot->flow);
+      }
+      ind_ofdpa_flow_result_push(slot->flow.cookie, slot->result,
+                                 (uint8_t)slot->flow.tableId);
+    }
+    else
+    {
+      ind_ofdpa_flow_shadow_remove(slot->flow.cookie);
+      ind_ofdpa_flow_stats_remove(slot->flow.cookie);
+      if (slot->result != INDIGO_ERROR_NONE)
+      {
+        LOG_ERROR("Failed to delete flow 0x%llx. (err = %d)",
+                  (unsigned long long)slot->flow.cookie, slot->result);
+      }
+    }
+    ind_ofdpa_flow_queue_tail++;
+  }
+}
+
+/* Block until the worker has finished every job queued before 'target' */
+static void ind_ofdpa_flow_batch_wait(uint32_t target)
+{
+  while ((int32_t)(__atomic_load_n(&ind_ofdpa_flow_queue_done, __ATOMIC_ACQUIRE) - target) < 0)
+  {
+    __atomic_store_n(&ind_ofdpa_flow_waiting, 1, __ATOMIC_SEQ_CST);
+    if ((int32_t)(__atomic_load_n(&ind_ofdpa_flow_queue_done, __ATOMIC_SEQ_CST) - target) < 0)
+    {
+      ind_ofdpa_eventfd_clear(ind_ofdpa_flow_wait_fd);
+    }
+    __atomic_store_n(&ind_ofdpa_flow_waiting, 0, __ATOMIC_RELAXED);
+  }
+}
+
+/*
+ * Wait for the worker to finish every queued job. Called before any other
+ * OF-DPA call so operations reach OF-DPA in order. Results are kept for
+ * the event loop to report.
+ */
+void ind_ofdpa_flow_batch_drain(void)
+{
+  ind_ofdpa_flow_batch_wait(ind_ofdpa_flow_queue_head);
+  ind_ofdpa_flow_batch_reap();
+}
+
+/* Whether the worker still has jobs to run */
+int ind_ofdpa_flow_batch_busy(void)
+{
+  return __atomic_load_n(&ind_ofdpa_flow_queue_done, __ATOMIC_ACQUIRE) !=
+         ind_ofdpa_flow_queue_head;
+}
+
+/* Report every reaped result, in order */
+static void ind_ofdpa_flow_batch_deliver(void)
+{
+  ind_ofdpa_flow_result_t res;
+  int i;
+
+  ind_ofdpa_flow_batch_reap();
+
+  /* Results reaped while reporting are reported too, after these */
+  for (i = 0; i < ind_ofdpa_flow_result_count; i++)
+  {
+    res = ind_ofdpa_flow_results[i];
+    indigo_core_flow_create_complete(res.flowId, res.result, res.tableId);
+  }
+  ind_ofdpa_flow_result_count = 0;
+}
+
+static void ind_ofdpa_flow_complete_ready(int socket_id, void *cookie,
+                                          int read_ready, int write_ready,
+                                          int error_seen)
+{
+  ind_ofdpa_eventfd_clear(ind_ofdpa_flow_complete_fd);
+  ind_ofdpa_flow_batch_deliver();
+}
+
+/* Get the slot at head for a new job, waiting for one to free up */
+static ind_ofdpa_flow_slot_t *ind_ofdpa_flow_batch_slot_get(void)
+{
+  uint32_t head = ind_ofdpa_flow_queue_head;
+
+  /* A slot is free once its result has been reaped */
+  if (head - ind_ofdpa_flow_queue_tail == IND_OFDPA_FLOW_QUEUE_SIZE)
+  {
+    ind_ofdpa_flow_batch_wait(ind_ofdpa_flow_queue_tail + 1);
+    ind_ofdpa_flow_batch_reap();
+  }
+
+  return &ind_ofdpa_flow_queue[head & IND_OFDPA_FLOW_QUEUE_MASK];
+}
+
+/* Hand the job in the slot at head to the worker */
+static void ind_ofdpa_flow_batch_submit(void)
+{
+  __atomic_store_n(&ind_ofdpa_flow_queue_head, ind_ofdpa_flow_queue_head + 1,
+                   __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&ind_ofdpa_flow_worker_sleeping, __ATOMIC_SEQ_CST))
+  {
+    ind_ofdpa_eventfd_signal(ind_ofdpa_flow_submit_fd);
+  }
+}
+
+/*
+ * Queue a translated flow add. Returns INDIGO_ERROR_PENDING if the flow
+ * was queued; otherwise the flow was added synchronously and the result
+ * is returned.
+ */
+indigo_error_t ind_ofdpa_flow_batch_add(ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_flow_slot_t *slot;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  if (!ind_ofdpa_flow_worker_running)
+  {
+    ofdpa_rv = ofdpaFlowAdd(flow);
+    if (ofdpa_rv == OFDPA_E_NONE)
+    {
+      ind_ofdpa_flow_shadow_set(flow);
+    }
+    return (indigoConvertOfdpaRv(ofdpa_rv));
+  }
+
+  slot = ind_ofdpa_flow_batch_slot_get();
+  slot->job = IND_OFDPA_FLOW_JOB_ADD;
+  slot->flow = *flow;
+  ind_ofdpa_flow_batch_submit();
+
+  return INDIGO_ERROR_PENDING;
+}
+
+/*
+ * Queue a flow delete behind the queued jobs. Failures are only logged,
+ * so INDIGO_ERROR_NONE is returned if the delete was queued; otherwise the
+ * flow was deleted synchronously and the result is returned.
+ */
+indigo_error_t ind_ofdpa_flow_batch_delete(uint64_t flowId)
+{
+  ind_ofdpa_flow_slot_t *slot;
+  OFDPA_ERROR_t ofdpa_rv;
+
+  if (!ind_ofdpa_flow_worker_running)
+  {
+    ofdpa_rv = ofdpaFlowByCookieDelete(flowId);
+    ind_ofdpa_flow_shadow_remove(flowId);
+    ind_ofdpa_flow_stats_remove(flowId);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_ERROR("Failed to delete flow. (ofdpa_rv = %d)", ofdpa_rv);
+    }
+    return (indigoConvertOfdpaRv(ofdpa_rv));
+  }
+
+  slot = ind_ofdpa_flow_batch_slot_get();
+  slot->job = IND_OFDPA_FLOW_JOB_DELETE;
+  memset(&slot->flow, 0, sizeof(slot->flow));
+  slot->flow.cookie = flowId;
+  ind_ofdpa_flow_batch_submit();
+
+  return INDIGO_ERROR_NONE;
+}
+
+void indigo_fwd_flush(void)
+{
+  ind_ofdpa_flow_batch_drain();
+  ind_ofdpa_flow_batch_deliver();
+}
+
+indigo_error_t ind_ofdpa_flow_batch_init(void)
+{
+  ind_ofdpa_flow_submit_fd = eventfd(0, 0);
+  ind_ofdpa_flow_complete_fd = eventfd(0, EFD_NONBLOCK);
+  ind_ofdpa_flow_wait_fd = eventfd(0, 0);
+  if ((ind_ofdpa_flow_submit_fd < 0) || (ind_ofdpa_flow_complete_fd < 0) ||
+      (ind_ofdpa_flow_wait_fd < 0))
+  {
+    LOG_ERROR("Failed to allocate flow queue eventfd.");
+    ind_ofdpa_flow_batch_finish();
+    return INDIGO_ERROR_RESOURCE;
+  }
+
+  if (ind_soc_socket_register(ind_ofdpa_flow_complete_fd,
+                              ind_ofdpa_flow_complete_ready, NULL) < 0)
+  {
+    LOG_ERROR("Failed to register flow queue eventfd.");
+    ind_ofdpa_flow_batch_finish();
+    return INDIGO_ERROR_UNKNOWN;
+  }
+
+  ind_ofdpa_flow_worker_stop = 0;
+  if (pthread_create(&ind_ofdpa_flow_worker, NULL,
+                     ind_ofdpa_flow_worker_main, NULL) != 0)
+  {
+    LOG_ERROR("Failed to start flow worker thread.");
+    ind_ofdpa_flow_batch_finish();
+    return INDIGO_ERROR_RESOURCE;
+  }
+  ind_ofdpa_flow_worker_running = 1;
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_flow_batch_finish(void)
+{
+  if (ind_ofdpa_flow_worker_running)
+  {
+    indigo_fwd_flush();
+
+    __atomic_store_n(&ind_ofdpa_flow_worker_stop, 1, __ATOMIC_SEQ_CST);
+    ind_ofdpa_eventfd_signal(ind_ofdpa_flow_submit_fd);
+    pthread_join(ind_ofdpa_flow_worker, NULL);
+    ind_ofdpa_flow_worker_running = 0;
+  }
+
+  if (ind_ofdpa_flow_complete_fd >= 0)
+  {
+    ind_soc_socket_unregister(ind_ofdpa_flow_complete_fd);
+    close(ind_ofdpa_flow_complete_fd);
+    ind_ofdpa_flow_complete_fd = -1;
+  }
+
+  if (ind_ofdpa_flow_submit_fd >= 0)
+  {
+    close(ind_ofdpa_flow_submit_fd);
+    ind_ofdpa_flow_submit_fd = -1;
+  }
+
+  if (ind_ofdpa_flow_wait_fd >= 0)
+  {
+    close(ind_ofdpa_flow_wait_fd);
+    ind_ofdpa_flow_wait_fd = -1;
+  }
+}
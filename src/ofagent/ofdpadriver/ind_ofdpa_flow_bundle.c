@@ -0,0 +1,444 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2013-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_flow_bundle.c
+*
+* @purpose      Staged flow changes of bundles for the OF-DPA Driver
+*
+* @component    OF-DPA
+*
+* @comments     Flow adds validated for a bundle keep their translation,
+*               keyed by the flow_add object, so the commit does not
+*               translate them again.
+*
+*               While the state manager commits a bundle, flow creates,
+*               modifies and deletes only record the OF-DPA operation,
+*               along with the flow as it was before. The reads this
+*               needs are made while recording. When every flow_mod of the
+*               bundle has applied, the operations are made back to back,
+*               in order. If OF-DPA rejects one, the ones before it are
+*               undone in reverse order.
+*
+*               OF-DPA has no transactions, so this is not atomic:
+*               packets meet a mix of old and new flows while the
+*               operations run, and while they are undone. A deleted flow
+*               that is added back starts its counters from zero.
+*
+* @end
+*
+**********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <AIM/aim.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+
+#define IND_OFDPA_FLOW_TRANSLATION_MIN_BUCKETS 256
+#define IND_OFDPA_FLOW_BUNDLE_MIN_OPS          64
+
+typedef struct ind_ofdpa_flow_translation_s
+{
+  struct ind_ofdpa_flow_translation_s *next;
+  const void       *flowAdd;
+  ofdpaFlowEntry_t  flow;
+} ind_ofdpa_flow_translation_t;
+
+typedef enum
+{
+  IND_OFDPA_FLOW_BUNDLE_ADD = 0,
+  IND_OFDPA_FLOW_BUNDLE_MODIFY,
+  IND_OFDPA_FLOW_BUNDLE_DELETE,
+} ind_ofdpa_flow_bundle_op_type_t;
+
+typedef struct ind_ofdpa_flow_bundle_op_s
+{
+  ind_ofdpa_flow_bundle_op_type_t type;
+  ofdpaFlowEntry_t      flow;     /* The flow as the operation leaves it */
+  ofdpaFlowEntry_t      prior;    /* The flow before; not for adds */
+  ofdpaFlowEntryStats_t stats;    /* Counters of the flow before */
+} ind_ofdpa_flow_bundle_op_t;
+
+/* Translations of validated flow adds, chained by flow_add object */
+static ind_ofdpa_flow_translation_t **ind_ofdpa_flow_translations;
+static uint32_t ind_ofdpa_flow_translation_buckets;     /* Power of 2 */
+static uint32_t ind_ofdpa_flow_translation_count;
+
+/* Operations recorded for the bundle being committed, in order */
+static int ind_ofdpa_flow_bundle_active;
+static ind_ofdpa_flow_bundle_op_t *ind_ofdpa_flow_bundle_ops;
+static uint32_t ind_ofdpa_flow_bundle_op_count;
+static uint32_t ind_ofdpa_flow_bundle_op_size;
+
+/*
+ * Latest operation on each flow, by cookie. Slots hold an index into
+ * the operations plus one, or 0 when empty.
+ */
+static uint32_t *ind_ofdpa_flow_bundle_index;
+static uint32_t ind_ofdpa_flow_bundle_index_slots;      /* Power of 2 */
+
+static uint32_t ind_ofdpa_flow_bundle_hash(uint64_t key)
+{
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return (uint32_t)key;
+}
+
+/****************************************************************
+ * Translations of validated flow adds
+ ****************************************************************/
+
+static ind_ofdpa_flow_translation_t **ind_ofdpa_flow_translation_bucket(const void *flowAdd)
+{
+  uint32_t hash = ind_ofdpa_flow_bundle_hash((uint64_t)(uintptr_t)flowAdd);
+
+  return &ind_ofdpa_flow_translations[hash & (ind_ofdpa_flow_translation_buckets - 1)];
+}
+
+static void ind_ofdpa_flow_translation_grow(void)
+{
+  ind_ofdpa_flow_translation_t **old = ind_ofdpa_flow_translations;
+  ind_ofdpa_flow_translation_t *cur, *next, **bucket;
+  uint32_t oldBuckets = ind_ofdpa_flow_translation_buckets;
+  uint32_t i;
+
+  ind_ofdpa_flow_translation_buckets = oldBuckets ?
+    oldBuckets * 2 : IND_OFDPA_FLOW_TRANSLATION_MIN_BUCKETS;
+  ind_ofdpa_flow_translations = calloc(ind_ofdpa_flow_translation_buckets,
+                                       sizeof(*ind_ofdpa_flow_translations));
+  AIM_TRUE_OR_DIE(ind_ofdpa_flow_translations != NULL);
+
+  for (i = 0; i < oldBuckets; i++)
+  {
+    for (cur = old[i]; cur != NULL; cur = next)
+    {
+      next = cur->next;
+      bucket = ind_ofdpa_flow_translation_bucket(cur->flowAdd);
+      cur->next = *bucket;
+      *bucket = cur;
+    }
+  }
+  free(old);
+}
+
+/* Unlink the translation of a flow_add, if there is one */
+static ind_ofdpa_flow_translation_t *ind_ofdpa_flow_translation_unlink(const void *flowAdd)
+{
+  ind_ofdpa_flow_translation_t *cur, **prev;
+
+  if (ind_ofdpa_flow_translation_count == 0)
+  {
+    return NULL;
+  }
+
+  for (prev = ind_ofdpa_flow_translation_bucket(flowAdd); (cur = *prev) != NULL;
+       prev = &cur->next)
+  {
+    if (cur->flowAdd == flowAdd)
+    {
+      *prev = cur->next;
+      ind_ofdpa_flow_translation_count--;
+      return cur;
+    }
+  }
+
+  return NULL;
+}
+
+void ind_ofdpa_flow_translation_keep(const void *flowAdd, const ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_flow_translation_t *trans, **bucket;
+
+  trans = ind_ofdpa_flow_translation_unlink(flowAdd);
+  if (trans == NULL)
+  {
+    trans = malloc(sizeof(*trans));
+    AIM_TRUE_OR_DIE(trans != NULL);
+  }
+
+  if (ind_ofdpa_flow_translation_count >= ind_ofdpa_flow_translation_buckets)
+  {
+    ind_ofdpa_flow_translation_grow();
+  }
+
+  trans->flowAdd = flowAdd;
+  trans->flow = *flow;
+  bucket = ind_ofdpa_flow_translation_bucket(flowAdd);
+  trans->next = *bucket;
+  *bucket = trans;
+  ind_ofdpa_flow_translation_count++;
+}
+
+/* Returns 1 and fills in flow if the flow_add was translated when validated */
+int ind_ofdpa_flow_translation_take(const void *flowAdd, ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_flow_translation_t *trans;
+
+  if ((trans = ind_ofdpa_flow_translation_unlink(flowAdd)) == NULL)
+  {
+    return 0;
+  }
+
+  *flow = trans->flow;
+  free(trans);
+  return 1;
+}
+
+void indigo_fwd_flow_release(of_flow_add_t *flow_add)
+{
+  free(ind_ofdpa_flow_translation_unlink(flow_add));
+}
+
+/****************************************************************
+ * Staged operations
+ ****************************************************************/
+
+static uint32_t *ind_ofdpa_flow_bundle_slot(uint64_t cookie)
+{
+  uint32_t mask = ind_ofdpa_flow_bundle_index_slots - 1;
+  uint32_t i, *slot;
+
+  for (i = ind_ofdpa_flow_bundle_hash(cookie) & mask; ; i = (i + 1) & mask)
+  {
+    slot = &ind_ofdpa_flow_bundle_index[i];
+    if ((*slot == 0) ||
+        (ind_ofdpa_flow_bundle_ops[*slot - 1].flow.cookie == cookie))
+    {
+      return slot;
+    }
+  }
+}
+
+/* Room for one more operation, with the index at most half full */
+static void ind_ofdpa_flow_bundle_reserve(void)
+{
+  uint32_t i;
+
+  if (ind_ofdpa_flow_bundle_op_count == ind_ofdpa_flow_bundle_op_size)
+  {
+    ind_ofdpa_flow_bundle_op_size = ind_ofdpa_flow_bundle_op_size ?
+      ind_ofdpa_flow_bundle_op_size * 2 : IND_OFDPA_FLOW_BUNDLE_MIN_OPS;
+    ind_ofdpa_flow_bundle_ops = realloc(ind_ofdpa_flow_bundle_ops,
+                                        ind_ofdpa_flow_bundle_op_size * sizeof(*ind_ofdpa_flow_bundle_ops));
+    AIM_TRUE_OR_DIE(ind_ofdpa_flow_bundle_ops != NULL);
+  }
+
+  if (2 * (ind_ofdpa_flow_bundle_op_count + 1) > ind_ofdpa_flow_bundle_index_slots)
+  {
+    ind_ofdpa_flow_bundle_index_slots = 2 * ind_ofdpa_flow_bundle_op_size;
+    free(ind_ofdpa_flow_bundle_index);
+    ind_ofdpa_flow_bundle_index = calloc(ind_ofdpa_flow_bundle_index_slots,
+                                         sizeof(*ind_ofdpa_flow_bundle_index));
+    AIM_TRUE_OR_DIE(ind_ofdpa_flow_bundle_index != NULL);
+
+    /* Later operations on a flow replace earlier ones */
+    for (i = 0; i < ind_ofdpa_flow_bundle_op_count; i++)
+    {
+      *ind_ofdpa_flow_bundle_slot(ind_ofdpa_flow_bundle_ops[i].flow.cookie) = i + 1;
+    }
+  }
+}
+
+static void ind_ofdpa_flow_bundle_push(ind_ofdpa_flow_bundle_op_type_t type,
+                                       const ofdpaFlowEntry_t *flow,
+                                       const ofdpaFlowEntry_t *prior,
+                                       const ofdpaFlowEntryStats_t *stats)
+{
+  ind_ofdpa_flow_bundle_op_t *op;
+
+  ind_ofdpa_flow_bundle_reserve();
+
+  op = &ind_ofdpa_flow_bundle_ops[ind_ofdpa_flow_bundle_op_count++];
+  op->type = type;
+  op->flow = *flow;
+  if (prior != NULL)
+  {
+    op->prior = *prior;
+    op->stats = *stats;
+  }
+  else
+  {
+    memset(&op->prior, 0, sizeof(op->prior));
+    memset(&op->stats, 0, sizeof(op->stats));
+  }
+
+  *ind_ofdpa_flow_bundle_slot(flow->cookie) = ind_ofdpa_flow_bundle_op_count;
+}
+
+static void ind_ofdpa_flow_bundle_clear(void)
+{
+  ind_ofdpa_flow_bundle_active = 0;
+  ind_ofdpa_flow_bundle_op_count = 0;
+  if (ind_ofdpa_flow_bundle_index != NULL)
+  {
+    memset(ind_ofdpa_flow_bundle_index, 0,
+           ind_ofdpa_flow_bundle_index_slots * sizeof(*ind_ofdpa_flow_bundle_index));
+  }
+}
+
+int ind_ofdpa_flow_bundle_staging(void)
+{
+  return ind_ofdpa_flow_bundle_active;
+}
+
+/*
+ * Get a flow as the operations recorded so far leave it, reading it from
+ * OF-DPA if the bundle has not touched it.
+ */
+OFDPA_ERROR_t ind_ofdpa_flow_bundle_get(uint64_t flowId, ofdpaFlowEntry_t *flow,
+                                        ofdpaFlowEntryStats_t *flowStats)
+{
+  ind_ofdpa_flow_bundle_op_t *op;
+  uint32_t slot = 0;
+
+  if (ind_ofdpa_flow_bundle_op_count > 0)
+  {
+    slot = *ind_ofdpa_flow_bundle_slot(flowId);
+  }
+
+  if (slot == 0)
+  {
+    return ofdpaFlowByCookieGet(flowId, flow, flowStats);
+  }
+
+  op = &ind_ofdpa_flow_bundle_ops[slot - 1];
+  if (op->type == IND_OFDPA_FLOW_BUNDLE_DELETE)
+  {
+    return OFDPA_E_NOT_FOUND;
+  }
+
+  *flow = op->flow;
+  *flowStats = op->stats;
+  return OFDPA_E_NONE;
+}
+
+void ind_ofdpa_flow_bundle_add(const ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_flow_bundle_push(IND_OFDPA_FLOW_BUNDLE_ADD, flow, NULL, NULL);
+}
+
+void ind_ofdpa_flow_bundle_modify(const ofdpaFlowEntry_t *prior,
+                                  const ofdpaFlowEntryStats_t *stats,
+                                  const ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_flow_bundle_push(IND_OFDPA_FLOW_BUNDLE_MODIFY, flow, prior, stats);
+}
+
+void ind_ofdpa_flow_bundle_delete(const ofdpaFlowEntry_t *prior,
+                                  const ofdpaFlowEntryStats_t *stats)
+{
+  ind_ofdpa_flow_bundle_push(IND_OFDPA_FLOW_BUNDLE_DELETE, prior, prior, stats);
+}
+
+static OFDPA_ERROR_t ind_ofdpa_flow_bundle_op_make(ind_ofdpa_flow_bundle_op_t *op)
+{
+  switch (op->type)
+  {
+    case IND_OFDPA_FLOW_BUNDLE_ADD:
+      return ofdpaFlowAdd(&op->flow);
+    case IND_OFDPA_FLOW_BUNDLE_MODIFY:
+      return ofdpaFlowModify(&op->flow);
+    default:
+      return ofdpaFlowByCookieDelete(op->flow.cookie);
+  }
+}
+
+static OFDPA_ERROR_t ind_ofdpa_flow_bundle_op_undo(ind_ofdpa_flow_bundle_op_t *op)
+{
+  switch (op->type)
+  {
+    case IND_OFDPA_FLOW_BUNDLE_ADD:
+      return ofdpaFlowByCookieDelete(op->flow.cookie);
+    case IND_OFDPA_FLOW_BUNDLE_MODIFY:
+      return ofdpaFlowModify(&op->prior);
+    default:
+      /* Its counters start again from zero */
+      ind_ofdpa_flow_stats_remove(op->prior.cookie);
+      return ofdpaFlowAdd(&op->prior);
+  }
+}
+
+indigo_error_t indigo_fwd_bundle_begin(void)
+{
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
+  ind_ofdpa_flow_bundle_clear();
+  ind_ofdpa_flow_bundle_active = 1;
+
+  return INDIGO_ERROR_NONE;
+}
+
+indigo_error_t indigo_fwd_bundle_commit(void)
+{
+  ind_ofdpa_flow_bundle_op_t *op;
+  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
+  uint32_t i, done;
+
+  for (done = 0; done < ind_ofdpa_flow_bundle_op_count; done++)
+  {
+    ofdpa_rv = ind_ofdpa_flow_bundle_op_make(&ind_ofdpa_flow_bundle_ops[done]);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      break;
+    }
+  }
+
+  if (ofdpa_rv != OFDPA_E_NONE)
+  {
+    LOG_ERROR("Failed to make bundled flow change %u of %u, undoing. (ofdpa_rv = %d)",
+              done + 1, ind_ofdpa_flow_bundle_op_count, ofdpa_rv);
+
+    for (i = done; i-- > 0; )
+    {
+      op = &ind_ofdpa_flow_bundle_ops[i];
+      if (ind_ofdpa_flow_bundle_op_undo(op) != OFDPA_E_NONE)
+      {
+        LOG_ERROR("Failed to undo bundled change of flow 0x%llx.",
+                  (unsigned long long)op->flow.cookie);
+      }
+    }
+  }
+  else
+  {
+    for (i = 0; i < ind_ofdpa_flow_bundle_op_count; i++)
+    {
+      op = &ind_ofdpa_flow_bundle_ops[i];
+      if (op->type == IND_OFDPA_FLOW_BUNDLE_DELETE)
+      {
+        ind_ofdpa_flow_shadow_remove(op->flow.cookie);
+        ind_ofdpa_flow_stats_remove(op->flow.cookie);
+      }
+      else
+      {
+        ind_ofdpa_flow_shadow_set(&op->flow);
+      }
+    }
+  }
+
+  ind_ofdpa_flow_bundle_clear();
+
+  return (indigoConvertOfdpaRv(ofdpa_rv));
+}
+
+void indigo_fwd_bundle_abort(void)
+{
+  ind_ofdpa_flow_bundle_clear();
+}
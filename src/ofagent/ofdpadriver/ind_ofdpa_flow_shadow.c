@@ -0,0 +1,129 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2013-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_flow_shadow.c
+*
+* @purpose      Shadow of the flows programmed by the OF-DPA Driver
+*
+* @component    OF-DPA
+*
+* @comments     A flow modify rebuilds the match and instructions from the
+*               flow_mod, so all it needs from OF-DPA is the table,
+*               priority and timeouts of the flow. The shadow keeps just
+*               those, keyed by flow id, so a modify does not have to read
+*               the flow back first.
+*
+*               The shadow is a flow id keyed ind_ofdpa_flow_map_t (see
+*               ind_ofdpa_util.c), capped at IND_OFDPA_FLOW_SHADOW_MAX
+*               flows. Flows that don't fit are read back from OF-DPA as
+*               before.
+*
+*               Building with IND_OFDPA_FLOW_SHADOW_CHECK reads every
+*               flow back anyway and logs any difference from the shadow.
+*
+* @end
+*
+**********************************************************************/
+
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+
+#define IND_OFDPA_FLOW_SHADOW_MIN_SLOTS 1024
+
+typedef struct ind_ofdpa_flow_shadow_s
+{
+  uint64_t flowId;              /* Key; must come first */
+  uint16_t priority;
+  uint16_t idleTime;
+  uint16_t hardTime;
+  uint8_t  tableId;
+} ind_ofdpa_flow_shadow_t;
+
+static ind_ofdpa_flow_map_t ind_ofdpa_flow_shadow =
+  IND_OFDPA_FLOW_MAP_INIT(ind_ofdpa_flow_shadow_t, IND_OFDPA_FLOW_SHADOW_MIN_SLOTS,
+                          IND_OFDPA_FLOW_SHADOW_MAX);
+
+/* Record a flow programmed in OF-DPA, replacing any earlier record */
+void ind_ofdpa_flow_shadow_set(const ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_flow_shadow_t rec;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.flowId = flow->cookie;
+  rec.tableId = (uint8_t)flow->tableId;
+  rec.priority = (uint16_t)flow->priority;
+  rec.idleTime = (uint16_t)flow->idle_time;
+  rec.hardTime = (uint16_t)flow->hard_time;
+
+  ind_ofdpa_flow_map_set(&ind_ofdpa_flow_shadow, &rec);
+}
+
+void ind_ofdpa_flow_shadow_remove(uint64_t flowId)
+{
+  ind_ofdpa_flow_map_remove(&ind_ofdpa_flow_shadow, flowId);
+}
+
+/*
+ * Fill in the cookie, table, priority and timeouts of a programmed flow.
+ * Returns 0 if the flow is not in the shadow.
+ */
+int ind_ofdpa_flow_shadow_get(uint64_t flowId, ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_flow_shadow_t *slot = ind_ofdpa_flow_map_find(&ind_ofdpa_flow_shadow, flowId);
+
+  if (slot == NULL)
+  {
+    return 0;
+  }
+
+  flow->cookie = flowId;
+  flow->tableId = slot->tableId;
+  flow->priority = slot->priority;
+  flow->idle_time = slot->idleTime;
+  flow->hard_time = slot->hardTime;
+
+#ifdef IND_OFDPA_FLOW_SHADOW_CHECK
+  {
+    ofdpaFlowEntry_t hwFlow;
+    ofdpaFlowEntryStats_t hwStats;
+
+    memset(&hwFlow, 0, sizeof(hwFlow));
+    if (ofdpaFlowByCookieGet(flowId, &hwFlow, &hwStats) != OFDPA_E_NONE)
+    {
+      LOG_ERROR("Shadowed flow 0x%llx is not in OF-DPA.", (unsigned long long)flowId);
+    }
+    else if ((hwFlow.tableId != flow->tableId) ||
+             (hwFlow.priority != flow->priority) ||
+             (hwFlow.idle_time != flow->idle_time) ||
+             (hwFlow.hard_time != flow->hard_time))
+    {
+      LOG_ERROR("Shadow of flow 0x%llx differs from OF-DPA: table %d/%d, "
+                "priority %d/%d, idle %d/%d, hard %d/%d.",
+                (unsigned long long)flowId,
+                flow->tableId, hwFlow.tableId,
+                flow->priority, hwFlow.priority,
+                flow->idle_time, hwFlow.idle_time,
+                flow->hard_time, hwFlow.hard_time);
+    }
+  }
+#endif
+
+  return 1;
+}
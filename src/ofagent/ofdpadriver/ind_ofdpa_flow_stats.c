@@ -0,0 +1,328 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2013-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_flow_stats.c
+*
+* @purpose      Cache of flow counters read from OF-DPA
+*
+* @component    OF-DPA
+*
+* @comments     Reading the counters of one flow by cookie makes OF-DPA
+*               search for the cookie. A flow stats request over a large
+*               table asks for every flow in turn, so instead the
+*               background poller (ind_ofdpa_poll.c) walks the tables with
+*               ofdpaFlowNextGet(), a slice at a time, and the cache keeps
+*               the counters of every flow it passes, keyed by flow id.
+*
+*               Counters are served from the cache while they are at most
+*               ind_ofdpa_flow_stats_max_age milliseconds old. That bound
+*               is how stale a controller may see the packet and byte
+*               counts; the flow duration is advanced by the age of the
+*               entry. A bound of 0 turns the cache off and reads every
+*               flow by cookie as before.
+*
+*               Requests never walk a table themselves, as a large table
+*               would hold up the event loop. A request for a flow that is
+*               not fresh in the cache enrolls the flow's table with the
+*               poller and reads the flow by cookie, so later requests
+*               mostly find the counters fresh. Table stats requests
+*               enroll every table, as their matched counts are summed
+*               from these counters.
+*
+*               Every counter read is also reported to the state manager,
+*               which keeps running totals of them for aggregate stats.
+*               indigo_fwd_table_counters_sync() enrolls a table with the
+*               poller, and lets the totals be used while the last complete
+*               walk of the table started within the max age.
+*
+*               The cache is a flow id keyed ind_ofdpa_flow_map_t (see
+*               ind_ofdpa_util.c), capped at IND_OFDPA_FLOW_STATS_MAX flows.
+*
+* @end
+*
+**********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "indigo/of_state_manager.h"
+#include "indigo/time.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+
+#define IND_OFDPA_FLOW_STATS_MIN_SLOTS  1024
+#define IND_OFDPA_FLOW_STATS_TABLES     256
+
+typedef struct ind_ofdpa_flow_stats_s
+{
+  uint64_t      flowId;         /* Key; must come first */
+  uint64_t      packets;
+  uint64_t      bytes;
+  indigo_time_t refreshed;      /* When the counters were read */
+  uint32_t      durationSec;
+  uint8_t       tableId;
+} ind_ofdpa_flow_stats_t;
+
+static ind_ofdpa_flow_map_t ind_ofdpa_flow_stats =
+  IND_OFDPA_FLOW_MAP_INIT(ind_ofdpa_flow_stats_t, IND_OFDPA_FLOW_STATS_MIN_SLOTS,
+                          IND_OFDPA_FLOW_STATS_MAX);
+
+/* When each table was last walked */
+static indigo_time_t ind_ofdpa_flow_stats_walked[IND_OFDPA_FLOW_STATS_TABLES];
+
+/* Tables stats requests have read, which the poller keeps walking */
+static uint8_t ind_ofdpa_flow_stats_polled[IND_OFDPA_FLOW_STATS_TABLES];
+
+/* Where the poller's walk has got to */
+static ofdpaFlowEntry_t ind_ofdpa_flow_stats_cursor;
+static int ind_ofdpa_flow_stats_cursor_valid;
+static uint32_t ind_ofdpa_flow_stats_cursor_table;
+static indigo_time_t ind_ofdpa_flow_stats_cursor_start;
+
+static uint32_t ind_ofdpa_flow_stats_max_age = IND_OFDPA_FLOW_STATS_MAX_AGE_MS;
+
+static ind_ofdpa_flow_stats_counters_t ind_ofdpa_flow_stats_counters;
+
+/* Record the counters of a flow, replacing any earlier record */
+static void ind_ofdpa_flow_stats_set(uint64_t flowId, uint8_t tableId,
+                                     const ofdpaFlowEntryStats_t *stats,
+                                     indigo_time_t now)
+{
+  ind_ofdpa_flow_stats_t rec;
+
+  if (flowId == 0)
+  {
+    return;
+  }
+
+  memset(&rec, 0, sizeof(rec));
+  rec.flowId = flowId;
+  rec.tableId = tableId;
+  rec.packets = stats->receivedPackets;
+  rec.bytes = stats->receivedBytes;
+  rec.durationSec = stats->durationSec;
+  rec.refreshed = now;
+
+  indigo_core_flow_counters_update(flowId, rec.packets, rec.bytes);
+
+  ind_ofdpa_flow_map_set(&ind_ofdpa_flow_stats, &rec);
+}
+
+void ind_ofdpa_flow_stats_remove(uint64_t flowId)
+{
+  ind_ofdpa_flow_map_remove(&ind_ofdpa_flow_stats, flowId);
+}
+
+/* Return the counters of a cached flow if they are fresh enough */
+static int ind_ofdpa_flow_stats_fresh(uint64_t flowId, indigo_time_t now,
+                                      ofdpaFlowEntryStats_t *flowStats)
+{
+  ind_ofdpa_flow_stats_t *slot = ind_ofdpa_flow_map_find(&ind_ofdpa_flow_stats, flowId);
+  indigo_time_t age;
+
+  if (slot == NULL)
+  {
+    return 0;
+  }
+
+  age = now - slot->refreshed;
+  if (age > ind_ofdpa_flow_stats_max_age)
+  {
+    return 0;
+  }
+
+  flowStats->receivedPackets = slot->packets;
+  flowStats->receivedBytes = slot->bytes;
+  flowStats->durationSec = slot->durationSec + (uint32_t)(age / 1000);
+
+  if (age > ind_ofdpa_flow_stats_counters.maxAgeServed)
+  {
+    ind_ofdpa_flow_stats_counters.maxAgeServed = age;
+  }
+
+  return 1;
+}
+
+/*
+ * Get the counters of a flow, from the cache if they are fresh enough.
+ * Otherwise reads the flow by cookie and hands its table to the poller.
+ */
+OFDPA_ERROR_t ind_ofdpa_flow_stats_get(uint64_t flowId, ofdpaFlowEntryStats_t *flowStats)
+{
+  OFDPA_ERROR_t rc;
+  ofdpaFlowEntry_t flow;
+  indigo_time_t now;
+
+  memset(&flow, 0, sizeof(flow));
+
+  if (ind_ofdpa_flow_stats_max_age == 0)
+  {
+    return ofdpaFlowByCookieGet(flowId, &flow, flowStats);
+  }
+
+  now = INDIGO_CURRENT_TIME;
+
+  if (ind_ofdpa_flow_stats_fresh(flowId, now, flowStats))
+  {
+    ind_ofdpa_flow_stats_counters.hits++;
+    return OFDPA_E_NONE;
+  }
+
+  ind_ofdpa_flow_stats_counters.misses++;
+  ind_ofdpa_flow_stats_counters.cookieReads++;
+
+  rc = ofdpaFlowByCookieGet(flowId, &flow, flowStats);
+  if (rc == OFDPA_E_NONE)
+  {
+    ind_ofdpa_flow_stats_set(flowId, (uint8_t)flow.tableId, flowStats, now);
+    ind_ofdpa_flow_stats_polled[(uint8_t)flow.tableId] = 1;
+  }
+
+  return rc;
+}
+
+/*
+ * Continue the background walk for at most budget OF-DPA calls. Returns
+ * the number of calls made and sets *cycleDone once every polled table
+ * has been walked.
+ */
+int ind_ofdpa_flow_stats_poll(int budget, int *cycleDone)
+{
+  OFDPA_ERROR_t rc;
+  ofdpaFlowEntryStats_t flowStats;
+  indigo_time_t now = INDIGO_CURRENT_TIME;
+  uint32_t t;
+  int spent = 0;
+
+  *cycleDone = 0;
+
+  if (ind_ofdpa_flow_stats_max_age == 0)
+  {
+    return 0;
+  }
+
+  while (spent < budget)
+  {
+    if (!ind_ofdpa_flow_stats_cursor_valid)
+    {
+      for (t = ind_ofdpa_flow_stats_cursor_table;
+           (t < IND_OFDPA_FLOW_STATS_TABLES) && !ind_ofdpa_flow_stats_polled[t];
+           t++)
+      {
+      }
+
+      if (t == IND_OFDPA_FLOW_STATS_TABLES)
+      {
+        ind_ofdpa_flow_stats_cursor_table = 0;
+        *cycleDone = 1;
+        break;
+      }
+
+      ind_ofdpa_flow_stats_cursor_table = t;
+      memset(&ind_ofdpa_flow_stats_cursor, 0, sizeof(ind_ofdpa_flow_stats_cursor));
+      if (ofdpaFlowEntryInit(t, &ind_ofdpa_flow_stats_cursor) != OFDPA_E_NONE)
+      {
+        ind_ofdpa_flow_stats_polled[t] = 0;
+        continue;
+      }
+      ind_ofdpa_flow_stats_cursor_valid = 1;
+      ind_ofdpa_flow_stats_cursor_start = now;
+      ind_ofdpa_flow_stats_counters.walks++;
+    }
+
+    rc = ofdpaFlowNextGet(&ind_ofdpa_flow_stats_cursor, &ind_ofdpa_flow_stats_cursor);
+    spent++;
+    if (rc != OFDPA_E_NONE)
+    {
+      /* End of the table */
+      ind_ofdpa_flow_stats_walked[ind_ofdpa_flow_stats_cursor_table] =
+        ind_ofdpa_flow_stats_cursor_start;
+      ind_ofdpa_flow_stats_cursor_valid = 0;
+      ind_ofdpa_flow_stats_cursor_table++;
+      continue;
+    }
+
+    ind_ofdpa_flow_stats_counters.walkedFlows++;
+
+    memset(&flowStats, 0, sizeof(flowStats));
+    if (ofdpaFlowStatsGet(&ind_ofdpa_flow_stats_cursor, &flowStats) == OFDPA_E_NONE)
+    {
+      ind_ofdpa_flow_stats_set(ind_ofdpa_flow_stats_cursor.cookie,
+                               (uint8_t)ind_ofdpa_flow_stats_cursor_table,
+                               &flowStats, now);
+    }
+    spent++;
+  }
+
+  return spent;
+}
+
+/* Have the poller keep the counters of a table's flows current */
+void ind_ofdpa_flow_stats_poll_table(uint8_t tableId)
+{
+  ind_ofdpa_flow_stats_polled[tableId] = 1;
+}
+
+/*
+ * Whether the counters reported for a table's flows can stand in for
+ * reading them. Never walks the table here, as a large table would hold
+ * up the event loop; the table is handed to the poller instead, and its
+ * reports are used while they are no older than the max age, that is
+ * while the last complete walk of the table started within it. The
+ * poller can fall behind (it is disabled, deferred by queued flow adds,
+ * or too slow for the table), so that is checked on every call.
+ */
+indigo_error_t indigo_fwd_table_counters_sync(uint8_t table_id)
+{
+  indigo_time_t walked;
+
+  if (ind_ofdpa_flow_stats_max_age == 0)
+  {
+    return INDIGO_ERROR_NOT_SUPPORTED;
+  }
+
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
+  ind_ofdpa_flow_stats_polled[table_id] = 1;
+
+  walked = ind_ofdpa_flow_stats_walked[table_id];
+  if ((walked == 0) || (INDIGO_CURRENT_TIME - walked > ind_ofdpa_flow_stats_max_age))
+  {
+    return INDIGO_ERROR_PENDING;
+  }
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_flow_stats_max_age_set(uint32_t maxAgeMs)
+{
+  ind_ofdpa_flow_stats_max_age = maxAgeMs;
+  memset(ind_ofdpa_flow_stats_walked, 0, sizeof(ind_ofdpa_flow_stats_walked));
+}
+
+uint32_t ind_ofdpa_flow_stats_max_age_get(void)
+{
+  return ind_ofdpa_flow_stats_max_age;
+}
+
+void ind_ofdpa_flow_stats_counters_get(ind_ofdpa_flow_stats_counters_t *counters)
+{
+  *counters = ind_ofdpa_flow_stats_counters;
+  counters->cached = ind_ofdpa_flow_stats.count;
+}
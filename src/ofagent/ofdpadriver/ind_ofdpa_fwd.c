@@ -38,6 +38,7 @@
 #include <pthread.h>
 #include <errno.h>
 #include "ind_ofdpa_util.h"
+#include "ind_ofdpa_flow_tables.h"
 #include "indigo/memory.h"
 #include "indigo/forwarding.h"
 #include "ind_ofdpa_log.h"
@@ -48,7 +49,9 @@
 
 static indigo_error_t ind_ofdpa_packet_out_actions_get(of_list_action_t *of_list_actions,
                                                        indPacketOutActions_t *packetOutActions);
-static indigo_error_t ind_ofdpa_match_fields_masks_get(const of_match_t *match, ofdpaFlowEntry_t *flow);
+static indigo_error_t ind_ofdpa_match_fields_masks_get(const of_match_t *match,
+                                                       ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                       ofdpaFlowEntry_t *flow);
 static indigo_error_t ind_ofdpa_translate_openflow_actions(of_object_id_t type, of_list_action_t *actions, ofdpaFlowEntry_t *flow);
 static indigo_error_t indigo_set_mpls_qos(ofdpa_mpls_set_qos_action_mod_msg_t *mpls_set_qos_action);
 static indigo_error_t indigo_oam_dataplane(ofdpa_oam_dataplane_ctr_mod_msg_t *oam_dataplane_ctr);
@@ -309,574 +312,223 @@ static void ind_ofdpa_populate_flow_bitmask(const of_match_t *match, ind_ofdpa_f
   LOG_TRACE("match_fields_bitmask is 0x%llX", *ind_ofdpa_match_fields_bitmask);
 }
 
-/* Get the flow match criteria from of_match */
-
-static indigo_error_t ind_ofdpa_match_fields_masks_get(const of_match_t *match, ofdpaFlowEntry_t *flow)
+/* The L4 ports and ICMP type and code an ACL policy flow matches depend on its IP protocol */
+static void ind_ofdpa_acl_policy_l4_match_get(const of_match_t *match, ofdpaFlowEntry_t *flow)
 {
-  indigo_error_t err = INDIGO_ERROR_NONE;
-  ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask;
-
-  ind_ofdpa_populate_flow_bitmask(match, &ind_ofdpa_match_fields_bitmask);
-
-  switch (flow->tableId)
+  if (match->fields.ip_proto == IPPROTO_TCP)
   {
-    case OFDPA_FLOW_TABLE_ID_INGRESS_PORT:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_ING_PORT_FLOW_MATCH_BITMAP) != IND_OFDPA_ING_PORT_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_ING_PORT_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_ING_PORT_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.ingressPortFlowEntry.match_criteria.inPort        = match->fields.in_port;
-        flow->flowData.ingressPortFlowEntry.match_criteria.inPortMask    = match->masks.in_port;
-        flow->flowData.ingressPortFlowEntry.match_criteria.tunnelId      = match->fields.tunnel_id;
-        flow->flowData.ingressPortFlowEntry.match_criteria.tunnelIdMask  = match->masks.tunnel_id;
-        flow->flowData.ingressPortFlowEntry.match_criteria.etherType     = match->fields.eth_type;
-        flow->flowData.ingressPortFlowEntry.match_criteria.etherTypeMask = match->masks.eth_type;
-        flow->flowData.ingressPortFlowEntry.match_criteria.lmepId        = match->fields.ofdpa_lmep_id;
-        flow->flowData.ingressPortFlowEntry.match_criteria.lmepIdMask    = match->masks.ofdpa_lmep_id;
-      }
-      break;
-
-    case OFDPA_FLOW_TABLE_ID_INJECTED_OAM:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_INJECTED_OAM_FLOW_MATCH_BITMAP) != IND_OFDPA_INJECTED_OAM_FLOW_MATCH_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_INJECTED_OAM_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_INJECTED_OAM_FLOW_MATCH_MAND_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.injectedOamFlowEntry.match_criteria.lmepId = match->fields.ofdpa_lmep_id;
-      }
-      break;
-
-    case OFDPA_FLOW_TABLE_ID_VLAN:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_VLAN_FLOW_MATCH_BITMAP) != IND_OFDPA_VLAN_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_VLAN_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_VLAN_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.vlanFlowEntry.match_criteria.inPort        = match->fields.in_port;
-        flow->flowData.vlanFlowEntry.match_criteria.vlanId        = match->fields.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.vlanFlowEntry.match_criteria.vlanIdMask    = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-      }
-      break;
-
-    case OFDPA_FLOW_TABLE_ID_VLAN_1:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_VLAN1_FLOW_MATCH_BITMAP) != IND_OFDPA_VLAN1_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_VLAN1_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_VLAN1_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.vlan1FlowEntry.match_criteria.inPort        = match->fields.in_port;
-        flow->flowData.vlan1FlowEntry.match_criteria.vlanId        = match->fields.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.vlan1FlowEntry.match_criteria.ovid          = match->fields.ofdpa_ovid;
-      }
-      break;
-
-    case OFDPA_FLOW_TABLE_ID_MAINTENANCE_POINT:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MP_FLOW_MATCH_BITMAP) != IND_OFDPA_MP_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MP_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_MP_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.mpFlowEntry.match_criteria.etherType          = match->fields.eth_type;
-        flow->flowData.mpFlowEntry.match_criteria.etherTypeMask      = match->masks.eth_type;
-        flow->flowData.mpFlowEntry.match_criteria.oamY1731Mdl        = match->fields.ofdpa_oam_y1731_mdl;
-        flow->flowData.mpFlowEntry.match_criteria.oamY1731MdlMask    = match->masks.ofdpa_oam_y1731_mdl & OFDPA_OAM_Y1731_MDL_EXACT_MASK;
-        flow->flowData.mpFlowEntry.match_criteria.oamY1731Opcode     = match->fields.ofdpa_oam_y1731_opcode;
-        flow->flowData.mpFlowEntry.match_criteria.oamY1731OpcodeMask = match->masks.ofdpa_oam_y1731_opcode;
-        flow->flowData.mpFlowEntry.match_criteria.inPort             = match->fields.in_port;
-        flow->flowData.mpFlowEntry.match_criteria.vlanId             = match->fields.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.mpFlowEntry.match_criteria.vlanIdMask         = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-
-        memcpy(flow->flowData.mpFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.mpFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
-      }
-      break;
-
-    case OFDPA_FLOW_TABLE_ID_MPLS_L2_PORT:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_BITMAP) != IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.mplsL2PortFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
-        flow->flowData.mplsL2PortFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
-        flow->flowData.mplsL2PortFlowEntry.match_criteria.etherType      = match->fields.eth_type;
-        flow->flowData.mplsL2PortFlowEntry.match_criteria.etherTypeMask  = match->masks.eth_type;
-        flow->flowData.mplsL2PortFlowEntry.match_criteria.tunnelId       = match->fields.tunnel_id;
-      }
-      break;
+    flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.tcp_src;
+    flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.tcp_src;
+    flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.tcp_dst;
+    flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.tcp_dst;
+  }
+  else if (match->fields.ip_proto == IPPROTO_UDP)
+  {
+    flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.udp_src;
+    flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.udp_src;
+    flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.udp_dst;
+    flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.udp_dst;
+  }
+  else if (match->fields.ip_proto == IPPROTO_SCTP)
+  {
+    flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.sctp_src;
+    flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.sctp_src;
+    flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.sctp_dst;
+    flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.sctp_dst;
+  }
 
-    case OFDPA_FLOW_TABLE_ID_TERMINATION_MAC:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_TERM_MAC_FLOW_MATCH_BITMAP) != IND_OFDPA_TERM_MAC_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_TERM_MAC_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_TERM_MAC_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.terminationMacFlowEntry.match_criteria.inPort     = match->fields.in_port;
-        flow->flowData.terminationMacFlowEntry.match_criteria.inPortMask = match->masks.in_port;
-        flow->flowData.terminationMacFlowEntry.match_criteria.etherType  = match->fields.eth_type;
+  if (match->fields.ip_proto == IPPROTO_ICMP)
+  {
+    flow->flowData.policyAclFlowEntry.match_criteria.icmpType     = match->fields.icmpv4_type;
+    flow->flowData.policyAclFlowEntry.match_criteria.icmpTypeMask = match->masks.icmpv4_type;
+    flow->flowData.policyAclFlowEntry.match_criteria.icmpCode     = match->fields.icmpv4_code;
+    flow->flowData.policyAclFlowEntry.match_criteria.icmpCodeMask = match->masks.icmpv4_code;
+  }
+  else if (match->fields.ip_proto == IPPROTO_ICMPV6)
+  {
+    flow->flowData.policyAclFlowEntry.match_criteria.icmpType     = match->fields.icmpv6_type;
+    flow->flowData.policyAclFlowEntry.match_criteria.icmpTypeMask = match->masks.icmpv6_type;
+    flow->flowData.policyAclFlowEntry.match_criteria.icmpCode     = match->fields.icmpv6_code;
+    flow->flowData.policyAclFlowEntry.match_criteria.icmpCodeMask = match->masks.icmpv6_code;
+  }
+}
 
-        memcpy(flow->flowData.terminationMacFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.terminationMacFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
+/*
+ * Match translators, one per table rule in ind_ofdpa_flow_tables.h. Each is
+ * a straight-line copy of the fields its tables take.
+ */
+#define IND_OFDPA_MF_VALUE(_member, _field, _ofField) \
+  flow->flowData._member.match_criteria._field = match->fields._ofField;
+#define IND_OFDPA_MF_MASKED(_member, _field, _ofField) \
+  flow->flowData._member.match_criteria._field = match->fields._ofField; \
+  flow->flowData._member.match_criteria._field##Mask = match->masks._ofField;
+#define IND_OFDPA_MF_VALUE_AND(_member, _field, _ofField, _mask) \
+  flow->flowData._member.match_criteria._field = match->fields._ofField & (_mask);
+#define IND_OFDPA_MF_MASKED_AND(_member, _field, _ofField, _mask) \
+  flow->flowData._member.match_criteria._field = match->fields._ofField; \
+  flow->flowData._member.match_criteria._field##Mask = match->masks._ofField & (_mask);
+#define IND_OFDPA_MF_BOTH_AND(_member, _field, _ofField, _mask) \
+  flow->flowData._member.match_criteria._field = match->fields._ofField & (_mask); \
+  flow->flowData._member.match_criteria._field##Mask = match->masks._ofField & (_mask);
+#define IND_OFDPA_MF_MAC(_member, _field, _ofField) \
+  memcpy(flow->flowData._member.match_criteria._field.addr, &match->fields._ofField, OF_MAC_ADDR_BYTES); \
+  memcpy(flow->flowData._member.match_criteria._field##Mask.addr, &match->masks._ofField, OF_MAC_ADDR_BYTES);
+#define IND_OFDPA_MF_IPV6(_member, _field, _ofField) \
+  memcpy(&flow->flowData._member.match_criteria._field, &match->fields._ofField, OF_IPV6_BYTES);
+#define IND_OFDPA_MF_IPV6_MASKED(_member, _field, _ofField) \
+  memcpy(&flow->flowData._member.match_criteria._field, &match->fields._ofField, OF_IPV6_BYTES); \
+  memcpy(&flow->flowData._member.match_criteria._field##Mask, &match->masks._ofField, OF_IPV6_BYTES);
+#define IND_OFDPA_MF_CALL(_function) \
+  _function(match, flow);
+
+typedef struct ind_ofdpa_flow_match_s
+{
+  ind_ofdpa_fields_t allowed;
+  ind_ofdpa_fields_t mandatory;
+  ind_ofdpa_fields_t altMandatory;     /* 0 if none */
+  void (*get)(const of_match_t *match, ofdpaFlowEntry_t *flow);
+} ind_ofdpa_flow_match_t;
+
+#define IND_OFDPA_FLOW_MATCH(_name, _allowed, _mandatory, _altMandatory) \
+static void ind_ofdpa_match_##_name##_get(const of_match_t *match, ofdpaFlowEntry_t *flow) \
+{ \
+  IND_OFDPA_##_name##_MATCH \
+} \
+static const ind_ofdpa_flow_match_t ind_ofdpa_flow_match_##_name = \
+  { _allowed, _mandatory, _altMandatory, ind_ofdpa_match_##_name##_get };
+
+IND_OFDPA_FLOW_MATCHES(IND_OFDPA_FLOW_MATCH)
+
+#undef IND_OFDPA_FLOW_MATCH
+#undef IND_OFDPA_MF_VALUE
+#undef IND_OFDPA_MF_MASKED
+#undef IND_OFDPA_MF_VALUE_AND
+#undef IND_OFDPA_MF_MASKED_AND
+#undef IND_OFDPA_MF_BOTH_AND
+#undef IND_OFDPA_MF_MAC
+#undef IND_OFDPA_MF_IPV6
+#undef IND_OFDPA_MF_IPV6_MASKED
+#undef IND_OFDPA_MF_CALL
+
+typedef struct ind_ofdpa_flow_table_s
+{
+  const ind_ofdpa_flow_match_t *match;
+  uint32_t instructions;               /* IND_OFDPA_INST_* allowed */
+} ind_ofdpa_flow_table_t;
 
-        flow->flowData.terminationMacFlowEntry.match_criteria.vlanId     = match->fields.vlan_vid;
-        flow->flowData.terminationMacFlowEntry.match_criteria.vlanIdMask = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-      }
-      break;
+#define IND_OFDPA_FLOW_TABLE(_id, _name, _apply, _write, _clear, _goto) \
+static const ind_ofdpa_flow_table_t ind_ofdpa_flow_table_##_id = \
+  { &ind_ofdpa_flow_match_##_name, \
+    ((_apply) ? IND_OFDPA_INST_APPLY_ACTIONS : 0) | \
+    ((_write) ? IND_OFDPA_INST_WRITE_ACTIONS : 0) | \
+    ((_clear) ? IND_OFDPA_INST_CLEAR_ACTIONS : 0) | \
+    ((_goto) ? IND_OFDPA_INST_GOTO_TABLE : 0) | \
+    IND_OFDPA_INST_METER };
 
-    case OFDPA_FLOW_TABLE_ID_MPLS_0:
-    case OFDPA_FLOW_TABLE_ID_MPLS_1:
-    case OFDPA_FLOW_TABLE_ID_MPLS_2:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MPLS_FLOW_MATCH_BITMAP) != IND_OFDPA_MPLS_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MPLS_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_MPLS_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.mplsFlowEntry.match_criteria.etherType               = match->fields.eth_type;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsBos                 = match->fields.mpls_bos;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsLabel               = match->fields.mpls_label;
-        flow->flowData.mplsFlowEntry.match_criteria.inPort                  = match->fields.in_port;
-        flow->flowData.mplsFlowEntry.match_criteria.inPortMask              = match->masks.in_port;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsTtl                 = match->fields.ofdpa_mpls_ttl;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsTtlMask             = match->masks.ofdpa_mpls_ttl;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsDataFirstNibble     = match->fields.ofdpa_mpls_data_first_nibble;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsDataFirstNibbleMask = match->masks.ofdpa_mpls_data_first_nibble;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsAchChannel          = match->fields.ofdpa_mpls_ach_channel;
-        flow->flowData.mplsFlowEntry.match_criteria.mplsAchChannelMask      = match->masks.ofdpa_mpls_ach_channel;
-        flow->flowData.mplsFlowEntry.match_criteria.nextLabelIsGal          = match->fields.ofdpa_mpls_next_label_is_gal;
-        flow->flowData.mplsFlowEntry.match_criteria.nextLabelIsGalMask      = match->masks.ofdpa_mpls_next_label_is_gal;
-        flow->flowData.mplsFlowEntry.match_criteria.destIp4                 = match->fields.ipv4_dst;
-        flow->flowData.mplsFlowEntry.match_criteria.destIp4Mask             = match->masks.ipv4_dst;
-
-        memcpy(&flow->flowData.mplsFlowEntry.match_criteria.destIp6, &match->fields.ipv6_dst, OF_IPV6_BYTES);
-        memcpy(&flow->flowData.mplsFlowEntry.match_criteria.destIp6Mask, &match->masks.ipv6_dst, OF_IPV6_BYTES);
-
-        flow->flowData.mplsFlowEntry.match_criteria.ipProto        = match->fields.ip_proto;
-        flow->flowData.mplsFlowEntry.match_criteria.ipProtoMask    = match->masks.ip_proto;
-        flow->flowData.mplsFlowEntry.match_criteria.udpSrcPort     = match->fields.udp_src;
-        flow->flowData.mplsFlowEntry.match_criteria.udpSrcPortMask = match->masks.udp_src;
-        flow->flowData.mplsFlowEntry.match_criteria.udpDstPort     = match->fields.udp_dst;
-        flow->flowData.mplsFlowEntry.match_criteria.udpDstPortMask = match->masks.udp_dst;
-      }
-      break;
+IND_OFDPA_FLOW_TABLES(IND_OFDPA_FLOW_TABLE)
 
-    case OFDPA_FLOW_TABLE_ID_MPLS_MAINTENANCE_POINT:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MPLS_MP_FLOW_MATCH_BITMAP) != IND_OFDPA_MPLS_MP_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MPLS_MP_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_MPLS_MP_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.mplsMpFlowEntry.match_criteria.lmepId         = match->fields.ofdpa_lmep_id;
-        flow->flowData.mplsMpFlowEntry.match_criteria.oamY1731Opcode = match->fields.ofdpa_oam_y1731_opcode;
-        flow->flowData.mplsMpFlowEntry.match_criteria.etherType      = match->fields.eth_type;
-      }
-      break;
+#undef IND_OFDPA_FLOW_TABLE
 
-    case OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_UCAST_ROUTING_FLOW_MATCH_BITMAP) != IND_OFDPA_UCAST_ROUTING_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if (((ind_ofdpa_match_fields_bitmask & IND_OFDPA_UCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP)
-                  != IND_OFDPA_UCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP) &&
-               ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_UCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP)
-                  != IND_OFDPA_UCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP))
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.unicastRoutingFlowEntry.match_criteria.etherType  = match->fields.eth_type;
-        flow->flowData.unicastRoutingFlowEntry.match_criteria.vrf        = match->fields.ofdpa_vrf;
-        flow->flowData.unicastRoutingFlowEntry.match_criteria.vrfMask    = match->masks.ofdpa_vrf;
-        flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp4     = match->fields.ipv4_dst;
-        flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp4Mask = match->masks.ipv4_dst;
-
-        memcpy(&flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp6, &match->fields.ipv6_dst, OF_IPV6_BYTES);
-        memcpy(&flow->flowData.unicastRoutingFlowEntry.match_criteria.dstIp6Mask, &match->masks.ipv6_dst, OF_IPV6_BYTES);
-      }
-      break;
-
-    case OFDPA_FLOW_TABLE_ID_MULTICAST_ROUTING:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_MCAST_ROUTING_FLOW_MATCH_BITMAP) != IND_OFDPA_MCAST_ROUTING_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if (((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP)
-                  != IND_OFDPA_MCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP) &&
-               ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_MCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP)
-                  != IND_OFDPA_MCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP))
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.etherType  = match->fields.eth_type;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.vlanId     = match->fields.vlan_vid;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.vrf        = match->fields.ofdpa_vrf;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.vrfMask    = match->masks.ofdpa_vrf;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp4     = match->fields.ipv4_src;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp4Mask = match->masks.ipv4_src;
-        flow->flowData.multicastRoutingFlowEntry.match_criteria.dstIp4     = match->fields.ipv4_dst;
-
-        memcpy(flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp6.s6_addr, match->fields.ipv6_src.addr, OF_IPV6_BYTES);
-        memcpy(flow->flowData.multicastRoutingFlowEntry.match_criteria.srcIp6Mask.s6_addr, match->masks.ipv6_src.addr, OF_IPV6_BYTES);
-        memcpy(flow->flowData.multicastRoutingFlowEntry.match_criteria.dstIp6.s6_addr, match->fields.ipv6_dst.addr, OF_IPV6_BYTES);
-      }
-      break;
-
-    case OFDPA_FLOW_TABLE_ID_BRIDGING:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_BRIDGING_FLOW_MATCH_BITMAP) != IND_OFDPA_BRIDGING_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.bridgingFlowEntry.match_criteria.vlanId       = match->fields.vlan_vid;
-        flow->flowData.bridgingFlowEntry.match_criteria.vlanIdMask   = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.bridgingFlowEntry.match_criteria.tunnelId     = match->fields.tunnel_id;
-        flow->flowData.bridgingFlowEntry.match_criteria.tunnelIdMask = match->masks.tunnel_id;
+/* Returns NULL for a table the driver does not know */
+static const ind_ofdpa_flow_table_t *ind_ofdpa_flow_table_get(uint32_t tableId)
+{
+  switch (tableId)
+  {
+#define IND_OFDPA_FLOW_TABLE(_id, _name, _apply, _write, _clear, _goto) \
+    case _id: \
+      return &ind_ofdpa_flow_table_##_id;
 
-        memcpy(flow->flowData.bridgingFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.bridgingFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
-      }
-      break;
+    IND_OFDPA_FLOW_TABLES(IND_OFDPA_FLOW_TABLE)
 
-    case OFDPA_FLOW_TABLE_ID_L2_POLICER:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_L2_POLICER_FLOW_MATCH_BITMAP) != IND_OFDPA_L2_POLICER_FLOW_MATCH_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_L2_POLICER_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_L2_POLICER_FLOW_MATCH_MAND_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.l2PolicerFlowEntry.match_criteria.tunnelId       = match->fields.tunnel_id;
-        flow->flowData.l2PolicerFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
-        flow->flowData.l2PolicerFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
-      }
-      break;
+#undef IND_OFDPA_FLOW_TABLE
+    default:
+      return NULL;
+  }
+}
 
-    case OFDPA_FLOW_TABLE_ID_L2_POLICER_ACTIONS:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_BITMAP) != IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_MAND_BITMAP)
-      {
-       err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.l2PolicerActionsFlowEntry.match_criteria.color             = match->fields.ofdpa_color;
-        flow->flowData.l2PolicerActionsFlowEntry.match_criteria.colorActionsIndex = match->fields.ofdpa_color_actions_index;
-      }
-      break;
+/*
+ * Ids of the flow tables OF-DPA supports. The set is fixed by the
+ * pipeline, so it is found once at startup rather than probed for each
+ * features or table stats request. The table sizes read at the same time
+ * are reported to the state manager, which tracks each table's headroom
+ * from them.
+ */
+#define IND_OFDPA_TABLE_IDS  255
 
-    case OFDPA_FLOW_TABLE_ID_PORT_DSCP_TRUST:
-    case OFDPA_FLOW_TABLE_ID_TUNNEL_DSCP_TRUST:
-    case OFDPA_FLOW_TABLE_ID_MPLS_DSCP_TRUST:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_DSCP_TRUST_FLOW_MATCH_BITMAP) != IND_OFDPA_DSCP_TRUST_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_DSCP_TRUST_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_DSCP_TRUST_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.dscpTrustFlowEntry.match_criteria.qosIndex       = match->fields.ofdpa_qos_index;
-        flow->flowData.dscpTrustFlowEntry.match_criteria.dscpValue      = match->fields.ip_dscp;
-        flow->flowData.dscpTrustFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
-        flow->flowData.dscpTrustFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
-      }
-      break;
+static uint8_t ind_ofdpa_tables[IND_OFDPA_TABLE_IDS];
+static uint32_t ind_ofdpa_table_count;
+static ofdpaFlowTableInfo_t ind_ofdpa_table_info[IND_OFDPA_TABLE_IDS];
 
-    case OFDPA_FLOW_TABLE_ID_PORT_PCP_TRUST:
-    case OFDPA_FLOW_TABLE_ID_TUNNEL_PCP_TRUST:
-    case OFDPA_FLOW_TABLE_ID_MPLS_PCP_TRUST:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_PCP_TRUST_FLOW_MATCH_BITMAP) != IND_OFDPA_PCP_TRUST_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_PCP_TRUST_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_PCP_TRUST_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.pcpTrustFlowEntry.match_criteria.qosIndex       = match->fields.ofdpa_qos_index;
-        flow->flowData.pcpTrustFlowEntry.match_criteria.pcpValue       = match->fields.vlan_pcp;
-        flow->flowData.pcpTrustFlowEntry.match_criteria.dei            = match->fields.ofdpa_dei;
-        flow->flowData.pcpTrustFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
-        flow->flowData.pcpTrustFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
-      }
-      break;
+void ind_ofdpa_tables_init(void)
+{
+  uint32_t tableId;
 
-    case OFDPA_FLOW_TABLE_ID_ACL_POLICY:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_ACL_POLICY_FLOW_MATCH_BITMAP) != IND_OFDPA_ACL_POLICY_FLOW_MATCH_BITMAP)
+  ind_ofdpa_table_count = 0;
+  memset(ind_ofdpa_table_info, 0, sizeof(ind_ofdpa_table_info));
+  for (tableId = 0; tableId < IND_OFDPA_TABLE_IDS; tableId++)
+  {
+    if (ofdpaFlowTableSupported(tableId) == OFDPA_E_NONE)
+    {
+      ind_ofdpa_tables[ind_ofdpa_table_count++] = tableId;
+      if (ofdpaFlowTableInfoGet(tableId, &ind_ofdpa_table_info[tableId]) != OFDPA_E_NONE)
       {
-        err = INDIGO_ERROR_COMPAT;
+        LOG_ERROR("Failed to get size of flow table %u.", tableId);
+        memset(&ind_ofdpa_table_info[tableId], 0, sizeof(ind_ofdpa_table_info[tableId]));
       }
-      else
-      {
-        flow->flowData.policyAclFlowEntry.match_criteria.inPort         = match->fields.in_port;
-        flow->flowData.policyAclFlowEntry.match_criteria.inPortMask     = match->masks.in_port;
-        flow->flowData.policyAclFlowEntry.match_criteria.mplsL2Port     = match->fields.ofdpa_mpls_l2_port;
-        flow->flowData.policyAclFlowEntry.match_criteria.mplsL2PortMask = match->masks.ofdpa_mpls_l2_port;
-
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.srcMac.addr, &match->fields.eth_src, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.srcMacMask.addr, &match->masks.eth_src, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
-
-        flow->flowData.policyAclFlowEntry.match_criteria.etherType     = match->fields.eth_type;
-        flow->flowData.policyAclFlowEntry.match_criteria.etherTypeMask = match->masks.eth_type;
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanId        = match->fields.vlan_vid;
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanIdMask    = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanPcp       = match->fields.vlan_pcp;
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanPcpMask   = match->masks.vlan_pcp;
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanDei       = match->fields.ofdpa_dei;
-        flow->flowData.policyAclFlowEntry.match_criteria.vlanDeiMask   = match->masks.ofdpa_dei;
-        flow->flowData.policyAclFlowEntry.match_criteria.tunnelId      = match->fields.tunnel_id;
-        flow->flowData.policyAclFlowEntry.match_criteria.tunnelIdMask  = match->masks.tunnel_id;
-        flow->flowData.policyAclFlowEntry.match_criteria.vrf           = match->fields.ofdpa_vrf;
-        flow->flowData.policyAclFlowEntry.match_criteria.vrfMask       = match->masks.ofdpa_vrf;
-        flow->flowData.policyAclFlowEntry.match_criteria.sourceIp4     = match->fields.ipv4_src;
-        flow->flowData.policyAclFlowEntry.match_criteria.sourceIp4Mask = match->masks.ipv4_src;
-        flow->flowData.policyAclFlowEntry.match_criteria.destIp4       = match->fields.ipv4_dst;
-        flow->flowData.policyAclFlowEntry.match_criteria.destIp4Mask   = match->masks.ipv4_dst;
-
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.sourceIp6.s6_addr, match->fields.ipv6_src.addr, OF_IPV6_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.sourceIp6Mask.s6_addr, match->masks.ipv6_src.addr, OF_IPV6_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destIp6.s6_addr, match->fields.ipv6_dst.addr, OF_IPV6_BYTES);
-        memcpy(flow->flowData.policyAclFlowEntry.match_criteria.destIp6Mask.s6_addr, match->masks.ipv6_dst.addr, OF_IPV6_BYTES);
-
-        flow->flowData.policyAclFlowEntry.match_criteria.ipv4ArpSpa     = match->fields.arp_spa;
-        flow->flowData.policyAclFlowEntry.match_criteria.ipv4ArpSpaMask = match->masks.arp_spa;
-        flow->flowData.policyAclFlowEntry.match_criteria.ipProto        = match->fields.ip_proto;
-        flow->flowData.policyAclFlowEntry.match_criteria.ipProtoMask    = match->masks.ip_proto;
-        flow->flowData.policyAclFlowEntry.match_criteria.dscp           = match->fields.ip_dscp;
-        flow->flowData.policyAclFlowEntry.match_criteria.dscpMask       = match->masks.ip_dscp;
-        flow->flowData.policyAclFlowEntry.match_criteria.ecn            = match->fields.ip_ecn;
-        flow->flowData.policyAclFlowEntry.match_criteria.ecnMask        = match->masks.ip_ecn;
-
-        if (match->fields.ip_proto == IPPROTO_TCP)
-        {
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.tcp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.tcp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.tcp_dst;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.tcp_dst;
-        }
-        else if (match->fields.ip_proto == IPPROTO_UDP)
-        {
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.udp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.udp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.udp_dst;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.udp_dst;
-        }
-        else if (match->fields.ip_proto == IPPROTO_SCTP)
-        {
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4Port      = match->fields.sctp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.srcL4PortMask  = match->masks.sctp_src;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4Port     = match->fields.sctp_dst;
-          flow->flowData.policyAclFlowEntry.match_criteria.destL4PortMask = match->masks.sctp_dst;
-        }
+    }
+  }
 
-        if (match->fields.ip_proto == IPPROTO_ICMP)
-        {
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpType     = match->fields.icmpv4_type;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpTypeMask = match->masks.icmpv4_type;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpCode     = match->fields.icmpv4_code;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpCodeMask = match->masks.icmpv4_code;
-        }
-        else if (match->fields.ip_proto == IPPROTO_ICMPV6)
-        {
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpType     = match->fields.icmpv6_type;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpTypeMask = match->masks.icmpv6_type;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpCode     = match->fields.icmpv6_code;
-          flow->flowData.policyAclFlowEntry.match_criteria.icmpCodeMask = match->masks.icmpv6_code;
-        }
+  LOG_INFO("OF-DPA supports %u flow tables.", ind_ofdpa_table_count);
+}
 
-        flow->flowData.policyAclFlowEntry.match_criteria.ipv6FlowLabel     = match->fields.ipv6_flabel;
-        flow->flowData.policyAclFlowEntry.match_criteria.ipv6FlowLabelMask = match->masks.ipv6_flabel;
-      }
-      break;
+indigo_error_t indigo_fwd_table_capacity_get(uint8_t table_id,
+                                             uint32_t *max_entries,
+                                             uint32_t *used_entries)
+{
+  if ((table_id >= IND_OFDPA_TABLE_IDS) ||
+      (ind_ofdpa_table_info[table_id].maxEntries == 0))
+  {
+    return INDIGO_ERROR_NOT_SUPPORTED;
+  }
 
-    case OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_BITMAP) != IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.colorActionsFlowEntry.match_criteria.color = match->fields.ofdpa_color;
-        flow->flowData.colorActionsFlowEntry.match_criteria.index  = match->fields.ofdpa_color_actions_index;
-      }
-      break;
+  *max_entries = ind_ofdpa_table_info[table_id].maxEntries;
+  *used_entries = ind_ofdpa_table_info[table_id].numEntries;
 
-    case OFDPA_FLOW_TABLE_ID_EGRESS_VLAN:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_BITMAP) != IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.egressVlanFlowEntry.match_criteria.outPort = match->fields.onf_actset_output;
-        flow->flowData.egressVlanFlowEntry.match_criteria.vlanId  = match->fields.vlan_vid;
-        flow->flowData.egressVlanFlowEntry.match_criteria.allowVlanTranslation = match->fields.ofdpa_allow_vlan_translation;
-      }
-      break;
-
-    case OFDPA_FLOW_TABLE_ID_EGRESS_VLAN_1:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_BITMAP) != IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.egressVlan1FlowEntry.match_criteria.outPort = match->fields.onf_actset_output;
-        flow->flowData.egressVlan1FlowEntry.match_criteria.vlanId  = match->fields.vlan_vid;
-        flow->flowData.egressVlan1FlowEntry.match_criteria.ovid    = match->fields.ofdpa_ovid;
-      }
-      break;
+  return INDIGO_ERROR_NONE;
+}
 
-    case OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_MP_FLOW_MATCH_BITMAP) != IND_OFDPA_EGRESS_MP_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_MP_FLOW_MATCH_MAND_BITMAP)
-              != IND_OFDPA_EGRESS_MP_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.egressMpFlowEntry.match_criteria.outPort            = match->fields.onf_actset_output;
-        flow->flowData.egressMpFlowEntry.match_criteria.vlanId             = match->fields.vlan_vid;
-        flow->flowData.egressMpFlowEntry.match_criteria.vlanIdMask         = match->masks.vlan_vid & (OFDPA_VID_PRESENT | OFDPA_VID_EXACT_MASK);
-        flow->flowData.egressMpFlowEntry.match_criteria.etherType          = match->fields.eth_type;
-        flow->flowData.egressMpFlowEntry.match_criteria.etherTypeMask      = match->masks.eth_type;
-        flow->flowData.egressMpFlowEntry.match_criteria.oamY1731Mdl        = match->fields.ofdpa_oam_y1731_mdl;
-        flow->flowData.egressMpFlowEntry.match_criteria.oamY1731MdlMask    = match->masks.ofdpa_oam_y1731_mdl & OFDPA_OAM_Y1731_MDL_EXACT_MASK;
-        flow->flowData.egressMpFlowEntry.match_criteria.oamY1731Opcode     = match->fields.ofdpa_oam_y1731_opcode;
-        flow->flowData.egressMpFlowEntry.match_criteria.oamY1731OpcodeMask = match->masks.ofdpa_oam_y1731_opcode;
-
-        memcpy(flow->flowData.egressMpFlowEntry.match_criteria.destMac.addr, &match->fields.eth_dst, OF_MAC_ADDR_BYTES);
-        memcpy(flow->flowData.egressMpFlowEntry.match_criteria.destMacMask.addr, &match->masks.eth_dst, OF_MAC_ADDR_BYTES);
-      }
-      break;
+/*
+ * Get the flow match criteria from of_match after checking the match
+ * fields against the table.
+ */
 
-    case OFDPA_FLOW_TABLE_ID_EGRESS_DSCP_PCP_REMARK:
-      if ((ind_ofdpa_match_fields_bitmask| IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_BITMAP)
-            != IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else if ((ind_ofdpa_match_fields_bitmask & IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_MAND_BITMAP)
-                != IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_MAND_BITMAP)
-      {
-        err = INDIGO_ERROR_COMPAT;
-      }
-      else
-      {
-        flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.etherType      = match->fields.eth_type;
-        flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.etherTypeMask  = match->masks.eth_type;
-        flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.outPort        = match->fields.onf_actset_output;
-        flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.trafficClass   = match->fields.ofdpa_traffic_class;
-        flow->flowData.egressDscpPcpRemarkFlowEntry.match_criteria.color          = match->fields.ofdpa_color;
-      }
-      break;
+static indigo_error_t ind_ofdpa_match_fields_masks_get(const of_match_t *match,
+                                                       ind_ofdpa_fields_t ind_ofdpa_match_fields_bitmask,
+                                                       ofdpaFlowEntry_t *flow)
+{
+  const ind_ofdpa_flow_table_t *table;
+  const ind_ofdpa_flow_match_t *rule;
 
-    default:
-      LOG_ERROR("Invalid table id %d", flow->tableId);
-      err = INDIGO_ERROR_PARAM;
-      break;
+  table = ind_ofdpa_flow_table_get(flow->tableId);
+  if (table == NULL)
+  {
+    LOG_ERROR("Invalid table id %d", flow->tableId);
+    return INDIGO_ERROR_PARAM;
   }
+  rule = table->match;
 
-  if (err == INDIGO_ERROR_COMPAT)
+  if ((((ind_ofdpa_match_fields_bitmask | rule->allowed) != rule->allowed) ||
+       (((ind_ofdpa_match_fields_bitmask & rule->mandatory) != rule->mandatory) &&
+        ((rule->altMandatory == 0) ||
+         ((ind_ofdpa_match_fields_bitmask & rule->altMandatory) != rule->altMandatory)))))
   {
     LOG_ERROR("Incompatible match field(s) for table %d.", flow->tableId);
+    return INDIGO_ERROR_COMPAT;
   }
 
-  return err;
+  rule->get(match, flow);
+
+  return INDIGO_ERROR_NONE;
 }
 
 static indigo_error_t ind_ofdpa_translate_openflow_actions(of_object_id_t type, of_list_action_t *actions, ofdpaFlowEntry_t *flow)
@@ -2030,6 +1682,26 @@ static indigo_error_t ind_ofdpa_translate_openflow_actions(of_object_id_t type,
   return INDIGO_ERROR_NONE;
 }
 
+/* Map an instruction to its IND_OFDPA_INST_* kind */
+static uint32_t ind_ofdpa_instruction_kind_get(of_object_id_t object_id)
+{
+  switch (object_id)
+  {
+    case OF_INSTRUCTION_APPLY_ACTIONS:
+      return IND_OFDPA_INST_APPLY_ACTIONS;
+    case OF_INSTRUCTION_WRITE_ACTIONS:
+      return IND_OFDPA_INST_WRITE_ACTIONS;
+    case OF_INSTRUCTION_CLEAR_ACTIONS:
+      return IND_OFDPA_INST_CLEAR_ACTIONS;
+    case OF_INSTRUCTION_GOTO_TABLE:
+      return IND_OFDPA_INST_GOTO_TABLE;
+    case OF_INSTRUCTION_METER:
+      return IND_OFDPA_INST_METER;
+    default:
+      return IND_OFDPA_INST_OTHER;
+  }
+}
+
 static indigo_error_t
 ind_ofdpa_instructions_get(of_flow_modify_t *flow_mod, ofdpaFlowEntry_t *flow)
 {
@@ -2041,7 +1713,15 @@ ind_ofdpa_instructions_get(of_flow_modify_t *flow_mod, ofdpaFlowEntry_t *flow)
   of_list_instruction_t insts;
   of_instruction_t inst;
   uint8_t table_id;
+  const ind_ofdpa_flow_table_t *table;
+
 
+  table = ind_ofdpa_flow_table_get(flow->tableId);
+  if (table == NULL)
+  {
+    LOG_ERROR("Invalid table id %d", flow->tableId);
+    return INDIGO_ERROR_PARAM;
+  }
 
   of_flow_modify_instructions_bind(flow_mod, &insts);
 
@@ -2049,45 +1729,16 @@ ind_ofdpa_instructions_get(of_flow_modify_t *flow_mod, ofdpaFlowEntry_t *flow)
 
   OF_LIST_INSTRUCTION_ITER(&insts, &inst, rv)
   {
+    /* Checked in the same pass; another walk of the LOCI list costs as much as the translation */
+    if ((ind_ofdpa_instruction_kind_get(inst.header.object_id) & table->instructions) == 0)
+    {
+      LOG_ERROR("Unsupported instruction %s for flow table %d.", of_object_id_str[inst.header.object_id], flow->tableId);
+      return INDIGO_ERROR_COMPAT;
+    }
+
     switch (inst.header.object_id)
     {
       case OF_INSTRUCTION_APPLY_ACTIONS:
-        switch (flow->tableId)
-        {
-          case OFDPA_FLOW_TABLE_ID_INGRESS_PORT:
-          case OFDPA_FLOW_TABLE_ID_PORT_DSCP_TRUST:
-          case OFDPA_FLOW_TABLE_ID_PORT_PCP_TRUST:
-          case OFDPA_FLOW_TABLE_ID_TUNNEL_DSCP_TRUST:
-          case OFDPA_FLOW_TABLE_ID_TUNNEL_PCP_TRUST:
-          case OFDPA_FLOW_TABLE_ID_INJECTED_OAM:
-          case OFDPA_FLOW_TABLE_ID_VLAN:
-          case OFDPA_FLOW_TABLE_ID_VLAN_1:
-          case OFDPA_FLOW_TABLE_ID_MAINTENANCE_POINT:
-          case OFDPA_FLOW_TABLE_ID_MPLS_L2_PORT:
-          case OFDPA_FLOW_TABLE_ID_MPLS_DSCP_TRUST:
-          case OFDPA_FLOW_TABLE_ID_MPLS_PCP_TRUST:
-          case OFDPA_FLOW_TABLE_ID_TERMINATION_MAC:
-          case OFDPA_FLOW_TABLE_ID_MPLS_0:
-          case OFDPA_FLOW_TABLE_ID_MPLS_1:
-          case OFDPA_FLOW_TABLE_ID_MPLS_2:
-          case OFDPA_FLOW_TABLE_ID_MPLS_MAINTENANCE_POINT:
-          case OFDPA_FLOW_TABLE_ID_BRIDGING:
-          case OFDPA_FLOW_TABLE_ID_L2_POLICER:
-          case OFDPA_FLOW_TABLE_ID_L2_POLICER_ACTIONS:
-          case OFDPA_FLOW_TABLE_ID_ACL_POLICY:
-          case OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS:
-          case OFDPA_FLOW_TABLE_ID_EGRESS_VLAN:
-          case OFDPA_FLOW_TABLE_ID_EGRESS_VLAN_1:
-          case OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT:
-          case OFDPA_FLOW_TABLE_ID_EGRESS_DSCP_PCP_REMARK:
-          case OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING:
-            break;
-          case OFDPA_FLOW_TABLE_ID_MULTICAST_ROUTING:
-          default:
-            LOG_ERROR("Unsupported instruction %s for flow table %d.", of_object_id_str[inst.header.object_id], flow->tableId);
-            return INDIGO_ERROR_COMPAT;
-        }
-
         of_instruction_apply_actions_actions_bind(&inst.apply_actions, &openflow_actions);
         if ((err = ind_ofdpa_translate_openflow_actions(inst.header.object_id, &openflow_actions, flow)) < 0)
         {
@@ -2095,31 +1746,6 @@ ind_ofdpa_instructions_get(of_flow_modify_t *flow_mod, ofdpaFlowEntry_t *flow)
         }
         break;
       case OF_INSTRUCTION_WRITE_ACTIONS:
-        switch (flow->tableId)
-        {
-          case OFDPA_FLOW_TABLE_ID_VLAN:
-          case OFDPA_FLOW_TABLE_ID_VLAN_1:
-          case OFDPA_FLOW_TABLE_ID_MPLS_L2_PORT:
-          case OFDPA_FLOW_TABLE_ID_MPLS_0:
-          case OFDPA_FLOW_TABLE_ID_MPLS_1:
-          case OFDPA_FLOW_TABLE_ID_MPLS_2:
-          case OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING:
-          case OFDPA_FLOW_TABLE_ID_MULTICAST_ROUTING:
-          case OFDPA_FLOW_TABLE_ID_BRIDGING:
-          case OFDPA_FLOW_TABLE_ID_L2_POLICER_ACTIONS:
-          case OFDPA_FLOW_TABLE_ID_ACL_POLICY:
-          case OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS:
-          case OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT:
-          case OFDPA_FLOW_TABLE_ID_EGRESS_DSCP_PCP_REMARK:
-            break;
-          case OFDPA_FLOW_TABLE_ID_INGRESS_PORT:
-          case OFDPA_FLOW_TABLE_ID_TERMINATION_MAC:
-          case OFDPA_FLOW_TABLE_ID_INJECTED_OAM:
-          case OFDPA_FLOW_TABLE_ID_L2_POLICER:
-          default:
-            LOG_ERROR("Unsupported instruction %s for flow table %d.", of_object_id_str[inst.header.object_id], flow->tableId);
-            return INDIGO_ERROR_COMPAT;
-        }
         of_instruction_write_actions_actions_bind(&inst.write_actions, &openflow_actions);
         if ((err = ind_ofdpa_translate_openflow_actions(inst.header.object_id, &openflow_actions, flow)) < 0)
         {
@@ -2250,6 +1876,31 @@ ind_ofdpa_instructions_get(of_flow_modify_t *flow_mod, ofdpaFlowEntry_t *flow)
   return INDIGO_ERROR_NONE;
 }
 
+/*
+ * Translate the match and instructions of a flow_mod message into an OF-DPA
+ * flow entry, checking that they fit the flow table.
+ */
+static indigo_error_t ind_ofdpa_flow_translate(of_flow_modify_t *flow_mod,
+                                               const of_match_t *match,
+                                               ofdpaFlowEntry_t *flow)
+{
+  indigo_error_t err;
+  ind_ofdpa_fields_t matchFields;
+
+  ind_ofdpa_populate_flow_bitmask(match, &matchFields);
+
+  /* Get the match fields and masks from LOCI match structure */
+  err = ind_ofdpa_match_fields_masks_get(match, matchFields, flow);
+  if (err != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Flow does not fit table %d. (err = %d)", flow->tableId, err);
+    return err;
+  }
+
+  /* Get the instructions set from the LOCI flow_mod object, checking each against the table */
+  return ind_ofdpa_instructions_get(flow_mod, flow);
+}
+
 static indigo_error_t ind_ofdpa_packet_out_actions_get(of_list_action_t *of_list_actions,
                                                        indPacketOutActions_t *packetOutActions)
 {
@@ -2299,8 +1950,6 @@ static indigo_error_t ind_ofdpa_packet_out_actions_get(of_list_action_t *of_list
 
 indigo_error_t indigo_fwd_forwarding_features_get(of_features_reply_t *features_reply)
 {
-  uint32_t tableId, tableCount = 0;
-
   LOG_TRACE("%s() called", __FUNCTION__);
 
   if (features_reply->version < OF_VERSION_1_3)
@@ -2310,14 +1959,7 @@ indigo_error_t indigo_fwd_forwarding_features_get(of_features_reply_t *features_
   }
 
   /* Number of tables supported by datapath. */
-  for (tableId = 0; tableId < 255; tableId++)
-  {
-    if (ofdpaFlowTableSupported(tableId) == OFDPA_E_NONE)
-    {
-      tableCount++;
-    }
-  }
-  of_features_reply_n_tables_set(features_reply, tableCount);
+  of_features_reply_n_tables_set(features_reply, ind_ofdpa_table_count);
 
   return INDIGO_ERROR_NONE;
 }
@@ -2327,7 +1969,6 @@ indigo_error_t indigo_fwd_flow_create(indigo_cookie_t flow_id,
                                       uint8_t *table_id)
 {
   indigo_error_t err = INDIGO_ERROR_NONE;
-  OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
   ofdpaFlowEntry_t flow;
   uint16_t priority;
   uint16_t idle_timeout, hard_timeout;
@@ -2341,17 +1982,40 @@ indigo_error_t indigo_fwd_flow_create(indigo_cookie_t flow_id,
     return INDIGO_ERROR_VERSION;
   }
 
-  memset(&flow, 0, sizeof(flow));
+  /* Bundled flows were translated when they were validated */
+  if (ind_ofdpa_flow_translation_take(flow_add, &flow))
+  {
+    *table_id = (uint8_t)flow.tableId;
+  }
+  else
+  {
+    memset(&flow, 0, sizeof(flow));
 
-  flow.cookie = flow_id;
+    /* Get the Flow Table ID */
+    of_flow_add_table_id_get(flow_add, table_id);
+    flow.tableId = (uint32_t)*table_id;
 
-  /* Get the Flow Table ID */
-  of_flow_add_table_id_get(flow_add, table_id);
-  flow.tableId = (uint32_t)*table_id;
+    /* ofdpa Flow priority */
+    of_flow_add_priority_get(flow_add, &priority);
+    flow.priority = (uint32_t)priority;
 
-  /* ofdpa Flow priority */
-  of_flow_add_priority_get(flow_add, &priority);
-  flow.priority = (uint32_t)priority;
+    memset(&of_match, 0, sizeof(of_match));
+    if (of_flow_add_match_get(flow_add, &of_match) < 0)
+    {
+      LOG_ERROR("Error getting openflow match criteria.");
+      return INDIGO_ERROR_UNKNOWN;
+    }
+
+    /* Get the match fields, masks and instructions from the LOCI flow add object */
+    err = ind_ofdpa_flow_translate(flow_add, &of_match, &flow);
+    if (err != INDIGO_ERROR_NONE)
+    {
+      LOG_TRACE("Failed to translate flow. (err = %d)", err);
+      return err;
+    }
+  }
+
+  flow.cookie = flow_id;
 
   /* Get the idle time and hard time */
   (void)of_flow_modify_idle_timeout_get((of_flow_modify_t *)flow_add, &idle_timeout);
@@ -2359,49 +2023,64 @@ indigo_error_t indigo_fwd_flow_create(indigo_cookie_t flow_id,
   flow.idle_time = (uint32_t)idle_timeout;
   flow.hard_time = (uint32_t)hard_timeout;
 
-  memset(&of_match, 0, sizeof(of_match));
-  if (of_flow_add_match_get(flow_add, &of_match) < 0)
+  if (ind_ofdpa_flow_bundle_staging())
   {
-    LOG_ERROR("Error getting openflow match criteria.");
-    return INDIGO_ERROR_UNKNOWN;
+    ind_ofdpa_flow_bundle_add(&flow);
+    return INDIGO_ERROR_NONE;
   }
 
-  /* Get the match fields and masks from LOCI match structure */
-  err = ind_ofdpa_match_fields_masks_get(&of_match, &flow);
-  if (err != INDIGO_ERROR_NONE)
-  {
-    LOG_ERROR("Error getting match fields and masks. (err = %d)", err);
-    return err;
-  }
+  /* Queue the flow; the result is reported when the batch is submitted */
+  return (ind_ofdpa_flow_batch_add(&flow));
+}
 
-  /* Get the instructions set from the LOCI flow add object */
-  err = ind_ofdpa_instructions_get(flow_add, &flow);
-  if (err != INDIGO_ERROR_NONE)
+indigo_error_t indigo_fwd_flow_validate(of_flow_add_t *flow_add)
+{
+  indigo_error_t err;
+  ofdpaFlowEntry_t flow;
+  uint8_t table_id;
+  uint16_t priority;
+  of_match_t of_match;
+
+  if (flow_add->version < OF_VERSION_1_3)
   {
-    LOG_TRACE("Failed to get flow instructions. (err = %d)", err);
-    return err;
+    return INDIGO_ERROR_VERSION;
   }
-  /* Submit the changes to ofdpa */
-  ofdpa_rv = ofdpaFlowAdd(&flow);
-  if (ofdpa_rv != OFDPA_E_NONE)
+
+  memset(&flow, 0, sizeof(flow));
+
+  of_flow_add_table_id_get(flow_add, &table_id);
+  flow.tableId = (uint32_t)table_id;
+
+  of_flow_add_priority_get(flow_add, &priority);
+  flow.priority = (uint32_t)priority;
+
+  memset(&of_match, 0, sizeof(of_match));
+  if (of_flow_add_match_get(flow_add, &of_match) < 0)
   {
-    LOG_TRACE("Failed to add flow. (ofdpa_rv = %d)", ofdpa_rv);
+    LOG_ERROR("Error getting openflow match criteria.");
+    return INDIGO_ERROR_UNKNOWN;
   }
-  else
+
+  /* The create of the same flow_add takes the translation */
+  err = ind_ofdpa_flow_translate(flow_add, &of_match, &flow);
+  if (err == INDIGO_ERROR_NONE)
   {
-    LOG_TRACE("Flow added successfully. (ofdpa_rv = %d)", ofdpa_rv);
+    ind_ofdpa_flow_translation_keep(flow_add, &flow);
   }
-  return (indigoConvertOfdpaRv(ofdpa_rv));
+
+  return err;
 }
 
 indigo_error_t indigo_fwd_flow_modify(indigo_cookie_t flow_id,
                                       of_flow_modify_t *flow_modify)
 {
   indigo_error_t err = INDIGO_ERROR_NONE;
-  ofdpaFlowEntry_t flow;
+  ofdpaFlowEntry_t flow, prior;
   ofdpaFlowEntryStats_t flowStats;
   OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
   of_match_t of_match;
+  uint16_t idle_timeout, hard_timeout;
+  int staging = ind_ofdpa_flow_bundle_staging();
 
   LOG_TRACE("Flow modify called");
 
@@ -2411,11 +2090,26 @@ indigo_error_t indigo_fwd_flow_modify(indigo_cookie_t flow_id,
     return INDIGO_ERROR_VERSION;
   }
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   memset(&flow, 0, sizeof(flow));
   memset(&flowStats, 0, sizeof(flowStats));
 
-  /* Get the flow entries and flow stats from the indigo cookie */
-  ofdpa_rv = ofdpaFlowByCookieGet(flow_id, &flow, &flowStats);
+  /*
+   * Get the flow entries and flow stats from the indigo cookie, unless
+   * shadowed. A bundle needs the whole flow to undo the change.
+   */
+  if (staging)
+  {
+    ofdpa_rv = ind_ofdpa_flow_bundle_get(flow_id, &flow, &flowStats);
+    prior = flow;
+  }
+  else if (!ind_ofdpa_flow_shadow_get(flow_id, &flow))
+  {
+    ofdpa_rv = ofdpaFlowByCookieGet(flow_id, &flow, &flowStats);
+  }
+
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     if (ofdpa_rv == OFDPA_E_NOT_FOUND)
@@ -2438,20 +2132,27 @@ indigo_error_t indigo_fwd_flow_modify(indigo_cookie_t flow_id,
 
   memset(&flow.flowData, 0, sizeof(flow.flowData));
 
-  /* Get the match fields and masks from LOCI match structure */
-  err = ind_ofdpa_match_fields_masks_get(&of_match, &flow);
+  /* Get the match fields, masks and modified instructions from the LOCI flow_mod object */
+  err = ind_ofdpa_flow_translate(flow_modify, &of_match, &flow);
   if (err != INDIGO_ERROR_NONE)
   {
-    LOG_ERROR("Error getting match fields and masks. (err = %d)", err);
+    LOG_TRACE("Failed to translate flow. (err = %d)", err);
     return err;
   }
 
-  /* Get the modified instructions set from the LOCI flow add object */
-  err = ind_ofdpa_instructions_get(flow_modify, &flow);
-  if (err != INDIGO_ERROR_NONE)
+  /* A flow add replacing this flow in place also sets its timeouts */
+  if (flow_modify->object_id == OF_FLOW_ADD)
   {
-    LOG_TRACE("Failed to get flow instructions. (err = %d)", err);
-    return err;
+    (void)of_flow_modify_idle_timeout_get(flow_modify, &idle_timeout);
+    (void)of_flow_modify_hard_timeout_get(flow_modify, &hard_timeout);
+    flow.idle_time = (uint32_t)idle_timeout;
+    flow.hard_time = (uint32_t)hard_timeout;
+  }
+
+  if (staging)
+  {
+    ind_ofdpa_flow_bundle_modify(&prior, &flowStats, &flow);
+    return INDIGO_ERROR_NONE;
   }
 
   /* Submit the changes to ofdpa */
@@ -2463,6 +2164,7 @@ indigo_error_t indigo_fwd_flow_modify(indigo_cookie_t flow_id,
   else
   {
     LOG_TRACE("Flow modified successfully. (ofdpa_rv = %d)", ofdpa_rv);
+    ind_ofdpa_flow_shadow_set(&flow);
   }
 
   return (indigoConvertOfdpaRv(ofdpa_rv));
@@ -2478,6 +2180,41 @@ indigo_error_t indigo_fwd_flow_delete(indigo_cookie_t flow_id,
 
   LOG_TRACE("Flow delete called");
 
+  /* Without final stats the delete just queues behind the flow adds */
+  if ((flow_stats == NULL) && !ind_ofdpa_flow_bundle_staging())
+  {
+    return ind_ofdpa_flow_batch_delete(flow_id);
+  }
+
+  /* Queued flow jobs go first */
+  ind_ofdpa_flow_batch_drain();
+
+  /* A bundle reads the whole flow now, to add it back if it has to */
+  if (ind_ofdpa_flow_bundle_staging())
+  {
+    memset(&flow, 0, sizeof(flow));
+    memset(&flowStats, 0, sizeof(flowStats));
+
+    ofdpa_rv = ind_ofdpa_flow_bundle_get(flow_id, &flow, &flowStats);
+    if (ofdpa_rv != OFDPA_E_NONE)
+    {
+      LOG_ERROR("Request to delete non-existent flow. (ofdpa_rv = %d)", ofdpa_rv);
+      return (indigoConvertOfdpaRv(ofdpa_rv));
+    }
+
+    if (flow_stats != NULL)
+    {
+      flow_stats->flow_id = flow_id;
+      flow_stats->packets = flowStats.receivedPackets;
+      flow_stats->bytes = flowStats.receivedBytes;
+      flow_stats->duration_ns = (flowStats.durationSec)*(IND_OFDPA_NANO_SEC); /* Convert to nano seconds*/
+    }
+
+    ind_ofdpa_flow_bundle_delete(&flow, &flowStats);
+    return INDIGO_ERROR_NONE;
+  }
+
+  /* Read the flow back for its final stats */
   memset(&flow, 0, sizeof(flow));
   memset(&flowStats, 0, sizeof(flowStats));
 
@@ -2493,6 +2230,8 @@ indigo_error_t indigo_fwd_flow_delete(indigo_cookie_t flow_id,
       LOG_ERROR("Invalid flow. (ofdpa_rv = %d)", ofdpa_rv);
     }
 
+    ind_ofdpa_flow_shadow_remove(flow_id);
+    ind_ofdpa_flow_stats_remove(flow_id);
     return (indigoConvertOfdpaRv(ofdpa_rv));
   }
 
@@ -2503,6 +2242,8 @@ indigo_error_t indigo_fwd_flow_delete(indigo_cookie_t flow_id,
 
   /* Delete the flow entry */
   ofdpa_rv = ofdpaFlowByCookieDelete(flow_id);
+  ind_ofdpa_flow_shadow_remove(flow_id);
+  ind_ofdpa_flow_stats_remove(flow_id);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to delete flow. (ofdpa_rv = %d)", ofdpa_rv);
@@ -2519,14 +2260,15 @@ indigo_error_t indigo_fwd_flow_stats_get(indigo_cookie_t flow_id,
                                          indigo_fi_flow_stats_t *flow_stats)
 {
   OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
-  ofdpaFlowEntry_t flow;
   ofdpaFlowEntryStats_t flowStats;
 
-  memset(&flow, 0, sizeof(flow));
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   memset(&flowStats, 0, sizeof(flowStats));
 
-  /* Get the flow and flow stats from flow id */
-  ofdpa_rv = ofdpaFlowByCookieGet(flow_id, &flow, &flowStats);
+  /* Counters may be up to ind_ofdpa_flow_stats_max_age_get() ms old */
+  ofdpa_rv = ind_ofdpa_flow_stats_get(flow_id, &flowStats);
   if (ofdpa_rv == OFDPA_E_NONE)
   {
     flow_stats->flow_id = flow_id;
@@ -2561,7 +2303,6 @@ indigo_error_t indigo_fwd_table_stats_get(of_table_stats_request_t *table_stats_
   of_version_t version = table_stats_request->version;
   uint32_t xid;
   uint32_t i;
-  ofdpaFlowTableInfo_t tableInfo;
   of_table_stats_entry_t entry[1];
   of_table_stats_reply_t *reply;
   of_list_table_stats_entry_t list[1];
@@ -2588,28 +2329,23 @@ indigo_error_t indigo_fwd_table_stats_get(of_table_stats_request_t *table_stats_
   of_table_stats_reply_entries_bind(*table_stats_reply, list);
 
 
-  for (i = 0; i < 255; i++)
+  /*
+   * The state manager fills in the active and matched counts, so no
+   * OF-DPA calls are made here. The background poller keeps the flow
+   * counters behind the matched counts of the listed tables current.
+   */
+  for (i = 0; i < ind_ofdpa_table_count; i++)
   {
-    if (ofdpaFlowTableSupported(i) == OFDPA_E_NONE)
-    {
-      of_table_stats_entry_init(entry, version, -1, 1);
-      (void)of_list_table_stats_entry_append_bind(list, entry);
+    of_table_stats_entry_init(entry, version, -1, 1);
+    (void)of_list_table_stats_entry_append_bind(list, entry);
 
-      /* Table Id */
-      of_table_stats_entry_table_id_set(entry, i);
-
-      /* Number of entries in the table */
-      if (ofdpaFlowTableInfoGet(i, &tableInfo) == OFDPA_E_NONE)
-      {
-        of_table_stats_entry_active_count_set(entry, tableInfo.numEntries);
-      }
+    /* Table Id */
+    of_table_stats_entry_table_id_set(entry, ind_ofdpa_tables[i]);
 
-      /* Number of packets looked up in table not supported. */
-      of_table_stats_entry_lookup_count_set(entry, 0);
+    /* Number of packets looked up in table not supported. */
+    of_table_stats_entry_lookup_count_set(entry, 0);
 
-      /* Number of packets that hit table not supported. */
-      of_table_stats_entry_matched_count_set(entry, 0);
-    }
+    ind_ofdpa_flow_stats_poll_table(ind_ofdpa_tables[i]);
   }
 
   return(INDIGO_ERROR_NONE);
@@ -2631,6 +2367,9 @@ indigo_error_t indigo_fwd_packet_out(of_packet_out_t *packet_out)
   of_packet_out_actions_bind(packet_out, of_list_action);
 
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   pkt.pstart = (char *)of_octets->data;
   pkt.size = of_octets->bytes;
 
@@ -2675,6 +2414,9 @@ indigo_error_t indigo_fwd_experimenter(of_experimenter_t *experimenter,
   ofdpa_oam_drop_status_mod_msg_t *oam_drop_status;
   ofdpa_mpls_tunnel_label_remark_action_mod_msg_t *mpls_tunnel_label_remark;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   LOG_TRACE("Action tables called");
 
   if (obj->version < OF_VERSION_1_3)
@@ -3027,6 +2769,9 @@ void indigo_set_mpls_qos_get_multipart(ofdpa_mpls_set_qos_action_multipart_reque
   ofdpa_mpls_set_qos_action_multipart_request_qos_index_get(request, &qosIndex);
   ofdpa_mpls_set_qos_action_multipart_request_mpls_tc_get(request, &mpls_tc);
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   ofdpa_rv = ofdpaMplsQosActionEntryGet(qosIndex, mpls_tc, &mplsQosEntry);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
@@ -3060,6 +2805,9 @@ void indigo_oam_dataplane_get_multipart(ofdpa_oam_dataplane_ctr_multipart_reques
   ofdpa_index.lmepId = lmepId;
   ofdpa_index.trafficClass = traffic_class;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   ofdpa_rv = ofdpaOamDataCountersLMGet(ofdpa_index, &TxFCl, &RxFCl);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
@@ -3084,6 +2832,9 @@ void indigo_drop_status_get_multipart(ofdpa_oam_drop_status_multipart_request_t
 
   ofdpa_oam_drop_status_multipart_request_index_get(request, &lmepId);
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   ofdpa_rv = ofdpaDropStatusGet(lmepId, &dropEntry);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
@@ -3120,6 +2871,9 @@ void indigo_remark_action_get_multipart(ofdpa_mpls_vpn_label_remark_action_multi
   ofdpa_mpls_vpn_label_remark_action_multipart_request_vlan_pcp_get(request, &vlanPcp);
   ofdpa_mpls_vpn_label_remark_action_multipart_request_vlan_dei_get(request, &vlanDei);
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   ofdpa_rv = ofdpaRemarkActionEntryGet(&remarkEntry);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
@@ -3152,32 +2906,32 @@ indigo_error_t indigo_fwd_expiration_enable_get(int *is_enabled)
 
 void ind_ofdpa_flow_event_receive(void)
 {
-  int flowTableId;
+  uint32_t i;
   ofdpaFlowEvent_t flowEventData;
 
   LOG_TRACE("Reading Flow Events");
 
-  for (flowTableId = 0; flowTableId < 255; flowTableId++)
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
+  for (i = 0; i < ind_ofdpa_table_count; i++)
   {
-    if (ofdpaFlowTableSupported(flowTableId) == OFDPA_E_NONE)
-    {
-      memset(&flowEventData, 0, sizeof(flowEventData));
-      flowEventData.flowMatch.tableId = flowTableId;
+    memset(&flowEventData, 0, sizeof(flowEventData));
+    flowEventData.flowMatch.tableId = ind_ofdpa_tables[i];
 
-      while (ofdpaFlowEventNextGet(&flowEventData) == OFDPA_E_NONE)
+    while (ofdpaFlowEventNextGet(&flowEventData) == OFDPA_E_NONE)
+    {
+      if (flowEventData.eventMask & OFDPA_FLOW_EVENT_HARD_TIMEOUT)
       {
-        if (flowEventData.eventMask & OFDPA_FLOW_EVENT_HARD_TIMEOUT)
-        {
-          LOG_TRACE("Received flow event on hard timeout.");
-          ind_core_flow_expiry_handler(flowEventData.flowMatch.cookie,
-                                       INDIGO_FLOW_REMOVED_HARD_TIMEOUT);
-        }
-        else
-        {
-          LOG_TRACE("Received flow event on idle timeout.");
-          ind_core_flow_expiry_handler(flowEventData.flowMatch.cookie,
-                                       INDIGO_FLOW_REMOVED_IDLE_TIMEOUT);
-        }
+        LOG_TRACE("Received flow event on hard timeout.");
+        ind_core_flow_expiry_handler(flowEventData.flowMatch.cookie,
+                                     INDIGO_FLOW_REMOVED_HARD_TIMEOUT);
+      }
+      else
+      {
+        LOG_TRACE("Received flow event on idle timeout.");
+        ind_core_flow_expiry_handler(flowEventData.flowMatch.cookie,
+                                     INDIGO_FLOW_REMOVED_IDLE_TIMEOUT);
       }
     }
   }
@@ -3241,6 +2995,9 @@ void ind_ofdpa_pkt_receive(void)
   of_match_t match;
   struct timeval timeout;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   /* Determine how large receive buffer must be */
   if (ofdpaMaxPktSizeGet(&maxPktSize) != OFDPA_E_NONE)
   {
@@ -695,6 +695,9 @@ indigo_error_t indigo_fwd_group_add(uint32_t id, uint8_t group_type, of_list_buc
 {
   indigo_error_t err;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   if ((group_type != OF_GROUP_TYPE_INDIRECT) &&
       (group_type != OF_GROUP_TYPE_SELECT) &&
       (group_type != OF_GROUP_TYPE_FF) &&
@@ -712,6 +715,9 @@ indigo_error_t indigo_fwd_group_modify(uint32_t id, of_list_bucket_t *buckets)
 {
   indigo_error_t err;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   err = ind_ofdpa_translate_group_buckets(id, buckets, OF_GROUP_MODIFY);
 
   return err;
@@ -725,6 +731,9 @@ void indigo_fwd_group_delete(uint32_t id)
 {
   OFDPA_ERROR_t ofdpa_rv;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   ofdpa_rv = ofdpaGroupDelete(id);
 
   if (ofdpa_rv != OFDPA_E_NONE)
@@ -744,6 +753,9 @@ void indigo_fwd_group_stats_get(uint32_t id, of_group_stats_entry_t *entry)
   OFDPA_ERROR_t ofdpa_rv;
   ofdpaGroupEntryStats_t groupStats;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   memset(&groupStats, 0, sizeof(groupStats));
   ofdpa_rv = ofdpaGroupStatsGet(id, &groupStats);
 
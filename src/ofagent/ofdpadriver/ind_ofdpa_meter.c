@@ -42,6 +42,9 @@ indigo_error_t indigo_fwd_meter_add(uint32_t id, uint16_t flag, of_list_meter_ba
   OFDPA_ERROR_t ofdpa_rv = OFDPA_E_NONE;
   ofdpaMeterEntry_t meter;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   memset(&meter, 0, sizeof(meter));
 
   LOG_TRACE("meter_add: id %d, flag 0x%x",id, flag);
@@ -150,6 +153,9 @@ indigo_error_t indigo_fwd_meter_delete(uint32_t id)
 
   LOG_TRACE("meter_del: id %d",id);
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   /* Submit the changes to ofdpa */
   ofdpa_rv = ofdpaMeterDelete(id);
   if (ofdpa_rv != OFDPA_E_NONE)
@@ -0,0 +1,475 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2013-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_poll.c
+*
+* @purpose      Background counter poller for the OF-DPA Driver
+*
+* @component    OF-DPA
+*
+* @comments     A socket manager timer runs the poller every
+*               IND_OFDPA_POLL_SLICE_MS. Each slice makes at most the
+*               poll budget of OF-DPA calls, shared between the counter
+*               classes (flows, ports, queues), and each class carries on
+*               from where its last slice stopped.
+*
+*               Flow counters go into the flow stats cache. Port and
+*               queue counters go into a fixed array of ports, each with
+*               its queues. Stats requests take the latest snapshot if it
+*               is no older than the flow stats max age, and read OF-DPA
+*               otherwise.
+*
+*               Group stats are not polled: OF-DPA reports only the
+*               reference count and age of a group, not traffic counters.
+*
+*               The poller skips a slice while the flow worker has adds
+*               queued, rather than block the event loop behind it.
+*
+* @end
+*
+**********************************************************************/
+
+#include <string.h>
+#include "indigo/forwarding.h"
+#include "indigo/time.h"
+#include "SocketManager/socketmanager.h"
+#include "ind_ofdpa_util.h"
+#include "ind_ofdpa_log.h"
+
+typedef struct ind_ofdpa_poll_port_s
+{
+  uint32_t              port;
+  uint32_t              numQueues;
+  indigo_time_t         refreshed;      /* 0 until the counters are read */
+  indigo_time_t         queuesRefreshed;
+  indigo_time_t         queueRefreshed[IND_OFDPA_POLL_QUEUES_MAX];
+  ofdpaPortStats_t      stats;
+  ofdpaPortQueueStats_t queues[IND_OFDPA_POLL_QUEUES_MAX];
+} ind_ofdpa_poll_port_t;
+
+static ind_ofdpa_poll_port_t ind_ofdpa_poll_ports[IND_OFDPA_POLL_PORTS_MAX];
+static uint32_t ind_ofdpa_poll_port_count;
+
+static uint32_t ind_ofdpa_poll_budget = IND_OFDPA_POLL_BUDGET;
+static int ind_ofdpa_poll_running;
+
+/* Class to go first in the next slice */
+static uint32_t ind_ofdpa_poll_first;
+
+/* Port and queue cursors */
+static uint32_t ind_ofdpa_poll_port_cursor;
+static uint32_t ind_ofdpa_poll_queue_port;
+static uint32_t ind_ofdpa_poll_queue_id;
+static int ind_ofdpa_poll_queue_counted;
+
+static ind_ofdpa_poll_stats_t ind_ofdpa_poll_stats[IND_OFDPA_POLL_CLASSES];
+
+/* Start of the current pass over each class */
+static indigo_time_t ind_ofdpa_poll_cycle_start[IND_OFDPA_POLL_CLASSES];
+static uint64_t ind_ofdpa_poll_cycle_rpcs[IND_OFDPA_POLL_CLASSES];
+
+static uint64_t ind_ofdpa_poll_deferred;
+
+static const char *ind_ofdpa_poll_class_names[IND_OFDPA_POLL_CLASSES] =
+{
+  "flows", "ports", "queues"
+};
+
+static ind_ofdpa_poll_port_t *ind_ofdpa_poll_port_find(uint32_t port, int create)
+{
+  ind_ofdpa_poll_port_t *slot;
+  uint32_t i;
+
+  for (i = 0; i < ind_ofdpa_poll_port_count; i++)
+  {
+    if (ind_ofdpa_poll_ports[i].port == port)
+    {
+      return &ind_ofdpa_poll_ports[i];
+    }
+  }
+
+  if (!create || (ind_ofdpa_poll_port_count >= IND_OFDPA_POLL_PORTS_MAX))
+  {
+    return NULL;
+  }
+
+  slot = &ind_ofdpa_poll_ports[ind_ofdpa_poll_port_count++];
+  memset(slot, 0, sizeof(*slot));
+  slot->port = port;
+
+  return slot;
+}
+
+/* Whether a snapshot taken at 'refreshed' may be served now */
+static int ind_ofdpa_poll_fresh(ind_ofdpa_poll_class_t cls,
+                                indigo_time_t refreshed, indigo_time_t now)
+{
+  uint32_t maxAge = ind_ofdpa_flow_stats_max_age_get();
+  indigo_time_t age = now - refreshed;
+
+  if ((refreshed == 0) || (maxAge == 0) || (age > maxAge))
+  {
+    ind_ofdpa_poll_stats[cls].onDemand++;
+    return 0;
+  }
+
+  ind_ofdpa_poll_stats[cls].served++;
+  if (age > ind_ofdpa_poll_stats[cls].maxAgeServed)
+  {
+    ind_ofdpa_poll_stats[cls].maxAgeServed = age;
+  }
+
+  return 1;
+}
+
+static int ind_ofdpa_poll_ports_run(int budget, int *cycleDone)
+{
+  ind_ofdpa_poll_port_t *slot;
+  ofdpaPortStats_t portStats;
+  indigo_time_t now = INDIGO_CURRENT_TIME;
+  uint32_t port;
+  int spent = 0;
+
+  *cycleDone = 0;
+
+  while (spent < budget)
+  {
+    spent++;
+    if (ofdpaPortNextGet(ind_ofdpa_poll_port_cursor, &port) != OFDPA_E_NONE)
+    {
+      ind_ofdpa_poll_port_cursor = 0;
+      *cycleDone = 1;
+      break;
+    }
+    ind_ofdpa_poll_port_cursor = port;
+
+    slot = ind_ofdpa_poll_port_find(port, 1);
+    if (slot == NULL)
+    {
+      continue;
+    }
+
+    spent++;
+    memset(&portStats, 0, sizeof(portStats));
+    if (ofdpaPortStatsGet(port, &portStats) == OFDPA_E_NONE)
+    {
+      slot->stats = portStats;
+      slot->refreshed = now;
+    }
+  }
+
+  return spent;
+}
+
+static int ind_ofdpa_poll_queues_run(int budget, int *cycleDone)
+{
+  ind_ofdpa_poll_port_t *slot;
+  ofdpaPortQueueStats_t queueStats;
+  indigo_time_t now = INDIGO_CURRENT_TIME;
+  uint32_t numQueues;
+  int spent = 0;
+
+  *cycleDone = 0;
+
+  while (spent < budget)
+  {
+    if (ind_ofdpa_poll_queue_port >= ind_ofdpa_poll_port_count)
+    {
+      ind_ofdpa_poll_queue_port = 0;
+      *cycleDone = 1;
+      break;
+    }
+    slot = &ind_ofdpa_poll_ports[ind_ofdpa_poll_queue_port];
+
+    if (!ind_ofdpa_poll_queue_counted)
+    {
+      spent++;
+      numQueues = 0;
+      if (ofdpaNumQueuesGet(slot->port, &numQueues) == OFDPA_E_NONE)
+      {
+        slot->numQueues = numQueues;
+        slot->queuesRefreshed = now;
+      }
+      ind_ofdpa_poll_queue_counted = 1;
+      ind_ofdpa_poll_queue_id = 0;
+    }
+
+    if ((ind_ofdpa_poll_queue_id >= slot->numQueues) ||
+        (ind_ofdpa_poll_queue_id >= IND_OFDPA_POLL_QUEUES_MAX))
+    {
+      ind_ofdpa_poll_queue_port++;
+      ind_ofdpa_poll_queue_counted = 0;
+      continue;
+    }
+
+    spent++;
+    memset(&queueStats, 0, sizeof(queueStats));
+    if (ofdpaQueueStatsGet(slot->port, ind_ofdpa_poll_queue_id, &queueStats) == OFDPA_E_NONE)
+    {
+      slot->queues[ind_ofdpa_poll_queue_id] = queueStats;
+      slot->queueRefreshed[ind_ofdpa_poll_queue_id] = now;
+    }
+    ind_ofdpa_poll_queue_id++;
+  }
+
+  return spent;
+}
+
+static int ind_ofdpa_poll_class_run(ind_ofdpa_poll_class_t cls, int budget, int *cycleDone)
+{
+  switch (cls)
+  {
+    case IND_OFDPA_POLL_FLOWS:
+      return ind_ofdpa_flow_stats_poll(budget, cycleDone);
+    case IND_OFDPA_POLL_PORTS:
+      return ind_ofdpa_poll_ports_run(budget, cycleDone);
+    case IND_OFDPA_POLL_QUEUES:
+      return ind_ofdpa_poll_queues_run(budget, cycleDone);
+    default:
+      *cycleDone = 0;
+      return 0;
+  }
+}
+
+/* One time slice: share the budget between the classes */
+static void ind_ofdpa_poll_slice(void *cookie)
+{
+  ind_ofdpa_poll_stats_t *stats;
+  indigo_time_t now;
+  int budget = ind_ofdpa_poll_budget;
+  int share, spent, cycleDone;
+  uint32_t i, cls;
+
+  /* Nothing is served from the snapshots without a max age */
+  if (ind_ofdpa_flow_stats_max_age_get() == 0)
+  {
+    return;
+  }
+
+  if (ind_ofdpa_flow_batch_busy())
+  {
+    ind_ofdpa_poll_deferred++;
+    return;
+  }
+
+  for (i = 0; (i < IND_OFDPA_POLL_CLASSES) && (budget > 0); i++)
+  {
+    cls = (ind_ofdpa_poll_first + i) % IND_OFDPA_POLL_CLASSES;
+    stats = &ind_ofdpa_poll_stats[cls];
+
+    /* What one class leaves unspent goes to the ones after it */
+    share = budget / (IND_OFDPA_POLL_CLASSES - i);
+    if (share == 0)
+    {
+      share = budget;
+    }
+
+    if (ind_ofdpa_poll_cycle_start[cls] == 0)
+    {
+      ind_ofdpa_poll_cycle_start[cls] = INDIGO_CURRENT_TIME;
+    }
+
+    spent = ind_ofdpa_poll_class_run(cls, share, &cycleDone);
+    budget -= spent;
+    stats->rpcs += spent;
+    ind_ofdpa_poll_cycle_rpcs[cls] += spent;
+
+    if (cycleDone)
+    {
+      now = INDIGO_CURRENT_TIME;
+      stats->cycles++;
+      stats->cycleMs = now - ind_ofdpa_poll_cycle_start[cls];
+      stats->cycleRpcs = ind_ofdpa_poll_cycle_rpcs[cls];
+      ind_ofdpa_poll_cycle_start[cls] = 0;
+      ind_ofdpa_poll_cycle_rpcs[cls] = 0;
+    }
+  }
+
+  ind_ofdpa_poll_first = (ind_ofdpa_poll_first + 1) % IND_OFDPA_POLL_CLASSES;
+}
+
+OFDPA_ERROR_t ind_ofdpa_poll_port_stats_get(uint32_t port, ofdpaPortStats_t *portStats)
+{
+  ind_ofdpa_poll_port_t *slot = ind_ofdpa_poll_port_find(port, 0);
+  indigo_time_t now = INDIGO_CURRENT_TIME;
+  OFDPA_ERROR_t rc;
+
+  if ((slot != NULL) && ind_ofdpa_poll_fresh(IND_OFDPA_POLL_PORTS, slot->refreshed, now))
+  {
+    *portStats = slot->stats;
+    portStats->duration_seconds += (uint32_t)((now - slot->refreshed) / 1000);
+    return OFDPA_E_NONE;
+  }
+  if (slot == NULL)
+  {
+    ind_ofdpa_poll_stats[IND_OFDPA_POLL_PORTS].onDemand++;
+  }
+
+  rc = ofdpaPortStatsGet(port, portStats);
+  if ((rc == OFDPA_E_NONE) &&
+      ((slot != NULL) || ((slot = ind_ofdpa_poll_port_find(port, 1)) != NULL)))
+  {
+    slot->stats = *portStats;
+    slot->refreshed = now;
+  }
+
+  return rc;
+}
+
+OFDPA_ERROR_t ind_ofdpa_poll_num_queues_get(uint32_t port, uint32_t *numQueues)
+{
+  ind_ofdpa_poll_port_t *slot = ind_ofdpa_poll_port_find(port, 0);
+  indigo_time_t now = INDIGO_CURRENT_TIME;
+  uint32_t maxAge = ind_ofdpa_flow_stats_max_age_get();
+  OFDPA_ERROR_t rc;
+
+  if ((slot != NULL) && (slot->queuesRefreshed != 0) && (maxAge != 0) &&
+      (now - slot->queuesRefreshed <= maxAge))
+  {
+    *numQueues = slot->numQueues;
+    return OFDPA_E_NONE;
+  }
+
+  rc = ofdpaNumQueuesGet(port, numQueues);
+  if ((rc == OFDPA_E_NONE) &&
+      ((slot != NULL) || ((slot = ind_ofdpa_poll_port_find(port, 1)) != NULL)))
+  {
+    slot->numQueues = *numQueues;
+    slot->queuesRefreshed = now;
+  }
+
+  return rc;
+}
+
+OFDPA_ERROR_t ind_ofdpa_poll_queue_stats_get(uint32_t port, uint32_t queueId,
+                                             ofdpaPortQueueStats_t *queueStats)
+{
+  ind_ofdpa_poll_port_t *slot = NULL;
+  indigo_time_t now = INDIGO_CURRENT_TIME;
+  OFDPA_ERROR_t rc;
+
+  if (queueId < IND_OFDPA_POLL_QUEUES_MAX)
+  {
+    slot = ind_ofdpa_poll_port_find(port, 0);
+  }
+
+  if ((slot != NULL) &&
+      ind_ofdpa_poll_fresh(IND_OFDPA_POLL_QUEUES, slot->queueRefreshed[queueId], now))
+  {
+    *queueStats = slot->queues[queueId];
+    queueStats->duration_seconds += (uint32_t)((now - slot->queueRefreshed[queueId]) / 1000);
+    return OFDPA_E_NONE;
+  }
+  if (slot == NULL)
+  {
+    ind_ofdpa_poll_stats[IND_OFDPA_POLL_QUEUES].onDemand++;
+  }
+
+  rc = ofdpaQueueStatsGet(port, queueId, queueStats);
+  if ((rc == OFDPA_E_NONE) && (slot != NULL))
+  {
+    slot->queues[queueId] = *queueStats;
+    slot->queueRefreshed[queueId] = now;
+  }
+
+  return rc;
+}
+
+void ind_ofdpa_poll_budget_set(uint32_t budget)
+{
+  ind_ofdpa_poll_budget = budget;
+}
+
+void ind_ofdpa_poll_stats_get(ind_ofdpa_poll_class_t cls, ind_ofdpa_poll_stats_t *stats)
+{
+  ind_ofdpa_flow_stats_counters_t counters;
+
+  if (cls >= IND_OFDPA_POLL_CLASSES)
+  {
+    memset(stats, 0, sizeof(*stats));
+    return;
+  }
+
+  *stats = ind_ofdpa_poll_stats[cls];
+
+  /* Flow requests are counted by the flow stats cache */
+  if (cls == IND_OFDPA_POLL_FLOWS)
+  {
+    ind_ofdpa_flow_stats_counters_get(&counters);
+    stats->served = counters.hits;
+    stats->onDemand = counters.misses;
+    stats->maxAgeServed = counters.maxAgeServed;
+  }
+}
+
+void ind_ofdpa_poll_stats_log(void)
+{
+  ind_ofdpa_poll_stats_t stats;
+  uint32_t cls;
+
+  LOG_INFO("Counter poller: budget %u calls per %u ms, %llu slices deferred.",
+           ind_ofdpa_poll_budget, IND_OFDPA_POLL_SLICE_MS,
+           (unsigned long long)ind_ofdpa_poll_deferred);
+
+  for (cls = 0; cls < IND_OFDPA_POLL_CLASSES; cls++)
+  {
+    ind_ofdpa_poll_stats_get(cls, &stats);
+    LOG_INFO("  %s: %llu calls, %llu passes, last pass %llu ms / %llu calls, "
+             "%llu served, %llu on demand, oldest served %llu ms.",
+             ind_ofdpa_poll_class_names[cls],
+             (unsigned long long)stats.rpcs,
+             (unsigned long long)stats.cycles,
+             (unsigned long long)stats.cycleMs,
+             (unsigned long long)stats.cycleRpcs,
+             (unsigned long long)stats.served,
+             (unsigned long long)stats.onDemand,
+             (unsigned long long)stats.maxAgeServed);
+  }
+}
+
+indigo_error_t ind_ofdpa_poll_init(void)
+{
+  indigo_error_t err;
+
+  if (ind_ofdpa_poll_budget == 0)
+  {
+    LOG_INFO("Counter poller disabled.");
+    return INDIGO_ERROR_NONE;
+  }
+
+  err = ind_soc_timer_event_register_with_priority(ind_ofdpa_poll_slice, NULL,
+                                                   IND_OFDPA_POLL_SLICE_MS,
+                                                   IND_SOC_LOWEST_PRIORITY);
+  if (err != INDIGO_ERROR_NONE)
+  {
+    LOG_ERROR("Failed to register counter poller timer. (err = %d)", err);
+    return err;
+  }
+  ind_ofdpa_poll_running = 1;
+
+  return INDIGO_ERROR_NONE;
+}
+
+void ind_ofdpa_poll_finish(void)
+{
+  if (ind_ofdpa_poll_running)
+  {
+    ind_soc_timer_event_unregister(ind_ofdpa_poll_slice, NULL);
+    ind_ofdpa_poll_running = 0;
+  }
+}
@@ -111,7 +111,7 @@ static indigo_error_t ind_ofdpa_port_stats_set(uint32_t port, of_list_port_stats
   }
 
   memset(&portStats, 0, sizeof(portStats));
-  ofdpa_rv = ofdpaPortStatsGet(port, &portStats);
+  ofdpa_rv = ind_ofdpa_poll_port_stats_get(port, &portStats);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to get stats on port %d.", port);
@@ -159,7 +159,7 @@ static indigo_error_t ind_ofdpa_queue_stats_set(of_port_no_t port,
     queueId = req_of_port_queue_id;
   }
 
-  ofdpa_rv = ofdpaNumQueuesGet(port, &numQueues);
+  ofdpa_rv = ind_ofdpa_poll_num_queues_get(port, &numQueues);
   if (ofdpa_rv != OFDPA_E_NONE)
   {
     LOG_ERROR("Failed to get no. of port queues. (ofdpa_rv = %d)", ofdpa_rv);
@@ -180,7 +180,7 @@ static indigo_error_t ind_ofdpa_queue_stats_set(of_port_no_t port,
       LOG_ERROR("Too many queue stats replies.");
       return INDIGO_ERROR_RESOURCE;
     }
-    ofdpa_rv = ofdpaQueueStatsGet(port, queueId, &queueStats);
+    ofdpa_rv = ind_ofdpa_poll_queue_stats_get(port, queueId, &queueStats);
     if (ofdpa_rv != OFDPA_E_NONE)
     {
       LOG_ERROR("Failed to queue stats for port %d on queue %d.", port, queueId);
@@ -329,6 +329,9 @@ indigo_error_t indigo_port_features_get(of_features_reply_t *features)
 {
   uint32_t capabilities = 0;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   LOG_TRACE("%s() called\n",__FUNCTION__);
 
   if (features->version < OF_VERSION_1_3)
@@ -354,6 +357,9 @@ indigo_error_t indigo_port_desc_stats_get(of_port_desc_stats_reply_t *port_desc_
   of_list_port_desc_t *of_list_port_desc = 0;
   uint32_t port= 0, nextPort = 0;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   LOG_TRACE("%s() called.", __FUNCTION__);
 
   if (port_desc_stats_reply->version < OF_VERSION_1_3)
@@ -423,6 +429,9 @@ indigo_error_t indigo_port_modify(of_port_mod_t *port_mod)
   uint32_t of_advertise;
   ofdpaMacAddr_t mac;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   LOG_TRACE("%s() called", __FUNCTION__);
 
   of_port_mod_port_no_get(port_mod, &of_port_no);
@@ -476,6 +485,9 @@ indigo_error_t indigo_port_stats_get(of_port_stats_request_t *port_stats_request
   int dump_all = 0;
   uint32_t port = 0;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   LOG_TRACE("%s() called", __FUNCTION__);
 
   if (port_stats_request->version < OF_VERSION_1_3)
@@ -560,6 +572,9 @@ indigo_error_t indigo_port_queue_config_get(of_queue_get_config_request_t *queue
   uint32_t dump_all = 0;
   uint32_t port;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   LOG_TRACE("%s called", __FUNCTION__);
 
   if (queue_config_request->version < OF_VERSION_1_3)
@@ -677,6 +692,9 @@ indigo_error_t indigo_port_queue_stats_get(of_queue_stats_request_t *queue_stats
   uint32_t port, all_ports = 0;
 
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   LOG_TRACE("Port queue stats called");
 
   if (queue_stats_request->version < OF_VERSION_1_3)
@@ -826,6 +844,9 @@ ind_ofdpa_port_event_receive(void)
   ofdpaPortEvent_t portEventData;
   int reason = 0;
 
+  /* Queued flow adds go first */
+  ind_ofdpa_flow_batch_drain();
+
   LOG_TRACE("Reading Port Events");
 
   memset(&portEventData, 0, sizeof(portEventData));
@@ -29,6 +29,8 @@
 * @end
 *
 **********************************************************************/
+#include <stdlib.h>
+#include <string.h>
 #include "ind_ofdpa_util.h"
 #include "ind_ofdpa_log.h"
 
@@ -73,4 +75,166 @@ indigo_error_t indigoConvertOfdpaRv(OFDPA_ERROR_t result)
   return indigoRv;
 }
 
+/*
+ * Flow id keyed hash table, used by the flow shadow and the flow stats
+ * cache. Open addressing with linear probing; removal shifts the rest of
+ * the probe run back, so there are no tombstones. The table doubles to
+ * stay at most half full.
+ */
+#define IND_OFDPA_FLOW_MAP_SLOT(_map, _i) \
+  ((_map)->slots + (size_t)(_i) * (_map)->recordSize)
 
+static uint64_t ind_ofdpa_flow_map_id(const uint8_t *slot)
+{
+  uint64_t flowId;
+
+  memcpy(&flowId, slot, sizeof(flowId));
+  return flowId;
+}
+
+static uint32_t ind_ofdpa_flow_map_hash(uint64_t flowId)
+{
+  flowId ^= flowId >> 33;
+  flowId *= 0xff51afd7ed558ccdULL;
+  flowId ^= flowId >> 33;
+  return (uint32_t)flowId;
+}
+
+/* Returns the record of a flow, or NULL */
+void *ind_ofdpa_flow_map_find(const ind_ofdpa_flow_map_t *map, uint64_t flowId)
+{
+  uint8_t *slot;
+  uint64_t slotId;
+  uint32_t mask = map->size - 1;
+  uint32_t i;
+
+  if ((map->size == 0) || (flowId == 0))
+  {
+    return NULL;
+  }
+
+  for (i = ind_ofdpa_flow_map_hash(flowId) & mask; ; i = (i + 1) & mask)
+  {
+    slot = IND_OFDPA_FLOW_MAP_SLOT(map, i);
+    slotId = ind_ofdpa_flow_map_id(slot);
+    if (slotId == flowId)
+    {
+      return slot;
+    }
+    if (slotId == 0)
+    {
+      return NULL;
+    }
+  }
+}
+
+static void ind_ofdpa_flow_map_insert(ind_ofdpa_flow_map_t *map, const void *record)
+{
+  uint32_t mask = map->size - 1;
+  uint32_t i;
+
+  for (i = ind_ofdpa_flow_map_hash(ind_ofdpa_flow_map_id(record)) & mask;
+       ind_ofdpa_flow_map_id(IND_OFDPA_FLOW_MAP_SLOT(map, i)) != 0;
+       i = (i + 1) & mask)
+  {
+  }
+
+  memcpy(IND_OFDPA_FLOW_MAP_SLOT(map, i), record, map->recordSize);
+  map->count++;
+}
+
+/* Double the table, keeping it at most half full */
+static int ind_ofdpa_flow_map_grow(ind_ofdpa_flow_map_t *map)
+{
+  uint8_t *old = map->slots;
+  uint32_t oldSize = map->size;
+  uint32_t size, i;
+
+  size = oldSize ? oldSize * 2 : map->minSize;
+
+  map->slots = calloc(size, map->recordSize);
+  if (map->slots == NULL)
+  {
+    map->slots = old;
+    return 0;
+  }
+  map->size = size;
+  map->count = 0;
+
+  for (i = 0; i < oldSize; i++)
+  {
+    if (ind_ofdpa_flow_map_id(old + (size_t)i * map->recordSize) != 0)
+    {
+      ind_ofdpa_flow_map_insert(map, old + (size_t)i * map->recordSize);
+    }
+  }
+  free(old);
+
+  return 1;
+}
+
+/*
+ * Store a record, replacing any earlier record of the flow. Returns 0 if
+ * the record was not stored because the table is at its cap or out of
+ * memory.
+ */
+int ind_ofdpa_flow_map_set(ind_ofdpa_flow_map_t *map, const void *record)
+{
+  uint64_t flowId = ind_ofdpa_flow_map_id(record);
+  void *slot;
+
+  if (flowId == 0)
+  {
+    return 0;
+  }
+
+  slot = ind_ofdpa_flow_map_find(map, flowId);
+  if (slot != NULL)
+  {
+    memcpy(slot, record, map->recordSize);
+    return 1;
+  }
+
+  if (map->count >= map->maxCount)
+  {
+    return 0;
+  }
+
+  if (((map->count + 1) * 2 > map->size) && !ind_ofdpa_flow_map_grow(map))
+  {
+    return 0;
+  }
+
+  ind_ofdpa_flow_map_insert(map, record);
+  return 1;
+}
+
+void ind_ofdpa_flow_map_remove(ind_ofdpa_flow_map_t *map, uint64_t flowId)
+{
+  uint8_t *slot = ind_ofdpa_flow_map_find(map, flowId);
+  uint32_t mask = map->size - 1;
+  uint32_t hole, i, home;
+  uint64_t slotId;
+
+  if (slot == NULL)
+  {
+    return;
+  }
+
+  /* Shift later members of the probe run back into the hole */
+  hole = (slot - map->slots) / map->recordSize;
+  for (i = (hole + 1) & mask;
+       (slotId = ind_ofdpa_flow_map_id(IND_OFDPA_FLOW_MAP_SLOT(map, i))) != 0;
+       i = (i + 1) & mask)
+  {
+    home = ind_ofdpa_flow_map_hash(slotId) & mask;
+    if (((i - home) & mask) >= ((i - hole) & mask))
+    {
+      memcpy(IND_OFDPA_FLOW_MAP_SLOT(map, hole), IND_OFDPA_FLOW_MAP_SLOT(map, i), map->recordSize);
+      hole = i;
+    }
+  }
+
+  memset(IND_OFDPA_FLOW_MAP_SLOT(map, hole), 0, map->recordSize);
+  map->count--;
+}
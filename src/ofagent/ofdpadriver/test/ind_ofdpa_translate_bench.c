@@ -0,0 +1,273 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2013-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_translate_bench.c
+*
+* @purpose      Flow translation cost of the OF-DPA Driver
+*
+* @component    OF-DPA
+*
+* @comments     Times indigo_fwd_flow_create on a few common flow shapes
+*               and prints the cost per flow, next to the cost of just
+*               decoding the match with LOCI, which is the floor for any
+*               translator.
+*
+*               ofdpaFlowAdd below takes the place of the one in the
+*               OF-DPA client library, so nothing reaches the switch. The
+*               flow worker is never started, so every add is made
+*               synchronously and only translation is timed.
+*
+*               Build it with the driver sources, the indigo and LOCI
+*               libraries and the OF-DPA client library, then run:
+*
+*                 ind_ofdpa_translate_bench [flows] [rounds]
+*
+* @end
+*
+**********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+
+int ofagent_of_version = 4;
+
+static long ind_ofdpa_bench_adds;
+
+OFDPA_ERROR_t ofdpaFlowAdd(ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_bench_adds++;
+  return OFDPA_E_NONE;
+}
+
+/* Timing a flow_mod LOCI could not build would be meaningless */
+static void ind_ofdpa_bench_check(int rv, const char *what)
+{
+  if (rv < 0)
+  {
+    fprintf(stderr, "failed to %s (%d)\n", what, rv);
+    exit(1);
+  }
+}
+
+typedef struct ind_ofdpa_bench_shape_s
+{
+  const char *name;
+  void (*build)(of_flow_add_t *flow_add, of_match_t *match, int i);
+} ind_ofdpa_bench_shape_t;
+
+static void ind_ofdpa_bench_goto(of_list_instruction_t *insts, uint8_t tableId)
+{
+  of_instruction_goto_table_t *inst;
+
+  inst = of_instruction_goto_table_new(OF_VERSION_1_3);
+  of_instruction_goto_table_table_id_set(inst, tableId);
+  of_list_append(insts, inst);
+  of_object_delete(inst);
+}
+
+static void ind_ofdpa_bench_write_group(of_list_instruction_t *insts, uint32_t groupId)
+{
+  of_instruction_write_actions_t *inst;
+  of_list_action_t *actions;
+  of_action_group_t *action;
+
+  actions = of_list_action_new(OF_VERSION_1_3);
+  action = of_action_group_new(OF_VERSION_1_3);
+  of_action_group_group_id_set(action, groupId);
+  of_list_append(actions, action);
+  of_object_delete(action);
+
+  inst = of_instruction_write_actions_new(OF_VERSION_1_3);
+  ind_ofdpa_bench_check(of_instruction_write_actions_actions_set(inst, actions), "set actions");
+  of_list_append(insts, inst);
+  of_object_delete(inst);
+  of_object_delete(actions);
+}
+
+/* VLAN table: in_port + vid, goto termination MAC */
+static void ind_ofdpa_bench_vlan(of_flow_add_t *flow_add, of_match_t *match, int i)
+{
+  of_list_instruction_t *insts = of_list_instruction_new(OF_VERSION_1_3);
+
+  match->fields.in_port = 1 + (i % 48);
+  match->masks.in_port = 0xffffffff;
+  match->fields.vlan_vid = 0x1000 | (1 + i % 4000);
+  match->masks.vlan_vid = 0x1fff;
+  of_flow_add_table_id_set(flow_add, OFDPA_FLOW_TABLE_ID_VLAN);
+
+  ind_ofdpa_bench_goto(insts, OFDPA_FLOW_TABLE_ID_TERMINATION_MAC);
+  ind_ofdpa_bench_check(of_flow_add_instructions_set(flow_add, insts), "set instructions");
+  of_object_delete(insts);
+}
+
+/* Bridging table: vid + MAC, write group, goto policy ACL */
+static void ind_ofdpa_bench_bridging(of_flow_add_t *flow_add, of_match_t *match, int i)
+{
+  of_list_instruction_t *insts = of_list_instruction_new(OF_VERSION_1_3);
+
+  match->fields.vlan_vid = 0x1000 | 10;
+  match->masks.vlan_vid = 0x1fff;
+  match->fields.eth_dst.addr[0] = 0x02;
+  match->fields.eth_dst.addr[4] = i >> 8;
+  match->fields.eth_dst.addr[5] = i;
+  memset(match->masks.eth_dst.addr, 0xff, sizeof(match->masks.eth_dst.addr));
+  of_flow_add_table_id_set(flow_add, OFDPA_FLOW_TABLE_ID_BRIDGING);
+
+  ind_ofdpa_bench_write_group(insts, 0x000a0001);
+  ind_ofdpa_bench_goto(insts, OFDPA_FLOW_TABLE_ID_ACL_POLICY);
+  ind_ofdpa_bench_check(of_flow_add_instructions_set(flow_add, insts), "set instructions");
+  of_object_delete(insts);
+}
+
+/* Unicast routing table: IPv4 prefix, write group, goto policy ACL */
+static void ind_ofdpa_bench_routing(of_flow_add_t *flow_add, of_match_t *match, int i)
+{
+  of_list_instruction_t *insts = of_list_instruction_new(OF_VERSION_1_3);
+
+  match->fields.eth_type = 0x0800;
+  match->masks.eth_type = 0xffff;
+  match->fields.ipv4_dst = 0x0a000000 | (i << 8);
+  match->masks.ipv4_dst = 0xffffff00;
+  of_flow_add_table_id_set(flow_add, OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING);
+
+  ind_ofdpa_bench_write_group(insts, 0x20000001);
+  ind_ofdpa_bench_goto(insts, OFDPA_FLOW_TABLE_ID_ACL_POLICY);
+  ind_ofdpa_bench_check(of_flow_add_instructions_set(flow_add, insts), "set instructions");
+  of_object_delete(insts);
+}
+
+/* Policy ACL table: a 5-tuple, clear actions */
+static void ind_ofdpa_bench_acl(of_flow_add_t *flow_add, of_match_t *match, int i)
+{
+  of_list_instruction_t *insts = of_list_instruction_new(OF_VERSION_1_3);
+  of_instruction_clear_actions_t *inst;
+
+  match->fields.in_port = 1 + (i % 48);
+  match->masks.in_port = 0xffffffff;
+  match->fields.eth_type = 0x0800;
+  match->masks.eth_type = 0xffff;
+  match->fields.ip_proto = IPPROTO_TCP;
+  match->masks.ip_proto = 0xff;
+  match->fields.ipv4_src = 0xc0a80000 | i;
+  match->masks.ipv4_src = 0xffffffff;
+  match->fields.tcp_dst = 1024 + i;
+  match->masks.tcp_dst = 0xffff;
+  of_flow_add_table_id_set(flow_add, OFDPA_FLOW_TABLE_ID_ACL_POLICY);
+
+  inst = of_instruction_clear_actions_new(OF_VERSION_1_3);
+  of_list_append(insts, inst);
+  of_object_delete(inst);
+  ind_ofdpa_bench_check(of_flow_add_instructions_set(flow_add, insts), "set instructions");
+  of_object_delete(insts);
+}
+
+static const ind_ofdpa_bench_shape_t ind_ofdpa_bench_shapes[] =
+{
+  { "vlan",      ind_ofdpa_bench_vlan },
+  { "bridging",  ind_ofdpa_bench_bridging },
+  { "routing",   ind_ofdpa_bench_routing },
+  { "acl",       ind_ofdpa_bench_acl },
+};
+
+static double ind_ofdpa_bench_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+int main(int argc, char *argv[])
+{
+  int flows = (argc > 1) ? atoi(argv[1]) : 2000;
+  int rounds = (argc > 2) ? atoi(argv[2]) : 100;
+  of_flow_add_t **flow_adds;
+  of_match_t match;
+  const ind_ofdpa_bench_shape_t *shape;
+  indigo_error_t rv;
+  uint8_t tableId;
+  double start, translate, decode;
+  int s, r, i;
+
+  flow_adds = calloc(flows, sizeof(*flow_adds));
+  if ((flows <= 0) || (rounds <= 0) || (flow_adds == NULL))
+  {
+    fprintf(stderr, "usage: %s [flows] [rounds]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%-10s %14s %14s\n", "shape", "translate ns", "decode ns");
+
+  for (s = 0; s < sizeof(ind_ofdpa_bench_shapes)/sizeof(ind_ofdpa_bench_shapes[0]); s++)
+  {
+    shape = &ind_ofdpa_bench_shapes[s];
+
+    for (i = 0; i < flows; i++)
+    {
+      memset(&match, 0, sizeof(match));
+      match.version = OF_VERSION_1_3;
+      flow_adds[i] = of_flow_add_new(OF_VERSION_1_3);
+      of_flow_add_priority_set(flow_adds[i], 100);
+      shape->build(flow_adds[i], &match, i);
+      ind_ofdpa_bench_check(of_flow_add_match_set(flow_adds[i], &match), "set match");
+    }
+
+    start = ind_ofdpa_bench_now();
+    for (r = 0; r < rounds; r++)
+    {
+      for (i = 0; i < flows; i++)
+      {
+        rv = indigo_fwd_flow_create(i + 1, flow_adds[i], &tableId);
+        if (rv != INDIGO_ERROR_NONE)
+        {
+          fprintf(stderr, "%s: flow %d rejected (%d)\n", shape->name, i, rv);
+          return 1;
+        }
+      }
+    }
+    translate = ind_ofdpa_bench_now() - start;
+
+    start = ind_ofdpa_bench_now();
+    for (r = 0; r < rounds; r++)
+    {
+      for (i = 0; i < flows; i++)
+      {
+        ind_ofdpa_bench_check(of_flow_add_match_get(flow_adds[i], &match), "decode match");
+      }
+    }
+    decode = ind_ofdpa_bench_now() - start;
+
+    printf("%-10s %14.1f %14.1f\n", shape->name,
+           translate * 1e9 / ((double)flows * rounds),
+           decode * 1e9 / ((double)flows * rounds));
+
+    for (i = 0; i < flows; i++)
+    {
+      of_object_delete(flow_adds[i]);
+    }
+  }
+
+  printf("%ld flows added\n", ind_ofdpa_bench_adds);
+  free(flow_adds);
+  return 0;
+}
@@ -0,0 +1,507 @@
+/*********************************************************************
+*
+* (C) Copyright Broadcom Corporation 2013-2016
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*      http://www.apache.org/licenses/LICENSE-2.0
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+**********************************************************************
+*
+* @filename     ind_ofdpa_translate_diff.c
+*
+* @purpose      Differential test of the OF-DPA Driver flow translation
+*
+* @component    OF-DPA
+*
+* @comments     Generates a corpus of random flow_mods from a fixed seed,
+*               runs each through indigo_fwd_flow_create and writes the
+*               result and the OF-DPA flow entry it produced to a file.
+*               Build the program once against the translator to be
+*               checked and once against a reference revision of
+*               ind_ofdpa_fwd.c (with the current headers and the rest of
+*               the driver), generate a file with each, and compare:
+*
+*                 ind_ofdpa_translate_diff gen <count> <file> [seed]
+*                 ind_ofdpa_translate_diff cmp <reference> <file>
+*
+*               The corpus covers every match field the driver knows,
+*               every flow table, and random instruction lists, so it
+*               exercises the per-table match and instruction rules.
+*               Many flow_mods are rejected; what matters is that both
+*               translators reject the same ones with the same error and
+*               build the same flow entry for the rest. cmp prints how
+*               many each table accepted, to show what was covered.
+*
+*               ofdpaFlowAdd below takes the place of the one in the
+*               OF-DPA client library and only records the flow entry.
+*               The flow worker is never started, so every add is made
+*               synchronously.
+*
+* @end
+*
+**********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <AIM/aim_log.h>
+#include "indigo/forwarding.h"
+#include "ind_ofdpa_util.h"
+
+int ofagent_of_version = 4;
+
+extern void __ind_ofdpa_driver_module_init__(void);
+
+#define IND_OFDPA_DIFF_MATCH_FIELDS       52
+#define IND_OFDPA_DIFF_TABLES             (sizeof(ind_ofdpa_diff_table_fields)/sizeof(ind_ofdpa_diff_table_fields[0]))
+
+typedef struct ind_ofdpa_diff_record_s
+{
+  uint32_t          index;
+  uint32_t          tableId;
+  int32_t           rv;
+  int32_t           added;
+  ofdpaFlowEntry_t  flow;
+} ind_ofdpa_diff_record_t;
+
+static ofdpaFlowEntry_t ind_ofdpa_diff_flow;
+static int ind_ofdpa_diff_added;
+
+OFDPA_ERROR_t ofdpaFlowAdd(ofdpaFlowEntry_t *flow)
+{
+  ind_ofdpa_diff_flow = *flow;
+  ind_ofdpa_diff_added = 1;
+  return OFDPA_E_NONE;
+}
+
+/* The corpus is useless if LOCI could not build a flow_mod */
+static void ind_ofdpa_diff_check(int rv, const char *what)
+{
+  if (rv < 0)
+  {
+    fprintf(stderr, "failed to set %s (%d)\n", what, rv);
+    exit(1);
+  }
+}
+
+static uint64_t ind_ofdpa_diff_seed = 88172645463325252ULL;
+
+/* xorshift64, so the corpus is the same on every build */
+static uint64_t ind_ofdpa_diff_rand(void)
+{
+  ind_ofdpa_diff_seed ^= ind_ofdpa_diff_seed << 13;
+  ind_ofdpa_diff_seed ^= ind_ofdpa_diff_seed >> 7;
+  ind_ofdpa_diff_seed ^= ind_ofdpa_diff_seed << 17;
+  return ind_ofdpa_diff_seed;
+}
+
+static void ind_ofdpa_diff_rand_fill(void *buf, int len)
+{
+  uint8_t *p = buf;
+
+  while (len--)
+  {
+    *p++ = ind_ofdpa_diff_rand();
+  }
+}
+
+/* Random value; the mask is either exact or random */
+#define IND_OFDPA_DIFF_FIELD(_field) \
+  do { \
+    ind_ofdpa_diff_rand_fill(&match->masks._field, sizeof(match->masks._field)); \
+    if (ind_ofdpa_diff_rand() % 2) \
+    { \
+      memset(&match->masks._field, 0xff, sizeof(match->masks._field)); \
+    } \
+    ind_ofdpa_diff_rand_fill(&match->fields._field, sizeof(match->fields._field)); \
+  } while (0)
+
+static void ind_ofdpa_diff_field_set(of_match_t *match, int field)
+{
+  static const uint8_t ipProtos[] =
+    { IPPROTO_TCP, IPPROTO_UDP, IPPROTO_SCTP, IPPROTO_ICMP, IPPROTO_ICMPV6, IPPROTO_GRE };
+
+  switch (field)
+  {
+    case 0:  IND_OFDPA_DIFF_FIELD(vlan_vid); break;
+    case 1:  IND_OFDPA_DIFF_FIELD(eth_src); break;
+    case 2:  IND_OFDPA_DIFF_FIELD(eth_dst); break;
+    case 3:  IND_OFDPA_DIFF_FIELD(in_port); break;
+    case 4:  IND_OFDPA_DIFF_FIELD(eth_type); break;
+    case 5:  IND_OFDPA_DIFF_FIELD(ipv4_dst); break;
+    case 6:  IND_OFDPA_DIFF_FIELD(ipv4_src); break;
+    case 7:  IND_OFDPA_DIFF_FIELD(ipv6_dst); break;
+    case 8:  IND_OFDPA_DIFF_FIELD(ipv6_src); break;
+    case 9:  IND_OFDPA_DIFF_FIELD(tunnel_id); break;
+    case 10: IND_OFDPA_DIFF_FIELD(vlan_pcp); break;
+    case 11: IND_OFDPA_DIFF_FIELD(ofdpa_dei); break;
+    case 12: IND_OFDPA_DIFF_FIELD(arp_spa); break;
+    case 13: IND_OFDPA_DIFF_FIELD(ip_dscp); break;
+    case 14: IND_OFDPA_DIFF_FIELD(ip_ecn); break;
+    case 15:
+      match->fields.ip_proto = ipProtos[ind_ofdpa_diff_rand() % sizeof(ipProtos)];
+      match->masks.ip_proto = 0xff;
+      break;
+    case 16: IND_OFDPA_DIFF_FIELD(tcp_src); break;
+    case 17: IND_OFDPA_DIFF_FIELD(tcp_dst); break;
+    case 18: IND_OFDPA_DIFF_FIELD(udp_src); break;
+    case 19: IND_OFDPA_DIFF_FIELD(udp_dst); break;
+    case 20: IND_OFDPA_DIFF_FIELD(sctp_src); break;
+    case 21: IND_OFDPA_DIFF_FIELD(sctp_dst); break;
+    case 22: IND_OFDPA_DIFF_FIELD(icmpv4_type); break;
+    case 23: IND_OFDPA_DIFF_FIELD(icmpv4_code); break;
+    case 24: IND_OFDPA_DIFF_FIELD(ipv6_flabel); break;
+    case 25: IND_OFDPA_DIFF_FIELD(icmpv6_type); break;
+    case 26: IND_OFDPA_DIFF_FIELD(icmpv6_code); break;
+    case 27: IND_OFDPA_DIFF_FIELD(mpls_label); break;
+    case 28: IND_OFDPA_DIFF_FIELD(mpls_bos); break;
+    case 29: IND_OFDPA_DIFF_FIELD(mpls_tc); break;
+    case 30: IND_OFDPA_DIFF_FIELD(ofdpa_mpls_l2_port); break;
+    case 31: IND_OFDPA_DIFF_FIELD(ofdpa_ovid); break;
+    case 32: IND_OFDPA_DIFF_FIELD(ofdpa_vrf); break;
+    case 33: IND_OFDPA_DIFF_FIELD(ofdpa_qos_index); break;
+    case 34: IND_OFDPA_DIFF_FIELD(ofdpa_lmep_id); break;
+    case 35: IND_OFDPA_DIFF_FIELD(ofdpa_mpls_ttl); break;
+    case 36: IND_OFDPA_DIFF_FIELD(ofdpa_bfd_discriminator); break;
+    case 37: IND_OFDPA_DIFF_FIELD(ofdpa_mpls_data_first_nibble); break;
+    case 38: IND_OFDPA_DIFF_FIELD(ofdpa_mpls_ach_channel); break;
+    case 39: IND_OFDPA_DIFF_FIELD(ofdpa_mpls_next_label_is_gal); break;
+    case 40: IND_OFDPA_DIFF_FIELD(ofdpa_oam_y1731_mdl); break;
+    case 41: IND_OFDPA_DIFF_FIELD(ofdpa_oam_y1731_opcode); break;
+    case 42: IND_OFDPA_DIFF_FIELD(ofdpa_color_actions_index); break;
+    case 43: IND_OFDPA_DIFF_FIELD(ofdpa_txfcl); break;
+    case 44: IND_OFDPA_DIFF_FIELD(ofdpa_rxfcl); break;
+    case 45: IND_OFDPA_DIFF_FIELD(ofdpa_rx_timestamp); break;
+    case 46: IND_OFDPA_DIFF_FIELD(ofdpa_l3_in_port); break;
+    case 47: IND_OFDPA_DIFF_FIELD(ofdpa_protection_index); break;
+    case 48: IND_OFDPA_DIFF_FIELD(ofdpa_color); break;
+    case 49: IND_OFDPA_DIFF_FIELD(ofdpa_traffic_class); break;
+    case 50: IND_OFDPA_DIFF_FIELD(ofdpa_allow_vlan_translation); break;
+    case 51: IND_OFDPA_DIFF_FIELD(onf_actset_output); break;
+  }
+}
+
+/* The IND_OFDPA_* match field bit of each field ind_ofdpa_diff_field_set() sets */
+static const ind_ofdpa_fields_t ind_ofdpa_diff_field_bits[IND_OFDPA_DIFF_MATCH_FIELDS] =
+{
+  IND_OFDPA_VLANID, IND_OFDPA_SRCMAC, IND_OFDPA_DSTMAC, IND_OFDPA_PORT,
+  IND_OFDPA_ETHER_TYPE, IND_OFDPA_IPV4_DST, IND_OFDPA_IPV4_SRC, IND_OFDPA_IPV6_DST,
+  IND_OFDPA_IPV6_SRC, IND_OFDPA_TUNNEL_ID, IND_OFDPA_VLAN_PCP, IND_OFDPA_VLAN_DEI,
+  IND_OFDPA_IPV4_ARP_SPA, IND_OFDPA_IP_DSCP, IND_OFDPA_IP_ECN, IND_OFDPA_IP_PROTO,
+  IND_OFDPA_TCP_L4_SRC_PORT, IND_OFDPA_TCP_L4_DST_PORT, IND_OFDPA_UDP_L4_SRC_PORT,
+  IND_OFDPA_UDP_L4_DST_PORT, IND_OFDPA_SCTP_L4_SRC_PORT, IND_OFDPA_SCTP_L4_DST_PORT,
+  IND_OFDPA_ICMPV4_TYPE, IND_OFDPA_ICMPV4_CODE, IND_OFDPA_IPV6_FLOW_LABEL,
+  IND_OFDPA_ICMPV6_TYPE, IND_OFDPA_ICMPV6_CODE, IND_OFDPA_MPLS_LABEL, IND_OFDPA_MPLS_BOS,
+  IND_OFDPA_MPLS_TC, IND_OFDPA_MPLS_L2_PORT, IND_OFDPA_OVID, IND_OFDPA_VRF,
+  IND_OFDPA_QOS_INDEX, IND_OFDPA_LMEP_ID, IND_OFDPA_MPLS_TTL, IND_OFDPA_BFD_DISCRIMINATOR,
+  IND_OFDPA_MPLS_DATA_FIRST_NIBBLE, IND_OFDPA_MPLS_ACH_CHANNEL,
+  IND_OFDPA_MPLS_NEXT_LABEL_IS_GAL, IND_OFDPA_OAM_Y1731_MDL, IND_OFDPA_OAM_Y1731_OPCODE,
+  IND_OFDPA_COLOR_ACTIONS_INDEX, IND_OFDPA_TXFCL, IND_OFDPA_RXFCL, IND_OFDPA_RX_TIMESTAMP,
+  IND_OFDPA_L3_IN_PORT, IND_OFDPA_PROTECTION_INDEX, IND_OFDPA_COLOR, IND_OFDPA_TC,
+  IND_OFDPA_ALLOW_VLAN_TRANSLATION, IND_ONF_ACTSET_OUTPUT,
+};
+
+/*
+ * The match field bitmaps OF-DPA documents for each table. Half the corpus
+ * starts from these so that most tables see flow_mods they accept; a
+ * purely random field set almost never has a table's mandatory fields.
+ */
+typedef struct ind_ofdpa_diff_table_s
+{
+  uint8_t            tableId;
+  ind_ofdpa_fields_t allowed;
+  ind_ofdpa_fields_t mandatory;
+  ind_ofdpa_fields_t altMandatory;
+} ind_ofdpa_diff_table_t;
+
+static const ind_ofdpa_diff_table_t ind_ofdpa_diff_table_fields[] =
+{
+  { OFDPA_FLOW_TABLE_ID_INGRESS_PORT,       IND_OFDPA_ING_PORT_FLOW_MATCH_BITMAP,           IND_OFDPA_ING_PORT_FLOW_MATCH_MAND_BITMAP,           0 },
+  { OFDPA_FLOW_TABLE_ID_INJECTED_OAM,       IND_OFDPA_INJECTED_OAM_FLOW_MATCH_BITMAP,       IND_OFDPA_INJECTED_OAM_FLOW_MATCH_MAND_BITMAP,       0 },
+  { OFDPA_FLOW_TABLE_ID_VLAN,               IND_OFDPA_VLAN_FLOW_MATCH_BITMAP,               IND_OFDPA_VLAN_FLOW_MATCH_MAND_BITMAP,               0 },
+  { OFDPA_FLOW_TABLE_ID_VLAN_1,             IND_OFDPA_VLAN1_FLOW_MATCH_BITMAP,              IND_OFDPA_VLAN1_FLOW_MATCH_MAND_BITMAP,              0 },
+  { OFDPA_FLOW_TABLE_ID_MAINTENANCE_POINT,  IND_OFDPA_MP_FLOW_MATCH_BITMAP,                 IND_OFDPA_MP_FLOW_MATCH_MAND_BITMAP,                 0 },
+  { OFDPA_FLOW_TABLE_ID_MPLS_L2_PORT,       IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_BITMAP,       IND_OFDPA_MPLS_L2_PORT_FLOW_MATCH_MAND_BITMAP,       0 },
+  { OFDPA_FLOW_TABLE_ID_TERMINATION_MAC,    IND_OFDPA_TERM_MAC_FLOW_MATCH_BITMAP,           IND_OFDPA_TERM_MAC_FLOW_MATCH_MAND_BITMAP,           0 },
+  { OFDPA_FLOW_TABLE_ID_MPLS_0,             IND_OFDPA_MPLS_FLOW_MATCH_BITMAP,               IND_OFDPA_MPLS_FLOW_MATCH_MAND_BITMAP,               0 },
+  { OFDPA_FLOW_TABLE_ID_MPLS_1,             IND_OFDPA_MPLS_FLOW_MATCH_BITMAP,               IND_OFDPA_MPLS_FLOW_MATCH_MAND_BITMAP,               0 },
+  { OFDPA_FLOW_TABLE_ID_MPLS_2,             IND_OFDPA_MPLS_FLOW_MATCH_BITMAP,               IND_OFDPA_MPLS_FLOW_MATCH_MAND_BITMAP,               0 },
+  { OFDPA_FLOW_TABLE_ID_MPLS_MAINTENANCE_POINT, IND_OFDPA_MPLS_MP_FLOW_MATCH_BITMAP,        IND_OFDPA_MPLS_MP_FLOW_MATCH_MAND_BITMAP,            0 },
+  { OFDPA_FLOW_TABLE_ID_UNICAST_ROUTING,    IND_OFDPA_UCAST_ROUTING_FLOW_MATCH_BITMAP,      IND_OFDPA_UCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP,    IND_OFDPA_UCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP },
+  { OFDPA_FLOW_TABLE_ID_MULTICAST_ROUTING,  IND_OFDPA_MCAST_ROUTING_FLOW_MATCH_BITMAP,      IND_OFDPA_MCAST_ROUTINGV4_FLOW_MATCH_MAND_BITMAP,    IND_OFDPA_MCAST_ROUTINGV6_FLOW_MATCH_MAND_BITMAP },
+  { OFDPA_FLOW_TABLE_ID_BRIDGING,           IND_OFDPA_BRIDGING_FLOW_MATCH_BITMAP,           0,                                                   0 },
+  { OFDPA_FLOW_TABLE_ID_L2_POLICER,         IND_OFDPA_L2_POLICER_FLOW_MATCH_BITMAP,         IND_OFDPA_L2_POLICER_FLOW_MATCH_MAND_BITMAP,         0 },
+  { OFDPA_FLOW_TABLE_ID_L2_POLICER_ACTIONS, IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_BITMAP, IND_OFDPA_L2_POLICER_ACTIONS_FLOW_MATCH_MAND_BITMAP, 0 },
+  { OFDPA_FLOW_TABLE_ID_PORT_DSCP_TRUST,    IND_OFDPA_DSCP_TRUST_FLOW_MATCH_BITMAP,         IND_OFDPA_DSCP_TRUST_FLOW_MATCH_MAND_BITMAP,         0 },
+  { OFDPA_FLOW_TABLE_ID_TUNNEL_DSCP_TRUST,  IND_OFDPA_DSCP_TRUST_FLOW_MATCH_BITMAP,         IND_OFDPA_DSCP_TRUST_FLOW_MATCH_MAND_BITMAP,         0 },
+  { OFDPA_FLOW_TABLE_ID_MPLS_DSCP_TRUST,    IND_OFDPA_DSCP_TRUST_FLOW_MATCH_BITMAP,         IND_OFDPA_DSCP_TRUST_FLOW_MATCH_MAND_BITMAP,         0 },
+  { OFDPA_FLOW_TABLE_ID_PORT_PCP_TRUST,     IND_OFDPA_PCP_TRUST_FLOW_MATCH_BITMAP,          IND_OFDPA_PCP_TRUST_FLOW_MATCH_MAND_BITMAP,          0 },
+  { OFDPA_FLOW_TABLE_ID_TUNNEL_PCP_TRUST,   IND_OFDPA_PCP_TRUST_FLOW_MATCH_BITMAP,          IND_OFDPA_PCP_TRUST_FLOW_MATCH_MAND_BITMAP,          0 },
+  { OFDPA_FLOW_TABLE_ID_MPLS_PCP_TRUST,     IND_OFDPA_PCP_TRUST_FLOW_MATCH_BITMAP,          IND_OFDPA_PCP_TRUST_FLOW_MATCH_MAND_BITMAP,          0 },
+  { OFDPA_FLOW_TABLE_ID_ACL_POLICY,         IND_OFDPA_ACL_POLICY_FLOW_MATCH_BITMAP,         0,                                                   0 },
+  { OFDPA_FLOW_TABLE_ID_COLOR_BASED_ACTIONS, IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_BITMAP, IND_OFDPA_COLOR_BASED_ACTIONS_FLOW_MATCH_MAND_BITMAP, 0 },
+  { OFDPA_FLOW_TABLE_ID_EGRESS_VLAN,        IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_BITMAP,        IND_OFDPA_EGRESS_VLAN_FLOW_MATCH_MAND_BITMAP,        0 },
+  { OFDPA_FLOW_TABLE_ID_EGRESS_VLAN_1,      IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_BITMAP,       IND_OFDPA_EGRESS_VLAN1_FLOW_MATCH_MAND_BITMAP,       0 },
+  { OFDPA_FLOW_TABLE_ID_EGRESS_MAINTENANCE_POINT, IND_OFDPA_EGRESS_MP_FLOW_MATCH_BITMAP,    IND_OFDPA_EGRESS_MP_FLOW_MATCH_MAND_BITMAP,          0 },
+  { OFDPA_FLOW_TABLE_ID_EGRESS_DSCP_PCP_REMARK, IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_BITMAP, IND_OFDPA_EGRESS_DSCP_PCP_REM_FLOW_MATCH_MAND_BITMAP, 0 },
+};
+
+/* Tables for the random field sets, some of them unknown to the driver */
+static const uint8_t ind_ofdpa_diff_tables[] =
+{
+  0, 1, 8, 9, 10, 11, 12, 13, 19, 20, 23, 24, 25, 26, 27, 28, 30,
+  50, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75,
+  76, 77, 78, 79, 80, 200, 210, 211, 212, 220, 230, 240, 250, 255,
+};
+
+static of_list_action_t *ind_ofdpa_diff_actions_new(void)
+{
+  of_list_action_t *actions = of_list_action_new(OF_VERSION_1_3);
+  of_object_t *action;
+  int count = ind_ofdpa_diff_rand() % 3;
+
+  while (count--)
+  {
+    switch (ind_ofdpa_diff_rand() % 3)
+    {
+      case 0:
+        action = of_action_output_new(OF_VERSION_1_3);
+        of_action_output_port_set(action, ind_ofdpa_diff_rand() % 64);
+        break;
+      case 1:
+        action = of_action_group_new(OF_VERSION_1_3);
+        of_action_group_group_id_set(action, ind_ofdpa_diff_rand());
+        break;
+      default:
+        action = of_action_pop_vlan_new(OF_VERSION_1_3);
+        break;
+    }
+    of_list_append(actions, action);
+    of_object_delete(action);
+  }
+
+  return actions;
+}
+
+static of_list_instruction_t *ind_ofdpa_diff_instructions_new(void)
+{
+  of_list_instruction_t *insts = of_list_instruction_new(OF_VERSION_1_3);
+  of_list_action_t *actions;
+  of_object_t *inst;
+  int count = ind_ofdpa_diff_rand() % 4;
+
+  while (count--)
+  {
+    switch (ind_ofdpa_diff_rand() % 5)
+    {
+      case 0:
+        actions = ind_ofdpa_diff_actions_new();
+        inst = of_instruction_apply_actions_new(OF_VERSION_1_3);
+        ind_ofdpa_diff_check(of_instruction_apply_actions_actions_set(inst, actions), "actions");
+        of_object_delete(actions);
+        break;
+      case 1:
+        actions = ind_ofdpa_diff_actions_new();
+        inst = of_instruction_write_actions_new(OF_VERSION_1_3);
+        ind_ofdpa_diff_check(of_instruction_write_actions_actions_set(inst, actions), "actions");
+        of_object_delete(actions);
+        break;
+      case 2:
+        inst = of_instruction_clear_actions_new(OF_VERSION_1_3);
+        break;
+      case 3:
+        inst = of_instruction_goto_table_new(OF_VERSION_1_3);
+        of_instruction_goto_table_table_id_set(inst, ind_ofdpa_diff_rand());
+        break;
+      default:
+        inst = of_instruction_meter_new(OF_VERSION_1_3);
+        of_instruction_meter_meter_id_set(inst, ind_ofdpa_diff_rand());
+        break;
+    }
+    of_list_append(insts, inst);
+    of_object_delete(inst);
+  }
+
+  return insts;
+}
+
+static int ind_ofdpa_diff_gen(int count, const char *path)
+{
+  FILE *out;
+  of_flow_add_t *flow_add;
+  of_list_instruction_t *insts;
+  of_match_t match;
+  ind_ofdpa_diff_record_t record;
+  const ind_ofdpa_diff_table_t *table;
+  ind_ofdpa_fields_t mandatory;
+  uint8_t tableId;
+  int i, field, fields, accepted = 0;
+
+  out = fopen(path, "wb");
+  if (out == NULL)
+  {
+    perror(path);
+    return 1;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    memset(&match, 0, sizeof(match));
+    match.version = OF_VERSION_1_3;
+
+    if (ind_ofdpa_diff_rand() % 2)
+    {
+      /* A table's mandatory fields, some of its optional ones, and now and then one it does not take */
+      table = &ind_ofdpa_diff_table_fields[ind_ofdpa_diff_rand() % IND_OFDPA_DIFF_TABLES];
+      tableId = table->tableId;
+      mandatory = ((table->altMandatory != 0) && (ind_ofdpa_diff_rand() % 2)) ?
+                    table->altMandatory : table->mandatory;
+      for (field = 0; field < IND_OFDPA_DIFF_MATCH_FIELDS; field++)
+      {
+        if ((ind_ofdpa_diff_field_bits[field] & mandatory) ||
+            ((ind_ofdpa_diff_field_bits[field] & table->allowed) && (ind_ofdpa_diff_rand() % 3 == 0)))
+        {
+          ind_ofdpa_diff_field_set(&match, field);
+        }
+      }
+      if (ind_ofdpa_diff_rand() % 8 == 0)
+      {
+        ind_ofdpa_diff_field_set(&match, ind_ofdpa_diff_rand() % IND_OFDPA_DIFF_MATCH_FIELDS);
+      }
+    }
+    else
+    {
+      fields = ind_ofdpa_diff_rand() % 5;
+      while (fields--)
+      {
+        ind_ofdpa_diff_field_set(&match, ind_ofdpa_diff_rand() % IND_OFDPA_DIFF_MATCH_FIELDS);
+      }
+      tableId = ind_ofdpa_diff_tables[ind_ofdpa_diff_rand() % sizeof(ind_ofdpa_diff_tables)];
+    }
+
+    flow_add = of_flow_add_new(OF_VERSION_1_3);
+    of_flow_add_table_id_set(flow_add, tableId);
+    of_flow_add_priority_set(flow_add, ind_ofdpa_diff_rand());
+    of_flow_add_idle_timeout_set(flow_add, ind_ofdpa_diff_rand());
+    of_flow_add_hard_timeout_set(flow_add, ind_ofdpa_diff_rand());
+    ind_ofdpa_diff_check(of_flow_add_match_set(flow_add, &match), "match");
+    insts = ind_ofdpa_diff_instructions_new();
+    ind_ofdpa_diff_check(of_flow_add_instructions_set(flow_add, insts), "instructions");
+    of_object_delete(insts);
+
+    memset(&ind_ofdpa_diff_flow, 0, sizeof(ind_ofdpa_diff_flow));
+    ind_ofdpa_diff_added = 0;
+
+    memset(&record, 0, sizeof(record));
+    record.index = i;
+    record.tableId = tableId;
+    record.rv = indigo_fwd_flow_create(i + 1, flow_add, &tableId);
+    record.added = ind_ofdpa_diff_added;
+    record.flow = ind_ofdpa_diff_flow;
+    if (fwrite(&record, sizeof(record), 1, out) != 1)
+    {
+      perror(path);
+      return 1;
+    }
+
+    if (record.rv == INDIGO_ERROR_NONE)
+    {
+      accepted++;
+    }
+    of_object_delete(flow_add);
+  }
+
+  fclose(out);
+  printf("%d flow_mods, %d accepted\n", count, accepted);
+  return 0;
+}
+
+static int ind_ofdpa_diff_cmp(const char *refPath, const char *path)
+{
+  FILE *ref, *in;
+  ind_ofdpa_diff_record_t a, b;
+  int mismatches[256];
+  int accepted[256];
+  int records = 0, total = 0, shown = 0, i;
+
+  ref = fopen(refPath, "rb");
+  in = fopen(path, "rb");
+  if ((ref == NULL) || (in == NULL))
+  {
+    perror((ref == NULL) ? refPath : path);
+    return 1;
+  }
+
+  memset(mismatches, 0, sizeof(mismatches));
+  memset(accepted, 0, sizeof(accepted));
+  while ((fread(&a, sizeof(a), 1, ref) == 1) && (fread(&b, sizeof(b), 1, in) == 1))
+  {
+    records++;
+    if (a.rv == INDIGO_ERROR_NONE)
+    {
+      accepted[a.tableId & 0xff]++;
+    }
+    if ((a.rv == b.rv) && (a.added == b.added) &&
+        (memcmp(&a.flow, &b.flow, sizeof(a.flow)) == 0))
+    {
+      continue;
+    }
+
+    mismatches[a.tableId & 0xff]++;
+    total++;
+    if (shown++ < 10)
+    {
+      printf("flow_mod %u table %u: rv %d/%d, added %d/%d%s\n",
+             a.index, a.tableId, a.rv, b.rv, a.added, b.added,
+             (memcmp(&a.flow, &b.flow, sizeof(a.flow)) != 0) ? ", flow entry differs" : "");
+    }
+  }
+
+  for (i = 0; i < 256; i++)
+  {
+    if ((accepted[i] != 0) || (mismatches[i] != 0))
+    {
+      printf("table %3d: %6d accepted, %d mismatches\n", i, accepted[i], mismatches[i]);
+    }
+  }
+  printf("%d flow_mods compared, %d mismatches\n", records, total);
+
+  fclose(ref);
+  fclose(in);
+  return (total != 0);
+}
+
+int main(int argc, char *argv[])
+{
+  if ((argc >= 4) && (strcmp(argv[1], "gen") == 0))
+  {
+    if ((argc > 4) && (strtoull(argv[4], NULL, 0) != 0))
+    {
+      ind_ofdpa_diff_seed = strtoull(argv[4], NULL, 0);
+    }
+
+    /* Most of the corpus is rejected; don't log every one */
+    __ind_ofdpa_driver_module_init__();
+    aim_log_fid_set_all(AIM_LOG_FLAG_ERROR, 0);
+    return ind_ofdpa_diff_gen(atoi(argv[2]), argv[3]);
+  }
+
+  if ((argc == 4) && (strcmp(argv[1], "cmp") == 0))
+  {
+    return ind_ofdpa_diff_cmp(argv[2], argv[3]);
+  }
+
+  fprintf(stderr, "usage: %s gen <count> <file> [seed]\n"
+                  "       %s cmp <reference> <file>\n", argv[0], argv[0]);
+  return 2;
+}